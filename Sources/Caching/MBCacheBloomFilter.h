@@ -0,0 +1,141 @@
+//
+//  MBCacheBloomFilter.h
+//  Mockingbird Toolbox
+//
+//  Created by Evan Coyne Maloney on 10/17/26.
+//  Copyright (c) 2026 Gilt Groupe. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#import "NSError+MBToolbox.h"
+
+//
+// NOTE: This header file is for use only within the implementation of
+//       MBFilesystemCache and its subclasses. It is not a public header.
+//
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark MBCacheBloomFilter class
+/******************************************************************************/
+
+/*!
+ A counting Bloom filter over a set of names, used to rule out the presence
+ of a cache file without consulting the filesystem.
+
+ `mightContainName:` never returns `NO` for a name that has been added and
+ not subsequently removed; it may, however, return `YES` for a name that
+ is absent. Each position in the filter is a 4-bit counter, which allows
+ names to be removed. A counter that saturates is never decremented again,
+ so removals can only ever leave extra false positives behind, never cause
+ false negatives.
+
+ All methods are thread-safe.
+ */
+@interface MBCacheBloomFilter : NSObject
+
+/*----------------------------------------------------------------------------*/
+#pragma mark Object lifecycle
+/*!    @name Object lifecycle                                                 */
+/*----------------------------------------------------------------------------*/
+
+/*!
+ Initializes an empty filter sized to hold `capacity` names with the given
+ false-positive rate.
+
+ @param     capacity The number of names the filter is expected to hold.
+
+ @param     rate The desired false-positive rate when the filter holds
+            `capacity` names; for example, `0.01` for 1%.
+
+ @return    The receiver.
+ */
+- (nonnull instancetype) initWithCapacity:(NSUInteger)capacity
+                        falsePositiveRate:(double)rate;
+
+/*!
+ Initializes the receiver from a file written by `writeToFile:error:`.
+
+ @param     path The path of the file.
+
+ @return    The receiver, or `nil` if the file could not be read or is not
+            a valid filter file.
+ */
+- (nullable instancetype) initWithContentsOfFile:(nonnull NSString*)path;
+
+/*!
+ Writes the receiver to a file, atomically.
+
+ @param     path The path of the file.
+
+ @param     errPtr If this method returns `NO` and this parameter is non-`nil`,
+            `*errPtr` will be updated to point to an `NSError` describing the
+            problem.
+
+ @return    `YES` if the file was written; `NO` otherwise.
+ */
+- (BOOL) writeToFile:(nonnull NSString*)path error:(NSErrorPtrPtr)errPtr;
+
+/*----------------------------------------------------------------------------*/
+#pragma mark Filter properties
+/*!    @name Filter properties                                                */
+/*----------------------------------------------------------------------------*/
+
+/*! The number of names the filter was sized to hold. */
+@property(nonatomic, readonly) NSUInteger capacity;
+
+/*! The number of names currently in the filter. */
+@property(nonatomic, readonly) NSUInteger count;
+
+/*! For a filter loaded from a file, the time at which the file was written;
+    otherwise, the time at which the filter was created. */
+@property(nonnull, nonatomic, readonly) NSDate* savedDate;
+
+/*! Returns `YES` if the filter has changed since it was created or loaded. */
+@property(nonatomic, readonly) BOOL hasChanges;
+
+/*! If `NO`, calls to `removeName:` are ignored. This allows a filter to
+    accept additions while it is being populated, without risking removal
+    of a name that hasn't been added yet. Defaults to `YES`. */
+@property(atomic, assign) BOOL acceptsRemovals;
+
+/*! The false-positive rate expected given the filter's size and `count`. */
+@property(nonatomic, readonly) double estimatedFalsePositiveRate;
+
+/*! The proportion of lookups of absent names for which the filter returned
+    `YES`, based on the lookups reported with `noteFalsePositive` and the
+    lookups for which `mightContainName:` returned `NO`. */
+@property(nonatomic, readonly) double observedFalsePositiveRate;
+
+/*----------------------------------------------------------------------------*/
+#pragma mark Using the filter
+/*!    @name Using the filter                                                 */
+/*----------------------------------------------------------------------------*/
+
+/*! Adds a name to the filter. */
+- (void) addName:(nonnull NSString*)name;
+
+/*! Removes a name that was previously added to the filter. */
+- (void) removeName:(nonnull NSString*)name;
+
+/*! Removes every name from the filter. */
+- (void) removeAllNames;
+
+/*!
+ Determines whether the filter might contain the given name.
+
+ @param     name The name.
+
+ @return    `NO` if the name is definitely not in the filter; `YES` if it
+            might be.
+ */
+- (BOOL) mightContainName:(nonnull NSString*)name;
+
+/*!
+ Records that `mightContainName:` returned `YES` for a name that turned out
+ to be absent. Used to calculate the `observedFalsePositiveRate`.
+ */
+- (void) noteFalsePositive;
+
+@end
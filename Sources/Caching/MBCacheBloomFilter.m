@@ -0,0 +1,316 @@
+//
+//  MBCacheBloomFilter.m
+//  Mockingbird Toolbox
+//
+//  Created by Evan Coyne Maloney on 10/17/26.
+//  Copyright (c) 2026 Gilt Groupe. All rights reserved.
+//
+
+#import <stdatomic.h>
+
+#import "MBCacheBloomFilter.h"
+#import "MBReadWriteLock.h"
+#import "MBModuleLogMacros.h"
+
+#define DEBUG_LOCAL     0
+
+/******************************************************************************/
+#pragma mark Constants
+/******************************************************************************/
+
+#define kBloomFileMagic             0x4D424246          // 'MBBF'
+#define kBloomFileVersion           1
+#define kMaxHashCount               16
+#define kCounterMax                 0xF
+
+/******************************************************************************/
+#pragma mark Types
+/******************************************************************************/
+
+// begins the filter file; followed by the packed 4-bit counters
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t hashCount;
+    uint32_t reserved;
+    uint64_t counterCount;
+    uint64_t capacity;
+    uint64_t count;
+    double savedAt;                 // NSTimeInterval since reference date
+} MBCacheBloomFilterHeader;
+
+/******************************************************************************/
+#pragma mark Hashing
+/******************************************************************************/
+
+// 64-bit FNV-1a over the name's UTF-8 bytes, finished with the splitmix64
+// mixer so that both halves of the result are usable as independent hashes
+static uint64_t MBBloomHashName(NSString* name)
+{
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    const char* bytes = [name UTF8String];
+    for (const char* c = bytes; c && *c; c++) {
+        hash ^= (uint8_t)*c;
+        hash *= 0x100000001B3ULL;
+    }
+
+    hash ^= hash >> 30;
+    hash *= 0xBF58476D1CE4E5B9ULL;
+    hash ^= hash >> 27;
+    hash *= 0x94D049BB133111EBULL;
+    hash ^= hash >> 31;
+    return hash;
+}
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark MBCacheBloomFilter implementation
+/******************************************************************************/
+
+@implementation MBCacheBloomFilter
+{
+    MBReadWriteLock* _lock;
+    NSMutableData* _counters;           // two 4-bit counters per byte
+    uint64_t _counterCount;
+    uint32_t _hashCount;
+    atomic_ulong _negativeLookups;
+    atomic_ulong _falsePositives;
+}
+
+/******************************************************************************/
+#pragma mark Object lifecycle
+/******************************************************************************/
+
+- (instancetype) _initWithCapacity:(NSUInteger)capacity
+                      counterCount:(uint64_t)counterCount
+                         hashCount:(uint32_t)hashCount
+{
+    self = [super init];
+    if (self) {
+        _capacity = capacity;
+        _counterCount = counterCount;
+        _hashCount = hashCount;
+        _counters = [NSMutableData dataWithLength:(NSUInteger)((counterCount + 1) / 2)];
+        _lock = [MBReadWriteLock new];
+        _savedDate = [NSDate date];
+        _acceptsRemovals = YES;
+        atomic_init(&_negativeLookups, 0);
+        atomic_init(&_falsePositives, 0);
+    }
+    return self;
+}
+
+- (instancetype) initWithCapacity:(NSUInteger)capacity falsePositiveRate:(double)rate
+{
+    // the standard optimal sizing: m = -n ln(p) / (ln 2)^2, k = (m / n) ln 2
+    double n = MAX(capacity, 1);
+    double p = MIN(MAX(rate, 1e-6), 0.5);
+    uint64_t m = (uint64_t) ceil(-n * log(p) / (M_LN2 * M_LN2));
+    uint32_t k = (uint32_t) MIN(MAX(round((m / n) * M_LN2), 1), kMaxHashCount);
+
+    return [self _initWithCapacity:capacity counterCount:m hashCount:k];
+}
+
+- (instancetype) initWithContentsOfFile:(NSString*)path
+{
+    NSData* data = [NSData dataWithContentsOfFile:path options:NSDataReadingMapped error:nil];
+    if (!data) {
+        return nil;
+    }
+
+    MBCacheBloomFilterHeader hdr;
+    if (data.length < sizeof(hdr)) {
+        return nil;
+    }
+    memcpy(&hdr, data.bytes, sizeof(hdr));
+    if (hdr.magic != kBloomFileMagic
+        || hdr.version != kBloomFileVersion
+        || hdr.hashCount < 1 || hdr.hashCount > kMaxHashCount
+        || hdr.counterCount < 1
+        || data.length - sizeof(hdr) != (hdr.counterCount + 1) / 2)
+    {
+        MBLogError(@"%@ ignoring unrecognized filter file at %@", [self class], path);
+        return nil;
+    }
+
+    self = [self _initWithCapacity:(NSUInteger)hdr.capacity counterCount:hdr.counterCount hashCount:hdr.hashCount];
+    if (self) {
+        [_counters replaceBytesInRange:NSMakeRange(0, _counters.length) withBytes:((const uint8_t*)data.bytes + sizeof(hdr))];
+        _count = (NSUInteger) hdr.count;
+        _savedDate = [NSDate dateWithTimeIntervalSinceReferenceDate:hdr.savedAt];
+    }
+    return self;
+}
+
+- (BOOL) writeToFile:(NSString*)path error:(NSErrorPtrPtr)errPtr
+{
+    MBCacheBloomFilterHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = kBloomFileMagic;
+    hdr.version = kBloomFileVersion;
+    hdr.hashCount = _hashCount;
+    hdr.counterCount = _counterCount;
+    hdr.capacity = _capacity;
+
+    // the save time is taken before the snapshot, so that a change
+    // made after the snapshot makes the saved filter appear out of date
+    NSTimeInterval savedAt = [NSDate timeIntervalSinceReferenceDate];
+    hdr.savedAt = savedAt;
+
+    NSMutableData* data = [NSMutableData dataWithCapacity:sizeof(hdr) + _counters.length];
+    [_lock lock];
+    hdr.count = _count;
+    [data appendBytes:&hdr length:sizeof(hdr)];
+    [data appendData:_counters];
+    _hasChanges = NO;
+    [_lock unlock];
+
+    if (![data writeToFile:path options:NSDataWritingAtomic error:errPtr]) {
+        [_lock lock];
+        _hasChanges = YES;
+        [_lock unlock];
+        return NO;
+    }
+    return YES;
+}
+
+/******************************************************************************/
+#pragma mark Filter properties
+/******************************************************************************/
+
+- (double) estimatedFalsePositiveRate
+{
+    // (1 - e^(-kn/m))^k
+    double n = self.count;
+    return pow(1.0 - exp(-(double)_hashCount * n / (double)_counterCount), _hashCount);
+}
+
+- (double) observedFalsePositiveRate
+{
+    double falsePositives = atomic_load_explicit(&_falsePositives, memory_order_relaxed);
+    double negatives = atomic_load_explicit(&_negativeLookups, memory_order_relaxed);
+    if (falsePositives + negatives == 0) {
+        return 0;
+    }
+    return falsePositives / (falsePositives + negatives);
+}
+
+- (NSUInteger) count
+{
+    [_lock lockForReading];
+    NSUInteger cnt = _count;
+    [_lock unlock];
+    return cnt;
+}
+
+- (BOOL) hasChanges
+{
+    [_lock lockForReading];
+    BOOL changed = _hasChanges;
+    [_lock unlock];
+    return changed;
+}
+
+/******************************************************************************/
+#pragma mark Counter access
+/******************************************************************************/
+
+static inline uint8_t MBBloomCounter(const uint8_t* counters, uint64_t i)
+{
+    uint8_t byte = counters[i >> 1];
+    return (i & 1) ? (byte >> 4) : (byte & 0xF);
+}
+
+static inline void MBBloomSetCounter(uint8_t* counters, uint64_t i, uint8_t value)
+{
+    uint8_t* byte = &counters[i >> 1];
+    *byte = (i & 1) ? (uint8_t)((*byte & 0x0F) | (value << 4)) : (uint8_t)((*byte & 0xF0) | value);
+}
+
+/******************************************************************************/
+#pragma mark Using the filter
+/******************************************************************************/
+
+- (void) addName:(NSString*)name
+{
+    uint64_t hash = MBBloomHashName(name);
+    uint64_t h1 = hash & 0xFFFFFFFF;
+    uint64_t h2 = (hash >> 32) | 1;
+
+    [_lock lock];
+    uint8_t* counters = _counters.mutableBytes;
+    for (uint32_t i=0; i<_hashCount; i++) {
+        uint64_t pos = (h1 + i * h2) % _counterCount;
+        uint8_t value = MBBloomCounter(counters, pos);
+        if (value < kCounterMax) {
+            MBBloomSetCounter(counters, pos, value + 1);
+        }
+    }
+    _count++;
+    _hasChanges = YES;
+    [_lock unlock];
+}
+
+- (void) removeName:(NSString*)name
+{
+    if (!self.acceptsRemovals) {
+        return;
+    }
+
+    uint64_t hash = MBBloomHashName(name);
+    uint64_t h1 = hash & 0xFFFFFFFF;
+    uint64_t h2 = (hash >> 32) | 1;
+
+    [_lock lock];
+    uint8_t* counters = _counters.mutableBytes;
+    for (uint32_t i=0; i<_hashCount; i++) {
+        // a saturated counter has lost track of how many names
+        // share it, so it can never safely be decremented
+        uint64_t pos = (h1 + i * h2) % _counterCount;
+        uint8_t value = MBBloomCounter(counters, pos);
+        if (value > 0 && value < kCounterMax) {
+            MBBloomSetCounter(counters, pos, value - 1);
+        }
+    }
+    if (_count > 0) {
+        _count--;
+    }
+    _hasChanges = YES;
+    [_lock unlock];
+}
+
+- (void) removeAllNames
+{
+    [_lock lock];
+    [_counters resetBytesInRange:NSMakeRange(0, _counters.length)];
+    _count = 0;
+    _hasChanges = YES;
+    [_lock unlock];
+}
+
+- (BOOL) mightContainName:(NSString*)name
+{
+    uint64_t hash = MBBloomHashName(name);
+    uint64_t h1 = hash & 0xFFFFFFFF;
+    uint64_t h2 = (hash >> 32) | 1;
+
+    BOOL present = YES;
+    [_lock lockForReading];
+    const uint8_t* counters = _counters.bytes;
+    for (uint32_t i=0; i<_hashCount && present; i++) {
+        present = (MBBloomCounter(counters, (h1 + i * h2) % _counterCount) != 0);
+    }
+    [_lock unlock];
+
+    if (!present) {
+        atomic_fetch_add_explicit(&_negativeLookups, 1, memory_order_relaxed);
+    }
+    return present;
+}
+
+- (void) noteFalsePositive
+{
+    atomic_fetch_add_explicit(&_falsePositives, 1, memory_order_relaxed);
+}
+
+@end
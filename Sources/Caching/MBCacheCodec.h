@@ -0,0 +1,119 @@
+//
+//  MBCacheCodec.h
+//  Mockingbird Toolbox
+//
+//  Created by Evan Coyne Maloney on 10/17/26.
+//  Copyright (c) 2026 Gilt Groupe. All rights reserved.
+//
+
+#import "MBFilesystemCache.h"
+
+/******************************************************************************/
+#pragma mark Types
+/******************************************************************************/
+
+/*!
+ Describes the contents of a cache file, as recorded in its header.
+ */
+typedef struct {
+    /*! The format version of the header. */
+    uint16_t version;
+
+    /*! The compression applied to the payload. */
+    MBFilesystemCacheCompression compression;
+
+    /*! The number of bytes in the payload as stored. */
+    uint64_t payloadLength;
+
+    /*! The number of bytes in the payload once decompressed. */
+    uint64_t decodedLength;
+
+    /*! The CRC32C checksum of the payload as stored. */
+    uint32_t checksum;
+
+    /*! When the file was encoded, in seconds since the reference date. */
+    NSTimeInterval createdAt;
+
+    /*! When the file expires, in seconds since the reference date, or `0`
+        if it does not expire. */
+    NSTimeInterval expiresAt;
+} MBCacheFileAttributes;
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark MBCacheCodec class
+/******************************************************************************/
+
+/*!
+ Encodes and decodes the contents of `MBFilesystemCache` files.
+
+ Encoded data begins with a fixed-size, versioned header recording the
+ compression applied to the payload, its length, a checksum, and the times
+ at which the data was encoded and expires. Data written using any
+ `MBFilesystemCacheCompression` can therefore be decoded regardless of the
+ compression currently selected, and torn or corrupt files are detected
+ before any attempt is made to reconstitute an object from them.
+
+ This class is for internal use by `MBFilesystemCache`.
+ */
+@interface MBCacheCodec : NSObject
+
+/*!
+ Encodes data using the given compression.
+
+ Data too small to benefit from compression, or that doesn't shrink when
+ compressed, is stored uncompressed behind the header.
+
+ @param     data The data to encode.
+
+ @param     compression The compression to use.
+
+ @param     expiresAt The time at which the data expires, in seconds since
+            the reference date, or `0` if it does not expire.
+
+ @return    The encoded data.
+ */
++ (nonnull NSData*) encodeData:(nonnull NSData*)data
+              usingCompression:(MBFilesystemCacheCompression)compression
+                     expiresAt:(NSTimeInterval)expiresAt;
+
+/*!
+ Decodes data returned by `encodeData:usingCompression:expiresAt:`,
+ verifying its checksum. Expiry is not checked.
+
+ @param     data The data to decode.
+
+ @param     errPtr If this method returns `nil` and this parameter is non-`nil`,
+            `*errPtr` will be updated to point to an `NSError` describing the
+            problem.
+
+ @return    The decoded data, or `nil` if `data` is corrupt or could not be
+            decoded.
+ */
++ (nullable NSData*) decodeData:(nonnull NSData*)data error:(NSErrorPtrPtr)errPtr;
+
+/*!
+ Reads the header of encoded data.
+
+ @param     attrs On success, updated to describe `data`.
+
+ @param     data The encoded data.
+
+ @return    `YES` if `data` begins with a valid header whose payload length
+            matches the data; `NO` otherwise.
+ */
++ (BOOL) getAttributes:(nonnull MBCacheFileAttributes*)attrs ofData:(nonnull NSData*)data;
+
+/*!
+ Reads the header of an encoded file without reading the rest of the file.
+
+ @param     attrs On success, updated to describe the file.
+
+ @param     path The path of the file.
+
+ @return    `YES` if the file begins with a valid header whose payload length
+            matches the size of the file; `NO` otherwise.
+ */
++ (BOOL) getAttributes:(nonnull MBCacheFileAttributes*)attrs ofFileAtPath:(nonnull NSString*)path;
+
+@end
@@ -0,0 +1,301 @@
+//
+//  MBCacheCodec.m
+//  Mockingbird Toolbox
+//
+//  Created by Evan Coyne Maloney on 10/17/26.
+//  Copyright (c) 2026 Gilt Groupe. All rights reserved.
+//
+
+#import <fcntl.h>
+#import <unistd.h>
+#import <sys/stat.h>
+#import <compression.h>
+
+#import "MBCacheCodec.h"
+#import "MBModuleLogMacros.h"
+
+#define DEBUG_LOCAL     0
+
+/******************************************************************************/
+#pragma mark Constants
+/******************************************************************************/
+
+#define kCodecMagic                 0x4643424D          // 'MBCF'
+#define kCodecVersion               1
+#define kCodecMinimumInputSize      128                 // smaller inputs aren't worth compressing
+#define kCodecMaximumDecodedSize    (1ULL << 30)        // guards against corrupt headers
+
+/******************************************************************************/
+#pragma mark Types
+/******************************************************************************/
+
+// begins every cache file; followed by the payload. the checksum covers
+// the header (with the checksum itself zeroed) as well as the payload
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t headerLength;
+    uint8_t compression;            // MBFilesystemCacheCompression
+    uint8_t reserved[3];
+    uint32_t checksum;              // CRC32C
+    uint64_t payloadLength;
+    uint64_t decodedLength;
+    double createdAt;               // NSTimeInterval since reference date
+    double expiresAt;               // 0 if the file doesn't expire
+} MBCacheFileHeader;
+
+/******************************************************************************/
+#pragma mark CRC32C
+/******************************************************************************/
+
+static uint32_t s_crc32cTable[8][256];
+
+static void MBInitCRC32CTable(void)
+{
+    // the reflected Castagnoli polynomial, extended for slicing-by-8
+    for (uint32_t i=0; i<256; i++) {
+        uint32_t crc = i;
+        for (int bit=0; bit<8; bit++) {
+            crc = (crc >> 1) ^ (0x82F63B78 & (0U - (crc & 1)));
+        }
+        s_crc32cTable[0][i] = crc;
+    }
+    for (uint32_t i=0; i<256; i++) {
+        for (int t=1; t<8; t++) {
+            uint32_t prev = s_crc32cTable[t - 1][i];
+            s_crc32cTable[t][i] = (prev >> 8) ^ s_crc32cTable[0][prev & 0xFF];
+        }
+    }
+}
+
+// continues a CRC32C over the given bytes; start with 0
+static uint32_t MBUpdateCRC32C(uint32_t crc, const uint8_t* bytes, size_t len)
+{
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        MBInitCRC32CTable();
+    });
+
+    crc = ~crc;
+    while (len && ((uintptr_t)bytes & 7)) {
+        crc = (crc >> 8) ^ s_crc32cTable[0][(crc ^ *bytes++) & 0xFF];
+        len--;
+    }
+
+    // eight bytes per step; assumes a little-endian CPU,
+    // which every platform we build for is
+    while (len >= 8) {
+        uint64_t word;
+        memcpy(&word, bytes, sizeof(word));
+        word ^= crc;
+        crc = s_crc32cTable[7][word & 0xFF]
+            ^ s_crc32cTable[6][(word >> 8) & 0xFF]
+            ^ s_crc32cTable[5][(word >> 16) & 0xFF]
+            ^ s_crc32cTable[4][(word >> 24) & 0xFF]
+            ^ s_crc32cTable[3][(word >> 32) & 0xFF]
+            ^ s_crc32cTable[2][(word >> 40) & 0xFF]
+            ^ s_crc32cTable[1][(word >> 48) & 0xFF]
+            ^ s_crc32cTable[0][word >> 56];
+        bytes += 8;
+        len -= 8;
+    }
+    while (len--) {
+        crc = (crc >> 8) ^ s_crc32cTable[0][(crc ^ *bytes++) & 0xFF];
+    }
+    return ~crc;
+}
+
+static uint32_t MBCacheFileChecksum(MBCacheFileHeader hdr, const uint8_t* payload, size_t len)
+{
+    hdr.checksum = 0;
+    uint32_t crc = MBUpdateCRC32C(0, (const uint8_t*)&hdr, sizeof(hdr));
+    return MBUpdateCRC32C(crc, payload, len);
+}
+
+/******************************************************************************/
+#pragma mark Headers
+/******************************************************************************/
+
+// validates everything but the checksum, which requires the payload
+static BOOL MBReadCacheFileHeader(MBCacheFileHeader* hdr, const void* bytes, size_t len, uint64_t fileLength)
+{
+    if (len < sizeof(*hdr)) {
+        return NO;
+    }
+    memcpy(hdr, bytes, sizeof(*hdr));
+    return (hdr->magic == kCodecMagic
+            && hdr->version == kCodecVersion
+            && hdr->headerLength == sizeof(*hdr)
+            && hdr->payloadLength == fileLength - sizeof(*hdr));
+}
+
+static void MBCopyAttributes(MBCacheFileAttributes* attrs, const MBCacheFileHeader* hdr)
+{
+    attrs->version = hdr->version;
+    attrs->compression = hdr->compression;
+    attrs->payloadLength = hdr->payloadLength;
+    attrs->decodedLength = hdr->decodedLength;
+    attrs->checksum = hdr->checksum;
+    attrs->createdAt = hdr->createdAt;
+    attrs->expiresAt = hdr->expiresAt;
+}
+
+/******************************************************************************/
+#pragma mark Compression algorithms
+/******************************************************************************/
+
+static BOOL MBCompressionAlgorithm(MBFilesystemCacheCompression compression, compression_algorithm* algorithm)
+{
+    switch (compression) {
+        case MBFilesystemCacheCompressionLZ4:
+            *algorithm = COMPRESSION_LZ4;
+            return YES;
+
+        case MBFilesystemCacheCompressionLZFSE:
+            *algorithm = COMPRESSION_LZFSE;
+            return YES;
+
+        case MBFilesystemCacheCompressionZLIB:
+            *algorithm = COMPRESSION_ZLIB;
+            return YES;
+
+        default:
+            return NO;
+    }
+}
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark MBCacheCodec implementation
+/******************************************************************************/
+
+@implementation MBCacheCodec
+
+/******************************************************************************/
+#pragma mark Reading headers
+/******************************************************************************/
+
++ (BOOL) getAttributes:(MBCacheFileAttributes*)attrs ofData:(NSData*)data
+{
+    MBCacheFileHeader hdr;
+    if (!MBReadCacheFileHeader(&hdr, data.bytes, data.length, data.length)) {
+        return NO;
+    }
+    MBCopyAttributes(attrs, &hdr);
+    return YES;
+}
+
++ (BOOL) getAttributes:(MBCacheFileAttributes*)attrs ofFileAtPath:(NSString*)path
+{
+    int fd = open([path fileSystemRepresentation], O_RDONLY);
+    if (fd < 0) {
+        return NO;
+    }
+
+    uint8_t buf[sizeof(MBCacheFileHeader)];
+    MBCacheFileHeader hdr;
+    struct stat st;
+    BOOL valid = (fstat(fd, &st) == 0
+                  && pread(fd, buf, sizeof(buf), 0) == (ssize_t)sizeof(buf)
+                  && MBReadCacheFileHeader(&hdr, buf, sizeof(buf), (uint64_t)st.st_size));
+    close(fd);
+
+    if (valid) {
+        MBCopyAttributes(attrs, &hdr);
+    }
+    return valid;
+}
+
+/******************************************************************************/
+#pragma mark Encoding & decoding
+/******************************************************************************/
+
++ (NSData*) encodeData:(NSData*)data
+      usingCompression:(MBFilesystemCacheCompression)compression
+             expiresAt:(NSTimeInterval)expiresAt
+{
+    MBCacheFileHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = kCodecMagic;
+    hdr.version = kCodecVersion;
+    hdr.headerLength = sizeof(hdr);
+    hdr.decodedLength = data.length;
+    hdr.createdAt = [NSDate timeIntervalSinceReferenceDate];
+    hdr.expiresAt = expiresAt;
+
+    // the payload is only kept compressed if that makes it smaller,
+    // so there's no point giving the encoder any more room than that
+    NSMutableData* encoded = nil;
+    compression_algorithm algorithm;
+    size_t inputLen = data.length;
+    if (inputLen >= kCodecMinimumInputSize && MBCompressionAlgorithm(compression, &algorithm)) {
+        encoded = [NSMutableData dataWithLength:sizeof(hdr) + inputLen - 1];
+        uint8_t* payload = (uint8_t*)encoded.mutableBytes + sizeof(hdr);
+        size_t payloadLen = compression_encode_buffer(payload, inputLen - 1, data.bytes, inputLen, NULL, algorithm);
+        if (payloadLen > 0) {
+            MBLogDebug(@"%@ compressed %lu bytes to %lu", self, (unsigned long)inputLen, (unsigned long)payloadLen);
+
+            hdr.compression = (uint8_t) compression;
+            encoded.length = sizeof(hdr) + payloadLen;
+        }
+        else {
+            encoded = nil;
+        }
+    }
+    if (!encoded) {
+        hdr.compression = MBFilesystemCacheCompressionNone;
+        encoded = [NSMutableData dataWithCapacity:sizeof(hdr) + inputLen];
+        [encoded appendBytes:&hdr length:sizeof(hdr)];
+        [encoded appendData:data];
+    }
+
+    hdr.payloadLength = encoded.length - sizeof(hdr);
+    hdr.checksum = MBCacheFileChecksum(hdr, (const uint8_t*)encoded.bytes + sizeof(hdr), (size_t)hdr.payloadLength);
+    memcpy(encoded.mutableBytes, &hdr, sizeof(hdr));
+    return encoded;
+}
+
++ (NSData*) decodeData:(NSData*)data error:(NSErrorPtrPtr)errPtr
+{
+    NSString* problem = nil;
+    MBCacheFileHeader hdr;
+    if (!MBReadCacheFileHeader(&hdr, data.bytes, data.length, data.length)) {
+        problem = @"missing or invalid header";
+    }
+    else {
+        const uint8_t* payload = (const uint8_t*)data.bytes + sizeof(hdr);
+        size_t payloadLen = (size_t) hdr.payloadLength;
+        compression_algorithm algorithm;
+        if (MBCacheFileChecksum(hdr, payload, payloadLen) != hdr.checksum) {
+            problem = @"checksum mismatch";
+        }
+        else if (hdr.compression == MBFilesystemCacheCompressionNone) {
+            if (hdr.decodedLength == payloadLen) {
+                return [data subdataWithRange:NSMakeRange(sizeof(hdr), payloadLen)];
+            }
+            problem = @"inconsistent length";
+        }
+        else if (!MBCompressionAlgorithm(hdr.compression, &algorithm)) {
+            problem = [NSString stringWithFormat:@"unknown compression %u", hdr.compression];
+        }
+        else if (hdr.decodedLength == 0 || hdr.decodedLength > kCodecMaximumDecodedSize) {
+            problem = @"inconsistent length";
+        }
+        else {
+            size_t decodedLen = (size_t) hdr.decodedLength;
+            NSMutableData* decoded = [NSMutableData dataWithLength:decodedLen];
+            if (compression_decode_buffer(decoded.mutableBytes, decodedLen, payload, payloadLen, NULL, algorithm) == decodedLen) {
+                return decoded;
+            }
+            problem = @"decompression failed";
+        }
+    }
+
+    if (errPtr) {
+        *errPtr = [NSError mockingbirdErrorWithDescription:[NSString stringWithFormat:@"Couldn't decode %lu bytes of cache data: %@", (unsigned long)data.length, problem]
+                                                      code:kMBErrorParseFailed];
+    }
+    return nil;
+}
+
+@end
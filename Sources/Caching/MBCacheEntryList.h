@@ -0,0 +1,119 @@
+//
+//  MBCacheEntryList.h
+//  Mockingbird Toolbox
+//
+//  Created by Evan Coyne Maloney on 10/17/26.
+//  Copyright (c) 2026 Gilt Groupe. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <stdatomic.h>
+
+#import "MBThreadsafeCache.h"
+
+//
+// NOTE: This header file is for use only within the implementation of
+//       MBThreadsafeCache and its subclasses. It is not a public header.
+//
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark MBCacheEntry class
+/******************************************************************************/
+
+/*!
+ Bookkeeping information for a single memory cache entry.
+
+ Entries are owned by the `MBCacheEntryList` containing them; the list links
+ are unretained. Instance variables are public so that the cache can access
+ them without the overhead of messaging.
+ */
+@interface MBCacheEntry : NSObject
+{
+@public
+    id _key;
+    id _originalKey;                    // the key the object was stored under, if known
+    NSUInteger _cost;
+    NSTimeInterval _expiresAt;          // 0 if the entry never expires
+    atomic_bool _referenced;
+    __unsafe_unretained MBCacheEntry* _newer;
+    __unsafe_unretained MBCacheEntry* _older;
+}
+@end
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark MBCacheEntryList class
+/******************************************************************************/
+
+/*!
+ Tracks the entries of one memory cache shard in recency order, and selects
+ eviction victims according to an `MBThreadsafeCacheEvictionPolicy`.
+
+ The list is not thread-safe; all methods except `entryAccessed:` must be
+ called while the owning shard is exclusively locked. When the list's policy
+ is `MBThreadsafeCacheEvictionPolicyCLOCK`, `entryAccessed:` only sets the
+ entry's reference bit, so it may be called while the shard is locked for
+ reading.
+ */
+@interface MBCacheEntryList : NSObject
+
+/*! The policy used to select eviction victims. */
+@property(nonatomic, assign) MBThreadsafeCacheEvictionPolicy policy;
+
+/*! The number of entries in the list. */
+@property(nonatomic, readonly) NSUInteger count;
+
+/*! The sum of the costs of the entries in the list. */
+@property(nonatomic, readonly) NSUInteger totalCost;
+
+/*!
+ Returns the entry for the given memory cache key, or `nil` if there
+ isn't one.
+ */
+- (nullable MBCacheEntry*) entryForKey:(nonnull id)key;
+
+/*!
+ Adds a new entry for the given key as the most-recently-used entry,
+ replacing any existing entry for the key.
+ */
+- (nonnull MBCacheEntry*) addEntryForKey:(nonnull id)key cost:(NSUInteger)cost;
+
+/*! Removes the entry for the given key, if there is one. */
+- (void) removeEntryForKey:(nonnull id)key;
+
+/*! Removes all entries. */
+- (void) removeAllEntries;
+
+/*!
+ Records an access of the given entry. Under LRU, the entry becomes the
+ most-recently-used; under CLOCK, its reference bit is set.
+ */
+- (void) entryAccessed:(nonnull MBCacheEntry*)entry;
+
+/*!
+ Returns the keys of the entries whose expiration time is at or before `now`.
+ */
+- (nonnull NSArray*) keysOfEntriesExpiredAsOf:(NSTimeInterval)now;
+
+/*!
+ Returns the keys of all entries, most recent first. Under LRU, this is the
+ order of most recent use; under CLOCK, the order in which entries were added.
+ */
+- (nonnull NSArray*) keysByRecency;
+
+/*!
+ Returns the entry that should be evicted next according to the list's
+ policy, or `nil` if the list is empty. The entry is not removed.
+ */
+- (nullable MBCacheEntry*) nextVictim;
+
+/*!
+ Enumerates the entries in the order in which they would be evicted, starting
+ with the `nextVictim`, until the block sets `*stop` or every entry has been
+ visited. Under CLOCK, entries whose reference bits are set are visited after
+ the others; other than by the call to `nextVictim`, no bits are cleared.
+ */
+- (void) enumerateVictimsUsingBlock:(nonnull void (^)(MBCacheEntry* __nonnull entry, BOOL* __nonnull stop))block;
+
+@end
@@ -0,0 +1,217 @@
+//
+//  MBCacheEntryList.m
+//  Mockingbird Toolbox
+//
+//  Created by Evan Coyne Maloney on 10/17/26.
+//  Copyright (c) 2026 Gilt Groupe. All rights reserved.
+//
+
+#import "MBCacheEntryList.h"
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark MBCacheEntry implementation
+/******************************************************************************/
+
+@implementation MBCacheEntry
+@end
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark MBCacheEntryList implementation
+/******************************************************************************/
+
+@implementation MBCacheEntryList
+{
+    NSMutableDictionary* _entries;
+    __unsafe_unretained MBCacheEntry* _newest;
+    __unsafe_unretained MBCacheEntry* _oldest;
+    __unsafe_unretained MBCacheEntry* _hand;
+}
+
+/******************************************************************************/
+#pragma mark Object lifecycle
+/******************************************************************************/
+
+- (instancetype) init
+{
+    self = [super init];
+    if (self) {
+        _entries = [NSMutableDictionary new];
+    }
+    return self;
+}
+
+/******************************************************************************/
+#pragma mark Linking & unlinking
+/******************************************************************************/
+
+- (void) _linkAsNewest:(MBCacheEntry*)entry
+{
+    entry->_newer = nil;
+    entry->_older = _newest;
+    if (_newest) {
+        _newest->_newer = entry;
+    }
+    _newest = entry;
+    if (!_oldest) {
+        _oldest = entry;
+    }
+}
+
+- (void) _unlink:(MBCacheEntry*)entry
+{
+    if (_hand == entry) {
+        _hand = entry->_newer;
+    }
+    if (entry->_newer) {
+        entry->_newer->_older = entry->_older;
+    }
+    else {
+        _newest = entry->_older;
+    }
+    if (entry->_older) {
+        entry->_older->_newer = entry->_newer;
+    }
+    else {
+        _oldest = entry->_newer;
+    }
+    entry->_newer = nil;
+    entry->_older = nil;
+}
+
+/******************************************************************************/
+#pragma mark Managing entries
+/******************************************************************************/
+
+- (NSUInteger) count
+{
+    return _entries.count;
+}
+
+- (MBCacheEntry*) entryForKey:(id)key
+{
+    return _entries[key];
+}
+
+- (MBCacheEntry*) addEntryForKey:(id)key cost:(NSUInteger)cost
+{
+    [self removeEntryForKey:key];
+
+    MBCacheEntry* entry = [MBCacheEntry new];
+    entry->_key = key;
+    entry->_cost = cost;
+    entry->_expiresAt = 0;
+    atomic_init(&entry->_referenced, false);
+
+    _entries[key] = entry;
+    [self _linkAsNewest:entry];
+    _totalCost += cost;
+    return entry;
+}
+
+- (void) removeEntryForKey:(id)key
+{
+    MBCacheEntry* entry = _entries[key];
+    if (entry) {
+        [self _unlink:entry];
+        _totalCost -= entry->_cost;
+        [_entries removeObjectForKey:key];
+    }
+}
+
+- (void) removeAllEntries
+{
+    _newest = nil;
+    _oldest = nil;
+    _hand = nil;
+    _totalCost = 0;
+    [_entries removeAllObjects];
+}
+
+- (NSArray*) keysOfEntriesExpiredAsOf:(NSTimeInterval)now
+{
+    NSMutableArray* keys = [NSMutableArray new];
+    for (MBCacheEntry* entry = _oldest; entry; entry = entry->_newer) {
+        if (entry->_expiresAt && entry->_expiresAt <= now) {
+            [keys addObject:entry->_key];
+        }
+    }
+    return keys;
+}
+
+- (NSArray*) keysByRecency
+{
+    NSMutableArray* keys = [NSMutableArray arrayWithCapacity:_entries.count];
+    for (MBCacheEntry* entry = _newest; entry; entry = entry->_older) {
+        [keys addObject:entry->_key];
+    }
+    return keys;
+}
+
+/******************************************************************************/
+#pragma mark Eviction policy
+/******************************************************************************/
+
+- (void) entryAccessed:(MBCacheEntry*)entry
+{
+    if (_policy == MBThreadsafeCacheEvictionPolicyCLOCK) {
+        atomic_store_explicit(&entry->_referenced, true, memory_order_relaxed);
+    }
+    else if (entry != _newest) {
+        [self _unlink:entry];
+        [self _linkAsNewest:entry];
+    }
+}
+
+- (MBCacheEntry*) nextVictim
+{
+    if (!_oldest) {
+        return nil;
+    }
+
+    if (_policy == MBThreadsafeCacheEvictionPolicyLRU) {
+        return _oldest;
+    }
+
+    // the CLOCK hand sweeps from oldest to newest, wrapping around; entries
+    // referenced since the last sweep get their bit cleared and a reprieve.
+    // this terminates within two passes, since every bit is cleared in one
+    MBCacheEntry* candidate = _hand ?: _oldest;
+    while (atomic_exchange_explicit(&candidate->_referenced, false, memory_order_relaxed)) {
+        candidate = candidate->_newer ?: _oldest;
+    }
+    _hand = candidate;
+    return candidate;
+}
+
+- (void) enumerateVictimsUsingBlock:(void (^)(MBCacheEntry* entry, BOOL* stop))block
+{
+    MBCacheEntry* first = [self nextVictim];
+    if (!first) {
+        return;
+    }
+
+    BOOL stop = NO;
+    if (_policy == MBThreadsafeCacheEvictionPolicyLRU) {
+        for (MBCacheEntry* entry = first; entry && !stop; entry = entry->_newer) {
+            block(entry, &stop);
+        }
+        return;
+    }
+
+    // the hand's sweep order, wrapping around: unreferenced entries would be
+    // evicted on the first pass, and referenced ones only on the second
+    for (int pass=0; pass<2 && !stop; pass++) {
+        MBCacheEntry* entry = first;
+        do {
+            BOOL referenced = atomic_load_explicit(&entry->_referenced, memory_order_relaxed);
+            if (referenced == (pass == 1)) {
+                block(entry, &stop);
+            }
+            entry = entry->_newer ?: _oldest;
+        } while (entry != first && !stop);
+    }
+}
+
+@end
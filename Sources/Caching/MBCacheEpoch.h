@@ -0,0 +1,105 @@
+//
+//  MBCacheEpoch.h
+//  Mockingbird Toolbox
+//
+//  Created by Evan Coyne Maloney on 10/17/26.
+//  Copyright (c) 2026 Gilt Groupe. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <stdatomic.h>
+
+//
+// NOTE: This header file is for use only within the implementation of
+//       MBThreadsafeCache and its subclasses. It is not a public header.
+//
+
+/******************************************************************************/
+#pragma mark Types
+/******************************************************************************/
+
+/*!
+ Announces which epoch a thread observed when it began reading shared data.
+
+ Each thread that reads has its own record, padded to occupy its own cache
+ line, so announcing a read never writes to memory shared with another thread.
+ Records are reused once their threads exit. The fields are public so that
+ the inline functions below can update them without a function call.
+ */
+typedef struct MBCacheEpochRecord {
+    atomic_ullong _epoch;                   // 0 when the thread isn't reading
+    NSUInteger _depth;                      // owned by the thread; for nesting
+    atomic_bool _inUse;
+    struct MBCacheEpochRecord* _next;       // never changes once published
+} __attribute__((aligned(64))) MBCacheEpochRecord;
+
+/*!
+ The current epoch. Advanced each time an object is retired.
+ */
+extern atomic_ullong MBCacheEpochCurrent;
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark Reading
+/******************************************************************************/
+
+/*!
+ Returns the calling thread's record, creating one if necessary.
+ */
+MBCacheEpochRecord* __nonnull MBCacheEpochRecordForCurrentThread(void);
+
+/*!
+ Begins a read. Between this call and the matching `MBCacheEpochExit()`, no
+ object retired via `MBCacheEpochRetire()` after the read began will be
+ released. Reads may nest.
+
+ This performs no atomic read-modify-write operations; its only cost is a
+ memory fence that orders the announcement before the reads that follow.
+ */
+static inline void MBCacheEpochEnter(MBCacheEpochRecord* __nonnull record)
+{
+    if (record->_depth++ == 0) {
+        atomic_store_explicit(&record->_epoch, atomic_load_explicit(&MBCacheEpochCurrent, memory_order_relaxed), memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+    }
+}
+
+/*!
+ Ends a read begun by `MBCacheEpochEnter()`. Any object obtained during the
+ read must have been retained before this is called.
+ */
+static inline void MBCacheEpochExit(MBCacheEpochRecord* __nonnull record)
+{
+    if (--record->_depth == 0) {
+        atomic_store_explicit(&record->_epoch, 0, memory_order_release);
+    }
+}
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark Reclamation
+/******************************************************************************/
+
+/*!
+ Releases an object once no thread can still be reading it.
+
+ The object must already be unreachable by new readers; that is, the pointer
+ through which readers found it must have been replaced (with sequentially
+ consistent ordering) before this is called. The object is released when
+ every thread that was reading at the time of this call has finished. Objects
+ awaiting release are checked whenever another object is retired, when
+ `MBCacheEpochReclaim()` is called, and periodically for as long as any
+ remain, so they don't wait for the next retirement.
+
+ Releasing an object can release the objects it holds and run arbitrary
+ code, so this must not be called while holding locks that code might need.
+
+ @param     obj A reference to the object, which the caller relinquishes;
+            typically obtained with `CFBridgingRetain()`.
+ */
+void MBCacheEpochRetire(CFTypeRef __nonnull obj);
+
+/*!
+ Releases any retired objects that are no longer being read.
+ */
+void MBCacheEpochReclaim(void);
@@ -0,0 +1,199 @@
+//
+//  MBCacheEpoch.m
+//  Mockingbird Toolbox
+//
+//  Created by Evan Coyne Maloney on 10/17/26.
+//  Copyright (c) 2026 Gilt Groupe. All rights reserved.
+//
+
+#import <pthread.h>
+
+#import "MBCacheEpoch.h"
+
+#define kInitialRetiredCapacity     16
+#define kRetiredDrainInterval       0.1     // seconds between checks while objects await release
+
+// an object awaiting release, along with the epoch in which it was retired
+typedef struct {
+    CFTypeRef obj;
+    uint64_t epoch;
+} MBCacheRetiredObject;
+
+atomic_ullong MBCacheEpochCurrent = 1;
+
+static _Atomic(MBCacheEpochRecord*) MBCacheEpochRecords = NULL;
+static pthread_key_t MBCacheEpochRecordKey;
+
+// guards the retired list; only writers take it
+static pthread_mutex_t MBCacheEpochRetiredLock = PTHREAD_MUTEX_INITIALIZER;
+static MBCacheRetiredObject* MBCacheEpochRetired = NULL;
+static NSUInteger MBCacheEpochRetiredCount = 0;
+static NSUInteger MBCacheEpochRetiredCapacity = 0;
+static BOOL MBCacheEpochDrainScheduled = NO;
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark Thread records
+/******************************************************************************/
+
+static void MBCacheEpochThreadExited(void* value)
+{
+    // the thread can't be reading any more, so its record can be reused
+    MBCacheEpochRecord* record = value;
+    record->_depth = 0;
+    atomic_store_explicit(&record->_epoch, 0, memory_order_release);
+    atomic_store_explicit(&record->_inUse, false, memory_order_release);
+}
+
+static MBCacheEpochRecord* MBCacheEpochAcquireRecord(void)
+{
+    // reuse a record abandoned by an exited thread, if there is one
+    for (MBCacheEpochRecord* record = atomic_load_explicit(&MBCacheEpochRecords, memory_order_acquire); record; record = record->_next) {
+        bool inUse = false;
+        if (atomic_compare_exchange_strong_explicit(&record->_inUse, &inUse, true, memory_order_acquire, memory_order_relaxed)) {
+            return record;
+        }
+    }
+
+    // otherwise, add a new one; records are never freed, since the
+    // writers scanning the list don't synchronize with the readers
+    MBCacheEpochRecord* record = NULL;
+    if (posix_memalign((void**)&record, sizeof(MBCacheEpochRecord), sizeof(MBCacheEpochRecord))) {
+        [NSException raise:NSMallocException format:@"couldn't allocate an epoch record"];
+    }
+    atomic_init(&record->_epoch, 0);
+    record->_depth = 0;
+    atomic_init(&record->_inUse, true);
+
+    MBCacheEpochRecord* head = atomic_load_explicit(&MBCacheEpochRecords, memory_order_relaxed);
+    do {
+        record->_next = head;
+    } while (!atomic_compare_exchange_weak_explicit(&MBCacheEpochRecords, &head, record, memory_order_release, memory_order_relaxed));
+    return record;
+}
+
+MBCacheEpochRecord* MBCacheEpochRecordForCurrentThread(void)
+{
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        pthread_key_create(&MBCacheEpochRecordKey, MBCacheEpochThreadExited);
+    });
+
+    MBCacheEpochRecord* record = pthread_getspecific(MBCacheEpochRecordKey);
+    if (!record) {
+        record = MBCacheEpochAcquireRecord();
+        pthread_setspecific(MBCacheEpochRecordKey, record);
+    }
+    return record;
+}
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark Reclamation
+/******************************************************************************/
+
+// returns the earliest epoch announced by a thread that is still reading
+static uint64_t MBCacheEpochOldestRead(void)
+{
+    uint64_t oldest = UINT64_MAX;
+    for (MBCacheEpochRecord* record = atomic_load_explicit(&MBCacheEpochRecords, memory_order_acquire); record; record = record->_next) {
+        uint64_t epoch = atomic_load_explicit(&record->_epoch, memory_order_seq_cst);
+        if (epoch && epoch < oldest) {
+            oldest = epoch;
+        }
+    }
+    return oldest;
+}
+
+// must be called with the retired list locked; moves the objects that
+// are safe to release into the array returned, which the caller frees
+static CFTypeRef* MBCacheEpochCollectReleasable(NSUInteger* countPtr)
+{
+    *countPtr = 0;
+    if (!MBCacheEpochRetiredCount) {
+        return NULL;
+    }
+
+    // an object retired in epoch E can only be held by a reader that
+    // announced E or earlier; later readers found its replacement
+    uint64_t oldest = MBCacheEpochOldestRead();
+    CFTypeRef* releasable = malloc(MBCacheEpochRetiredCount * sizeof(CFTypeRef));
+    NSUInteger kept = 0;
+    for (NSUInteger i=0; i<MBCacheEpochRetiredCount; i++) {
+        if (MBCacheEpochRetired[i].epoch < oldest) {
+            releasable[(*countPtr)++] = MBCacheEpochRetired[i].obj;
+        }
+        else {
+            MBCacheEpochRetired[kept++] = MBCacheEpochRetired[i];
+        }
+    }
+    MBCacheEpochRetiredCount = kept;
+    return releasable;
+}
+
+// releases outside the lock, since deallocation can run arbitrary code
+static void MBCacheEpochRelease(CFTypeRef* releasable, NSUInteger count)
+{
+    for (NSUInteger i=0; i<count; i++) {
+        CFRelease(releasable[i]);
+    }
+    free(releasable);
+}
+
+static void MBCacheEpochDrain(void);
+
+// must be called with the retired list locked; objects still being read
+// when they were retired are released by a later check, even if nothing
+// else is ever retired
+static void MBCacheEpochScheduleDrain(void)
+{
+    if (!MBCacheEpochRetiredCount || MBCacheEpochDrainScheduled) {
+        return;
+    }
+    MBCacheEpochDrainScheduled = YES;
+
+    dispatch_time_t when = dispatch_time(DISPATCH_TIME_NOW, (int64_t)(kRetiredDrainInterval * NSEC_PER_SEC));
+    dispatch_after(when, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
+        MBCacheEpochDrain();
+    });
+}
+
+static void MBCacheEpochDrain(void)
+{
+    NSUInteger count = 0;
+    pthread_mutex_lock(&MBCacheEpochRetiredLock);
+    MBCacheEpochDrainScheduled = NO;
+    CFTypeRef* releasable = MBCacheEpochCollectReleasable(&count);
+    MBCacheEpochScheduleDrain();
+    pthread_mutex_unlock(&MBCacheEpochRetiredLock);
+
+    MBCacheEpochRelease(releasable, count);
+}
+
+void MBCacheEpochRetire(CFTypeRef obj)
+{
+    NSUInteger count = 0;
+    pthread_mutex_lock(&MBCacheEpochRetiredLock);
+    if (MBCacheEpochRetiredCount == MBCacheEpochRetiredCapacity) {
+        MBCacheEpochRetiredCapacity = MAX(kInitialRetiredCapacity, MBCacheEpochRetiredCapacity * 2);
+        MBCacheEpochRetired = reallocf(MBCacheEpochRetired, MBCacheEpochRetiredCapacity * sizeof(MBCacheRetiredObject));
+    }
+    uint64_t epoch = atomic_fetch_add_explicit(&MBCacheEpochCurrent, 1, memory_order_seq_cst);
+    MBCacheEpochRetired[MBCacheEpochRetiredCount++] = (MBCacheRetiredObject){obj, epoch};
+    CFTypeRef* releasable = MBCacheEpochCollectReleasable(&count);
+    MBCacheEpochScheduleDrain();
+    pthread_mutex_unlock(&MBCacheEpochRetiredLock);
+
+    MBCacheEpochRelease(releasable, count);
+}
+
+void MBCacheEpochReclaim(void)
+{
+    NSUInteger count = 0;
+    pthread_mutex_lock(&MBCacheEpochRetiredLock);
+    CFTypeRef* releasable = MBCacheEpochCollectReleasable(&count);
+    MBCacheEpochScheduleDrain();
+    pthread_mutex_unlock(&MBCacheEpochRetiredLock);
+
+    MBCacheEpochRelease(releasable, count);
+}
@@ -0,0 +1,179 @@
+//
+//  MBCacheFileIndex.h
+//  Mockingbird Toolbox
+//
+//  Created by Evan Coyne Maloney on 10/17/26.
+//  Copyright (c) 2026 Gilt Groupe. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+//
+// NOTE: This header file is for use only within the implementation of
+//       MBFilesystemCache and its subclasses. It is not a public header.
+//
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark MBCacheFileInfo class
+/******************************************************************************/
+
+/*!
+ Information about a single file recorded in an `MBCacheFileIndex`.
+
+ Instance variables are public so that they can be accessed without the
+ overhead of messaging. Instances are never mutated once they have been
+ recorded in an index.
+ */
+@interface MBCacheFileInfo : NSObject
+{
+@public
+    unsigned long long _size;
+    NSTimeInterval _modifiedAt;         // since the reference date
+    NSTimeInterval _accessedAt;         // since the reference date
+}
+@end
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark MBCacheFileIndex class
+/******************************************************************************/
+
+/*!
+ A compact, persistent record of the files present in a cache directory,
+ along with their sizes, modification times and access times. Consulting the
+ index lets a cache answer presence and age queries without issuing a system
+ call, and choose files to evict without walking the directory.
+
+ The index is saved to its own file shortly after it changes. When the
+ receiver is created, the saved index is loaded on a background queue; if
+ there is no saved index, or the cache directory was modified after the
+ index was last saved (for example, because the process exited before a
+ pending save), the index is rebuilt from the directory instead. Until
+ loading completes, `isLoaded` returns `NO`, and callers must consult the
+ filesystem directly.
+
+ Changes recorded while the index is loading are preserved once it loads.
+
+ All methods are thread-safe.
+ */
+@interface MBCacheFileIndex : NSObject
+
+/*----------------------------------------------------------------------------*/
+#pragma mark Object lifecycle
+/*!    @name Object lifecycle                                                 */
+/*----------------------------------------------------------------------------*/
+
+/*!
+ Initializes the receiver to index the given directory, and begins loading
+ the index in the background.
+
+ @param     dir The directory whose files are to be indexed.
+
+ @param     path The path of the file in which the index is saved. This must
+            not be within `dir`.
+
+ @return    The receiver.
+ */
+- (nonnull instancetype) initWithDirectory:(nonnull NSString*)dir
+                             indexFilePath:(nonnull NSString*)path;
+
+/*----------------------------------------------------------------------------*/
+#pragma mark Index properties
+/*!    @name Index properties                                                 */
+/*----------------------------------------------------------------------------*/
+
+/*! The indexed directory. */
+@property(nonnull, nonatomic, readonly) NSString* directory;
+
+/*! The path of the file in which the index is saved. */
+@property(nonnull, nonatomic, readonly) NSString* indexFilePath;
+
+/*! Returns `YES` once the index has been loaded or rebuilt, and may be
+    relied upon to answer queries. */
+@property(nonatomic, readonly) BOOL isLoaded;
+
+/*!
+ Executes the given block on a background queue once the index has been
+ loaded or rebuilt. If it already has been, the block is executed soon.
+
+ @param     block The block to execute.
+ */
+- (void) performBlockWhenLoaded:(nonnull void (^)(void))block;
+
+/*! The number of files in the index. */
+@property(nonatomic, readonly) NSUInteger count;
+
+/*! The sum of the sizes of the files in the index, in bytes. */
+@property(nonatomic, readonly) unsigned long long totalSize;
+
+/*----------------------------------------------------------------------------*/
+#pragma mark Querying the index
+/*!    @name Querying the index                                               */
+/*----------------------------------------------------------------------------*/
+
+/*!
+ Returns the information recorded for the file with the given name.
+
+ @param     name The filename, relative to the indexed directory.
+
+ @return    The file information, or `nil` if the file is not in the index.
+ */
+- (nullable MBCacheFileInfo*) infoForFileNamed:(nonnull NSString*)name;
+
+/*!
+ Returns the names of the least recently accessed files in the index, in
+ order of access, up to and including the first file at which their sizes
+ total at least `size` bytes.
+
+ @param     size The number of bytes the returned files should account for.
+
+ @return    The filenames, relative to the indexed directory.
+ */
+- (nonnull NSArray*) leastRecentlyAccessedFileNamesTotaling:(unsigned long long)size;
+
+/*----------------------------------------------------------------------------*/
+#pragma mark Updating the index
+/*!    @name Updating the index                                               */
+/*----------------------------------------------------------------------------*/
+
+/*!
+ Records that the file with the given name was written.
+
+ @param     name The filename, relative to the indexed directory.
+
+ @param     size The size of the file, in bytes.
+
+ @param     modifiedAt The time at which the file was written, as a time
+            interval since the reference date.
+ */
+- (void) recordFileNamed:(nonnull NSString*)name
+                    size:(unsigned long long)size
+              modifiedAt:(NSTimeInterval)modifiedAt;
+
+/*!
+ Records that the file with the given name was read. Has no effect if the
+ file is not in the index.
+
+ @param     name The filename, relative to the indexed directory.
+ */
+- (void) noteAccessToFileNamed:(nonnull NSString*)name;
+
+/*!
+ Records that the file with the given name was removed.
+
+ @param     name The filename, relative to the indexed directory.
+ */
+- (void) removeFileNamed:(nonnull NSString*)name;
+
+/*!
+ Records that every file in the indexed directory was removed.
+ */
+- (void) removeAllFiles;
+
+/*!
+ Immediately saves the index if it has changed since it was last saved.
+ */
+- (void) save;
+
+@end
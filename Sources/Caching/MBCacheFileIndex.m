@@ -0,0 +1,439 @@
+//
+//  MBCacheFileIndex.m
+//  Mockingbird Toolbox
+//
+//  Created by Evan Coyne Maloney on 10/17/26.
+//  Copyright (c) 2026 Gilt Groupe. All rights reserved.
+//
+
+#import <stdatomic.h>
+
+#import "MBCacheFileIndex.h"
+#import "MBReadWriteLock.h"
+#import "MBModuleLogMacros.h"
+
+#define DEBUG_LOCAL     0
+
+/******************************************************************************/
+#pragma mark Constants
+/******************************************************************************/
+
+#define kIndexFileMagic             0x4D424649          // 'MBFI'
+#define kIndexFileVersion           2
+#define kIndexSaveDelay             2.0                 // seconds
+
+/******************************************************************************/
+#pragma mark Types
+/******************************************************************************/
+
+// begins the index file; it is followed by `count` entries, each consisting
+// of a uint16_t name length, the UTF-8 name, a uint64_t size, and doubles
+// holding the modification and access times
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t count;
+    double savedAt;                 // NSTimeInterval since reference date
+} MBCacheFileIndexHeader;
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark MBCacheFileInfo implementation
+/******************************************************************************/
+
+@implementation MBCacheFileInfo
+@end
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark MBCacheFileIndex implementation
+/******************************************************************************/
+
+@implementation MBCacheFileIndex
+{
+    MBReadWriteLock* _lock;
+    NSMutableDictionary* _files;            // filename -> MBCacheFileInfo
+    NSMutableSet* _removedWhileLoading;
+    unsigned long long _totalSize;
+    BOOL _clearedWhileLoading;
+    BOOL _dirty;
+    atomic_bool _loaded;
+    atomic_bool _saveScheduled;
+    dispatch_queue_t _queue;                // loads & saves the index file
+}
+
+/******************************************************************************/
+#pragma mark Object lifecycle
+/******************************************************************************/
+
+- (instancetype) initWithDirectory:(NSString*)dir indexFilePath:(NSString*)path
+{
+    self = [super init];
+    if (self) {
+        _directory = dir;
+        _indexFilePath = path;
+        _lock = [MBReadWriteLock new];
+        _files = [NSMutableDictionary new];
+        _removedWhileLoading = [NSMutableSet new];
+        atomic_init(&_loaded, false);
+        atomic_init(&_saveScheduled, false);
+
+        _queue = dispatch_queue_create("MBCacheFileIndex", DISPATCH_QUEUE_SERIAL);
+        dispatch_set_target_queue(_queue, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0));
+
+        __weak MBCacheFileIndex* weakSelf = self;
+        dispatch_async(_queue, ^{
+            [weakSelf _load];
+        });
+    }
+    return self;
+}
+
+/******************************************************************************/
+#pragma mark Index properties
+/******************************************************************************/
+
+- (BOOL) isLoaded
+{
+    return atomic_load(&_loaded);
+}
+
+- (void) performBlockWhenLoaded:(void (^)(void))block
+{
+    // _queue is serial, and the load is the first thing enqueued on it
+    dispatch_async(_queue, block);
+}
+
+- (NSUInteger) count
+{
+    [_lock lockForReading];
+    NSUInteger cnt = _files.count;
+    [_lock unlock];
+    return cnt;
+}
+
+- (unsigned long long) totalSize
+{
+    [_lock lockForReading];
+    unsigned long long size = _totalSize;
+    [_lock unlock];
+    return size;
+}
+
+/******************************************************************************/
+#pragma mark Loading
+/******************************************************************************/
+
+// executes on _queue
+- (void) _load
+{
+    MBLogDebugTrace();
+
+    BOOL rebuilt = NO;
+    NSDictionary* files = [self _readIndexFile];
+    if (!files) {
+        files = [self _scanDirectory];
+        rebuilt = YES;
+    }
+
+    // merge in the loaded files, giving precedence to
+    // any changes recorded while we were loading
+    [_lock lock];
+    if (!_clearedWhileLoading) {
+        [files enumerateKeysAndObjectsUsingBlock:^(NSString* name, MBCacheFileInfo* info, BOOL* stop) {
+            if (!_files[name] && ![_removedWhileLoading containsObject:name]) {
+                _files[name] = info;
+                _totalSize += info->_size;
+            }
+        }];
+    }
+    _removedWhileLoading = nil;
+    _dirty = _dirty || rebuilt;
+    atomic_store(&_loaded, true);
+    [_lock unlock];
+
+    MBLogDebug(@"%@ %@ %lu files in %@", [self class], (rebuilt ? @"rebuilt index of" : @"loaded index of"), (unsigned long)files.count, _directory);
+
+    if (rebuilt) {
+        [self _save];
+    }
+}
+
+- (NSDictionary*) _readIndexFile
+{
+    NSData* data = [NSData dataWithContentsOfFile:_indexFilePath options:NSDataReadingMapped error:nil];
+    if (!data) {
+        return nil;
+    }
+
+    const uint8_t* bytes = data.bytes;
+    NSUInteger length = data.length;
+
+    MBCacheFileIndexHeader hdr;
+    if (length < sizeof(hdr)) {
+        return nil;
+    }
+    memcpy(&hdr, bytes, sizeof(hdr));
+    if (hdr.magic != kIndexFileMagic || hdr.version != kIndexFileVersion) {
+        MBLogError(@"%@ ignoring unrecognized index file at %@", [self class], _indexFilePath);
+        return nil;
+    }
+
+    // if the directory changed after the index was saved, the index can't
+    // be trusted; a one-second margin covers coarse timestamp granularity
+    NSDictionary* dirAttrs = [[NSFileManager new] attributesOfItemAtPath:_directory error:nil];
+    if (!dirAttrs) {
+        return @{};     // the directory doesn't exist, so it has no files
+    }
+    NSTimeInterval dirModifiedAt = [[dirAttrs fileModificationDate] timeIntervalSinceReferenceDate];
+    if (dirModifiedAt >= hdr.savedAt - 1.0) {
+        MBLogDebug(@"%@ index file at %@ is out of date", [self class], _indexFilePath);
+        return nil;
+    }
+
+    NSMutableDictionary* files = [NSMutableDictionary dictionaryWithCapacity:(NSUInteger)hdr.count];
+    NSUInteger offset = sizeof(hdr);
+    for (uint64_t i=0; i<hdr.count; i++) {
+        @autoreleasepool {
+            uint16_t nameLength;
+            if (length - offset < sizeof(nameLength)) {
+                return nil;
+            }
+            memcpy(&nameLength, bytes + offset, sizeof(nameLength));
+            offset += sizeof(nameLength);
+
+            if (length - offset < nameLength + sizeof(uint64_t) + (2 * sizeof(double))) {
+                return nil;
+            }
+            NSString* name = [[NSString alloc] initWithBytes:(bytes + offset) length:nameLength encoding:NSUTF8StringEncoding];
+            offset += nameLength;
+
+            MBCacheFileInfo* info = [MBCacheFileInfo new];
+            memcpy(&info->_size, bytes + offset, sizeof(uint64_t));
+            offset += sizeof(uint64_t);
+            memcpy(&info->_modifiedAt, bytes + offset, sizeof(double));
+            offset += sizeof(double);
+            memcpy(&info->_accessedAt, bytes + offset, sizeof(double));
+            offset += sizeof(double);
+
+            if (!name) {
+                return nil;
+            }
+            files[name] = info;
+        }
+    }
+    return files;
+}
+
+- (NSDictionary*) _scanDirectory
+{
+    NSMutableDictionary* files = [NSMutableDictionary new];
+
+    NSArray* keys = @[NSURLIsRegularFileKey, NSURLFileSizeKey, NSURLContentModificationDateKey];
+    NSDirectoryEnumerator* dirEnum = [[NSFileManager new] enumeratorAtURL:[NSURL fileURLWithPath:_directory isDirectory:YES]
+                                               includingPropertiesForKeys:keys
+                                                                  options:(NSDirectoryEnumerationSkipsSubdirectoryDescendants | NSDirectoryEnumerationSkipsHiddenFiles)
+                                                             errorHandler:nil];
+    for (NSURL* url in dirEnum) {
+        @autoreleasepool {
+            NSDictionary* values = [url resourceValuesForKeys:keys error:nil];
+            if ([values[NSURLIsRegularFileKey] boolValue]) {
+                MBCacheFileInfo* info = [MBCacheFileInfo new];
+                info->_size = [values[NSURLFileSizeKey] unsignedLongLongValue];
+                info->_modifiedAt = [values[NSURLContentModificationDateKey] timeIntervalSinceReferenceDate];
+                info->_accessedAt = info->_modifiedAt;      // atime is unreliable
+                files[[url lastPathComponent]] = info;
+            }
+        }
+    }
+    return files;
+}
+
+/******************************************************************************/
+#pragma mark Saving
+/******************************************************************************/
+
+- (void) _scheduleSave
+{
+    if (atomic_exchange(&_saveScheduled, true)) {
+        return;     // already scheduled
+    }
+
+    __weak MBCacheFileIndex* weakSelf = self;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(kIndexSaveDelay * NSEC_PER_SEC)), _queue, ^{
+        MBCacheFileIndex* strongSelf = weakSelf;
+        if (strongSelf) {
+            atomic_store(&strongSelf->_saveScheduled, false);
+            [strongSelf _save];
+        }
+    });
+}
+
+- (void) save
+{
+    dispatch_sync(_queue, ^{
+        [self _save];
+    });
+}
+
+// executes on _queue
+- (void) _save
+{
+    // the save time is taken before the snapshot, so that a file written
+    // after the snapshot makes the saved index appear out of date
+    NSTimeInterval savedAt = [NSDate timeIntervalSinceReferenceDate];
+
+    [_lock lock];
+    if (!_dirty || !atomic_load(&_loaded)) {
+        [_lock unlock];
+        return;
+    }
+    NSDictionary* files = [_files copy];
+    _dirty = NO;
+    [_lock unlock];
+
+    MBCacheFileIndexHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = kIndexFileMagic;
+    hdr.version = kIndexFileVersion;
+    hdr.count = files.count;
+    hdr.savedAt = savedAt;
+
+    NSMutableData* data = [NSMutableData dataWithCapacity:sizeof(hdr) + files.count * 64];
+    [data appendBytes:&hdr length:sizeof(hdr)];
+    [files enumerateKeysAndObjectsUsingBlock:^(NSString* name, MBCacheFileInfo* info, BOOL* stop) {
+        NSData* nameData = [name dataUsingEncoding:NSUTF8StringEncoding];
+        uint16_t nameLength = (uint16_t) nameData.length;
+        uint64_t size = info->_size;
+        double modifiedAt = info->_modifiedAt;
+        double accessedAt = info->_accessedAt;
+        [data appendBytes:&nameLength length:sizeof(nameLength)];
+        [data appendData:nameData];
+        [data appendBytes:&size length:sizeof(size)];
+        [data appendBytes:&modifiedAt length:sizeof(modifiedAt)];
+        [data appendBytes:&accessedAt length:sizeof(accessedAt)];
+    }];
+
+    NSError* err = nil;
+    if (![data writeToFile:_indexFilePath options:NSDataWritingAtomic error:&err]) {
+        MBLogError(@"%@ error while trying to save the index file at %@: %@", [self class], _indexFilePath, [err localizedDescription]);
+
+        [_lock lock];
+        _dirty = YES;
+        [_lock unlock];
+    }
+}
+
+/******************************************************************************/
+#pragma mark Querying the index
+/******************************************************************************/
+
+- (MBCacheFileInfo*) infoForFileNamed:(NSString*)name
+{
+    [_lock lockForReading];
+    MBCacheFileInfo* info = _files[name];
+    [_lock unlock];
+    return info;
+}
+
+- (NSArray*) leastRecentlyAccessedFileNamesTotaling:(unsigned long long)size
+{
+    [_lock lockForReading];
+    NSArray* names = [_files keysSortedByValueUsingComparator:^NSComparisonResult(MBCacheFileInfo* info1, MBCacheFileInfo* info2) {
+        if (info1->_accessedAt < info2->_accessedAt) {
+            return NSOrderedAscending;
+        }
+        else if (info1->_accessedAt > info2->_accessedAt) {
+            return NSOrderedDescending;
+        }
+        return NSOrderedSame;
+    }];
+
+    NSUInteger cnt = 0;
+    unsigned long long total = 0;
+    while (cnt < names.count && total < size) {
+        total += ((MBCacheFileInfo*)_files[names[cnt]])->_size;
+        cnt++;
+    }
+    [_lock unlock];
+
+    return [names subarrayWithRange:NSMakeRange(0, cnt)];
+}
+
+/******************************************************************************/
+#pragma mark Updating the index
+/******************************************************************************/
+
+- (void) recordFileNamed:(NSString*)name
+                    size:(unsigned long long)size
+              modifiedAt:(NSTimeInterval)modifiedAt
+{
+    MBCacheFileInfo* info = [MBCacheFileInfo new];
+    info->_size = size;
+    info->_modifiedAt = modifiedAt;
+    info->_accessedAt = modifiedAt;
+
+    [_lock lock];
+    MBCacheFileInfo* old = _files[name];
+    if (old) {
+        _totalSize -= old->_size;
+    }
+    _files[name] = info;
+    _totalSize += size;
+    _dirty = YES;
+    [_lock unlock];
+
+    [self _scheduleSave];
+}
+
+- (void) noteAccessToFileNamed:(NSString*)name
+{
+    NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+
+    [_lock lock];
+    MBCacheFileInfo* old = _files[name];
+    if (old) {
+        // recorded instances are never mutated, so readers
+        // holding one never see it change underneath them
+        MBCacheFileInfo* info = [MBCacheFileInfo new];
+        info->_size = old->_size;
+        info->_modifiedAt = old->_modifiedAt;
+        info->_accessedAt = now;
+        _files[name] = info;
+        _dirty = YES;
+    }
+    [_lock unlock];
+
+    if (old) {
+        [self _scheduleSave];
+    }
+}
+
+- (void) removeFileNamed:(NSString*)name
+{
+    [_lock lock];
+    MBCacheFileInfo* old = _files[name];
+    if (old) {
+        _totalSize -= old->_size;
+        [_files removeObjectForKey:name];
+    }
+    [_removedWhileLoading addObject:name];
+    _dirty = YES;
+    [_lock unlock];
+
+    [self _scheduleSave];
+}
+
+- (void) removeAllFiles
+{
+    [_lock lock];
+    [_files removeAllObjects];
+    _totalSize = 0;
+    _clearedWhileLoading = !atomic_load(&_loaded);
+    _dirty = YES;
+    [_lock unlock];
+
+    [self _scheduleSave];
+}
+
+@end
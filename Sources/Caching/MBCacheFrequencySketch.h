@@ -0,0 +1,57 @@
+//
+//  MBCacheFrequencySketch.h
+//  Mockingbird Toolbox
+//
+//  Created by Evan Coyne Maloney on 10/17/26.
+//  Copyright (c) 2026 Gilt Groupe. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+//
+// NOTE: This header file is for use only within the implementation of
+//       MBThreadsafeCache and its subclasses. It is not a public header.
+//
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark MBCacheFrequencySketch class
+/******************************************************************************/
+
+/*!
+ Estimates how often keys have been accessed recently, in a fixed amount of
+ memory, for use by the TinyLFU admission policy.
+
+ The sketch is a count-min sketch of four rows of 4-bit saturating counters,
+ updated conservatively (only the smallest of a key's counters are
+ incremented). Once the number of recorded accesses reaches ten times the
+ sketch's capacity, every counter is halved, so that the estimates reflect
+ recent popularity rather than all-time popularity.
+
+ Estimates may be too high, due to hash collisions, but are never too low
+ except as a result of aging.
+
+ All methods are thread-safe and lock-free. Increments that race with aging
+ may be lost, which only makes the estimates slightly more conservative.
+ */
+@interface MBCacheFrequencySketch : NSObject
+
+/*!
+ Initializes a sketch sized for tracking the given number of keys.
+
+ @param     capacity The number of keys the sketch should distinguish
+            between, such as the maximum number of entries in the cache.
+ */
+- (nonnull instancetype) initWithCapacity:(NSUInteger)capacity;
+
+/*! The capacity with which the sketch was initialized. */
+@property(nonatomic, readonly) NSUInteger capacity;
+
+/*! Records an access of the given key. */
+- (void) incrementKey:(nonnull id)key;
+
+/*! Returns the estimated number of recent accesses of the given key, from
+    `0` to `15`. */
+- (NSUInteger) frequencyOfKey:(nonnull id)key;
+
+@end
@@ -0,0 +1,163 @@
+//
+//  MBCacheFrequencySketch.m
+//  Mockingbird Toolbox
+//
+//  Created by Evan Coyne Maloney on 10/17/26.
+//  Copyright (c) 2026 Gilt Groupe. All rights reserved.
+//
+
+#import <stdatomic.h>
+
+#import "MBCacheFrequencySketch.h"
+
+/******************************************************************************/
+#pragma mark Constants
+/******************************************************************************/
+
+#define kSketchDepth                4
+#define kSketchMinimumWidth         64
+#define kSketchMaximumCount         15          // counters are 4 bits wide
+#define kSketchSampleFactor         10          // accesses per key before aging
+
+static const uint64_t kSketchSeeds[kSketchDepth] = {
+    0xC3A5C85C97CB3127ULL, 0xB492B66FBE98F273ULL,
+    0x9AE16A3B2F90404FULL, 0xCBF29CE484222325ULL
+};
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark MBCacheFrequencySketch implementation
+/******************************************************************************/
+
+@implementation MBCacheFrequencySketch
+{
+    // two 4-bit counters per byte; each row is _width counters long
+    atomic_uchar* _table;
+    NSUInteger _width;
+    NSUInteger _mask;
+    uint64_t _sampleLimit;
+    atomic_ullong _samples;
+}
+
+/******************************************************************************/
+#pragma mark Object lifecycle
+/******************************************************************************/
+
+- (instancetype) initWithCapacity:(NSUInteger)capacity
+{
+    self = [super init];
+    if (self) {
+        _capacity = capacity;
+
+        NSUInteger width = kSketchMinimumWidth;
+        while (width < capacity && width < (NSUIntegerMax >> 2)) {
+            width <<= 1;
+        }
+        _width = width;
+        _mask = width - 1;
+        _sampleLimit = (uint64_t)MAX(capacity, 1) * kSketchSampleFactor;
+
+        size_t bytes = kSketchDepth * width / 2;
+        _table = malloc(bytes * sizeof(atomic_uchar));
+        for (size_t i=0; i<bytes; i++) {
+            atomic_init(&_table[i], 0);
+        }
+        atomic_init(&_samples, 0);
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    free(_table);
+}
+
+/******************************************************************************/
+#pragma mark Counters
+/******************************************************************************/
+
+// returns the index of the counter for the hash in the given row
+static inline NSUInteger MBSketchCounterIndex(uint64_t hash, NSUInteger row, NSUInteger width, NSUInteger mask)
+{
+    uint64_t x = (hash + kSketchSeeds[row]) * 0x9E3779B97F4A7C15ULL;
+    x ^= x >> 32;
+    return (row * width) + (NSUInteger)(x & mask);
+}
+
+static inline unsigned MBSketchNibble(unsigned char byte, NSUInteger index)
+{
+    return (index & 1) ? (byte >> 4) : (byte & 0x0F);
+}
+
+static inline unsigned MBSketchCounterValue(atomic_uchar* table, NSUInteger index)
+{
+    return MBSketchNibble(atomic_load_explicit(&table[index >> 1], memory_order_relaxed), index);
+}
+
+// increments the counter unless it is saturated; the compare-and-swap keeps
+// a racing increment of either counter in the byte from carrying into the other
+static inline void MBSketchIncrementCounter(atomic_uchar* table, NSUInteger index)
+{
+    unsigned char increment = (index & 1) ? 0x10 : 0x01;
+    unsigned char byte = atomic_load_explicit(&table[index >> 1], memory_order_relaxed);
+    while (MBSketchNibble(byte, index) < kSketchMaximumCount) {
+        if (atomic_compare_exchange_weak_explicit(&table[index >> 1], &byte, (unsigned char)(byte + increment),
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+            break;
+        }
+    }
+}
+
+- (void) incrementKey:(id)key
+{
+    uint64_t hash = (uint64_t)[key hash];
+    NSUInteger indices[kSketchDepth];
+    unsigned minimum = kSketchMaximumCount;
+    for (NSUInteger row=0; row<kSketchDepth; row++) {
+        indices[row] = MBSketchCounterIndex(hash, row, _width, _mask);
+        minimum = MIN(minimum, MBSketchCounterValue(_table, indices[row]));
+    }
+    if (minimum == kSketchMaximumCount) {
+        return;
+    }
+
+    // conservative update: only the counters holding the current estimate
+    // are incremented, which reduces the overestimation caused by collisions
+    for (NSUInteger row=0; row<kSketchDepth; row++) {
+        if (MBSketchCounterValue(_table, indices[row]) == minimum) {
+            MBSketchIncrementCounter(_table, indices[row]);
+        }
+    }
+
+    if (atomic_fetch_add_explicit(&_samples, 1, memory_order_relaxed) + 1 == _sampleLimit) {
+        [self _age];
+    }
+}
+
+- (NSUInteger) frequencyOfKey:(id)key
+{
+    uint64_t hash = (uint64_t)[key hash];
+    unsigned minimum = kSketchMaximumCount;
+    for (NSUInteger row=0; row<kSketchDepth; row++) {
+        minimum = MIN(minimum, MBSketchCounterValue(_table, MBSketchCounterIndex(hash, row, _width, _mask)));
+    }
+    return minimum;
+}
+
+/******************************************************************************/
+#pragma mark Aging
+/******************************************************************************/
+
+- (void) _age
+{
+    // halves both counters in each byte; only the thread whose increment
+    // reached the limit gets here, so aging never runs concurrently
+    size_t bytes = kSketchDepth * _width / 2;
+    for (size_t i=0; i<bytes; i++) {
+        unsigned char byte = atomic_load_explicit(&_table[i], memory_order_relaxed);
+        atomic_store_explicit(&_table[i], (unsigned char)((byte >> 1) & 0x77), memory_order_relaxed);
+    }
+    atomic_fetch_sub_explicit(&_samples, _sampleLimit / 2, memory_order_relaxed);
+}
+
+@end
@@ -34,11 +34,26 @@
  A singleton `NSOperationQueue` intended to be used for performing cache
  write operations.
 
+ Writes submitted via `addOperation:` are coalesced: when an
+ `MBCacheWriteOperation` is added while another write to the same file is
+ still waiting to execute, the waiting operation is updated to write the
+ newer object and the added operation is discarded. As a result, a key that
+ is updated repeatedly in quick succession is only written to the filesystem
+ once, with its final value.
+
  @warning   You *must not* create instances of this class yourself; this class
             is a singleton. Call the `instance` class method (declared by the
             `MBSingleton` protocol) to acquire the singleton instance.
  */
 @interface MBCacheWriteQueue : MBOperationQueue <MBSingleton>
+
+/*! Returns the number of cache file writes waiting to be executed. */
+@property(nonatomic, readonly) NSUInteger pendingWriteCount;
+
+/*! Returns the number of cache file writes that were never performed because
+    a newer write to the same file superseded them while they were pending. */
+@property(nonatomic, readonly) NSUInteger supersededWriteCount;
+
 @end
 
 /******************************************************************************/
@@ -101,7 +116,9 @@
 /*----------------------------------------------------------------------------*/
 
 /*! Returns the cache object to be written to the filesystem by this 
-    operation. */
+    operation. If the operation is superseded by a newer write to the same
+    file while it is pending in the `MBCacheWriteQueue`, this will change to
+    reflect the newer object. */
 @property(nonnull, nonatomic, readonly) id cacheObject;
 
 /*! Returns the `MBFilesystemCache` instance responsible for managing the
@@ -109,3 +126,110 @@
 @property(nonnull, nonatomic, readonly) MBFilesystemCache* cache;
 
 @end
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark MBCachePruneOperation class
+/******************************************************************************/
+
+/*!
+ An `NSOperation` subclass used by `MBFilesystemCache`s to delete cache files
+ that have exceeded a maximum age.
+
+ The cache directory is read in bounded batches, so that memory use doesn't
+ grow with the number of files in the cache. Within each batch, files are
+ examined and deleted by a small pool of workers, and the operation pauses
+ briefly between batches to avoid monopolizing the disk. Progress and rate
+ counters may be read from any thread while the operation executes.
+
+ The operation checks for cancellation between batches. A cancelled operation
+ can be resumed by a new operation whose `resumeAfterFilename` is set to the
+ cancelled operation's `resumeFilename`; the new operation will skip the
+ files that were already examined without having to examine them again.
+
+ `MBCachePruneOperation` instances are typically added to the
+ `MBFilesystemOperationQueue` singleton.
+ */
+@interface MBCachePruneOperation : NSOperation
+
+/*----------------------------------------------------------------------------*/
+#pragma mark Object lifecycle
+/*!    @name Object lifecycle                                                 */
+/*----------------------------------------------------------------------------*/
+
+/*!
+ Creates a new `MBCachePruneOperation` instance that can be used to delete
+ the files in a cache directory that are older than a certain age.
+
+ @param     cacheDir The path of the cache directory.
+
+ @param     ageInSeconds The maximum age allowed for cache files. Files whose
+            modification times are older than this age will be deleted.
+
+ @return    The newly-created `MBCachePruneOperation` instance.
+ */
++ (nonnull instancetype) operationForCacheDirectory:(nonnull NSString*)cacheDir
+                                             maxAge:(NSTimeInterval)ageInSeconds;
+
+/*----------------------------------------------------------------------------*/
+#pragma mark Configuring the operation
+/*!    @name Configuring the operation                                        */
+/*----------------------------------------------------------------------------*/
+
+/*! The path of the cache directory being pruned. */
+@property(nonnull, nonatomic, readonly) NSString* cacheDirectory;
+
+/*! The maximum age allowed for cache files, in seconds. */
+@property(nonatomic, readonly) NSTimeInterval maxAge;
+
+/*! The `MBFilesystemCache` that owns the cache directory, if any. It is
+    notified as each of its cache files is deleted. */
+@property(nullable, nonatomic, weak) MBFilesystemCache* cache;
+
+/*! The maximum number of directory entries read and processed at once.
+    Defaults to `256`. */
+@property(nonatomic, assign) NSUInteger batchSize;
+
+/*! The number of workers that examine and delete files concurrently within
+    each batch. Defaults to `4`. */
+@property(nonatomic, assign) NSUInteger workerCount;
+
+/*! The length of the pause between batches, in seconds. Defaults to `0.01`. */
+@property(nonatomic, assign) NSTimeInterval batchInterval;
+
+/*! If non-`nil`, the receiver skips the directory entries up to and including
+    the file with this name before examining any files. If no such file is
+    found, the whole directory is examined. This must be set before the
+    operation starts. */
+@property(nullable, nonatomic, copy) NSString* resumeAfterFilename;
+
+/*----------------------------------------------------------------------------*/
+#pragma mark Monitoring progress
+/*!    @name Monitoring progress                                              */
+/*----------------------------------------------------------------------------*/
+
+/*! The number of files examined so far. */
+@property(nonatomic, readonly) NSUInteger examinedFileCount;
+
+/*! The number of files deleted so far. */
+@property(nonatomic, readonly) NSUInteger deletedFileCount;
+
+/*! The total size of the files deleted so far, in bytes. */
+@property(nonatomic, readonly) unsigned long long deletedByteCount;
+
+/*! The time the operation has spent executing, in seconds. */
+@property(nonatomic, readonly) NSTimeInterval elapsedTime;
+
+/*! The average number of files examined per second of execution. */
+@property(nonatomic, readonly) double examinedFilesPerSecond;
+
+/*! The average number of files deleted per second of execution. */
+@property(nonatomic, readonly) double deletedFilesPerSecond;
+
+/*! The name of the last file that was fully processed and remains in the
+    directory, for use as the `resumeAfterFilename` of a subsequent operation
+    if the receiver is cancelled. `nil` until the first batch completes, or if
+    the receiver ran to completion. */
+@property(nullable, atomic, readonly) NSString* resumeFilename;
+
+@end
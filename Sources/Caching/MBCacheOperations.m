@@ -6,13 +6,32 @@
 //  Copyright (c) 2011 Gilt Groupe. All rights reserved.
 //
 
+#import <stdatomic.h>
+#import <dirent.h>
+#import <sys/stat.h>
+#import <unistd.h>
+
+#import "MBAvailability.h"
+
+#if MB_BUILD_UIKIT
+#import <UIKit/UIKit.h>
+#endif
+
 #import "MBCacheOperations.h"
-#import "MBModuleLogMacros.h"
+#import "MBFilesystemCache+Subclassing.h"
 #import "MBModuleLogMacros.h"
 
 #define DEBUG_LOCAL     0
 #define DEBUG_VERBOSE   0
 
+/******************************************************************************/
+#pragma mark Constants
+/******************************************************************************/
+
+#define kPruneDefaultBatchSize          256
+#define kPruneDefaultWorkerCount        4
+#define kPruneDefaultBatchInterval      0.01        // seconds
+
 /******************************************************************************/
 #pragma mark -
 #pragma mark MBCacheReadQueue implementation
@@ -29,10 +48,82 @@ MBImplementSingleton();
 #pragma mark MBCacheWriteQueue implementation
 /******************************************************************************/
 
+@interface MBCacheWriteQueue ()
+- (void) writeOperationStarted:(nonnull MBCacheWriteOperation*)op;
+@end
+
+@interface MBCacheWriteOperation ()
+@property(nullable, nonatomic, weak) MBCacheWriteQueue* coalescingQueue;
+- (BOOL) supersedeWithObject:(nonnull id)obj forCache:(nonnull MBFilesystemCache*)fc;
+@end
+
 @implementation MBCacheWriteQueue
+{
+    NSMutableDictionary* _pendingWrites;    // file path -> MBCacheWriteOperation
+    atomic_ulong _supersededWriteCount;
+}
 
 MBImplementSingleton();
 
+- (void) addOperation:(NSOperation*)op
+{
+    if ([op isKindOfClass:[MBCacheWriteOperation class]]) {
+        MBCacheWriteOperation* writeOp = (MBCacheWriteOperation*) op;
+        NSString* path = writeOp.filePath;
+
+        @synchronized (self) {
+            MBCacheWriteOperation* pending = _pendingWrites[path];
+            if ([pending supersedeWithObject:writeOp.cacheObject forCache:writeOp.cache]) {
+                MBLogDebug(@"%@ coalesced write to file: %@", [self class], path);
+
+                atomic_fetch_add_explicit(&_supersededWriteCount, 1, memory_order_relaxed);
+                return;
+            }
+
+            if (!_pendingWrites) {
+                _pendingWrites = [NSMutableDictionary new];
+            }
+            _pendingWrites[path] = writeOp;
+            writeOp.coalescingQueue = self;
+        }
+    }
+
+    [super addOperation:op];
+}
+
+- (void) cancelAllOperations
+{
+    @synchronized (self) {
+        [_pendingWrites removeAllObjects];
+    }
+
+    [super cancelAllOperations];
+}
+
+- (void) writeOperationStarted:(MBCacheWriteOperation*)op
+{
+    @synchronized (self) {
+        // the operation can no longer be superseded, so a later
+        // write to the same file will need an operation of its own
+        NSString* path = op.filePath;
+        if (_pendingWrites[path] == op) {
+            [_pendingWrites removeObjectForKey:path];
+        }
+    }
+}
+
+- (NSUInteger) pendingWriteCount
+{
+    @synchronized (self) {
+        return _pendingWrites.count;
+    }
+}
+
+- (NSUInteger) supersededWriteCount
+{
+    return atomic_load_explicit(&_supersededWriteCount, memory_order_relaxed);
+}
+
 @end
 
 /******************************************************************************/
@@ -44,6 +135,7 @@ MBImplementSingleton();
 {
     MBFilesystemCache* _cache;
     id _cacheObject;
+    BOOL _started;
 }
 
 /******************************************************************************/
@@ -73,11 +165,325 @@ MBImplementSingleton();
 #pragma mark Implementation
 /******************************************************************************/
 
+- (id) cacheObject
+{
+    @synchronized (self) {
+        return _cacheObject;
+    }
+}
+
+- (MBFilesystemCache*) cache
+{
+    @synchronized (self) {
+        return _cache;
+    }
+}
+
+- (BOOL) supersedeWithObject:(id)obj forCache:(MBFilesystemCache*)fc
+{
+    @synchronized (self) {
+        if (_started || self.isCancelled) {
+            return NO;
+        }
+        _cacheObject = obj;
+        _cache = fc;
+        return YES;
+    }
+}
+
 - (NSData*) dataForOperation
+{
+    MBLogDebugTrace();
+
+    id obj = nil;
+    MBFilesystemCache* cache = nil;
+    @synchronized (self) {
+        _started = YES;
+        obj = _cacheObject;
+        cache = _cache;
+    }
+    [_coalescingQueue writeOperationStarted:self];
+
+    // compression happens here, on the write queue, rather than on
+    // the thread that stored the object
+    NSData* data = [cache cacheDataFromObject:obj];
+    return (data ? [cache encodedCacheData:data] : nil);
+}
+
+- (BOOL) writeData:(NSData*)data toFile:(NSString*)path error:(NSErrorPtrPtr)errPtr
+{
+    // the cache decides how its files are actually stored
+    return [self.cache writeCacheData:data toFile:path error:errPtr];
+}
+
+@end
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark MBCachePruneOperation implementation
+/******************************************************************************/
+
+@interface MBCachePruneOperation ()
+@property(nullable, atomic, readwrite, copy) NSString* resumeFilename;
+@end
+
+@implementation MBCachePruneOperation
+{
+    atomic_ulong _examinedFileCount;
+    atomic_ulong _deletedFileCount;
+    atomic_ullong _deletedByteCount;
+    _Atomic(NSTimeInterval) _startedAt;
+    _Atomic(NSTimeInterval) _finishedAt;
+#if MB_BUILD_UIKIT
+    UIBackgroundTaskIdentifier _taskID;
+#endif
+}
+
+/******************************************************************************/
+#pragma mark Object lifecycle
+/******************************************************************************/
+
++ (instancetype) operationForCacheDirectory:(NSString*)cacheDir
+                                     maxAge:(NSTimeInterval)ageInSeconds
+{
+    return [[self alloc] initWithCacheDirectory:cacheDir maxAge:ageInSeconds];
+}
+
+- (instancetype) initWithCacheDirectory:(NSString*)cacheDir
+                                 maxAge:(NSTimeInterval)ageInSeconds
+{
+    self = [super init];
+    if (self) {
+        _cacheDirectory = cacheDir;
+        _maxAge = ageInSeconds;
+        _batchSize = kPruneDefaultBatchSize;
+        _workerCount = kPruneDefaultWorkerCount;
+        _batchInterval = kPruneDefaultBatchInterval;
+        atomic_init(&_examinedFileCount, 0);
+        atomic_init(&_deletedFileCount, 0);
+        atomic_init(&_deletedByteCount, 0);
+        atomic_init(&_startedAt, 0);
+        atomic_init(&_finishedAt, 0);
+#if MB_BUILD_UIKIT
+        _taskID = UIBackgroundTaskInvalid;
+#endif
+    }
+    return self;
+}
+
+/******************************************************************************/
+#pragma mark Monitoring progress
+/******************************************************************************/
+
+- (NSUInteger) examinedFileCount
+{
+    return atomic_load_explicit(&_examinedFileCount, memory_order_relaxed);
+}
+
+- (NSUInteger) deletedFileCount
+{
+    return atomic_load_explicit(&_deletedFileCount, memory_order_relaxed);
+}
+
+- (unsigned long long) deletedByteCount
+{
+    return atomic_load_explicit(&_deletedByteCount, memory_order_relaxed);
+}
+
+- (NSTimeInterval) elapsedTime
+{
+    NSTimeInterval startedAt = atomic_load(&_startedAt);
+    if (!startedAt) {
+        return 0;
+    }
+    NSTimeInterval finishedAt = atomic_load(&_finishedAt);
+    return (finishedAt ?: [NSDate timeIntervalSinceReferenceDate]) - startedAt;
+}
+
+- (double) examinedFilesPerSecond
+{
+    NSTimeInterval elapsed = self.elapsedTime;
+    return (elapsed > 0 ? self.examinedFileCount / elapsed : 0);
+}
+
+- (double) deletedFilesPerSecond
+{
+    NSTimeInterval elapsed = self.elapsedTime;
+    return (elapsed > 0 ? self.deletedFileCount / elapsed : 0);
+}
+
+/******************************************************************************/
+#pragma mark Operation implementation
+/******************************************************************************/
+
+- (void) main
 {
     MBLogDebugTrace();
     
-    return [_cache cacheDataFromObject:_cacheObject];
+    @autoreleasepool {
+        @try {
+#if MB_BUILD_UIKIT
+            UIApplication* app = [UIApplication sharedApplication];
+            _taskID = [app beginBackgroundTaskWithExpirationHandler:^{
+                // out of background time; we'll stop after the current batch
+                [self cancel];
+                [app endBackgroundTask:_taskID];
+                _taskID = UIBackgroundTaskInvalid;
+            }];
+#endif
+
+            atomic_store(&_startedAt, [NSDate timeIntervalSinceReferenceDate]);
+            [self _prune];
+            atomic_store(&_finishedAt, [NSDate timeIntervalSinceReferenceDate]);
+
+            MBLogDebug(@"%@ deleted %lu of %lu files examined in %@ (%g files/sec)", [self class], (unsigned long)self.deletedFileCount, (unsigned long)self.examinedFileCount, _cacheDirectory, self.examinedFilesPerSecond);
+
+#if MB_BUILD_UIKIT
+            if (_taskID != UIBackgroundTaskInvalid) {
+                [app endBackgroundTask:_taskID];
+                _taskID = UIBackgroundTaskInvalid;
+            }
+#endif
+        }
+        @catch (NSException* ex) {
+            MBLogError(@"%@ caught %@: %@", [self class], [ex name], [ex reason]);
+        }
+    }
+}
+
+- (void) _prune
+{
+    DIR* dir = opendir([_cacheDirectory fileSystemRepresentation]);
+    if (!dir) {
+        if (errno != ENOENT) {
+            MBLogError(@"%@ error while trying to open cache directory at %@: %s", [self class], _cacheDirectory, strerror(errno));
+        }
+        return;
+    }
+
+    // skipping entries costs only a readdir(), not a stat()
+    NSString* resumeAfter = _resumeAfterFilename;
+    if (resumeAfter && ![self _skipEntriesOfDirectory:dir throughFilename:resumeAfter]) {
+        MBLogDebug(@"%@ couldn't find %@ to resume after; examining all of %@", [self class], resumeAfter, _cacheDirectory);
+        rewinddir(dir);
+    }
+
+    NSTimeInterval cutoff = [[NSDate date] timeIntervalSince1970] - _maxAge;
+    NSUInteger batchSize = MAX(_batchSize, 1);
+    NSMutableArray* filenames = [NSMutableArray arrayWithCapacity:batchSize];
+    NSFileManager* fileMgr = [NSFileManager new];
+    BOOL done = NO;
+    while (!done && !self.isCancelled) {
+        @autoreleasepool {
+            [filenames removeAllObjects];
+            struct dirent* entry;
+            while (filenames.count < batchSize && (entry = readdir(dir))) {
+                if (entry->d_type != DT_REG && entry->d_type != DT_UNKNOWN) {
+                    continue;
+                }
+                if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..")) {
+                    continue;
+                }
+                [filenames addObject:[fileMgr stringWithFileSystemRepresentation:entry->d_name length:strlen(entry->d_name)]];
+            }
+            done = (filenames.count < batchSize);
+
+            [self _pruneFilesNamed:filenames modifiedBefore:cutoff];
+
+            // give other users of the disk a turn
+            if (!done && _batchInterval > 0) {
+                [NSThread sleepForTimeInterval:_batchInterval];
+            }
+        }
+    }
+    closedir(dir);
+
+    if (done) {
+        self.resumeFilename = nil;
+    }
+}
+
+- (BOOL) _skipEntriesOfDirectory:(DIR*)dir throughFilename:(NSString*)filename
+{
+    const char* name = [filename fileSystemRepresentation];
+    struct dirent* entry;
+    while ((entry = readdir(dir))) {
+        if (!strcmp(entry->d_name, name)) {
+            return YES;
+        }
+    }
+    return NO;
+}
+
+- (void) _pruneFilesNamed:(NSArray*)filenames modifiedBefore:(NSTimeInterval)cutoff
+{
+    NSUInteger fileCnt = filenames.count;
+    if (!fileCnt) {
+        return;
+    }
+
+    BOOL* removed = calloc(fileCnt, sizeof(BOOL));
+    NSUInteger workerCnt = MIN(MAX(_workerCount, 1), fileCnt);
+    MBFilesystemCache* cache = self.cache;
+    dispatch_apply(workerCnt, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^(size_t worker) {
+        for (NSUInteger i=worker; i<fileCnt; i+=workerCnt) {
+            @autoreleasepool {
+                removed[i] = [self _pruneFileNamed:filenames[i] modifiedBefore:cutoff cache:cache];
+            }
+        }
+    });
+
+    // the last file left in place marks our position in the directory
+    for (NSUInteger i=fileCnt; i>0; i--) {
+        if (!removed[i-1]) {
+            self.resumeFilename = filenames[i-1];
+            break;
+        }
+    }
+    free(removed);
+}
+
+// returns YES if the file is no longer in the directory
+- (BOOL) _pruneFileNamed:(NSString*)filename
+          modifiedBefore:(NSTimeInterval)cutoff
+                   cache:(MBFilesystemCache*)cache
+{
+    NSString* path = [_cacheDirectory stringByAppendingPathComponent:filename];
+    const char* fsPath = [path fileSystemRepresentation];
+
+    struct stat st;
+    if (lstat(fsPath, &st) != 0) {
+        if (errno == ENOENT) {
+            return YES;
+        }
+        MBLogError(@"%@ error while trying to determine attributes of cache file at %@: %s", [self class], path, strerror(errno));
+        return NO;
+    }
+    atomic_fetch_add_explicit(&_examinedFileCount, 1, memory_order_relaxed);
+
+    if (!S_ISREG(st.st_mode)) {
+        return NO;
+    }
+
+    NSTimeInterval modifiedAt = st.st_mtimespec.tv_sec + (st.st_mtimespec.tv_nsec / (double)NSEC_PER_SEC);
+    if (modifiedAt > cutoff) {
+        return NO;
+    }
+
+    MBLogDebug(@"Cache file %@ is TOO OLD to keep; deleting", path);
+
+    if (unlink(fsPath) != 0) {
+        if (errno == ENOENT) {
+            return YES;
+        }
+        MBLogError(@"%@ error while deleting obsolete cache file at %@: %s", [self class], path, strerror(errno));
+        return NO;
+    }
+    atomic_fetch_add_explicit(&_deletedFileCount, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&_deletedByteCount, (unsigned long long)st.st_size, memory_order_relaxed);
+
+    [cache cacheFilePrunedAtPath:path];
+    return YES;
 }
 
 @end
@@ -0,0 +1,197 @@
+//
+//  MBCacheSegmentStore.h
+//  Mockingbird Toolbox
+//
+//  Created by Evan Coyne Maloney on 10/17/26.
+//  Copyright (c) 2026 Gilt Groupe. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#import "NSError+MBToolbox.h"
+
+//
+// NOTE: This header file is for use only within the implementation of
+//       MBFilesystemCache and its subclasses. It is not a public header.
+//
+
+/******************************************************************************/
+#pragma mark Constants
+/******************************************************************************/
+
+// default value for the segmentSizeLimit property (8 MB)
+extern const unsigned long long kMBCacheSegmentDefaultSizeLimit;
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark MBCacheSegmentStore class
+/******************************************************************************/
+
+/*!
+ Stores named blobs of data by appending them to a small number of large
+ *segment* files, rather than writing one file per blob.
+
+ An in-memory index maps each name to the segment, offset and length of its
+ most recent record. Overwriting or removing a name leaves the old record in
+ place as garbage; once enough of a sealed segment is garbage, its live
+ records are copied forward into the active segment in the background and the
+ segment file is deleted.
+
+ The index is rebuilt by scanning the segment files when the store is
+ created. Removals are recorded by appending *tombstone* records, so that
+ a removed name does not reappear when the store is reopened. A record left
+ incomplete by a crash is discarded, along with anything following it in its
+ segment.
+
+ Segment files are memory-mapped when first read, and the mapping is kept for
+ the lifetime of the segment. Data returned by the store is a read-only view
+ into the mapping rather than a copy, so serving a read requires neither a
+ system call nor a `memcpy()`. Because records are never modified in place,
+ each view remains valid for as long as it exists, even if its segment is
+ later compacted or deleted.
+
+ All methods are thread-safe. Reads never wait on writes to complete.
+ */
+@interface MBCacheSegmentStore : NSObject
+
+/*----------------------------------------------------------------------------*/
+#pragma mark Object lifecycle
+/*!    @name Object lifecycle                                                 */
+/*----------------------------------------------------------------------------*/
+
+/*!
+ Initializes the receiver to store its segment files in the given directory,
+ loading any segments already there.
+
+ @param     dir The directory path. It will be created if necessary.
+
+ @return    The receiver.
+ */
+- (nonnull instancetype) initWithDirectory:(nonnull NSString*)dir;
+
+/*----------------------------------------------------------------------------*/
+#pragma mark Store properties
+/*!    @name Store properties                                                 */
+/*----------------------------------------------------------------------------*/
+
+/*! The directory containing the receiver's segment files. */
+@property(nonnull, nonatomic, readonly) NSString* directory;
+
+/*! The size, in bytes, beyond which the active segment is sealed and a new
+    one is started. A record larger than this limit gets a segment of its own.
+    Defaults to `kMBCacheSegmentDefaultSizeLimit`. */
+@property(atomic, assign) unsigned long long segmentSizeLimit;
+
+/*! The fraction of a sealed segment's bytes that must be garbage before the
+    segment is compacted. Defaults to `0.5`. */
+@property(atomic, assign) double compactionThreshold;
+
+/*! The number of names with data in the store. */
+@property(nonatomic, readonly) NSUInteger count;
+
+/*! The number of bytes occupied by the current records of the names with
+    data in the store. Garbage awaiting compaction is not included, so the
+    segment files may be larger than this. */
+@property(nonatomic, readonly) unsigned long long liveSize;
+
+/*! The number of segment files currently in use. */
+@property(nonatomic, readonly) NSUInteger segmentCount;
+
+/*! The number of segments compacted since the receiver was created. */
+@property(nonatomic, readonly) NSUInteger compactionCount;
+
+/*----------------------------------------------------------------------------*/
+#pragma mark Accessing data
+/*!    @name Accessing data                                                   */
+/*----------------------------------------------------------------------------*/
+
+/*!
+ Determines whether the store contains data for the given name.
+
+ @param     name The name.
+
+ @return    `YES` if there is data for `name`; `NO` otherwise.
+ */
+- (BOOL) containsDataForName:(nonnull NSString*)name;
+
+/*!
+ Returns the data most recently written for the given name.
+
+ @param     name The name.
+
+ @param     errPtr If this method returns `nil` because the data could not be
+            read, and this parameter is non-`nil`, `*errPtr` will be updated
+            to point to an `NSError` describing the problem.
+
+ @return    The data, or `nil` if there is none or it could not be read. The
+            returned data is backed by a memory mapping of a segment file.
+ */
+- (nullable NSData*) dataForName:(nonnull NSString*)name error:(NSErrorPtrPtr)errPtr;
+
+/*!
+ Returns the time at which the data for the given name was written.
+
+ @param     name The name.
+
+ @return    The write date, or `nil` if there is no data for `name`.
+ */
+- (nullable NSDate*) writeDateForName:(nonnull NSString*)name;
+
+/*!
+ Returns the names whose data was written longest ago, in order of writing,
+ up to and including the first name at which the sizes of their records
+ total at least `size` bytes.
+
+ @param     size The number of bytes the returned names' records should
+            account for.
+
+ @return    The names.
+ */
+- (nonnull NSArray*) namesOfOldestDataTotaling:(unsigned long long)size;
+
+/*----------------------------------------------------------------------------*/
+#pragma mark Modifying data
+/*!    @name Modifying data                                                   */
+/*----------------------------------------------------------------------------*/
+
+/*!
+ Appends the given data to the active segment as the new data for `name`.
+
+ @param     data The data to write.
+
+ @param     name The name.
+
+ @param     errPtr If this method returns `NO` and this parameter is non-`nil`,
+            `*errPtr` will be updated to point to an `NSError` describing the
+            problem.
+
+ @return    `YES` if the data was written; `NO` otherwise.
+ */
+- (BOOL) writeData:(nonnull NSData*)data forName:(nonnull NSString*)name error:(NSErrorPtrPtr)errPtr;
+
+/*!
+ Removes the data for the given name, if there is any.
+
+ @param     name The name.
+ */
+- (void) removeDataForName:(nonnull NSString*)name;
+
+/*!
+ Removes the data for every name written before the given date.
+
+ @param     date The cutoff date.
+ */
+- (void) removeDataWrittenBefore:(nonnull NSDate*)date;
+
+/*!
+ Removes all data from the store and deletes its segment files.
+ */
+- (void) removeAllData;
+
+/*!
+ Synchronously compacts every sealed segment whose proportion of garbage
+ has reached the `compactionThreshold`.
+ */
+- (void) compact;
+
+@end
@@ -0,0 +1,892 @@
+//
+//  MBCacheSegmentStore.m
+//  Mockingbird Toolbox
+//
+//  Created by Evan Coyne Maloney on 10/17/26.
+//  Copyright (c) 2026 Gilt Groupe. All rights reserved.
+//
+
+#import <fcntl.h>
+#import <unistd.h>
+#import <sys/stat.h>
+#import <sys/mman.h>
+#import <stdatomic.h>
+
+#import "MBCacheSegmentStore.h"
+#import "MBReadWriteLock.h"
+#import "MBModuleLogMacros.h"
+
+#define DEBUG_LOCAL     0
+
+/******************************************************************************/
+#pragma mark Constants
+/******************************************************************************/
+
+const unsigned long long kMBCacheSegmentDefaultSizeLimit    = 8 * 1024 * 1024;
+
+#define kSegmentFileExtension           @"segment"
+#define kSegmentRecordMagic             0x4D425347          // 'MBSG'
+#define kSegmentRecordFlagTombstone     0x1
+#define kDefaultCompactionThreshold     0.5
+
+/******************************************************************************/
+#pragma mark Types
+/******************************************************************************/
+
+// precedes the name and data of every record in a segment file
+typedef struct {
+    uint32_t magic;
+    uint32_t flags;
+    uint32_t nameLength;
+    uint32_t reserved;
+    uint64_t dataLength;
+    double writtenAt;               // NSTimeInterval since reference date
+} MBCacheSegmentRecordHeader;
+
+static inline unsigned long long MBSegmentRecordSize(uint32_t nameLength, uint64_t dataLength)
+{
+    return sizeof(MBCacheSegmentRecordHeader) + nameLength + dataLength;
+}
+
+/******************************************************************************/
+#pragma mark File I/O helpers
+/******************************************************************************/
+
+static BOOL MBReadFully(int fd, void* buf, size_t len, off_t offset)
+{
+    while (len > 0) {
+        ssize_t got = pread(fd, buf, len, offset);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return NO;
+        }
+        buf = (char*)buf + got;
+        len -= (size_t)got;
+        offset += got;
+    }
+    return YES;
+}
+
+static BOOL MBWriteFully(int fd, const void* buf, size_t len, off_t offset)
+{
+    while (len > 0) {
+        ssize_t put = pwrite(fd, buf, len, offset);
+        if (put < 0 && errno == EINTR) {
+            continue;
+        }
+        if (put <= 0) {
+            return NO;
+        }
+        buf = (const char*)buf + put;
+        len -= (size_t)put;
+        offset += put;
+    }
+    return YES;
+}
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark MBCacheSegmentMapping class
+/******************************************************************************/
+
+// a read-only memory mapping of a segment file; data handed out by the store
+// points into the mapping and retains it, so the mapping outlives any views
+// of it even after the segment is compacted or deleted
+@interface MBCacheSegmentMapping : NSObject
+{
+@public
+    void* _bytes;
+    size_t _length;
+}
+@end
+
+@implementation MBCacheSegmentMapping
+
+- (instancetype) initWithFileDescriptor:(int)fd length:(size_t)length
+{
+    self = [super init];
+    if (self) {
+        _bytes = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+        if (_bytes == MAP_FAILED) {
+            MBLogError(@"%@ couldn't map %lu bytes of segment file: %s", [self class], (unsigned long)length, strerror(errno));
+            return nil;
+        }
+        _length = length;
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    if (_bytes && _bytes != MAP_FAILED) {
+        munmap(_bytes, _length);
+    }
+}
+
+@end
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark MBCacheSegment class
+/******************************************************************************/
+
+// a segment file, which stays open for as long as the object exists; readers
+// holding a reference can keep reading even after compaction unlinks the file
+@interface MBCacheSegment : NSObject
+{
+@public
+    uint32_t _number;
+    int _fd;
+    NSString* _path;
+    unsigned long long _size;           // guarded by the store's append lock
+    unsigned long long _garbage;        // guarded by the store's index lock
+    MBCacheSegmentMapping* _mapping;    // guarded by @synchronized (self)
+}
+@end
+
+@implementation MBCacheSegment
+
+- (void) dealloc
+{
+    if (_fd >= 0) {
+        close(_fd);
+    }
+}
+
+// returns a mapping covering at least the first `end` bytes of the segment;
+// the active segment is mapped to its full size limit up front, since bytes
+// appended to the file become visible through an existing shared mapping
+- (MBCacheSegmentMapping*) mappingCoveringOffset:(unsigned long long)end
+                                   minimumLength:(unsigned long long)minLength
+{
+    @synchronized (self) {
+        if (!_mapping || _mapping->_length < end) {
+            MBCacheSegmentMapping* mapping = [[MBCacheSegmentMapping alloc] initWithFileDescriptor:_fd
+                                                                                            length:(size_t)MAX(end, minLength)];
+            if (!mapping) {
+                return nil;
+            }
+            _mapping = mapping;
+        }
+        return _mapping;
+    }
+}
+
+@end
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark MBCacheSegmentRecord class
+/******************************************************************************/
+
+// the location of a name's current record
+@interface MBCacheSegmentRecord : NSObject
+{
+@public
+    MBCacheSegment* _segment;
+    unsigned long long _offset;
+    uint32_t _nameLength;
+    uint64_t _dataLength;
+    NSTimeInterval _writtenAt;
+}
+@end
+
+@implementation MBCacheSegmentRecord
+@end
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark MBCacheSegmentStore implementation
+/******************************************************************************/
+
+@implementation MBCacheSegmentStore
+{
+    MBReadWriteLock* _indexLock;        // guards _index, _segments & garbage
+    NSLock* _appendLock;                // serializes appends; guards _active & sizes
+    NSMutableDictionary* _index;        // name -> MBCacheSegmentRecord
+    NSMutableDictionary* _segments;     // segment number -> MBCacheSegment
+    MBCacheSegment* _active;
+    unsigned long long _liveSize;       // guarded by the index lock
+    uint32_t _nextSegmentNumber;
+    dispatch_queue_t _compactionQueue;
+    atomic_bool _compactionScheduled;
+    atomic_ulong _compactionCount;
+}
+
+/******************************************************************************/
+#pragma mark Object lifecycle
+/******************************************************************************/
+
+- (instancetype) initWithDirectory:(NSString*)dir
+{
+    self = [super init];
+    if (self) {
+        _directory = dir;
+        _segmentSizeLimit = kMBCacheSegmentDefaultSizeLimit;
+        _compactionThreshold = kDefaultCompactionThreshold;
+        _indexLock = [MBReadWriteLock new];
+        _appendLock = [NSLock new];
+        _index = [NSMutableDictionary new];
+        _segments = [NSMutableDictionary new];
+        atomic_init(&_compactionScheduled, false);
+        atomic_init(&_compactionCount, 0);
+
+        _compactionQueue = dispatch_queue_create("MBCacheSegmentStore.compaction", DISPATCH_QUEUE_SERIAL);
+        dispatch_set_target_queue(_compactionQueue, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0));
+
+        [self _loadSegments];
+        [self _scheduleCompaction];
+    }
+    return self;
+}
+
+/******************************************************************************/
+#pragma mark Segment files
+/******************************************************************************/
+
+- (NSString*) _pathForSegmentNumber:(uint32_t)number
+{
+    NSString* file = [NSString stringWithFormat:@"%08x.%@", number, kSegmentFileExtension];
+    return [_directory stringByAppendingPathComponent:file];
+}
+
+- (MBCacheSegment*) _openSegmentNumber:(uint32_t)number create:(BOOL)create
+{
+    NSString* path = [self _pathForSegmentNumber:number];
+    int flags = O_RDWR | (create ? (O_CREAT | O_EXCL) : 0);
+    int fd = open([path fileSystemRepresentation], flags, 0644);
+    if (fd < 0) {
+        MBLogError(@"%@ couldn't open segment file at %@: %s", [self class], path, strerror(errno));
+        return nil;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        MBLogError(@"%@ couldn't determine size of segment file at %@: %s", [self class], path, strerror(errno));
+        close(fd);
+        return nil;
+    }
+
+    MBCacheSegment* seg = [MBCacheSegment new];
+    seg->_number = number;
+    seg->_fd = fd;
+    seg->_path = path;
+    seg->_size = (unsigned long long) st.st_size;
+    return seg;
+}
+
+- (void) _loadSegments
+{
+    NSFileManager* fm = [NSFileManager new];
+    NSError* err = nil;
+    if (![fm createDirectoryAtPath:_directory withIntermediateDirectories:YES attributes:nil error:&err]) {
+        MBLogError(@"%@ error while trying to create segment directory at %@: %@", [self class], _directory, [err localizedDescription]);
+        return;
+    }
+
+    NSMutableArray* numbers = [NSMutableArray new];
+    for (NSString* file in [fm contentsOfDirectoryAtPath:_directory error:nil]) {
+        unsigned int number = 0;
+        if ([[file pathExtension] isEqualToString:kSegmentFileExtension]
+            && [[NSScanner scannerWithString:[file stringByDeletingPathExtension]] scanHexInt:&number])
+        {
+            [numbers addObject:@(number)];
+        }
+    }
+    [numbers sortUsingSelector:@selector(compare:)];
+
+    // replaying the segments oldest-first leaves each name's newest record
+    // in the index; this happens during init, so no locking is needed
+    for (NSNumber* number in numbers) {
+        MBCacheSegment* seg = [self _openSegmentNumber:[number unsignedIntValue] create:NO];
+        if (seg) {
+            _segments[number] = seg;
+            [self _scanSegment:seg];
+            _active = seg;
+        }
+        _nextSegmentNumber = [number unsignedIntValue] + 1;
+    }
+
+    MBLogDebug(@"%@ loaded %lu names from %lu segments in %@", [self class], (unsigned long)_index.count, (unsigned long)_segments.count, _directory);
+}
+
+- (void) _scanSegment:(MBCacheSegment*)seg
+{
+    unsigned long long offset = 0;
+    unsigned long long end = seg->_size;
+    while (offset < end) {
+        @autoreleasepool {
+            MBCacheSegmentRecordHeader hdr;
+            NSString* name = [self _readRecordHeader:&hdr fromSegment:seg atOffset:offset];
+            if (!name) {
+                break;
+            }
+            [self _indexRecordHeader:&hdr named:name inSegment:seg atOffset:offset];
+            offset += MBSegmentRecordSize(hdr.nameLength, hdr.dataLength);
+        }
+    }
+
+    if (offset < end) {
+        MBLogError(@"%@ discarding %llu bytes following an incomplete record in segment file: %@", [self class], end - offset, seg->_path);
+
+        if (ftruncate(seg->_fd, (off_t)offset) != 0) {
+            MBLogError(@"%@ couldn't truncate segment file at %@: %s", [self class], seg->_path, strerror(errno));
+        }
+        seg->_size = offset;
+    }
+}
+
+// returns the record's name, or nil if the record is invalid or incomplete
+- (NSString*) _readRecordHeader:(MBCacheSegmentRecordHeader*)hdr
+                    fromSegment:(MBCacheSegment*)seg
+                       atOffset:(unsigned long long)offset
+{
+    unsigned long long remaining = seg->_size - offset;
+    if (remaining < sizeof(*hdr)
+        || !MBReadFully(seg->_fd, hdr, sizeof(*hdr), (off_t)offset)
+        || hdr->magic != kSegmentRecordMagic
+        || hdr->dataLength > remaining
+        || MBSegmentRecordSize(hdr->nameLength, hdr->dataLength) > remaining)
+    {
+        return nil;
+    }
+
+    NSMutableData* nameData = [NSMutableData dataWithLength:hdr->nameLength];
+    if (!MBReadFully(seg->_fd, nameData.mutableBytes, hdr->nameLength, (off_t)(offset + sizeof(*hdr)))) {
+        return nil;
+    }
+    return [[NSString alloc] initWithData:nameData encoding:NSUTF8StringEncoding];
+}
+
+/******************************************************************************/
+#pragma mark Index maintenance
+/******************************************************************************/
+
+// must be called with the index locked exclusively (or during init)
+- (void) _indexRecordHeader:(MBCacheSegmentRecordHeader*)hdr
+                      named:(NSString*)name
+                  inSegment:(MBCacheSegment*)seg
+                   atOffset:(unsigned long long)offset
+{
+    if (hdr->flags & kSegmentRecordFlagTombstone) {
+        [self _discardRecordNamed:name];
+        seg->_garbage += MBSegmentRecordSize(hdr->nameLength, hdr->dataLength);
+    }
+    else {
+        MBCacheSegmentRecord* rec = [MBCacheSegmentRecord new];
+        rec->_segment = seg;
+        rec->_offset = offset;
+        rec->_nameLength = hdr->nameLength;
+        rec->_dataLength = hdr->dataLength;
+        rec->_writtenAt = hdr->writtenAt;
+        [self _installRecord:rec named:name];
+    }
+}
+
+// must be called with the index locked exclusively; returns YES if
+// a segment became eligible for compaction as a result
+- (BOOL) _discardRecordNamed:(NSString*)name
+{
+    MBCacheSegmentRecord* old = _index[name];
+    if (!old) {
+        return NO;
+    }
+
+    [_index removeObjectForKey:name];
+
+    unsigned long long size = MBSegmentRecordSize(old->_nameLength, old->_dataLength);
+    MBCacheSegment* seg = old->_segment;
+    seg->_garbage += size;
+    _liveSize -= size;
+    return (seg != _active && seg->_garbage >= _compactionThreshold * seg->_size);
+}
+
+// must be called with the index locked exclusively; returns YES if
+// a segment became eligible for compaction as a result
+- (BOOL) _installRecord:(MBCacheSegmentRecord*)rec named:(NSString*)name
+{
+    BOOL compact = [self _discardRecordNamed:name];
+    _index[name] = rec;
+    _liveSize += MBSegmentRecordSize(rec->_nameLength, rec->_dataLength);
+    return compact;
+}
+
+/******************************************************************************/
+#pragma mark Appending records
+/******************************************************************************/
+
+// must be called with the append lock held
+- (MBCacheSegment*) _activeSegmentForRecordOfSize:(unsigned long long)size
+{
+    if (_active && _active->_size > 0 && _active->_size + size > _segmentSizeLimit) {
+        MBLogDebug(@"%@ sealing segment file: %@", [self class], _active->_path);
+
+        [_indexLock lockForReading];
+        BOOL compact = (_active->_garbage >= _compactionThreshold * _active->_size);
+        [_indexLock unlock];
+
+        _active = nil;
+        if (compact) {
+            [self _scheduleCompaction];
+        }
+    }
+
+    if (!_active) {
+        MBCacheSegment* seg = [self _openSegmentNumber:_nextSegmentNumber++ create:YES];
+        if (seg) {
+            [_indexLock lock];
+            _segments[@(seg->_number)] = seg;
+            [_indexLock unlock];
+
+            _active = seg;
+        }
+    }
+    return _active;
+}
+
+// must be called with the append lock held; does not update the index
+- (MBCacheSegmentRecord*) _appendRecordNamed:(NSString*)name
+                                        data:(NSData*)data
+                                       flags:(uint32_t)flags
+                                   writtenAt:(NSTimeInterval)writtenAt
+                                       error:(NSErrorPtrPtr)errPtr
+{
+    NSData* nameData = [name dataUsingEncoding:NSUTF8StringEncoding];
+
+    MBCacheSegmentRecordHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = kSegmentRecordMagic;
+    hdr.flags = flags;
+    hdr.nameLength = (uint32_t) nameData.length;
+    hdr.dataLength = data.length;
+    hdr.writtenAt = writtenAt;
+
+    unsigned long long size = MBSegmentRecordSize(hdr.nameLength, hdr.dataLength);
+    MBCacheSegment* seg = [self _activeSegmentForRecordOfSize:size];
+    if (!seg) {
+        if (errPtr) {
+            *errPtr = [NSError mockingbirdErrorWithDescription:[NSString stringWithFormat:@"Couldn't create a segment file in %@", _directory]];
+        }
+        return nil;
+    }
+
+    unsigned long long offset = seg->_size;
+    if (!MBWriteFully(seg->_fd, &hdr, sizeof(hdr), (off_t)offset)
+        || !MBWriteFully(seg->_fd, nameData.bytes, nameData.length, (off_t)(offset + sizeof(hdr)))
+        || !MBWriteFully(seg->_fd, data.bytes, data.length, (off_t)(offset + sizeof(hdr) + nameData.length)))
+    {
+        int code = errno;
+        MBLogError(@"%@ error while appending to segment file at %@: %s", [self class], seg->_path, strerror(code));
+
+        // don't leave a partial record behind
+        ftruncate(seg->_fd, (off_t)offset);
+        if (errPtr) {
+            *errPtr = [NSError errorWithDomain:NSPOSIXErrorDomain code:code userInfo:nil];
+        }
+        return nil;
+    }
+    seg->_size += size;
+
+    MBCacheSegmentRecord* rec = [MBCacheSegmentRecord new];
+    rec->_segment = seg;
+    rec->_offset = offset;
+    rec->_nameLength = hdr.nameLength;
+    rec->_dataLength = hdr.dataLength;
+    rec->_writtenAt = writtenAt;
+    return rec;
+}
+
+/******************************************************************************/
+#pragma mark Store properties
+/******************************************************************************/
+
+- (NSUInteger) count
+{
+    [_indexLock lockForReading];
+    NSUInteger cnt = _index.count;
+    [_indexLock unlock];
+    return cnt;
+}
+
+- (unsigned long long) liveSize
+{
+    [_indexLock lockForReading];
+    unsigned long long size = _liveSize;
+    [_indexLock unlock];
+    return size;
+}
+
+- (NSUInteger) segmentCount
+{
+    [_indexLock lockForReading];
+    NSUInteger cnt = _segments.count;
+    [_indexLock unlock];
+    return cnt;
+}
+
+- (NSUInteger) compactionCount
+{
+    return atomic_load_explicit(&_compactionCount, memory_order_relaxed);
+}
+
+/******************************************************************************/
+#pragma mark Accessing data
+/******************************************************************************/
+
+- (MBCacheSegmentRecord*) _recordNamed:(NSString*)name
+{
+    [_indexLock lockForReading];
+    MBCacheSegmentRecord* rec = _index[name];
+    [_indexLock unlock];
+    return rec;
+}
+
+- (BOOL) containsDataForName:(NSString*)name
+{
+    return ([self _recordNamed:name] != nil);
+}
+
+- (NSData*) _dataForRecord:(MBCacheSegmentRecord*)rec error:(NSErrorPtrPtr)errPtr
+{
+    if (rec->_dataLength == 0) {
+        return [NSData data];
+    }
+
+    // serve the data straight out of the segment's mapping, without a copy;
+    // the deallocator captures the mapping, keeping it alive for the view
+    unsigned long long start = rec->_offset + sizeof(MBCacheSegmentRecordHeader) + rec->_nameLength;
+    unsigned long long end = start + rec->_dataLength;
+    MBCacheSegmentMapping* mapping = [rec->_segment mappingCoveringOffset:end minimumLength:_segmentSizeLimit];
+    if (mapping) {
+        return [[NSData alloc] initWithBytesNoCopy:((char*)mapping->_bytes + start)
+                                            length:(NSUInteger)rec->_dataLength
+                                       deallocator:^(void* bytes, NSUInteger length) {
+                                           (void) mapping;
+                                       }];
+    }
+
+    // couldn't map the segment; fall back to reading a copy
+    NSMutableData* data = [NSMutableData dataWithLength:(NSUInteger)rec->_dataLength];
+    off_t offset = (off_t)(rec->_offset + sizeof(MBCacheSegmentRecordHeader) + rec->_nameLength);
+    if (!MBReadFully(rec->_segment->_fd, data.mutableBytes, data.length, offset)) {
+        int code = errno;
+        MBLogError(@"%@ error while reading from segment file at %@: %s", [self class], rec->_segment->_path, strerror(code));
+        if (errPtr) {
+            *errPtr = [NSError errorWithDomain:NSPOSIXErrorDomain code:code userInfo:nil];
+        }
+        return nil;
+    }
+    return data;
+}
+
+- (NSData*) dataForName:(NSString*)name error:(NSErrorPtrPtr)errPtr
+{
+    // the read happens outside the lock; the record keeps its
+    // segment (and therefore the segment's file) open
+    MBCacheSegmentRecord* rec = [self _recordNamed:name];
+    if (!rec) {
+        return nil;
+    }
+    return [self _dataForRecord:rec error:errPtr];
+}
+
+- (NSDate*) writeDateForName:(NSString*)name
+{
+    MBCacheSegmentRecord* rec = [self _recordNamed:name];
+    if (!rec) {
+        return nil;
+    }
+    return [NSDate dateWithTimeIntervalSinceReferenceDate:rec->_writtenAt];
+}
+
+- (NSArray*) namesOfOldestDataTotaling:(unsigned long long)size
+{
+    [_indexLock lockForReading];
+    NSArray* names = [_index keysSortedByValueUsingComparator:^NSComparisonResult(MBCacheSegmentRecord* rec1, MBCacheSegmentRecord* rec2) {
+        if (rec1->_writtenAt < rec2->_writtenAt) {
+            return NSOrderedAscending;
+        }
+        else if (rec1->_writtenAt > rec2->_writtenAt) {
+            return NSOrderedDescending;
+        }
+        return NSOrderedSame;
+    }];
+
+    NSUInteger cnt = 0;
+    unsigned long long total = 0;
+    while (cnt < names.count && total < size) {
+        MBCacheSegmentRecord* rec = _index[names[cnt]];
+        total += MBSegmentRecordSize(rec->_nameLength, rec->_dataLength);
+        cnt++;
+    }
+    [_indexLock unlock];
+
+    return [names subarrayWithRange:NSMakeRange(0, cnt)];
+}
+
+/******************************************************************************/
+#pragma mark Modifying data
+/******************************************************************************/
+
+- (BOOL) writeData:(NSData*)data forName:(NSString*)name error:(NSErrorPtrPtr)errPtr
+{
+    MBLogDebugTrace();
+
+    BOOL compact = NO;
+
+    [_appendLock lock];
+    MBCacheSegmentRecord* rec = [self _appendRecordNamed:name
+                                                    data:data
+                                                   flags:0
+                                               writtenAt:[NSDate timeIntervalSinceReferenceDate]
+                                                   error:errPtr];
+    if (rec) {
+        [_indexLock lock];
+        compact = [self _installRecord:rec named:name];
+        [_indexLock unlock];
+    }
+    [_appendLock unlock];
+
+    if (compact) {
+        [self _scheduleCompaction];
+    }
+    return (rec != nil);
+}
+
+- (void) _removeDataForName:(NSString*)name writtenBefore:(NSTimeInterval)cutoff
+{
+    BOOL compact = NO;
+
+    [_appendLock lock];
+    MBCacheSegmentRecord* current = [self _recordNamed:name];
+    if (current && current->_writtenAt < cutoff) {
+        // the tombstone keeps the name from reappearing when the store is
+        // reopened; even if it can't be written, the name is removed for now
+        MBCacheSegmentRecord* tombstone = [self _appendRecordNamed:name
+                                                              data:nil
+                                                             flags:kSegmentRecordFlagTombstone
+                                                         writtenAt:[NSDate timeIntervalSinceReferenceDate]
+                                                             error:nil];
+        [_indexLock lock];
+        compact = [self _discardRecordNamed:name];
+        if (tombstone) {
+            tombstone->_segment->_garbage += MBSegmentRecordSize(tombstone->_nameLength, 0);
+        }
+        [_indexLock unlock];
+    }
+    [_appendLock unlock];
+
+    if (compact) {
+        [self _scheduleCompaction];
+    }
+}
+
+- (void) removeDataForName:(NSString*)name
+{
+    MBLogDebugTrace();
+
+    [self _removeDataForName:name writtenBefore:DBL_MAX];
+}
+
+- (void) removeDataWrittenBefore:(NSDate*)date
+{
+    MBLogDebugTrace();
+
+    NSTimeInterval cutoff = [date timeIntervalSinceReferenceDate];
+    NSMutableArray* names = [NSMutableArray new];
+
+    [_indexLock lockForReading];
+    [_index enumerateKeysAndObjectsUsingBlock:^(NSString* name, MBCacheSegmentRecord* rec, BOOL* stop) {
+        if (rec->_writtenAt < cutoff) {
+            [names addObject:name];
+        }
+    }];
+    [_indexLock unlock];
+
+    // each name is re-checked in case it was rewritten in the meantime
+    for (NSString* name in names) {
+        [self _removeDataForName:name writtenBefore:cutoff];
+    }
+}
+
+- (void) removeAllData
+{
+    MBLogDebugTrace();
+
+    [_appendLock lock];
+    [_indexLock lock];
+    for (MBCacheSegment* seg in [_segments allValues]) {
+        if (unlink([seg->_path fileSystemRepresentation]) != 0 && errno != ENOENT) {
+            MBLogError(@"%@ couldn't delete segment file at %@: %s", [self class], seg->_path, strerror(errno));
+        }
+    }
+    [_segments removeAllObjects];
+    [_index removeAllObjects];
+    _liveSize = 0;
+    _active = nil;
+    [_indexLock unlock];
+    [_appendLock unlock];
+}
+
+/******************************************************************************/
+#pragma mark Compaction
+/******************************************************************************/
+
+- (void) _scheduleCompaction
+{
+    if (atomic_exchange(&_compactionScheduled, true)) {
+        return;     // already scheduled
+    }
+
+    __weak MBCacheSegmentStore* weakSelf = self;
+    dispatch_async(_compactionQueue, ^{
+        MBCacheSegmentStore* strongSelf = weakSelf;
+        if (strongSelf) {
+            atomic_store(&strongSelf->_compactionScheduled, false);
+            [strongSelf _compactEligibleSegments];
+        }
+    });
+}
+
+- (void) compact
+{
+    MBLogDebugTrace();
+
+    dispatch_sync(_compactionQueue, ^{
+        [self _compactEligibleSegments];
+    });
+}
+
+// must be called on the compaction queue
+- (void) _compactEligibleSegments
+{
+    NSMutableArray* victims = [NSMutableArray new];
+
+    [_appendLock lock];
+    [_indexLock lockForReading];
+    double threshold = _compactionThreshold;
+    for (MBCacheSegment* seg in [_segments allValues]) {
+        if (seg != _active && seg->_garbage >= threshold * seg->_size) {
+            [victims addObject:seg];
+        }
+    }
+    [_indexLock unlock];
+    [_appendLock unlock];
+
+    [victims sortUsingComparator:^NSComparisonResult(MBCacheSegment* s1, MBCacheSegment* s2) {
+        return (s1->_number < s2->_number) ? NSOrderedAscending : NSOrderedDescending;
+    }];
+
+    for (MBCacheSegment* seg in victims) {
+        if (![self _compactSegment:seg]) {
+            break;
+        }
+    }
+}
+
+// must be called with the index locked
+- (BOOL) _hasSegmentOlderThan:(MBCacheSegment*)seg
+{
+    for (MBCacheSegment* other in [_segments allValues]) {
+        if (other->_number < seg->_number) {
+            return YES;
+        }
+    }
+    return NO;
+}
+
+// copies a sealed segment's live records into the active segment, then
+// deletes it; returns NO if the segment couldn't be fully copied
+- (BOOL) _compactSegment:(MBCacheSegment*)seg
+{
+    MBLogDebug(@"%@ compacting segment file: %@", [self class], seg->_path);
+
+    // a sealed segment is never appended to, so its size is stable
+    unsigned long long offset = 0;
+    unsigned long long end = seg->_size;
+    while (offset < end) {
+        @autoreleasepool {
+            MBCacheSegmentRecordHeader hdr;
+            NSString* name = [self _readRecordHeader:&hdr fromSegment:seg atOffset:offset];
+            if (!name) {
+                MBLogError(@"%@ couldn't read record at offset %llu of segment file: %@", [self class], offset, seg->_path);
+                return NO;
+            }
+
+            if (hdr.flags & kSegmentRecordFlagTombstone) {
+                // a tombstone is only needed if an older segment may
+                // still hold a record it shadows
+                [_appendLock lock];
+                [_indexLock lockForReading];
+                BOOL needed = !_index[name] && [self _hasSegmentOlderThan:seg];
+                [_indexLock unlock];
+                if (needed) {
+                    MBCacheSegmentRecord* tombstone = [self _appendRecordNamed:name
+                                                                          data:nil
+                                                                         flags:kSegmentRecordFlagTombstone
+                                                                     writtenAt:hdr.writtenAt
+                                                                         error:nil];
+                    if (tombstone) {
+                        [_indexLock lock];
+                        tombstone->_segment->_garbage += MBSegmentRecordSize(tombstone->_nameLength, 0);
+                        [_indexLock unlock];
+                    }
+                    needed = (tombstone == nil);
+                }
+                [_appendLock unlock];
+
+                if (needed) {
+                    return NO;
+                }
+            }
+            else {
+                MBCacheSegmentRecord* current = [self _recordNamed:name];
+                if (current && current->_segment == seg && current->_offset == offset) {
+                    NSData* data = [self _dataForRecord:current error:nil];
+                    if (!data) {
+                        return NO;
+                    }
+
+                    [_appendLock lock];
+                    MBCacheSegmentRecord* rec = [self _appendRecordNamed:name
+                                                                    data:data
+                                                                   flags:0
+                                                               writtenAt:hdr.writtenAt
+                                                                   error:nil];
+                    if (rec) {
+                        [_indexLock lock];
+                        if (_index[name] == current) {
+                            [self _installRecord:rec named:name];
+                        }
+                        else {
+                            // rewritten or removed while we were copying
+                            rec->_segment->_garbage += MBSegmentRecordSize(rec->_nameLength, rec->_dataLength);
+                        }
+                        [_indexLock unlock];
+                    }
+                    [_appendLock unlock];
+
+                    if (!rec) {
+                        return NO;
+                    }
+                }
+            }
+
+            offset += MBSegmentRecordSize(hdr.nameLength, hdr.dataLength);
+        }
+    }
+
+    [_indexLock lock];
+    [_segments removeObjectForKey:@(seg->_number)];
+    [_indexLock unlock];
+
+    if (unlink([seg->_path fileSystemRepresentation]) != 0 && errno != ENOENT) {
+        MBLogError(@"%@ couldn't delete compacted segment file at %@: %s", [self class], seg->_path, strerror(errno));
+    }
+    atomic_fetch_add_explicit(&_compactionCount, 1, memory_order_relaxed);
+    return YES;
+}
+
+@end
@@ -0,0 +1,196 @@
+//
+//  MBCacheStatistics.h
+//  Mockingbird Toolbox
+//
+//  Created by Evan Coyne Maloney on 10/17/26.
+//  Copyright (c) 2026 Gilt Groupe. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/******************************************************************************/
+#pragma mark Types
+/******************************************************************************/
+
+/*!
+ Identifies the counters maintained by an `MBThreadsafeCache`.
+ */
+typedef NS_ENUM(NSUInteger, MBCacheCounter) {
+    /*! Lookups satisfied by the memory cache. */
+    MBCacheCounterMemoryHits        = 0,
+
+    /*! Lookups not satisfied by the memory cache. */
+    MBCacheCounterMemoryMisses      = 1,
+
+    /*! Lookups that missed the memory cache but were satisfied by a slower
+        tier, such as the filesystem. */
+    MBCacheCounterDiskHits          = 2,
+
+    /*! Objects stored through the public mutators. */
+    MBCacheCounterSets              = 3,
+
+    /*! Objects evicted from the memory cache to honor its limits. */
+    MBCacheCounterEvictions         = 4,
+
+    /*! Objects removed from the memory cache because they expired. */
+    MBCacheCounterExpirations       = 5,
+
+    /*! Bytes read from a slower tier. */
+    MBCacheCounterBytesRead         = 6,
+
+    /*! Bytes written to a slower tier. */
+    MBCacheCounterBytesWritten      = 7,
+
+    /*! Objects not stored in the memory cache because the admission policy
+        judged them less valuable than the entries they would displace. */
+    MBCacheCounterRejections        = 8
+};
+
+/*!
+ Identifies the latency histograms maintained by an `MBThreadsafeCache`.
+ */
+typedef NS_ENUM(NSUInteger, MBCacheLatency) {
+    /*! Time spent waiting to acquire a shard lock. */
+    MBCacheLatencyLockWait          = 0,
+
+    /*! Time spent producing an object that wasn't in the memory cache, by
+        reading it from a slower tier or by executing a loader. */
+    MBCacheLatencyLoad              = 1
+};
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark MBCacheLatencyHistogram class
+/******************************************************************************/
+
+/*!
+ An immutable histogram of latency samples.
+
+ Samples are counted in buckets whose bounds are powers of two: bucket `0`
+ holds samples of less than 2 nanoseconds, and bucket *n* holds samples of
+ at least 2^*n* but less than 2^(*n*+1) nanoseconds. The last bucket also
+ holds every longer sample.
+ */
+@interface MBCacheLatencyHistogram : NSObject
+
+/*! The number of buckets in every histogram. */
++ (NSUInteger) bucketCount;
+
+/*! The number of samples in the histogram. */
+@property(nonatomic, readonly) uint64_t count;
+
+/*! The sum of the samples in the histogram, in nanoseconds. */
+@property(nonatomic, readonly) uint64_t totalNanoseconds;
+
+/*! The mean of the samples in the histogram, in nanoseconds, or `0` if the
+    histogram is empty. */
+@property(nonatomic, readonly) double meanNanoseconds;
+
+/*! An array of `NSNumber`s containing the number of samples in each bucket. */
+@property(nonnull, nonatomic, readonly) NSArray* bucketCounts;
+
+/*!
+ Estimates the given percentile of the samples.
+
+ @param     percentile The percentile, from `0` to `100`.
+
+ @return    The exclusive upper bound, in nanoseconds, of the bucket containing
+            the requested percentile, or `0` if the histogram is empty.
+ */
+- (uint64_t) nanosecondsAtPercentile:(double)percentile;
+
+/*!
+ Returns a property list representation of the histogram, suitable for
+ forwarding to a metrics system.
+ */
+- (nonnull NSDictionary*) dictionaryRepresentation;
+
+@end
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark MBCacheStatistics class
+/******************************************************************************/
+
+/*!
+ An immutable snapshot of the statistics gathered by an `MBThreadsafeCache`,
+ as returned by its `statistics` method.
+
+ The counters are cumulative over the lifetime of the cache; to measure an
+ interval, compare two snapshots. Because the counters are updated without
+ locking, a snapshot taken while the cache is in use may not reflect every
+ operation in progress.
+ */
+@interface MBCacheStatistics : NSObject
+
+/*! The number of lookups satisfied by the memory cache. */
+@property(nonatomic, readonly) uint64_t memoryHits;
+
+/*! The number of lookups not satisfied by the memory cache. */
+@property(nonatomic, readonly) uint64_t memoryMisses;
+
+/*! The number of lookups that missed the memory cache but were satisfied by
+    the filesystem. Always `0` for caches without a filesystem tier. */
+@property(nonatomic, readonly) uint64_t diskHits;
+
+/*! The number of lookups satisfied by any tier of the cache. */
+@property(nonatomic, readonly) uint64_t hits;
+
+/*! The number of lookups not satisfied by any tier of the cache. */
+@property(nonatomic, readonly) uint64_t misses;
+
+/*! The fraction of lookups satisfied by any tier of the cache, from `0`
+    to `1`, or `0` if there have been no lookups. */
+@property(nonatomic, readonly) double hitRate;
+
+/*! The number of objects stored through the public mutators. */
+@property(nonatomic, readonly) uint64_t sets;
+
+/*! The number of objects evicted from the memory cache because the
+    `countLimit` or `totalCostLimit` was exceeded. */
+@property(nonatomic, readonly) uint64_t evictions;
+
+/*! The number of objects removed from the memory cache because their
+    time-to-live had elapsed. */
+@property(nonatomic, readonly) uint64_t expirations;
+
+/*! The number of objects not stored in the memory cache because the
+    `admissionPolicy` judged them less valuable than the entries they would
+    have displaced. */
+@property(nonatomic, readonly) uint64_t rejections;
+
+/*! The number of bytes read from the filesystem. */
+@property(nonatomic, readonly) uint64_t bytesRead;
+
+/*! The number of bytes written to the filesystem. */
+@property(nonatomic, readonly) uint64_t bytesWritten;
+
+/*! Time spent waiting to acquire shard locks. Empty unless the cache's
+    `measuresLatency` property was set. */
+@property(nonnull, nonatomic, readonly) MBCacheLatencyHistogram* lockWaitLatency;
+
+/*! Time spent producing objects that weren't in the memory cache. Empty
+    unless the cache's `measuresLatency` property was set. */
+@property(nonnull, nonatomic, readonly) MBCacheLatencyHistogram* loadLatency;
+
+/*!
+ Returns the value of the given counter.
+
+ @param     counter The counter.
+ */
+- (uint64_t) valueOfCounter:(MBCacheCounter)counter;
+
+/*!
+ Returns the histogram of the given latency.
+
+ @param     latency The latency.
+ */
+- (nonnull MBCacheLatencyHistogram*) histogramOfLatency:(MBCacheLatency)latency;
+
+/*!
+ Returns a property list representation of the statistics, suitable for
+ forwarding to a metrics system.
+ */
+- (nonnull NSDictionary*) dictionaryRepresentation;
+
+@end
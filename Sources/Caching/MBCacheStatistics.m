@@ -0,0 +1,183 @@
+//
+//  MBCacheStatistics.m
+//  Mockingbird Toolbox
+//
+//  Created by Evan Coyne Maloney on 10/17/26.
+//  Copyright (c) 2026 Gilt Groupe. All rights reserved.
+//
+
+#import "MBCacheStatistics.h"
+#import "MBCacheStatisticsRecorder.h"
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark MBCacheLatencyHistogram implementation
+/******************************************************************************/
+
+@implementation MBCacheLatencyHistogram
+{
+    uint64_t _buckets[kMBCacheLatencyBucketCount];
+}
+
++ (NSUInteger) bucketCount
+{
+    return kMBCacheLatencyBucketCount;
+}
+
+- (instancetype) initWithRecorders:(NSArray*)recorders latency:(MBCacheLatency)latency
+{
+    self = [super init];
+    if (self) {
+        for (MBCacheStatisticsRecorder* stats in recorders) {
+            for (NSUInteger b=0; b<kMBCacheLatencyBucketCount; b++) {
+                uint64_t count = atomic_load_explicit(&stats->_latencyBuckets[latency][b], memory_order_relaxed);
+                _buckets[b] += count;
+                _count += count;
+            }
+            _totalNanoseconds += atomic_load_explicit(&stats->_latencyTotals[latency], memory_order_relaxed);
+        }
+    }
+    return self;
+}
+
+- (double) meanNanoseconds
+{
+    return (_count ? (double)_totalNanoseconds / _count : 0);
+}
+
+- (NSArray*) bucketCounts
+{
+    NSMutableArray* counts = [NSMutableArray arrayWithCapacity:kMBCacheLatencyBucketCount];
+    for (NSUInteger b=0; b<kMBCacheLatencyBucketCount; b++) {
+        [counts addObject:@(_buckets[b])];
+    }
+    return counts;
+}
+
+- (uint64_t) nanosecondsAtPercentile:(double)percentile
+{
+    if (!_count) {
+        return 0;
+    }
+
+    double rank = MAX(0, MIN(percentile, 100)) / 100.0 * _count;
+    uint64_t seen = 0;
+    NSUInteger b = 0;
+    for (; b<kMBCacheLatencyBucketCount - 1; b++) {
+        seen += _buckets[b];
+        if (seen && seen >= rank) {
+            break;
+        }
+    }
+    return (2ULL << b);
+}
+
+- (NSDictionary*) dictionaryRepresentation
+{
+    return @{@"count": @(_count),
+             @"totalNanoseconds": @(_totalNanoseconds),
+             @"p50": @([self nanosecondsAtPercentile:50]),
+             @"p90": @([self nanosecondsAtPercentile:90]),
+             @"p99": @([self nanosecondsAtPercentile:99]),
+             @"buckets": [self bucketCounts]};
+}
+
+- (NSString*) description
+{
+    return [NSString stringWithFormat:@"<%@: %p; count = %llu; mean = %gns; p50 < %lluns; p99 < %lluns>",
+            [self class], self, _count, self.meanNanoseconds,
+            [self nanosecondsAtPercentile:50], [self nanosecondsAtPercentile:99]];
+}
+
+@end
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark MBCacheStatistics implementation
+/******************************************************************************/
+
+@implementation MBCacheStatistics
+{
+    uint64_t _counters[kMBCacheCounterCount];
+}
+
+- (instancetype) initWithRecorders:(NSArray*)recorders
+{
+    self = [super init];
+    if (self) {
+        for (MBCacheStatisticsRecorder* stats in recorders) {
+            for (NSUInteger i=0; i<kMBCacheCounterCount; i++) {
+                _counters[i] += atomic_load_explicit(&stats->_counters[i], memory_order_relaxed);
+            }
+        }
+        _lockWaitLatency = [[MBCacheLatencyHistogram alloc] initWithRecorders:recorders latency:MBCacheLatencyLockWait];
+        _loadLatency = [[MBCacheLatencyHistogram alloc] initWithRecorders:recorders latency:MBCacheLatencyLoad];
+    }
+    return self;
+}
+
+- (uint64_t) valueOfCounter:(MBCacheCounter)counter
+{
+    return (counter < kMBCacheCounterCount ? _counters[counter] : 0);
+}
+
+- (MBCacheLatencyHistogram*) histogramOfLatency:(MBCacheLatency)latency
+{
+    return (latency == MBCacheLatencyLockWait ? _lockWaitLatency : _loadLatency);
+}
+
+- (uint64_t) memoryHits      { return _counters[MBCacheCounterMemoryHits]; }
+- (uint64_t) memoryMisses    { return _counters[MBCacheCounterMemoryMisses]; }
+- (uint64_t) diskHits        { return _counters[MBCacheCounterDiskHits]; }
+- (uint64_t) sets            { return _counters[MBCacheCounterSets]; }
+- (uint64_t) evictions       { return _counters[MBCacheCounterEvictions]; }
+- (uint64_t) expirations     { return _counters[MBCacheCounterExpirations]; }
+- (uint64_t) rejections      { return _counters[MBCacheCounterRejections]; }
+- (uint64_t) bytesRead       { return _counters[MBCacheCounterBytesRead]; }
+- (uint64_t) bytesWritten    { return _counters[MBCacheCounterBytesWritten]; }
+
+- (uint64_t) hits
+{
+    return self.memoryHits + self.diskHits;
+}
+
+- (uint64_t) misses
+{
+    // every disk hit was first a memory miss; the counters aren't read
+    // atomically as a group, so guard against a momentary inversion
+    uint64_t memoryMisses = self.memoryMisses;
+    uint64_t diskHits = self.diskHits;
+    return (memoryMisses > diskHits ? memoryMisses - diskHits : 0);
+}
+
+- (double) hitRate
+{
+    uint64_t hits = self.hits;
+    uint64_t lookups = hits + self.misses;
+    return (lookups ? (double)hits / lookups : 0);
+}
+
+- (NSDictionary*) dictionaryRepresentation
+{
+    return @{@"memoryHits": @(self.memoryHits),
+             @"memoryMisses": @(self.memoryMisses),
+             @"diskHits": @(self.diskHits),
+             @"hits": @(self.hits),
+             @"misses": @(self.misses),
+             @"sets": @(self.sets),
+             @"evictions": @(self.evictions),
+             @"expirations": @(self.expirations),
+             @"rejections": @(self.rejections),
+             @"bytesRead": @(self.bytesRead),
+             @"bytesWritten": @(self.bytesWritten),
+             @"lockWaitLatency": [_lockWaitLatency dictionaryRepresentation],
+             @"loadLatency": [_loadLatency dictionaryRepresentation]};
+}
+
+- (NSString*) description
+{
+    return [NSString stringWithFormat:@"<%@: %p; hits = %llu (memory = %llu, disk = %llu); misses = %llu; sets = %llu; evictions = %llu>",
+            [self class], self, self.hits, self.memoryHits, self.diskHits, self.misses, self.sets, self.evictions];
+}
+
+@end
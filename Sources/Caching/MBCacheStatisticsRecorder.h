@@ -0,0 +1,109 @@
+//
+//  MBCacheStatisticsRecorder.h
+//  Mockingbird Toolbox
+//
+//  Created by Evan Coyne Maloney on 10/17/26.
+//  Copyright (c) 2026 Gilt Groupe. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <stdatomic.h>
+#import <mach/mach_time.h>
+
+#import "MBCacheStatistics.h"
+
+//
+// NOTE: This header file is for use only within the implementation of
+//       MBThreadsafeCache and its subclasses. It is not a public header.
+//
+
+/******************************************************************************/
+#pragma mark Constants
+/******************************************************************************/
+
+#define kMBCacheCounterCount            (MBCacheCounterRejections + 1)
+#define kMBCacheLatencyCount            (MBCacheLatencyLoad + 1)
+#define kMBCacheLatencyBucketCount      32
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark MBCacheStatisticsRecorder class
+/******************************************************************************/
+
+/*!
+ Accumulates the statistics of one memory cache shard.
+
+ Each shard has its own recorder, so the counters are only contended by
+ threads that are already contending for the same shard. Every update is a
+ relaxed atomic increment. Instance variables are public so that the inline
+ functions below can update them without the overhead of messaging.
+ */
+@interface MBCacheStatisticsRecorder : NSObject
+{
+@public
+    atomic_bool _measuresLatency;
+    atomic_ullong _counters[kMBCacheCounterCount];
+    atomic_ullong _latencyBuckets[kMBCacheLatencyCount][kMBCacheLatencyBucketCount];
+    atomic_ullong _latencyTotals[kMBCacheLatencyCount];
+}
+@end
+
+/*!
+ The numerator and denominator for converting `mach_absolute_time()` units
+ to nanoseconds; populated before the first recorder is created.
+ */
+extern mach_timebase_info_data_t MBCacheStatisticsTimebase;
+
+/*!
+ Adds to one of a recorder's counters.
+ */
+static inline void MBCacheStatisticsIncrement(MBCacheStatisticsRecorder* __nonnull stats, MBCacheCounter counter, uint64_t amount)
+{
+    atomic_fetch_add_explicit(&stats->_counters[counter], amount, memory_order_relaxed);
+}
+
+/*!
+ Begins measuring a latency. Returns `0` if the recorder isn't measuring
+ latency; otherwise, the result should be passed to `MBCacheStatisticsEnd()`.
+ */
+static inline uint64_t MBCacheStatisticsBegin(MBCacheStatisticsRecorder* __nonnull stats)
+{
+    if (!atomic_load_explicit(&stats->_measuresLatency, memory_order_relaxed)) {
+        return 0;
+    }
+    return mach_absolute_time();
+}
+
+/*!
+ Records the time elapsed since a value returned by `MBCacheStatisticsBegin()`.
+ Does nothing if `start` is `0`.
+ */
+static inline void MBCacheStatisticsEnd(MBCacheStatisticsRecorder* __nonnull stats, MBCacheLatency latency, uint64_t start)
+{
+    if (!start) {
+        return;
+    }
+    uint64_t nanos = (mach_absolute_time() - start) * MBCacheStatisticsTimebase.numer / MBCacheStatisticsTimebase.denom;
+    unsigned bucket = (nanos < 2 ? 0 : 63 - __builtin_clzll(nanos));
+    if (bucket >= kMBCacheLatencyBucketCount) {
+        bucket = kMBCacheLatencyBucketCount - 1;
+    }
+    atomic_fetch_add_explicit(&stats->_latencyBuckets[latency][bucket], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stats->_latencyTotals[latency], nanos, memory_order_relaxed);
+}
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark MBCacheStatistics snapshots
+/******************************************************************************/
+
+@interface MBCacheStatistics (MBCacheStatisticsRecorder)
+
+/*!
+ Creates a snapshot of the sum of the given recorders.
+
+ @param     recorders An array of `MBCacheStatisticsRecorder`s.
+ */
+- (nonnull instancetype) initWithRecorders:(nonnull NSArray*)recorders;
+
+@end
@@ -0,0 +1,45 @@
+//
+//  MBCacheStatisticsRecorder.m
+//  Mockingbird Toolbox
+//
+//  Created by Evan Coyne Maloney on 10/17/26.
+//  Copyright (c) 2026 Gilt Groupe. All rights reserved.
+//
+
+#import "MBCacheStatisticsRecorder.h"
+
+mach_timebase_info_data_t MBCacheStatisticsTimebase = {1, 1};
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark MBCacheStatisticsRecorder implementation
+/******************************************************************************/
+
+@implementation MBCacheStatisticsRecorder
+
++ (void) initialize
+{
+    if (self == [MBCacheStatisticsRecorder class]) {
+        mach_timebase_info(&MBCacheStatisticsTimebase);
+    }
+}
+
+- (instancetype) init
+{
+    self = [super init];
+    if (self) {
+        atomic_init(&_measuresLatency, false);
+        for (NSUInteger i=0; i<kMBCacheCounterCount; i++) {
+            atomic_init(&_counters[i], 0);
+        }
+        for (NSUInteger i=0; i<kMBCacheLatencyCount; i++) {
+            for (NSUInteger b=0; b<kMBCacheLatencyBucketCount; b++) {
+                atomic_init(&_latencyBuckets[i][b], 0);
+            }
+            atomic_init(&_latencyTotals[i], 0);
+        }
+    }
+    return self;
+}
+
+@end
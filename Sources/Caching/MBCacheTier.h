@@ -0,0 +1,94 @@
+//
+//  MBCacheTier.h
+//  Mockingbird Toolbox
+//
+//  Created by Evan Coyne Maloney on 10/17/26.
+//  Copyright (c) 2026 Gilt Groupe. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#import "MBCacheStatistics.h"
+
+@protocol MBCacheTier;
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark MBCacheTierDelegate protocol
+/******************************************************************************/
+
+/*!
+ Receives notifications about the objects an `MBCacheTier` drops to stay
+ within its limits.
+ */
+@protocol MBCacheTierDelegate <NSObject>
+
+/*!
+ Called when a tier drops an object because a limit was exceeded, either by
+ evicting it or by declining to admit it. Objects that are explicitly removed,
+ replaced or that expire are not reported.
+
+ @param     tier The tier that dropped the object.
+
+ @param     obj The object that was dropped.
+
+ @param     key The key under which the object was stored.
+
+ @note      The tier calls this method after releasing its internal locks,
+            so the implementation may store the object in a different tier
+            or call back into `tier`. Objects dropped while the caller of the
+            operation that dropped them holds the tier's `lock` are reported
+            when it calls `unlock`.
+ */
+- (void) cacheTier:(nonnull id<MBCacheTier>)tier droppedObject:(nonnull id)obj forKey:(nonnull id)key;
+
+@end
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark MBCacheTier protocol
+/******************************************************************************/
+
+/*!
+ A single level in a stack of caches assembled by an `MBTieredCache`.
+
+ `MBThreadsafeCache` and its subclasses conform to this protocol, so a memory
+ cache and an `MBFilesystemCache` can be stacked directly. Every method must
+ be safe to call from any thread.
+ */
+@protocol MBCacheTier <NSObject>
+
+/*!
+ Returns the object the tier holds for the given key.
+
+ @param     key The key.
+
+ @return    The object, or `nil` if the tier doesn't hold one.
+ */
+- (nullable id) objectForKey:(nonnull id)key;
+
+/*!
+ Stores an object in the tier, replacing any existing object for the key.
+
+ @param     obj The object.
+
+ @param     key The key.
+ */
+- (void) setObject:(nonnull id)obj forKey:(nonnull id)key;
+
+/*!
+ Removes any object the tier holds for the given key.
+
+ @param     key The key.
+ */
+- (void) removeObjectForKey:(nonnull id)key;
+
+/*!
+ Returns a snapshot of the statistics gathered by the tier.
+ */
+- (nonnull MBCacheStatistics*) statistics;
+
+/*! The delegate notified when the tier drops an object. */
+@property(nullable, nonatomic, weak) id<MBCacheTierDelegate> tierDelegate;
+
+@end
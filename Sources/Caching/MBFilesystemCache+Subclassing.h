@@ -59,6 +59,118 @@
  */
 - (nonnull NSString*) filePathForCacheKey:(nonnull id)key;
 
+/*----------------------------------------------------------------------------*/
+#pragma mark Cache file storage
+/*!    @name Cache file storage                                               */
+/*----------------------------------------------------------------------------*/
+
+/*!
+ Reads the contents of the cache file at the given path.
+
+ All access to cache file contents goes through the methods in this section,
+ which store each cache file either as an individual file or as a record in
+ a segment file, depending on the receiver's `storageMode`. Subclasses may
+ override them to store cache files by some other means.
+
+ @param     path The path of the cache file, as returned by
+            `filePathForCacheKey:`.
+
+ @param     errPtr If this method returns `nil` and this parameter is non-`nil`,
+            `*errPtr` will be updated to point to an `NSError` describing the
+            problem.
+
+ @return    The contents of the file, or `nil` if it couldn't be read.
+ */
+- (nullable NSData*) cacheDataFromFile:(nonnull NSString*)path error:(NSErrorPtrPtr)errPtr;
+
+/*!
+ Writes the contents of the cache file at the given path, replacing any
+ previous contents. This is called by `MBCacheWriteOperation`s executing on
+ the `writeQueue`.
+
+ @param     data The data to write.
+
+ @param     path The path of the cache file, as returned by
+            `filePathForCacheKey:`.
+
+ @param     errPtr If this method returns `NO` and this parameter is non-`nil`,
+            `*errPtr` will be updated to point to an `NSError` describing the
+            problem.
+
+ @return    `YES` if the data was written; `NO` otherwise.
+ */
+- (BOOL) writeCacheData:(nonnull NSData*)data toFile:(nonnull NSString*)path error:(NSErrorPtrPtr)errPtr;
+
+/*!
+ Determines whether a cache file exists at the given path.
+
+ @param     path The path of the cache file, as returned by
+            `filePathForCacheKey:`.
+
+ @return    `YES` if the cache file exists and is readable; `NO` otherwise.
+ */
+- (BOOL) cacheFileExistsAtPath:(nonnull NSString*)path;
+
+/*!
+ Returns the time at which the cache file at the given path was last written.
+
+ @param     path The path of the cache file, as returned by
+            `filePathForCacheKey:`.
+
+ @return    The modification date, or `nil` if it couldn't be determined.
+ */
+- (nullable NSDate*) modificationDateOfCacheFileAtPath:(nonnull NSString*)path;
+
+/*!
+ Removes the cache file at the given path, if it exists.
+
+ @param     path The path of the cache file, as returned by
+            `filePathForCacheKey:`.
+ */
+- (void) removeCacheFileAtPath:(nonnull NSString*)path;
+
+/*!
+ Called by an `MBCachePruneOperation` after it has deleted the cache file
+ at the given path, so that the receiver can update any records it keeps of
+ its cache files. This may be called from multiple threads at once.
+
+ @param     path The path of the deleted cache file.
+ */
+- (void) cacheFilePrunedAtPath:(nonnull NSString*)path;
+
+/*----------------------------------------------------------------------------*/
+#pragma mark Encoding cache files
+/*!    @name Encoding cache files                                             */
+/*----------------------------------------------------------------------------*/
+
+/*!
+ Encodes the data returned by `cacheDataFromObject:` for writing to a cache
+ file, compressing it as specified by the receiver's `compression` property.
+ The encoded data begins with a header recording the compression, a checksum,
+ and the time at which the file expires.
+
+ @param     data The data to encode.
+
+ @return    The encoded data.
+ */
+- (nonnull NSData*) encodedCacheData:(nonnull NSData*)data;
+
+/*!
+ Decodes the contents of a cache file written using `encodedCacheData:`,
+ yielding data suitable for passing to `objectFromCacheData:`. The file
+ may have been written using any compression. Files that are truncated or
+ whose checksums don't match are rejected.
+
+ @param     data The contents of the cache file.
+
+ @param     errPtr If this method returns `nil` and this parameter is non-`nil`,
+            `*errPtr` will be updated to point to an `NSError` describing the
+            problem.
+
+ @return    The decoded data, or `nil` if it couldn't be decoded.
+ */
+- (nullable NSData*) decodedCacheData:(nonnull NSData*)data error:(NSErrorPtrPtr)errPtr;
+
 /*----------------------------------------------------------------------------*/
 #pragma mark Loading cache objects
 /*!    @name Loading cache objects                                            */
@@ -67,15 +179,17 @@
 /*!
  Loads the cache object contained in the specified file.
  
- The default implementation reads the file into an `NSData` instance and then
- returns the result of calling `objectFromCacheData:` with that `NSData`.
+ The default implementation reads the file into an `NSData` instance, decodes
+ it using `decodedCacheData:error:` and then returns the result of calling
+ `objectFromCacheData:` with the decoded `NSData`. Files that have expired are
+ not decoded.
 
  Subclasses may override this method to provide a more efficient mechanism
  for reconstituting objects from files.
  
  @param     path The path of the file to read.
  
- @return    The cache object, or `nil` if it couldn't be read..
+ @return    The cache object, or `nil` if it couldn't be read or has expired.
  */
 - (nullable id) objectFromCacheFile:(nonnull NSString*)path;
 
@@ -104,7 +218,11 @@
  to determine whether the specified object should be stored in the memory cache.
  
  If the delegate method returns `YES`, the object will be stored in the cache
- and associated with the specified key.
+ and associated with the specified key, via `objectLoaded:forKey:`.
+
+ Because storing the object locks the memory cache shard, this method must
+ not be called with the shard already locked; `internalSetObject:forKey:`,
+ which is, consults the delegate and stores the object itself.
  
  @param     cacheObj The object that may be stored in the cache.
  
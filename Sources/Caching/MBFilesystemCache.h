@@ -11,6 +11,7 @@
 @class MBFilesystemCache;
 @class MBCacheReadQueue;
 @class MBCacheWriteQueue;
+@class MBCachePruneOperation;
 
 /******************************************************************************/
 #pragma mark Constants
@@ -19,6 +20,56 @@
 // default value for maxAgeOfCacheFiles property (36 hours)
 extern const NSTimeInterval kMBFilesystemCacheDefaultMaxAge;
 
+/*!
+ Specifies how an `MBFilesystemCache` stores cache files on disk.
+ */
+typedef NS_ENUM(NSUInteger, MBFilesystemCacheStorageMode) {
+    /*! Each cache file is stored as an individual file in the cache
+        directory. This is the default. */
+    MBFilesystemCacheStorageModeFilePerKey = 0,
+
+    /*! Cache files are appended as records to a small number of large
+        segment files, which are indexed in memory and compacted in the
+        background. This avoids creating one file per key, which is
+        preferable for caches holding very many small objects. */
+    MBFilesystemCacheStorageModeSegmented = 1
+};
+
+/*!
+ Specifies the hash function used by an `MBFilesystemCache` to derive the
+ names of cache files from cache keys.
+ */
+typedef NS_ENUM(NSUInteger, MBFilesystemCacheKeyHash) {
+    /*! MD5. This is the default, and is compatible with cache files written
+        by earlier versions of `MBFilesystemCache`. */
+    MBFilesystemCacheKeyHashMD5 = 0,
+
+    /*! 128-bit MurmurHash3, which is much faster to compute than MD5. Cache
+        files named using MD5 are not found when this hash is in use. */
+    MBFilesystemCacheKeyHashMurmur3 = 1
+};
+
+/*!
+ Specifies how an `MBFilesystemCache` compresses the contents of the cache
+ files it writes.
+ */
+typedef NS_ENUM(NSUInteger, MBFilesystemCacheCompression) {
+    /*! Cache files are written uncompressed. This is the default. */
+    MBFilesystemCacheCompressionNone = 0,
+
+    /*! LZ4, which is very fast to compress and decompress, at the cost of
+        a lower compression ratio. */
+    MBFilesystemCacheCompressionLZ4 = 1,
+
+    /*! LZFSE, which compresses about as densely as zlib while being
+        considerably faster to decompress. */
+    MBFilesystemCacheCompressionLZFSE = 2,
+
+    /*! zlib (raw DEFLATE) at its default level, the densest and slowest of
+        the available methods. */
+    MBFilesystemCacheCompressionZLIB = 3
+};
+
 /******************************************************************************/
 #pragma mark -
 #pragma mark MBFilesystemCacheDelegate protocol
@@ -35,7 +86,9 @@ extern const NSTimeInterval kMBFilesystemCacheDefaultMaxAge;
  key.
  
  The cache object associated with the given key will be stored in a file
- with the name returned by this method.
+ with the name returned by this method. The same key must always yield the
+ same filename; the cache remembers the filename most recently returned on
+ each thread, so that a single cache operation calls this method only once.
  
  @param     key The cache key for which the filename is sought.
  
@@ -187,6 +240,100 @@ extern const NSTimeInterval kMBFilesystemCacheDefaultMaxAge;
 - (nonnull instancetype) initWithName:(nonnull NSString*)name
                         cacheDelegate:(nonnull id)delegate;
 
+/*!
+ Initializes the receiver with the given name, spreading its memory cache
+ across multiple independently-locked shards.
+
+ @warning   Do not use the same cache name for more than one `MBFilesystemCache`
+            at any given time. Unpredictable results will occur if you do.
+
+ @param     name The name of the filesystem cache. Must not be `nil`, and must
+            not contain any characters that are illegal filename characters
+            in the local filesystem. This name will be used in the path of
+            the directory in which the receiver's files will be stored.
+ 
+ @param     delegate The `MBFilesystemCacheDelegate` that will be used as
+            the receiver's delegate. Must not be `nil`.
+
+ @param     shards The number of memory cache shards. See
+            `MBThreadsafeCache`'s `initWithShardCount:...` initializers.
+ 
+ @return    The receiver.
+ */
+- (nonnull instancetype) initWithName:(nonnull NSString*)name
+                        cacheDelegate:(nonnull id)delegate
+                           shardCount:(NSUInteger)shards;
+
+/*!
+ Initializes the receiver with the given name, memory cache shard count and
+ filesystem storage mode.
+
+ The storage mode determines only how cache files are laid out on disk; the
+ `MBFilesystemCacheDelegate` is consulted in the same way regardless.
+
+ @warning   Do not use the same cache name for more than one `MBFilesystemCache`
+            at any given time, and do not change the storage mode of a named
+            cache once files have been stored in it. Unpredictable results
+            will occur if you do.
+
+ @param     name The name of the filesystem cache. Must not be `nil`, and must
+            not contain any characters that are illegal filename characters
+            in the local filesystem. This name will be used in the path of
+            the directory in which the receiver's files will be stored.
+ 
+ @param     delegate The `MBFilesystemCacheDelegate` that will be used as
+            the receiver's delegate. Must not be `nil`.
+
+ @param     shards The number of memory cache shards. See
+            `MBThreadsafeCache`'s `initWithShardCount:...` initializers.
+
+ @param     mode The storage mode.
+ 
+ @return    The receiver.
+ */
+- (nonnull instancetype) initWithName:(nonnull NSString*)name
+                        cacheDelegate:(nonnull id)delegate
+                           shardCount:(NSUInteger)shards
+                          storageMode:(MBFilesystemCacheStorageMode)mode;
+
+/*!
+ Initializes the receiver with the given name, memory cache shard count,
+ filesystem storage mode and memory cache concurrency mode.
+
+ @warning   Do not use the same cache name for more than one `MBFilesystemCache`
+            at any given time, and do not change the storage mode of a named
+            cache once files have been stored in it. Unpredictable results
+            will occur if you do.
+
+ @param     name The name of the filesystem cache. Must not be `nil`, and must
+            not contain any characters that are illegal filename characters
+            in the local filesystem. This name will be used in the path of
+            the directory in which the receiver's files will be stored.
+ 
+ @param     delegate The `MBFilesystemCacheDelegate` that will be used as
+            the receiver's delegate. Must not be `nil`. When
+            `concurrency` is `MBThreadsafeCacheConcurrencyModeExclusiveNonRecursive`,
+            the delegate's `shouldStoreObject:forKey:inMemoryCache:` method
+            is called with a memory cache shard locked, and so must not
+            call back into the receiver.
+
+ @param     shards The number of memory cache shards. See
+            `MBThreadsafeCache`'s `initWithShardCount:...` initializers.
+
+ @param     mode The storage mode.
+
+ @param     concurrency The `MBThreadsafeCacheConcurrencyMode` determining
+            how the memory cache coordinates access among threads. The other
+            initializers use `MBThreadsafeCacheConcurrencyModeExclusive`.
+ 
+ @return    The receiver.
+ */
+- (nonnull instancetype) initWithName:(nonnull NSString*)name
+                        cacheDelegate:(nonnull id)delegate
+                           shardCount:(NSUInteger)shards
+                          storageMode:(MBFilesystemCacheStorageMode)mode
+                      concurrencyMode:(MBThreadsafeCacheConcurrencyMode)concurrency;
+
 /*----------------------------------------------------------------------------*/
 #pragma mark Cache properties
 /*!    @name Cache properties                                                 */
@@ -200,6 +347,25 @@ extern const NSTimeInterval kMBFilesystemCacheDefaultMaxAge;
     cache write operations. */
 @property(nonnull, nonatomic, readonly) MBCacheWriteQueue* writeQueue;
 
+/*! Returns the mode used to store cache files on disk. */
+@property(nonatomic, readonly) MBFilesystemCacheStorageMode storageMode;
+
+/*! The hash function used by the receiver's implementation of
+    `filenameForCacheKey:` to derive the names of cache files from the
+    `description`s of cache keys. Changing the hash function effectively
+    empties the filesystem cache, so this property should be set immediately
+    after the receiver is initialized. Defaults to
+    `MBFilesystemCacheKeyHashMD5`. */
+@property(nonatomic, assign) MBFilesystemCacheKeyHash keyHash;
+
+/*! The compression applied to the contents of cache files as they are
+    written. Each cache file records the compression used to write it, so
+    changing this property does not prevent existing cache files from being
+    read. Payloads
+    too small to benefit, or that don't shrink when compressed, are written
+    uncompressed. Defaults to `MBFilesystemCacheCompressionNone`. */
+@property(atomic, assign) MBFilesystemCacheCompression compression;
+
 /*! Returns the name of the cache, which is used to determine the directory
     in which cache files are stored. This is name provided when the receiver
     is initialized. */
@@ -210,10 +376,65 @@ extern const NSTimeInterval kMBFilesystemCacheDefaultMaxAge;
 
 /*! Returns the maximum age of the files in the cache, in seconds. Files that
     are older than this value will not be used by the cache and will
-    eventually be deleted. This defaults to the value of the constant 
-    `kMBFilesystemCacheDefaultMaxAge` (currently, 36 hours). */
+    eventually be deleted. Each cache file records the time at which it
+    expires, based on the value of this property when the file was written;
+    changing it does not affect the expiry of existing files. This defaults
+    to the value of the constant `kMBFilesystemCacheDefaultMaxAge`
+    (currently, 36 hours). */
 @property(nonatomic, assign) NSTimeInterval maxAgeOfCacheFiles;
 
+/*! The maximum number of bytes the receiver's cache files may occupy, or `0`
+    for no limit. Whenever a cache file is written and the total exceeds this
+    value, the least recently accessed cache files are deleted in the
+    background until the total falls below 90% of the limit. The total is
+    tracked as files are written and deleted, so enforcing the limit never
+    requires walking the cache directory. Until the receiver has finished
+    loading its index of cache files, the total isn't known; the limit is
+    enforced as soon as loading completes.
+
+    When the `storageMode` is `MBFilesystemCacheStorageModeSegmented`, the
+    limit applies to the records of the cached objects, and the records
+    written longest ago are removed first, since reads aren't tracked. The
+    space removed records occupied is reclaimed when their segment files are
+    compacted, so the segment files may briefly exceed the limit.
+
+    Defaults to `0`. */
+@property(atomic, assign) unsigned long long maxSizeOfCacheFiles;
+
+/*! Returns the number of bytes occupied by the receiver's cache files, or
+    `0` if it is not yet known because the receiver's index of cache files
+    is still loading. When the `storageMode` is
+    `MBFilesystemCacheStorageModeSegmented`, this is the size of the
+    cached objects' records, excluding space awaiting compaction. */
+@property(nonatomic, readonly) unsigned long long sizeOfCacheFiles;
+
+/*! If `YES` and the memory cache is bounded by a `countLimit` or
+    `totalCostLimit`, objects evicted from the memory cache are written to the
+    filesystem cache when no cache file exists for them, instead of simply
+    being dropped. This is useful for objects that enter the memory cache via
+    `objectLoaded:forKey:` rather than `setObject:forKey:`. Because eviction
+    occurs without knowledge of the original cache key, the delegate's
+    `shouldStoreObject:forKey:inFilesystemCache:` is not consulted. Defaults
+    to `NO`. */
+@property(nonatomic, assign) BOOL demotesEvictedObjects;
+
+/*! If `YES`, the receiver keeps a Bloom filter of the names of its cache
+    files, which allows most lookups of keys that are not in the filesystem
+    cache to be answered without touching the filesystem. The filter is saved
+    alongside the cache directory, and is reloaded when this property is set
+    if it is still up-to-date; otherwise, it is rebuilt from the cache
+    directory in the background, and is consulted once the rebuild completes.
+    This property should be set immediately after the receiver is initialized.
+    It has no effect when the `storageMode` is
+    `MBFilesystemCacheStorageModeSegmented`, since the segment store already
+    answers such lookups from memory. Defaults to `NO`. */
+@property(nonatomic, assign) BOOL usesBloomFilter;
+
+/*! The proportion of lookups of keys absent from the filesystem cache for
+    which the Bloom filter failed to rule out the key, requiring the
+    filesystem to be consulted. Returns `0` if `usesBloomFilter` is `NO`. */
+@property(nonatomic, readonly) double bloomFilterFalsePositiveRate;
+
 /*----------------------------------------------------------------------------*/
 #pragma mark Checking for objects in the cache
 /*!    @name Checking for objects in the cache                                */
@@ -274,6 +495,138 @@ extern const NSTimeInterval kMBFilesystemCacheDefaultMaxAge;
  */
 - (nullable id) objectForKeyInMemoryCache:(nonnull id)key;
 
+/*!
+ Retrieves an object from the cache asynchronously, loading it from the
+ filesystem cache if necessary.
+
+ The memory cache is checked on the calling thread; if the object is found
+ there, `completion` is executed immediately, before this method returns.
+ Otherwise, reading the cache file and reconstituting the object from it are
+ performed by an operation on the receiver's `readQueue`, and `completion` is
+ executed on that queue once the load finishes. The calling thread is never
+ blocked on filesystem access.
+
+ As with `objectForKey:`, an object loaded from the filesystem is stored in
+ the memory cache if the delegate permits it, and concurrent loads of the same
+ key, whether made by this method, `objectForKey:` or `objectsForKeys:`, share
+ a single read of its cache file.
+
+ @param     key The cache key of the object to retrieve.
+
+ @param     completion A block to execute with the object associated with
+            `key`, or `nil` if it was in neither the memory cache nor the
+            filesystem cache.
+ */
+- (void) objectForKey:(nonnull id)key
+           completion:(nonnull void (^)(id __nullable cacheObj))completion;
+
+/*!
+ Retrieves the objects associated with the given keys, loading them from the
+ filesystem cache if necessary.
+
+ The memory cache is consulted for the entire batch first, with each of its
+ shards locked only once. The keys that miss the memory cache are then loaded
+ from the filesystem concurrently, by operations on the receiver's
+ `readQueue`, and this method returns once all of them have completed. As
+ with `objectForKey:`, objects loaded from the filesystem are stored in the
+ memory cache if the delegate permits it.
+
+ @param     keys The cache keys of the objects to retrieve. Each key must
+            conform to `NSCopying`.
+
+ @return    A dictionary mapping each key found in either the memory cache or
+            the filesystem cache to its object. Keys found in neither are
+            omitted.
+ */
+- (nonnull NSDictionary*) objectsForKeys:(nonnull NSArray*)keys;
+
+/*!
+ Retrieves the objects associated with the given keys asynchronously,
+ loading them from the filesystem cache if necessary.
+
+ The memory cache is checked on the calling thread; if every object is found
+ there, `completion` is executed immediately, before this method returns.
+ Otherwise, the remaining objects are loaded concurrently by operations on
+ the receiver's `readQueue`, and `completion` is executed on that queue once
+ all of them have completed.
+
+ @param     keys The cache keys of the objects to retrieve. Each key must
+            conform to `NSCopying`.
+
+ @param     completion A block to execute with a dictionary mapping each key
+            found in either the memory cache or the filesystem cache to its
+            object.
+ */
+- (void) objectsForKeys:(nonnull NSArray*)keys
+             completion:(nonnull void (^)(NSDictionary* __nonnull cacheObjs))completion;
+
+/*----------------------------------------------------------------------------*/
+#pragma mark Warming the memory cache
+/*!    @name Warming the memory cache                                         */
+/*----------------------------------------------------------------------------*/
+
+/*!
+ Loads the objects associated with the given keys from the filesystem cache
+ into the memory cache in the background.
+
+ This is intended to be called shortly after the receiver is created, so that
+ the memory cache holds the objects most likely to be needed before they are
+ requested. Objects are loaded a few at a time on the `readQueue`, at low
+ priority, so that preloading doesn't hold up other cache reads. Keys that are
+ already in the memory cache, or that have no cache file, are skipped; the
+ delegate is consulted as to whether each loaded object should be stored in
+ the memory cache.
+
+ @param     keys The cache keys of the objects to load.
+
+ @param     completion An optional block to execute once every key has been
+            processed. It receives the number of objects loaded into the
+            memory cache, and is executed on an arbitrary thread.
+ */
+- (void) preloadObjectsForKeys:(nonnull NSArray*)keys
+                    completion:(nullable void (^)(NSUInteger loadedCount))completion;
+
+/*!
+ Saves the hot set: the names of the cache files whose objects are currently
+ in the memory cache, up to `hotSetCountLimit` of them, most recently used
+ first when the memory cache is bounded. The hot set is saved alongside the
+ cache directory, and can be loaded by `preloadHotSetWithCompletion:` the
+ next time the cache is created.
+
+ This is called automatically if `hotSetSaveInterval` is set.
+
+ @param     errPtr If this method returns `NO` and this parameter is non-`nil`,
+            `*errPtr` will be updated to point to an `NSError` describing the
+            problem.
+
+ @return    `YES` if the hot set was saved; `NO` otherwise.
+ */
+- (BOOL) saveHotSet:(NSErrorPtrPtr)errPtr;
+
+/*!
+ Loads the objects in the most recently saved hot set from the filesystem
+ cache into the memory cache in the background, in the manner of
+ `preloadObjectsForKeys:completion:`.
+
+ Because the hot set records cache filenames rather than cache keys, the
+ delegate is not asked whether the loaded objects should be stored in the
+ memory cache; they were stored there when the hot set was saved.
+
+ @param     completion An optional block to execute once the hot set has been
+            loaded. It receives the number of objects loaded into the memory
+            cache, which is `0` if no hot set has been saved, and is executed
+            on an arbitrary thread.
+ */
+- (void) preloadHotSetWithCompletion:(nullable void (^)(NSUInteger loadedCount))completion;
+
+/*! The maximum number of cache files recorded in the hot set by `saveHotSet:`.
+    Defaults to `1000`. */
+@property(atomic, assign) NSUInteger hotSetCountLimit;
+
+/*! If greater than `0`, the hot set is saved by a background timer at this
+    interval, in seconds. Defaults to `0`. */
+@property(nonatomic, assign) NSTimeInterval hotSetSaveInterval;
+
 /*----------------------------------------------------------------------------*/
 #pragma mark Managing the filesystem cache
 /*!    @name Managing the filesystem cache                                    */
@@ -289,6 +642,12 @@ extern const NSTimeInterval kMBFilesystemCacheDefaultMaxAge;
 /*!
  Deletes all cache files older than a certain age.
 
+ The files are deleted by an `MBCachePruneOperation` executing in the
+ background, which is available from the `pruneOperation` property. If a
+ previous prune operation is still executing, this method does nothing. If
+ the previous operation was cancelled before it finished, the new operation
+ resumes where it left off.
+
  The memory cache is not affected by calls to this method.
  
  @param     ageInSeconds The maximum age allowed for cache files. Files older
@@ -304,4 +663,9 @@ extern const NSTimeInterval kMBFilesystemCacheDefaultMaxAge;
  */
 - (void) purgeOutOfDateCacheFiles;
 
+/*! Returns the operation created by the most recent call to
+    `purgeCacheFilesOlderThan:`, which can be used to monitor its progress,
+    or `nil` if there has been none. */
+@property(nullable, atomic, readonly) MBCachePruneOperation* pruneOperation;
+
 @end
@@ -6,6 +6,9 @@
 //  Copyright (c) 2011 Gilt Groupe. All rights reserved.
 //
 
+#import <stdatomic.h>
+#import <pthread.h>
+
 #import "MBAvailability.h"
 
 #if MB_BUILD_UIKIT
@@ -14,6 +17,10 @@
 
 #import "MBFilesystemCache.h"
 #import "MBCacheOperations.h"
+#import "MBCacheSegmentStore.h"
+#import "MBCacheFileIndex.h"
+#import "MBCacheBloomFilter.h"
+#import "MBCacheCodec.h"
 #import "NSString+MBMessageDigest.h"
 #import "MBThreadsafeCache+Subclassing.h"
 #import "MBModuleLogMacros.h"
@@ -26,8 +33,17 @@
 
 const NSTimeInterval kMBFilesystemCacheDefaultMaxAge    = 129600;       // 36 hours
 
-#define kFilesystemCacheStorageVersion                  0
+#define kFilesystemCacheStorageVersion                  1           // files begin with an MBCacheCodec header
 #define kFilesystemCacheBaseExtension                   @"cache"
+#define kFilesystemCacheIndexExtension                  @"index"
+#define kFilesystemCacheBloomFilterExtension            @"bloom"
+#define kFilesystemCacheBloomFilterCapacity             10000
+#define kFilesystemCacheBloomFilterRate                 0.01
+#define kFilesystemCacheBloomFilterSaveDelay            2.0         // seconds
+#define kFilesystemCacheSizeLowWaterFraction            0.9
+#define kFilesystemCacheHotSetExtension                 @"hotset"
+#define kFilesystemCacheHotSetDefaultCountLimit         1000
+#define kFilesystemCachePreloadConcurrency              4
 
 #define kCacheDelegateSelectorObjectFromCacheData       @selector(objectFromCacheData:)
 #define kCacheDelegateSelectorCacheDataFromObject       @selector(cacheDataFromObject:)
@@ -36,46 +52,110 @@ const NSTimeInterval kMBFilesystemCacheDefaultMaxAge    = 129600;       // 36 ho
 
 /******************************************************************************/
 #pragma mark -
-#pragma mark MBCachePruneOperation interface
+#pragma mark MBCacheFilenameMemo class
 /******************************************************************************/
 
-@interface MBCachePruneOperation : NSOperation
-#if MB_BUILD_UIKIT
+// remembers the cache filename most recently derived from a cache key on a
+// given thread, so that the several steps of a single get or set each don't
+// have to hash the key again. during a batch operation, it also holds the
+// filenames of every key in the batch
+@interface MBCacheFilenameMemo : NSObject
 {
-    UIBackgroundTaskIdentifier _taskID;
+@public
+    uint64_t _cacheID;
+    id _key;
+    NSString* _filename;
+    uint64_t _batchCacheID;
+    NSMapTable* _batchFilenames;        // key -> filename
 }
-#endif
+@end
 
-@property(nonnull, nonatomic, strong) NSString* cacheDir;
-@property(nonatomic, assign) NSTimeInterval maxAge;
+@implementation MBCacheFilenameMemo
+@end
 
-+ (nonnull MBCachePruneOperation*) operationForCacheDirectory:(nonnull NSString*)cacheDir
-                                                       maxAge:(NSTimeInterval)ageInSeconds;
+static pthread_key_t s_filenameMemoKey;
+static atomic_ullong s_nextFilenameMemoID = 1;
 
-@end
+static void MBReleaseFilenameMemo(void* memo)
+{
+    CFRelease(memo);
+}
+
+static MBCacheFilenameMemo* MBCurrentThreadFilenameMemo(void)
+{
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        pthread_key_create(&s_filenameMemoKey, MBReleaseFilenameMemo);
+    });
+
+    MBCacheFilenameMemo* memo = (__bridge MBCacheFilenameMemo*) pthread_getspecific(s_filenameMemoKey);
+    if (!memo) {
+        memo = [MBCacheFilenameMemo new];
+        pthread_setspecific(s_filenameMemoKey, CFBridgingRetain(memo));
+    }
+    return memo;
+}
 
 /******************************************************************************/
 #pragma mark -
 #pragma mark MBFilesystemCache class
 /******************************************************************************/
 
+@interface MBFilesystemCache ()
+// receives updates as soon as it exists, but is only
+// consulted once _bloomFilterReady has been set
+@property(nullable, atomic, strong) MBCacheBloomFilter* bloomFilter;
+@property(nullable, atomic, readwrite, strong) MBCachePruneOperation* pruneOperation;
+@end
+
 @implementation MBFilesystemCache
 {
     NSFileManager* _fm;
     NSString* _cacheDir;
+    NSString* _bloomFilterPath;
+    MBCacheSegmentStore* _segmentStore;     // nil unless storage is segmented
+    MBCacheFileIndex* _fileIndex;           // nil if storage is segmented
+    atomic_bool _bloomFilterReady;
+    atomic_bool _bloomFilterSaveScheduled;
+    atomic_ullong _maxSizeOfCacheFiles;
+    atomic_bool _evictionScheduled;
+    atomic_ullong _filenameMemoID;          // identifies our filename memo entries
+    NSString* _hotSetPath;
+    dispatch_source_t _hotSetSaveTimer;
 }
 
 /******************************************************************************/
 #pragma mark Object lifecycle
 /******************************************************************************/
 
-- (instancetype) initWithName:(NSString*)name cacheDelegate:(id)delegate
+- (instancetype) initWithName:(NSString*)name
+                cacheDelegate:(id)delegate
+                   shardCount:(NSUInteger)shards
+                  storageMode:(MBFilesystemCacheStorageMode)mode
+              concurrencyMode:(MBThreadsafeCacheConcurrencyMode)concurrency
 {
-    self = [super init];
+#if MB_BUILD_UIKIT
+    self = [super initWithConcurrencyMode:concurrency
+                               shardCount:shards
+                      exceptionProtection:NO
+                     ignoreMemoryWarnings:NO];
+#else
+    self = [super initWithConcurrencyMode:concurrency
+                               shardCount:shards
+                      exceptionProtection:NO];
+#endif
     if (self) {
         _cacheName = name;
         _fm = [NSFileManager new];
         _cacheDir = [self _directoryPathForCacheNamed:name];
+        _bloomFilterPath = [_cacheDir stringByAppendingPathExtension:kFilesystemCacheBloomFilterExtension];
+        _hotSetPath = [_cacheDir stringByAppendingPathExtension:kFilesystemCacheHotSetExtension];
+        _hotSetCountLimit = kFilesystemCacheHotSetDefaultCountLimit;
+        atomic_init(&_bloomFilterReady, false);
+        atomic_init(&_bloomFilterSaveScheduled, false);
+        atomic_init(&_maxSizeOfCacheFiles, 0);
+        atomic_init(&_evictionScheduled, false);
+        atomic_init(&_filenameMemoID, atomic_fetch_add(&s_nextFilenameMemoID, 1));
         MBLogDebug(@"%@ named %@ will use directory: %@", [self class], name, _cacheDir);
         _cacheDelegate = delegate;
         
@@ -83,15 +163,58 @@ const NSTimeInterval kMBFilesystemCacheDefaultMaxAge    = 129600;       // 36 ho
         
         _readQueue = [MBCacheReadQueue instance];
         _writeQueue = [MBCacheWriteQueue instance];
+
+        _storageMode = mode;
+        if (mode == MBFilesystemCacheStorageModeSegmented) {
+            _segmentStore = [[MBCacheSegmentStore alloc] initWithDirectory:_cacheDir];
+        }
+        else {
+            NSString* indexPath = [_cacheDir stringByAppendingPathExtension:kFilesystemCacheIndexExtension];
+            _fileIndex = [[MBCacheFileIndex alloc] initWithDirectory:_cacheDir indexFilePath:indexPath];
+        }
     }
     return self;
 }
 
+- (instancetype) initWithName:(NSString*)name
+                cacheDelegate:(id)delegate
+                   shardCount:(NSUInteger)shards
+                  storageMode:(MBFilesystemCacheStorageMode)mode
+{
+    return [self initWithName:name
+                cacheDelegate:delegate
+                   shardCount:shards
+                  storageMode:mode
+              concurrencyMode:MBThreadsafeCacheConcurrencyModeExclusive];
+}
+
+- (instancetype) initWithName:(NSString*)name
+                cacheDelegate:(id)delegate
+                   shardCount:(NSUInteger)shards
+{
+    return [self initWithName:name
+                cacheDelegate:delegate
+                   shardCount:shards
+                  storageMode:MBFilesystemCacheStorageModeFilePerKey];
+}
+
+- (instancetype) initWithName:(NSString*)name cacheDelegate:(id)delegate
+{
+    return [self initWithName:name cacheDelegate:delegate shardCount:1];
+}
+
 - (instancetype) initWithName:(NSString*)name
 {
     return [self initWithName:name cacheDelegate:self];
 }
 
+- (void) dealloc
+{
+    if (_hotSetSaveTimer) {
+        dispatch_source_cancel(_hotSetSaveTimer);
+    }
+}
+
 /******************************************************************************/
 #pragma mark Memory management
 /******************************************************************************/
@@ -115,8 +238,87 @@ const NSTimeInterval kMBFilesystemCacheDefaultMaxAge    = 129600;       // 36 ho
  
 - (nonnull NSString*) filenameForCacheKey:(nonnull id)key
 {
-    NSString* md5 = [[key description] MD5];
-    return [NSString stringWithFormat:@"%@.%@", md5, [self fileExtensionForCacheKey:key]];
+    NSString* desc = [key description];
+    NSString* hash = (_keyHash == MBFilesystemCacheKeyHashMurmur3 ? [desc Murmur3] : [desc MD5]);
+    return [hash stringByAppendingPathExtension:[self fileExtensionForCacheKey:key]];
+}
+
+/******************************************************************************/
+#pragma mark Cache filenames
+/******************************************************************************/
+
+- (void) setCacheDelegate:(id)cacheDelegate
+{
+    _cacheDelegate = cacheDelegate;
+
+    [self _forgetCacheFilenames];
+}
+
+- (void) setKeyHash:(MBFilesystemCacheKeyHash)keyHash
+{
+    _keyHash = keyHash;
+
+    [self _forgetCacheFilenames];
+}
+
+- (void) _forgetCacheFilenames
+{
+    // invalidates every thread's memo for this cache
+    atomic_store(&_filenameMemoID, atomic_fetch_add(&s_nextFilenameMemoID, 1));
+}
+
+- (NSString*) _cacheFilenameForKey:(id)key
+{
+    uint64_t cacheID = atomic_load_explicit(&_filenameMemoID, memory_order_relaxed);
+    MBCacheFilenameMemo* memo = MBCurrentThreadFilenameMemo();
+    if (memo->_cacheID == cacheID && (memo->_key == key || [memo->_key isEqual:key])) {
+        return memo->_filename;
+    }
+    if (memo->_batchFilenames && memo->_batchCacheID == cacheID) {
+        NSString* filename = [memo->_batchFilenames objectForKey:key];
+        if (filename) {
+            return filename;
+        }
+    }
+
+    NSString* filename = [_cacheDelegate filenameForCacheKey:key];
+
+    // the memo holds a copy of the key so that it can't be fooled
+    // by a mutable key that changes after its filename is derived
+    memo->_cacheID = cacheID;
+    memo->_key = ([key conformsToProtocol:@protocol(NSCopying)] ? [key copy] : key);
+    memo->_filename = filename;
+    return filename;
+}
+
+// derives the filename of each key once, and makes them available to
+// _cacheFilenameForKey: on the calling thread while the block executes
+- (void) _performBatchForKeys:(NSArray*)keys usingBlock:(void (^)(NSArray* cacheFiles))block
+{
+    uint64_t cacheID = atomic_load_explicit(&_filenameMemoID, memory_order_relaxed);
+    NSMutableArray* cacheFiles = [NSMutableArray arrayWithCapacity:keys.count];
+    NSMapTable* batch = [NSMapTable strongToStrongObjectsMapTable];
+    for (id key in keys) {
+        NSString* filename = [batch objectForKey:key];
+        if (!filename) {
+            filename = [_cacheDelegate filenameForCacheKey:key];
+            [batch setObject:filename forKey:key];
+        }
+        [cacheFiles addObject:filename];
+    }
+
+    MBCacheFilenameMemo* memo = MBCurrentThreadFilenameMemo();
+    uint64_t outerCacheID = memo->_batchCacheID;
+    NSMapTable* outerBatch = memo->_batchFilenames;
+    memo->_batchCacheID = cacheID;
+    memo->_batchFilenames = batch;
+    @try {
+        block(cacheFiles);
+    }
+    @finally {
+        memo->_batchCacheID = outerCacheID;
+        memo->_batchFilenames = outerBatch;
+    }
 }
 
 /******************************************************************************/
@@ -155,12 +357,17 @@ const NSTimeInterval kMBFilesystemCacheDefaultMaxAge    = 129600;       // 36 ho
 
 - (NSString*) fileExtensionForCacheKey:(id)key
 {
-    return [NSString stringWithFormat:@"%@%u", kFilesystemCacheBaseExtension, kFilesystemCacheStorageVersion];
+    static NSString* s_extension = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        s_extension = [NSString stringWithFormat:@"%@%u", kFilesystemCacheBaseExtension, kFilesystemCacheStorageVersion];
+    });
+    return s_extension;
 }
 
 - (NSString*) filePathForCacheKey:(id)key
 {
-    NSString* filename = [_cacheDelegate filenameForCacheKey:key];
+    NSString* filename = [self _cacheFilenameForKey:key];
     return [self _pathForCacheFilename:filename];
 }
 
@@ -169,14 +376,423 @@ const NSTimeInterval kMBFilesystemCacheDefaultMaxAge    = 129600;       // 36 ho
     MBLogDebugTrace();
     
     NSError* err = nil;
-    NSData* fileData = [NSData dataWithContentsOfFile:path options:NSDataReadingMapped error:&err];
+    NSData* fileData = [self cacheDataFromFile:path error:&err];
     if (!fileData) {
         MBLogError(@"%@ error while trying to load the cache file at %@: %@", [self class], path, [err localizedDescription]);
         return nil;
     }
-    
+
+    // an expired file is rejected without decoding its payload
+    MBCacheFileAttributes attrs;
+    if ([MBCacheCodec getAttributes:&attrs ofData:fileData]
+        && attrs.expiresAt > 0
+        && attrs.expiresAt <= [NSDate timeIntervalSinceReferenceDate])
+    {
+        MBLogDebug(@"%@ ignoring expired cache file at %@", [self class], path);
+        return nil;
+    }
+
+    NSData* cacheData = [self decodedCacheData:fileData error:&err];
+    if (!cacheData) {
+        MBLogError(@"%@ error while trying to decode the cache file at %@: %@", [self class], path, [err localizedDescription]);
+        return nil;
+    }
+
     // we got our file data; use it to reconstitute our object
-    return [self objectFromCacheData:fileData];
+    return [self objectFromCacheData:cacheData];
+}
+
+/******************************************************************************/
+#pragma mark Encoding cache files
+/******************************************************************************/
+
+- (NSData*) encodedCacheData:(NSData*)data
+{
+    NSTimeInterval maxAge = _maxAgeOfCacheFiles;
+    NSTimeInterval expiresAt = (maxAge > 0 ? [NSDate timeIntervalSinceReferenceDate] + maxAge : 0);
+    return [MBCacheCodec encodeData:data usingCompression:self.compression expiresAt:expiresAt];
+}
+
+- (NSData*) decodedCacheData:(NSData*)data error:(NSErrorPtrPtr)errPtr
+{
+    return [MBCacheCodec decodeData:data error:errPtr];
+}
+
+/******************************************************************************/
+#pragma mark Cache file storage
+/******************************************************************************/
+
+- (NSData*) cacheDataFromFile:(NSString*)path error:(NSErrorPtrPtr)errPtr
+{
+    if (_segmentStore) {
+        NSData* data = [_segmentStore dataForName:[path lastPathComponent] error:errPtr];
+        if (data) {
+            [self incrementCounter:MBCacheCounterBytesRead by:data.length forKey:[path lastPathComponent]];
+        }
+        else if (errPtr && !*errPtr) {
+            *errPtr = [NSError mockingbirdErrorWithCode:kMBErrorCouldNotLoadFile];
+        }
+        return data;
+    }
+
+    NSError* err = nil;
+    NSData* data = [NSData dataWithContentsOfFile:path options:NSDataReadingMapped error:&err];
+    if (data) {
+        [_fileIndex noteAccessToFileNamed:[path lastPathComponent]];
+        [self incrementCounter:MBCacheCounterBytesRead by:data.length forKey:[path lastPathComponent]];
+    }
+    else if ([err.domain isEqualToString:NSCocoaErrorDomain] && err.code == NSFileReadNoSuchFileError) {
+        // the file was deleted behind our back; keep the index honest
+        [_fileIndex removeFileNamed:[path lastPathComponent]];
+    }
+    if (errPtr) {
+        *errPtr = err;
+    }
+    return data;
+}
+
+- (BOOL) writeCacheData:(NSData*)data toFile:(NSString*)path error:(NSErrorPtrPtr)errPtr
+{
+    NSString* cacheFile = [path lastPathComponent];
+    if (_segmentStore) {
+        if (![_segmentStore writeData:data forName:cacheFile error:errPtr]) {
+            return NO;
+        }
+        [self incrementCounter:MBCacheCounterBytesWritten by:data.length forKey:cacheFile];
+
+        [self _evictCacheFilesIfOverSizeLimit];
+        return YES;
+    }
+
+    NSDataWritingOptions options = NSDataWritingAtomic;
+#if TARGET_OS_IPHONE
+    options |= NSDataWritingFileProtectionNone;
+#endif
+    if (![data writeToFile:path options:options error:errPtr]) {
+        return NO;
+    }
+    [self incrementCounter:MBCacheCounterBytesWritten by:data.length forKey:cacheFile];
+
+    MBCacheBloomFilter* filter = self.bloomFilter;
+    if (filter && !(_fileIndex.isLoaded && [_fileIndex infoForFileNamed:cacheFile])) {
+        // overwriting a file we know about doesn't add a name
+        [filter addName:cacheFile];
+        [self _bloomFilterChanged];
+    }
+    [_fileIndex recordFileNamed:cacheFile
+                           size:data.length
+                     modifiedAt:[NSDate timeIntervalSinceReferenceDate]];
+
+    [self _evictCacheFilesIfOverSizeLimit];
+    return YES;
+}
+
+- (BOOL) cacheFileExistsAtPath:(NSString*)path
+{
+    if (_segmentStore) {
+        return [_segmentStore containsDataForName:[path lastPathComponent]];
+    }
+    if (_fileIndex.isLoaded) {
+        return ([_fileIndex infoForFileNamed:[path lastPathComponent]] != nil);
+    }
+    return [_fm isReadableFileAtPath:path];
+}
+
+- (NSDate*) modificationDateOfCacheFileAtPath:(NSString*)path
+{
+    if (_segmentStore) {
+        return [_segmentStore writeDateForName:[path lastPathComponent]];
+    }
+    if (_fileIndex.isLoaded) {
+        MBCacheFileInfo* info = [_fileIndex infoForFileNamed:[path lastPathComponent]];
+        return (info ? [NSDate dateWithTimeIntervalSinceReferenceDate:info->_modifiedAt] : nil);
+    }
+
+    // reading the header is cheaper than asking for the file's attributes
+    MBCacheFileAttributes attrs;
+    if ([MBCacheCodec getAttributes:&attrs ofFileAtPath:path]) {
+        return [NSDate dateWithTimeIntervalSinceReferenceDate:attrs.createdAt];
+    }
+
+    NSError* err = nil;
+    NSDictionary* fileAttr = [_fm attributesOfItemAtPath:path error:&err];
+    if (!fileAttr) {
+        MBLogError(@"%@ error while trying to determine attributes of cache file at %@: %@", [self class], path, [err localizedDescription]);
+        return nil;
+    }
+    return [fileAttr fileModificationDate];
+}
+
+- (void) removeCacheFileAtPath:(NSString*)path
+{
+    if (_segmentStore) {
+        [_segmentStore removeDataForName:[path lastPathComponent]];
+    }
+    else if ([self cacheFileExistsAtPath:path]) {
+        [_fileIndex removeFileNamed:[path lastPathComponent]];
+
+        MBCacheBloomFilter* filter = self.bloomFilter;
+        if (filter) {
+            [filter removeName:[path lastPathComponent]];
+            [self _bloomFilterChanged];
+        }
+
+        MBFileDeleteOperation* op = [MBFileDeleteOperation operationForDeletingFile:path];
+
+        [[MBFilesystemOperationQueue instance] addOperation:op];
+    }
+}
+
+/******************************************************************************/
+#pragma mark Size limit
+/******************************************************************************/
+
+- (unsigned long long) maxSizeOfCacheFiles
+{
+    return atomic_load(&_maxSizeOfCacheFiles);
+}
+
+- (void) setMaxSizeOfCacheFiles:(unsigned long long)size
+{
+    atomic_store(&_maxSizeOfCacheFiles, size);
+
+    [self _evictCacheFilesIfOverSizeLimit];
+}
+
+- (unsigned long long) sizeOfCacheFiles
+{
+    if (_segmentStore) {
+        return _segmentStore.liveSize;
+    }
+    return (_fileIndex.isLoaded ? _fileIndex.totalSize : 0);
+}
+
+- (void) _evictCacheFilesIfOverSizeLimit
+{
+    // the segment store and the index track the total as data comes and
+    // goes, so this check costs no filesystem access
+    unsigned long long limit = atomic_load(&_maxSizeOfCacheFiles);
+    if (!limit) {
+        return;
+    }
+    if (_fileIndex && !_fileIndex.isLoaded) {
+        // the total isn't known until the index has loaded; check again then
+        if (!atomic_exchange(&_evictionScheduled, true)) {
+            __weak MBFilesystemCache* weakSelf = self;
+            [_fileIndex performBlockWhenLoaded:^{
+                MBFilesystemCache* strongSelf = weakSelf;
+                if (strongSelf) {
+                    atomic_store(&strongSelf->_evictionScheduled, false);
+                    [strongSelf _evictCacheFilesIfOverSizeLimit];
+                }
+            }];
+        }
+        return;
+    }
+    if (self.sizeOfCacheFiles <= limit) {
+        return;
+    }
+    if (atomic_exchange(&_evictionScheduled, true)) {
+        return;     // already scheduled
+    }
+
+    __weak MBFilesystemCache* weakSelf = self;
+    [[MBFilesystemOperationQueue instance] addOperationWithBlock:^{
+        MBFilesystemCache* strongSelf = weakSelf;
+        if (strongSelf) {
+            atomic_store(&strongSelf->_evictionScheduled, false);
+            [strongSelf _evictLeastRecentlyAccessedCacheFiles];
+        }
+    }];
+}
+
+// executes on the MBFilesystemOperationQueue
+- (void) _evictLeastRecentlyAccessedCacheFiles
+{
+    unsigned long long limit = atomic_load(&_maxSizeOfCacheFiles);
+    unsigned long long size = self.sizeOfCacheFiles;
+    if (!limit || size <= limit) {
+        return;
+    }
+
+    // evicting down to a low-water mark keeps us from
+    // having to evict again on the very next write
+    unsigned long long target = (unsigned long long)(limit * kFilesystemCacheSizeLowWaterFraction);
+
+    if (_segmentStore) {
+        // the segment store doesn't track reads, so the data
+        // written longest ago goes first
+        NSArray* names = [_segmentStore namesOfOldestDataTotaling:(size - target)];
+        for (NSString* name in names) {
+            [_segmentStore removeDataForName:name];
+        }
+
+        MBLogDebug(@"%@ evicted %lu cache records to stay within %llu bytes", [self class], (unsigned long)names.count, limit);
+        return;
+    }
+
+    NSArray* cacheFiles = [_fileIndex leastRecentlyAccessedFileNamesTotaling:(size - target)];
+
+    MBCacheBloomFilter* filter = self.bloomFilter;
+    NSFileManager* fm = [NSFileManager new];
+    for (NSString* cacheFile in cacheFiles) {
+        @autoreleasepool {
+            [_fileIndex removeFileNamed:cacheFile];
+            [filter removeName:cacheFile];
+
+            NSError* err = nil;
+            NSString* path = [self _pathForCacheFilename:cacheFile];
+            if (![fm removeItemAtPath:path error:&err] && !([err.domain isEqualToString:NSCocoaErrorDomain] && err.code == NSFileNoSuchFileError)) {
+                MBLogError(@"%@ error while evicting cache file at %@: %@", [self class], path, [err localizedDescription]);
+            }
+        }
+    }
+    if (filter && cacheFiles.count) {
+        [self _bloomFilterChanged];
+    }
+
+    MBLogDebug(@"%@ evicted %lu cache files to stay within %llu bytes", [self class], (unsigned long)cacheFiles.count, limit);
+}
+
+/******************************************************************************/
+#pragma mark Bloom filter
+/******************************************************************************/
+
+- (void) setUsesBloomFilter:(BOOL)usesBloomFilter
+{
+    if (usesBloomFilter == _usesBloomFilter) {
+        return;
+    }
+    _usesBloomFilter = usesBloomFilter;
+
+    atomic_store(&_bloomFilterReady, false);
+    self.bloomFilter = nil;
+
+    if (usesBloomFilter && !_segmentStore) {
+        [self _loadBloomFilter];
+    }
+}
+
+- (double) bloomFilterFalsePositiveRate
+{
+    return [self.bloomFilter observedFalsePositiveRate];
+}
+
+- (void) _loadBloomFilter
+{
+    NSDictionary* dirAttrs = [_fm attributesOfItemAtPath:_cacheDir error:nil];
+    if (!dirAttrs) {
+        // no cache directory means no cache files
+        self.bloomFilter = [[MBCacheBloomFilter alloc] initWithCapacity:kFilesystemCacheBloomFilterCapacity
+                                                      falsePositiveRate:kFilesystemCacheBloomFilterRate];
+        atomic_store(&_bloomFilterReady, true);
+        return;
+    }
+
+    // the saved filter can only be trusted if the directory hasn't changed
+    // since it was saved; a one-second margin covers coarse timestamps
+    MBCacheBloomFilter* saved = [[MBCacheBloomFilter alloc] initWithContentsOfFile:_bloomFilterPath];
+    NSTimeInterval dirModifiedAt = [[dirAttrs fileModificationDate] timeIntervalSinceReferenceDate];
+    if (saved && dirModifiedAt < [saved.savedDate timeIntervalSinceReferenceDate] - 1.0) {
+        MBLogDebug(@"%@ loaded Bloom filter of %lu files from %@", [self class], (unsigned long)saved.count, _bloomFilterPath);
+        self.bloomFilter = saved;
+        atomic_store(&_bloomFilterReady, true);
+        return;
+    }
+
+    // rebuild in the background; until then, the new filter accepts the
+    // names of files as they're written, but isn't consulted for lookups.
+    // removals are ignored, since the name being removed may not have
+    // been added by the directory scan yet
+    NSUInteger capacity = MAX(kFilesystemCacheBloomFilterCapacity, saved.count * 2);
+    MBCacheBloomFilter* filter = [[MBCacheBloomFilter alloc] initWithCapacity:capacity
+                                                            falsePositiveRate:kFilesystemCacheBloomFilterRate];
+    filter.acceptsRemovals = NO;
+    self.bloomFilter = filter;
+
+    NSString* cacheDir = _cacheDir;
+    __weak MBFilesystemCache* weakSelf = self;
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
+        NSDirectoryEnumerator* dirEnum = [[NSFileManager new] enumeratorAtURL:[NSURL fileURLWithPath:cacheDir isDirectory:YES]
+                                                   includingPropertiesForKeys:@[]
+                                                                      options:(NSDirectoryEnumerationSkipsSubdirectoryDescendants | NSDirectoryEnumerationSkipsHiddenFiles)
+                                                                 errorHandler:nil];
+        for (NSURL* url in dirEnum) {
+            @autoreleasepool {
+                [filter addName:[url lastPathComponent]];
+            }
+        }
+        filter.acceptsRemovals = YES;
+
+        MBFilesystemCache* strongSelf = weakSelf;
+        if (strongSelf && strongSelf.bloomFilter == filter) {
+            MBLogDebug(@"%@ rebuilt Bloom filter of %lu files in %@", [strongSelf class], (unsigned long)filter.count, cacheDir);
+            atomic_store(&strongSelf->_bloomFilterReady, true);
+            [strongSelf _bloomFilterChanged];
+        }
+    });
+}
+
+- (void) _bloomFilterChanged
+{
+    if (atomic_exchange(&_bloomFilterSaveScheduled, true)) {
+        return;     // already scheduled
+    }
+
+    __weak MBFilesystemCache* weakSelf = self;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(kFilesystemCacheBloomFilterSaveDelay * NSEC_PER_SEC)),
+                   dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
+        MBFilesystemCache* strongSelf = weakSelf;
+        if (strongSelf) {
+            atomic_store(&strongSelf->_bloomFilterSaveScheduled, false);
+            [strongSelf _saveBloomFilter];
+        }
+    });
+}
+
+- (void) _saveBloomFilter
+{
+    // a filter that's still being rebuilt would be saved incomplete
+    MBCacheBloomFilter* filter = self.bloomFilter;
+    if (!filter || !atomic_load(&_bloomFilterReady) || !filter.hasChanges) {
+        return;
+    }
+
+    NSError* err = nil;
+    if (![filter writeToFile:_bloomFilterPath error:&err]) {
+        MBLogError(@"%@ error while trying to save the Bloom filter at %@: %@", [self class], _bloomFilterPath, [err localizedDescription]);
+    }
+    else {
+        MBLogDebug(@"%@ saved Bloom filter of %lu files (estimated false-positive rate: %g)", [self class], (unsigned long)filter.count, filter.estimatedFalsePositiveRate);
+    }
+}
+
+- (BOOL) _cacheFileExistsNamed:(NSString*)cacheFile
+{
+    // a definite miss costs neither path construction nor a filesystem probe
+    MBCacheBloomFilter* filter = (atomic_load(&_bloomFilterReady) ? self.bloomFilter : nil);
+    if (filter && ![filter mightContainName:cacheFile]) {
+        return NO;
+    }
+
+    BOOL exists = [self cacheFileExistsAtPath:[self _pathForCacheFilename:cacheFile]];
+    if (filter && !exists) {
+        [filter noteFalsePositive];
+    }
+    return exists;
+}
+
+- (void) cacheFilePrunedAtPath:(NSString*)path
+{
+    NSString* cacheFile = [path lastPathComponent];
+
+    [_fileIndex removeFileNamed:cacheFile];
+
+    MBCacheBloomFilter* filter = self.bloomFilter;
+    if (filter) {
+        [filter removeName:cacheFile];
+        [self _bloomFilterChanged];
+    }
 }
 
 /******************************************************************************/
@@ -218,7 +834,7 @@ const NSTimeInterval kMBFilesystemCacheDefaultMaxAge    = 129600;       // 36 ho
         // make sure we have a valid cache directory
         [self ensureCacheDirectory];
         
-        NSString* cacheFile = [_cacheDelegate filenameForCacheKey:key];
+        NSString* cacheFile = [self _cacheFilenameForKey:key];
         NSString* path = [self _pathForCacheFilename:cacheFile];
 
         MBCacheWriteOperation* op = [MBCacheWriteOperation operationForWritingObject:cacheObj
@@ -233,71 +849,159 @@ const NSTimeInterval kMBFilesystemCacheDefaultMaxAge    = 129600;       // 36 ho
 #pragma mark Primitive methods for subclass use
 /******************************************************************************/
 
+- (id) memoryCacheKeyForKey:(id)key
+{
+    // the memory cache is keyed by cache filename
+    return [self _cacheFilenameForKey:key];
+}
+
 - (BOOL) internalIsKeyInCache:(id)key
 {
-    NSString* cacheFile = [_cacheDelegate filenameForCacheKey:key];
+    NSString* cacheFile = [self _cacheFilenameForKey:key];
     return [super internalIsKeyInCache:cacheFile];
 }
 
 - (id) internalObjectForKey:(id)key
 {
-    NSString* cacheFile = [_cacheDelegate filenameForCacheKey:key];
-
-    id obj = [super internalObjectForKey:cacheFile];
-    if (obj) {
-        // fetched from memory cache
-        return obj;
-    }
-    
-    // not in memory cache; try to load from filesystem
-    NSString* path = [self _pathForCacheFilename:cacheFile];
-    id cacheObj = [self objectFromCacheFile:path];
-    if (cacheObj) {
-        [self storeObjectInMemoryCacheIfAppropriate:cacheObj forKey:key];
-    }
-    return cacheObj;
+    // only the memory cache is consulted here, since this is called with the
+    // shard locked; filesystem loads happen in objectForKey: without a lock
+    NSString* cacheFile = [self _cacheFilenameForKey:key];
+    return [super internalObjectForKey:cacheFile];
 }
 
 - (void) internalSetObject:(id)obj forKey:(id)key
 {
-    [self storeObjectInMemoryCacheIfAppropriate:obj forKey:key];
+    // we're called with the shard locked, so rather than going through
+    // objectLoaded:forKey:, which locks it, store into memory directly
+    if ([self shouldStoreObjectInMemoryCache:obj forKey:key]) {
+        NSString* cacheFile = [self _cacheFilenameForKey:key];
+        if (cacheFile) {
+            [super internalSetObject:obj forMemoryCacheKey:cacheFile originalKey:key];
+        }
+    }
 
     [self storeObjectInFilesystemCacheIfAppropriate:obj forKey:key];
 }
 
 - (void) internalRemoveObjectForKey:(id)key
 {
-    NSString* cacheFile = [_cacheDelegate filenameForCacheKey:key];
+    NSString* cacheFile = [self _cacheFilenameForKey:key];
 
     // remove from memory cache
     [super internalRemoveObjectForKey:cacheFile];
     
-    // if the cache entry has an associated file...
-    NSString* path = [self _pathForCacheFilename:cacheFile];
-    if ([_fm isReadableFileAtPath:path]) {
-        // ...then remove the file
-        MBFileDeleteOperation* op = [MBFileDeleteOperation operationForDeletingFile:path];
-
-        [[MBFilesystemOperationQueue instance] addOperation:op];
-    }
+    // remove the associated file, if there is one
+    [self removeCacheFileAtPath:[self _pathForCacheFilename:cacheFile]];
 }
 
 - (void) objectLoaded:(id)cacheObj forKey:(id)key
 {
     MBLogDebugTrace();
 
-    NSString* cacheFile = [_cacheDelegate filenameForCacheKey:key];
+    NSString* cacheFile = [self _cacheFilenameForKey:key];
 
     if (cacheFile) {
-        [self lock];
-        [self internalCache][cacheFile] = cacheObj;
-        [self unlock];
+        // the memory cache is keyed by filename; we message super so the
+        // object goes straight into memory (along with any count/cost
+        // bookkeeping) without being written back to the filesystem
+        [self lockShardForKey:cacheFile];
+        [super internalSetObject:cacheObj forMemoryCacheKey:cacheFile originalKey:key];
+        [self unlockShardForKey:cacheFile];
     }
     else {
         MBLogError(@"%@ couldn't create cache filename for key: %@", [self class], key);
     }
 }
 
+- (id) _objectLoadedIfAbsent:(id)cacheObj forKey:(id)key cacheFile:(NSString*)cacheFile
+{
+    // re-validate the miss now that the filesystem read has completed; if
+    // the key was stored while we were reading, the stored value is newer
+    // than what's on disk, so it wins. the probe only needs the read lock;
+    // the check is repeated under the exclusive lock before inserting
+    [self lockShardForReadingForKey:cacheFile];
+    id obj = [super internalObjectForKey:cacheFile];
+    [self unlockShardForReadingForKey:cacheFile];
+    if (obj) {
+        return obj;
+    }
+
+    [self lockShardForKey:cacheFile];
+    obj = [super internalObjectForKey:cacheFile];
+    if (!obj) {
+        [super internalSetObject:cacheObj forMemoryCacheKey:cacheFile originalKey:key];
+        obj = cacheObj;
+    }
+    [self unlockShardForKey:cacheFile];
+    return obj;
+}
+
+- (id) _objectFromFilesystemForKey:(id)key
+{
+    return [self _objectFromFilesystemForKey:key cacheFile:[self _cacheFilenameForKey:key]];
+}
+
+- (id) _objectFromFilesystemForKey:(id)key cacheFile:(NSString*)cacheFile
+{
+    if (!cacheFile) {
+        return nil;
+    }
+
+    // concurrent misses on the same file share a single read & decode; the
+    // memory cache is re-checked first, in case the key was stored or loaded
+    // since the caller's miss
+    return [self objectForMemoryCacheKey:cacheFile
+                          coalescingLoad:^id(NSErrorPtrPtr errPtr) {
+                              return [self _loadObjectFromFilesystemForKey:key cacheFile:cacheFile];
+                          }
+                                   error:nil];
+}
+
+- (id) _loadObjectFromFilesystemForKey:(id)key cacheFile:(NSString*)cacheFile
+{
+    if (![self _cacheFileExistsNamed:cacheFile]) {
+        return nil;
+    }
+
+    // no cache lock is held while reading & decoding the file
+    uint64_t start = [self beginMeasuringLatency];
+    id cacheObj = [self objectFromCacheFile:[self _pathForCacheFilename:cacheFile]];
+    [self endMeasuringLatency:MBCacheLatencyLoad startedAt:start forKey:cacheFile];
+    if (!cacheObj) {
+        return nil;
+    }
+
+    [self incrementCounter:MBCacheCounterDiskHits by:1 forKey:cacheFile];
+    if ([self shouldStoreObjectInMemoryCache:cacheObj forKey:key]) {
+        cacheObj = [self _objectLoadedIfAbsent:cacheObj forKey:key cacheFile:cacheFile];
+    }
+    return cacheObj;
+}
+
+- (void) internalObjectEvicted:(id)cacheObj forKey:(id)cacheFile
+{
+    if (!_demotesEvictedObjects) {
+        return;
+    }
+
+    // the filesystem is checked on the write queue rather than here,
+    // since we're called with the memory cache shard locked
+    NSString* path = [self _pathForCacheFilename:cacheFile];
+    NSOperationQueue* writeQueue = _writeQueue;
+    __weak MBFilesystemCache* weakSelf = self;
+    [writeQueue addOperationWithBlock:^{
+        MBFilesystemCache* strongSelf = weakSelf;
+        if (strongSelf && ![strongSelf cacheFileExistsAtPath:path]) {
+            MBLogDebug(@"%@ demoting evicted object to file: %@", [strongSelf class], path);
+
+            [strongSelf ensureCacheDirectory];
+            [writeQueue addOperation:[MBCacheWriteOperation operationForWritingObject:cacheObj
+                                                                               toFile:path
+                                                                             forCache:strongSelf]];
+        }
+    }];
+}
+
 /******************************************************************************/
 #pragma mark Converting cache objects to/from NSData
 /******************************************************************************/
@@ -336,6 +1040,19 @@ const NSTimeInterval kMBFilesystemCacheDefaultMaxAge    = 129600;       // 36 ho
 - (void) clearFilesystemCache
 {
     MBLogDebugTrace();
+
+    if (_segmentStore) {
+        [_segmentStore removeAllData];
+        return;
+    }
+
+    [_fileIndex removeAllFiles];
+
+    MBCacheBloomFilter* filter = self.bloomFilter;
+    if (filter) {
+        [filter removeAllNames];
+        [self _bloomFilterChanged];
+    }
     
     MBFileDeleteOperation* op = [MBFileDeleteOperation operationForDeletingFile:_cacheDir];
     
@@ -346,8 +1063,32 @@ const NSTimeInterval kMBFilesystemCacheDefaultMaxAge    = 129600;       // 36 ho
 {
     MBLogDebugTrace();
 
+    if (_segmentStore) {
+        MBCacheSegmentStore* store = _segmentStore;
+        NSDate* cutoff = [NSDate dateWithTimeIntervalSinceNow:-ageInSeconds];
+        [[MBFilesystemOperationQueue instance] addOperationWithBlock:^{
+            [store removeDataWrittenBefore:cutoff];
+        }];
+        return;
+    }
+
     MBCachePruneOperation* op = [MBCachePruneOperation operationForCacheDirectory:_cacheDir
                                                                            maxAge:ageInSeconds];
+    op.cache = self;
+
+    @synchronized (self) {
+        MBCachePruneOperation* previous = self.pruneOperation;
+        if (previous && !previous.isFinished) {
+            MBLogDebug(@"%@ is already pruning %@", [self class], _cacheDir);
+            return;
+        }
+
+        // pick up where a cancelled prune left off
+        if (previous.isCancelled) {
+            op.resumeAfterFilename = previous.resumeFilename;
+        }
+        self.pruneOperation = op;
+    }
 
     [[MBFilesystemOperationQueue instance] addOperation:op];
 }
@@ -365,13 +1106,12 @@ const NSTimeInterval kMBFilesystemCacheDefaultMaxAge    = 129600;       // 36 ho
 {
     MBLogDebugTrace();
 
-    NSString* cacheFile = [_cacheDelegate filenameForCacheKey:key];
-    if ([super isKeyInCache:cacheFile]) {
+    if ([super isKeyInCache:key]) {
         return YES;
     }
     
-    NSString* path = [self _pathForCacheFilename:cacheFile];
-    return [_fm isReadableFileAtPath:path];
+    NSString* cacheFile = [self _cacheFilenameForKey:key];
+    return [self _cacheFileExistsNamed:cacheFile];
 }
 
 - (BOOL) isKeyInFilesystemCache:(id)key
@@ -379,40 +1119,32 @@ const NSTimeInterval kMBFilesystemCacheDefaultMaxAge    = 129600;       // 36 ho
     MBLogDebugTrace();
     
     // first, check to see if there's a file
-    NSString* cacheFile = [_cacheDelegate filenameForCacheKey:key];
-    NSString* path = [self _pathForCacheFilename:cacheFile];
-    if (![_fm isReadableFileAtPath:path]) {
+    NSString* cacheFile = [self _cacheFilenameForKey:key];
+    if (![self _cacheFileExistsNamed:cacheFile]) {
         return NO;
     }
     
     // there is a file, make sure it's recent enough
-    NSError* err = nil;
-    NSDictionary* fileAttr = [_fm attributesOfItemAtPath:path error:&err];
-    if (!fileAttr) {
-        MBLogError(@"%@ error while trying to determine attributes of cache file at %@: %@", [self class], path, [err localizedDescription]);
-        return NO;  // couldn't get attributes; act as though file doesn't exist
-    }
-    else {
-        NSDate* modDate = [fileAttr fileModificationDate];
-        if (modDate) {
-            MBLogDebug(@"Mod date of file %@: %@", path, modDate);
-            
-            NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
-            NSTimeInterval fileWrittenAt = [modDate timeIntervalSinceReferenceDate];
-            if ((fileWrittenAt + _maxAgeOfCacheFiles) > now) {
-                MBLogDebug(@"Cache file %@ is recent enough to use", path);
-                return YES; // we have a file, and it is recent enough to use
-            }
-            else {
-                MBLogDebug(@"Cache file %@ is TOO OLD to use (it is %g seconds old)", path, (now - fileWrittenAt));
-                return NO;  // file too old; pretend it doesn't exist
-            }
+    NSString* path = [self _pathForCacheFilename:cacheFile];
+    NSDate* modDate = [self modificationDateOfCacheFileAtPath:path];
+    if (modDate) {
+        MBLogDebug(@"Mod date of file %@: %@", path, modDate);
+        
+        NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+        NSTimeInterval fileWrittenAt = [modDate timeIntervalSinceReferenceDate];
+        if ((fileWrittenAt + _maxAgeOfCacheFiles) > now) {
+            MBLogDebug(@"Cache file %@ is recent enough to use", path);
+            return YES; // we have a file, and it is recent enough to use
         }
         else {
-            MBLogError(@"%@ couldn't determine modification date of file: %@", [self class], path);
-            return NO;  // coudn't determine mod date; pretend file doesn't exist
+            MBLogDebug(@"Cache file %@ is TOO OLD to use (it is %g seconds old)", path, (now - fileWrittenAt));
+            return NO;  // file too old; pretend it doesn't exist
         }
     }
+    else {
+        MBLogError(@"%@ couldn't determine modification date of file: %@", [self class], path);
+        return NO;  // coudn't determine mod date; pretend file doesn't exist
+    }
 }
 
 - (BOOL) isKeyInMemoryCache:(id)key
@@ -426,131 +1158,334 @@ const NSTimeInterval kMBFilesystemCacheDefaultMaxAge    = 129600;       // 36 ho
 #pragma mark Public API - Accessing cache contents
 /******************************************************************************/
 
+- (id) objectForKey:(id)key
+{
+    MBLogDebugTrace();
+
+    // the shard lock is held only while probing the memory cache (and, after
+    // a successful filesystem load, while inserting into it) so that a slow
+    // file read never stalls other users of the cache
+    id obj = [self objectForKeyInMemoryCache:key];
+    if (obj) {
+        return obj;
+    }
+    return [self _objectFromFilesystemForKey:key];
+}
+
 - (id) objectForKeyInMemoryCache:(id)key
 {
     MBLogDebugTrace();
     
-    [self lock];
-    id obj = [self internalCache][key];
-    [self unlock];
+    NSString* cacheFile = [self _cacheFilenameForKey:key];
+    id obj = nil;
+    if ([self lookUpObject:&obj inSnapshotForMemoryCacheKey:cacheFile]) {
+        return obj;
+    }
+
+    [self lockShardForReadingForKey:cacheFile];
+    obj = [super internalObjectForKey:cacheFile];
+    [self recordLookupOfKey:cacheFile hit:(obj != nil)];
+    [self unlockShardForReadingForKey:cacheFile];
     return obj;
 }
 
-@end
+- (void) objectForKey:(id)key completion:(void (^)(id cacheObj))completion
+{
+    MBLogDebugTrace();
 
-/******************************************************************************/
-#pragma mark -
-#pragma mark MBCachePruneOperation class
-/******************************************************************************/
+    id obj = [self objectForKeyInMemoryCache:key];
+    if (obj) {
+        completion(obj);
+        return;
+    }
 
-@implementation MBCachePruneOperation
+    // memory cache miss; hand the disk load to the read queue so
+    // the calling thread doesn't wait on the filesystem
+    __weak MBFilesystemCache* weakSelf = self;
+    [_readQueue addOperationWithBlock:^{
+        MBFilesystemCache* strongSelf = weakSelf;
+        // this re-checks the memory cache, since another load
+        // may have completed while we were queued
+        completion([strongSelf _objectFromFilesystemForKey:key]);
+    }];
+}
 
 /******************************************************************************/
-#pragma mark Object lifecycle
+#pragma mark Public API - Batch access
 /******************************************************************************/
 
-+ (MBCachePruneOperation*) operationForCacheDirectory:(NSString*)cacheDir
-                                             maxAge:(NSTimeInterval)ageInSeconds
+// returns one operation per key, each of which loads its object from
+// the filesystem and adds it to the results
+- (NSArray*) _operationsForLoadingKeys:(NSArray*)keys
+                            cacheFiles:(NSArray*)cacheFiles
+                          intoResults:(NSMutableDictionary*)results
 {
-    MBCachePruneOperation* cpo = [self new];
-    cpo.cacheDir = cacheDir;
-    cpo.maxAge = ageInSeconds;
-    return cpo;
+    NSMutableArray* ops = [NSMutableArray arrayWithCapacity:keys.count];
+    __weak MBFilesystemCache* weakSelf = self;
+    [keys enumerateObjectsUsingBlock:^(id key, NSUInteger i, BOOL* stop) {
+        NSString* cacheFile = cacheFiles[i];
+        [ops addObject:[NSBlockOperation blockOperationWithBlock:^{
+            id cacheObj = [weakSelf _objectFromFilesystemForKey:key cacheFile:cacheFile];
+            if (cacheObj) {
+                @synchronized (results) {
+                    results[key] = cacheObj;
+                }
+            }
+        }]];
+    }];
+    return ops;
 }
 
-- (instancetype) init
+// probes the memory cache for every key, returning the objects found
+// and setting *missingKeys and *missingFiles to describe the rest
+- (NSDictionary*) _memoryCacheObjectsForKeys:(NSArray*)keys
+                                 missingKeys:(NSArray**)missingKeys
+                                missingFiles:(NSArray**)missingFiles
 {
-    self = [super init];
-#if MB_BUILD_UIKIT
-    if (self) {
-        _taskID = UIBackgroundTaskInvalid;
+    __block NSDictionary* found = nil;
+    NSMutableArray* keysToLoad = [NSMutableArray array];
+    NSMutableArray* filesToLoad = [NSMutableArray array];
+    [self _performBatchForKeys:keys usingBlock:^(NSArray* cacheFiles) {
+        // messaging super consults only the memory cache
+        found = [super objectsForKeys:keys];
+
+        if (found.count < keys.count) {
+            [keys enumerateObjectsUsingBlock:^(id key, NSUInteger i, BOOL* stop) {
+                if (!found[key]) {
+                    [keysToLoad addObject:key];
+                    [filesToLoad addObject:cacheFiles[i]];
+                }
+            }];
+        }
+    }];
+    *missingKeys = keysToLoad;
+    *missingFiles = filesToLoad;
+    return found;
+}
+
+- (nonnull NSDictionary*) objectsForKeys:(nonnull NSArray*)keys
+{
+    MBLogDebugTrace();
+
+    NSArray* missingKeys = nil;
+    NSArray* missingFiles = nil;
+    NSDictionary* found = [self _memoryCacheObjectsForKeys:keys missingKeys:&missingKeys missingFiles:&missingFiles];
+    if (!missingKeys.count) {
+        return found;
     }
-#endif
-    return self;
+
+    // the filesystem loads are issued concurrently on the read queue; if
+    // we're already executing on it, they're performed inline instead, so
+    // that the queue can't end up waiting on itself
+    NSMutableDictionary* results = [found mutableCopy];
+    NSArray* ops = [self _operationsForLoadingKeys:missingKeys cacheFiles:missingFiles intoResults:results];
+    if ([NSOperationQueue currentQueue] == _readQueue) {
+        for (NSOperation* op in ops) {
+            [op start];
+        }
+    }
+    else {
+        [_readQueue addOperations:ops waitUntilFinished:YES];
+    }
+    return results;
+}
+
+- (void) objectsForKeys:(nonnull NSArray*)keys completion:(nonnull void (^)(NSDictionary* __nonnull cacheObjs))completion
+{
+    MBLogDebugTrace();
+
+    NSArray* missingKeys = nil;
+    NSArray* missingFiles = nil;
+    NSDictionary* found = [self _memoryCacheObjectsForKeys:keys missingKeys:&missingKeys missingFiles:&missingFiles];
+    if (!missingKeys.count) {
+        completion(found);
+        return;
+    }
+
+    NSMutableDictionary* results = [found mutableCopy];
+    NSArray* ops = [self _operationsForLoadingKeys:missingKeys cacheFiles:missingFiles intoResults:results];
+    NSOperation* done = [NSBlockOperation blockOperationWithBlock:^{
+        completion(results);
+    }];
+    for (NSOperation* op in ops) {
+        [done addDependency:op];
+    }
+    [_readQueue addOperations:ops waitUntilFinished:NO];
+    [_readQueue addOperation:done];
+}
+
+- (void) setObjectsAndKeys:(nonnull NSDictionary*)objectsAndKeys
+{
+    MBLogDebugTrace();
+
+    [self _performBatchForKeys:[objectsAndKeys allKeys] usingBlock:^(NSArray* cacheFiles) {
+        [super setObjectsAndKeys:objectsAndKeys];
+    }];
 }
 
 /******************************************************************************/
-#pragma mark Operation implementation
+#pragma mark Public API - Warming the memory cache
 /******************************************************************************/
 
-- (void) main
+- (BOOL) _isCacheFileInMemoryCache:(NSString*)cacheFile
 {
-    MBLogDebugTrace();
-    
-    @autoreleasepool {
-        @try {
-#if MB_BUILD_UIKIT
-            UIApplication* app = [UIApplication sharedApplication];
-            _taskID = [app beginBackgroundTaskWithExpirationHandler:^{
-                [app endBackgroundTask:_taskID];
-                _taskID = UIBackgroundTaskInvalid;
-            }];
-#endif
+    [self lockShardForReadingForKey:cacheFile];
+    BOOL inCache = [super internalIsKeyInCache:cacheFile];
+    [self unlockShardForReadingForKey:cacheFile];
+    return inCache;
+}
 
-            NSFileManager* fileMgr = [NSFileManager new];
-            dispatch_queue_t q = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
-            dispatch_async(q, ^{
-                NSError* err = nil;
-                NSArray* files = [fileMgr contentsOfDirectoryAtPath:_cacheDir error:&err];
-                if (err) {
-                    MBLogError(@"Error enumerating directory at path <%@>: %@ ", _cacheDir, err);
+// returns YES if the object was loaded into the memory cache; the key is
+// nil for hot set entries, which were in the memory cache before, so the
+// delegate isn't asked again whether they belong there
+- (BOOL) _preloadObjectForKey:(id)key cacheFile:(NSString*)cacheFile
+{
+    if ([self _isCacheFileInMemoryCache:cacheFile] || ![self _cacheFileExistsNamed:cacheFile]) {
+        return NO;
+    }
+
+    uint64_t start = [self beginMeasuringLatency];
+    id cacheObj = [self objectFromCacheFile:[self _pathForCacheFilename:cacheFile]];
+    [self endMeasuringLatency:MBCacheLatencyLoad startedAt:start forKey:cacheFile];
+    if (!cacheObj || (key && ![self shouldStoreObjectInMemoryCache:cacheObj forKey:key])) {
+        return NO;
+    }
+    [self _objectLoadedIfAbsent:cacheObj forKey:key cacheFile:cacheFile];
+    return YES;
+}
+
+// loads a few files at a time on the read queue, at low priority so that
+// warming up doesn't hold up foreground cache reads queued behind it; each
+// worker operation loads every nth file. keys is nil for a hot set
+- (void) _preloadCacheFiles:(NSArray*)cacheFiles
+                    forKeys:(NSArray*)keys
+                 completion:(void (^)(NSUInteger loadedCount))completion
+{
+    __block atomic_ulong loadedCount;
+    atomic_init(&loadedCount, 0);
+
+    NSUInteger fileCnt = cacheFiles.count;
+    NSUInteger workerCnt = MIN(fileCnt, (NSUInteger)kFilesystemCachePreloadConcurrency);
+    NSMutableArray* ops = [NSMutableArray arrayWithCapacity:workerCnt];
+    __weak MBFilesystemCache* weakSelf = self;
+    for (NSUInteger worker=0; worker<workerCnt; worker++) {
+        NSOperation* op = [NSBlockOperation blockOperationWithBlock:^{
+            for (NSUInteger i=worker; i<fileCnt; i+=workerCnt) {
+                MBFilesystemCache* strongSelf = weakSelf;
+                if (!strongSelf) {
                     return;
                 }
-                
-                NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
-                
-                NSUInteger i=0;
-                NSUInteger fileCnt = files.count;
-#if MB_BUILD_UIKIT
-                while (i < fileCnt && _taskID != UIBackgroundTaskInvalid) {
-#else
-                while (i < fileCnt) {
-#endif
-                    NSString* path = [_cacheDir stringByAppendingPathComponent:files[i]];
-                    
-                    NSDictionary* fileAttr = [fileMgr attributesOfItemAtPath:path error:&err];
-                    if (err) {
-                        MBLogError(@"%@ error while trying to determine attributes of cache file at %@: %@", [self class], path, [err localizedDescription]);
-                    }
-                    else {
-                        NSDate* modDate = [fileAttr fileModificationDate];
-                        if (modDate) {
-                            MBLogDebug(@"Mod date of file %@: %@", path, modDate);
-                            
-                            NSTimeInterval fileWrittenAt = [modDate timeIntervalSinceReferenceDate];
-                            if ((fileWrittenAt + _maxAge) > now) {
-                                MBLogDebug(@"Cache file %@ is recent enough to keep", path);
-                            }
-                            else {
-                                MBLogDebug(@"Cache file %@ is TOO OLD to keep (it is %g seconds old); deleting", path, (now - fileWrittenAt));
-                                
-                                [fileMgr removeItemAtPath:path error:&err];
-                                if (err) {
-                                    MBLogError(@"%@ error while deleting obsolete cache file at %@: %@", [self class], path, [err localizedDescription]);
-                                }
-                            }
-                        }
-                        else {
-                            MBLogError(@"%@ couldn't determine modification date of file: %@", [self class], path);
-                        }
-                    }
-                    
-                    i++;
+                id key = keys[i];       // nil if keys is nil
+                if ([strongSelf _preloadObjectForKey:key cacheFile:cacheFiles[i]]) {
+                    atomic_fetch_add_explicit(&loadedCount, 1, memory_order_relaxed);
                 }
-                
-#if MB_BUILD_UIKIT
-                if (_taskID != UIBackgroundTaskInvalid) {
-                    [app endBackgroundTask:_taskID];
+            }
+        }];
+        op.queuePriority = NSOperationQueuePriorityLow;
+        [ops addObject:op];
+    }
+
+    NSString* cacheName = _cacheName;
+    NSOperation* done = [NSBlockOperation blockOperationWithBlock:^{
+        NSUInteger loaded = atomic_load(&loadedCount);
+        MBLogDebug(@"%@ preloaded %lu of %lu cache files for %@", [MBFilesystemCache class], (unsigned long)loaded, (unsigned long)fileCnt, cacheName);
+        if (completion) {
+            completion(loaded);
+        }
+    }];
+    done.queuePriority = NSOperationQueuePriorityLow;
+    for (NSOperation* op in ops) {
+        [done addDependency:op];
+    }
+    [_readQueue addOperations:ops waitUntilFinished:NO];
+    [_readQueue addOperation:done];
+}
+
+- (void) preloadObjectsForKeys:(nonnull NSArray*)keys
+                    completion:(nullable void (^)(NSUInteger loadedCount))completion
+{
+    MBLogDebugTrace();
+
+    __block NSArray* cacheFiles = nil;
+    [self _performBatchForKeys:keys usingBlock:^(NSArray* batchFiles) {
+        cacheFiles = batchFiles;
+    }];
+    [self _preloadCacheFiles:cacheFiles forKeys:keys completion:completion];
+}
+
+- (BOOL) saveHotSet:(NSErrorPtrPtr)errPtr
+{
+    MBLogDebugTrace();
+
+    // the memory cache is keyed by cache filename
+    NSArray* cacheFiles = [self memoryCacheKeysWithLimit:self.hotSetCountLimit];
+    NSData* data = [NSPropertyListSerialization dataWithPropertyList:cacheFiles
+                                                              format:NSPropertyListBinaryFormat_v1_0
+                                                             options:0
+                                                               error:errPtr];
+    if (!data) {
+        return NO;
+    }
+    return [data writeToFile:_hotSetPath options:NSDataWritingAtomic error:errPtr];
+}
+
+- (void) preloadHotSetWithCompletion:(nullable void (^)(NSUInteger loadedCount))completion
+{
+    MBLogDebugTrace();
+
+    NSString* hotSetPath = _hotSetPath;
+    __weak MBFilesystemCache* weakSelf = self;
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
+        NSMutableArray* cacheFiles = [NSMutableArray array];
+        NSData* data = [NSData dataWithContentsOfFile:hotSetPath];
+        id plist = (data ? [NSPropertyListSerialization propertyListWithData:data options:0 format:NULL error:nil] : nil);
+        if ([plist isKindOfClass:[NSArray class]]) {
+            for (id cacheFile in plist) {
+                if ([cacheFile isKindOfClass:[NSString class]]) {
+                    [cacheFiles addObject:cacheFile];
                 }
-#endif
-            });
+            }
         }
-        @catch (NSException* ex) {
-            MBLogError(@"%@ caught %@: %@", [self class], [ex name], [ex reason]);
+
+        MBFilesystemCache* strongSelf = weakSelf;
+        if (strongSelf && cacheFiles.count) {
+            [strongSelf _preloadCacheFiles:cacheFiles forKeys:nil completion:completion];
         }
-    }
+        else if (completion) {
+            completion(0);
+        }
+    });
 }
 
+- (void) setHotSetSaveInterval:(NSTimeInterval)interval
+{
+    @synchronized (self) {
+        _hotSetSaveInterval = interval;
 
-@end
+        if (_hotSetSaveTimer) {
+            dispatch_source_cancel(_hotSetSaveTimer);
+            _hotSetSaveTimer = nil;
+        }
+
+        if (interval > 0) {
+            dispatch_queue_t q = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0);
+            dispatch_source_t timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, q);
+            uint64_t nanos = (uint64_t)(interval * NSEC_PER_SEC);
+            dispatch_source_set_timer(timer, dispatch_time(DISPATCH_TIME_NOW, nanos), nanos, nanos / 10);
 
+            __weak MBFilesystemCache* weakSelf = self;
+            dispatch_source_set_event_handler(timer, ^{
+                MBFilesystemCache* strongSelf = weakSelf;
+                NSError* err = nil;
+                if (strongSelf && ![strongSelf saveHotSet:&err]) {
+                    MBLogError(@"%@ error while trying to save the hot set at %@: %@", [strongSelf class], strongSelf->_hotSetPath, [err localizedDescription]);
+                }
+            });
+            dispatch_resume(timer);
+
+            _hotSetSaveTimer = timer;
+        }
+    }
+}
+
+@end
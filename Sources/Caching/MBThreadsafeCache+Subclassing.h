@@ -30,6 +30,10 @@
  Returns the internal `NSMutableDictionary` where in-memory cached objects are
  stored.
 
+ @warning   If the receiver has more than one shard, this method returns
+            the dictionary of the first shard only. Sharding-aware subclasses
+            should use `internalCacheForKey:` instead.
+
  @note      The cache is locked when this method is called by the
             `MBThreadsafeCache` superclass implementation; subclasses that call
             this method directly or perform mutations on the returned
@@ -37,6 +41,226 @@
  */
 - (nonnull NSMutableDictionary*) internalCache;
 
+/*!
+ Returns the internal `NSMutableDictionary` of the shard responsible for
+ storing the in-memory object associated with the given memory cache key.
+
+ When the receiver has only one shard, this returns the same dictionary as
+ `internalCache`.
+
+ @param     key The memory cache key, as returned by `memoryCacheKeyForKey:`.
+
+ @note      Subclasses that call this method directly or perform mutations on
+            the returned dictionary must only do so while holding the lock
+            acquired by `lockShardForKey:` (or `lock`). Mutations made
+            directly to the dictionary bypass the bookkeeping used to enforce
+            the `countLimit` and `totalCostLimit`; use the `internal...`
+            primitives of `MBThreadsafeCache` instead when limits are in use.
+ */
+- (nonnull NSMutableDictionary*) internalCacheForKey:(nonnull id)key;
+
+/*!
+ Returns the memory cache keys of the objects currently in the memory cache.
+
+ When the memory cache is bounded by a `countLimit` or `totalCostLimit`, or
+ objects expire, the keys are ordered approximately from most to least
+ recently used; otherwise, their order is unspecified.
+
+ Each shard is locked in turn while its keys are gathered, so this method
+ must not be called while the cache is locked.
+
+ @param     limit The maximum number of keys to return, or `0` for no limit.
+
+ @return    The memory cache keys.
+ */
+- (nonnull NSArray*) memoryCacheKeysWithLimit:(NSUInteger)limit;
+
+/*----------------------------------------------------------------------------*/
+#pragma mark Sharding
+/*!    @name Sharding                                                         */
+/*----------------------------------------------------------------------------*/
+
+/*!
+ Returns the key under which the value for `key` is stored in the memory
+ cache. The returned key also determines the shard responsible for the value.
+
+ The default implementation returns `key`. Subclasses that store values in
+ the memory cache under a derived key must override this method to return
+ that derived key, so the public accessors lock the same shard that the
+ `internal...` primitives operate on.
+
+ @param     key The cache key, as passed to the public accessors.
+
+ @return    The memory cache key.
+ */
+- (nonnull id) memoryCacheKeyForKey:(nonnull id)key;
+
+/*!
+ Locks the shard responsible for the given memory cache key.
+
+ Exclusive access is acquired regardless of the receiver's
+ `concurrencyMode`. When the mode is `MBThreadsafeCacheConcurrencyModeExclusive`
+ or `MBThreadsafeCacheConcurrencyModeSnapshot`, the lock is recursive, so it is
+ safe to call this method while the same shard (or the entire cache) is already
+ locked by the calling thread; otherwise, the lock is not recursive, and
+ subclasses must not call this method from within primitives that the cache
+ invokes with the shard locked.
+
+ In `MBThreadsafeCacheConcurrencyModeSnapshot`, changes made to the memory
+ cache while the shard is locked are published to readers when it is
+ unlocked.
+
+ @param     key The memory cache key, as returned by `memoryCacheKeyForKey:`.
+ */
+- (void) lockShardForKey:(nonnull id)key;
+
+/*!
+ Unlocks the shard responsible for the given memory cache key.
+
+ @param     key The memory cache key, as returned by `memoryCacheKeyForKey:`.
+ */
+- (void) unlockShardForKey:(nonnull id)key;
+
+/*!
+ Locks the shard responsible for the given memory cache key for reading.
+
+ In `MBThreadsafeCacheConcurrencyModeReadWrite`, other readers of the shard
+ may hold the lock at the same time; in the other modes, this is equivalent
+ to `lockShardForKey:`. While the lock is held, subclasses may call the
+ `internal...` primitives that only read the memory cache, such as
+ `internalObjectForKey:` and `internalIsKeyInCache:`, but must not mutate it.
+
+ @param     key The memory cache key, as returned by `memoryCacheKeyForKey:`.
+ */
+- (void) lockShardForReadingForKey:(nonnull id)key;
+
+/*!
+ Unlocks a shard locked by `lockShardForReadingForKey:`.
+
+ @param     key The memory cache key, as returned by `memoryCacheKeyForKey:`.
+ */
+- (void) unlockShardForReadingForKey:(nonnull id)key;
+
+/*!
+ Looks up a memory cache key without locking, using the snapshot of the
+ key's shard published for readers in `MBThreadsafeCacheConcurrencyModeSnapshot`.
+ If the lookup succeeds, it is recorded in the counters reported by
+ `statistics`.
+
+ Subclasses that probe the memory cache on behalf of their own public
+ accessors should try this method first, and fall back to locking the shard
+ only if it returns `NO`.
+
+ @param     objPtr On success, set to the object associated with `key` in the
+            snapshot, or `nil` if there is none.
+
+ @param     key The memory cache key, as returned by `memoryCacheKeyForKey:`.
+
+ @return    `YES` if the lookup was performed; `NO` if the receiver uses
+            another concurrency mode, or if the shard has no snapshot because
+            it tracks expiry or filters admission.
+ */
+- (BOOL) lookUpObject:(id __nullable __strong * __nonnull)objPtr inSnapshotForMemoryCacheKey:(nonnull id)key;
+
+/*----------------------------------------------------------------------------*/
+#pragma mark Gathering statistics
+/*!    @name Gathering statistics                                             */
+/*----------------------------------------------------------------------------*/
+
+/*!
+ Records a lookup of the memory cache in the counters reported by
+ `statistics`, and informs the `admissionPolicy` of the access.
+
+ `MBThreadsafeCache` records the lookups made through its public accessors
+ itself; subclasses that probe the memory cache through the `internal...`
+ primitives on behalf of their own public accessors should call this method
+ once per lookup. Internal re-checks should not be recorded.
+
+ @param     key The memory cache key, as returned by `memoryCacheKeyForKey:`.
+
+ @param     hit `YES` if the memory cache contained an object for `key`.
+
+ @note      The shard containing `key` must be locked, for reading or
+            exclusively, when this method is called.
+ */
+- (void) recordLookupOfKey:(nonnull id)key hit:(BOOL)hit;
+
+/*!
+ Adds to one of the counters reported by `statistics`.
+
+ `MBThreadsafeCache` maintains the memory cache counters itself; subclasses
+ with slower tiers use this method to report activity in those tiers. The
+ shard lock need not be held.
+
+ @param     counter The counter.
+
+ @param     amount The amount to add.
+
+ @param     key The memory cache key, as returned by `memoryCacheKeyForKey:`,
+            to which the activity relates.
+ */
+- (void) incrementCounter:(MBCacheCounter)counter by:(uint64_t)amount forKey:(nonnull id)key;
+
+/*!
+ Begins measuring a latency.
+
+ @return    A value to be passed to `endMeasuringLatency:startedAt:forKey:`,
+            or `0` if the receiver's `measuresLatency` property is `NO`.
+ */
+- (uint64_t) beginMeasuringLatency;
+
+/*!
+ Records the time elapsed since `beginMeasuringLatency` was called in the
+ given latency histogram. Does nothing if `start` is `0`.
+
+ @param     latency The latency histogram.
+
+ @param     start The value returned by `beginMeasuringLatency`.
+
+ @param     key The memory cache key, as returned by `memoryCacheKeyForKey:`,
+            to which the activity relates.
+ */
+- (void) endMeasuringLatency:(MBCacheLatency)latency startedAt:(uint64_t)start forKey:(nonnull id)key;
+
+/*----------------------------------------------------------------------------*/
+#pragma mark Coalescing loads
+/*!    @name Coalescing loads                                                 */
+/*----------------------------------------------------------------------------*/
+
+/*!
+ Returns the object held in the memory cache for the given memory cache key,
+ or calls `loader` to produce it, making sure that concurrent callers for the
+ same key share a single call to a loader.
+
+ This is the mechanism underlying `objectForKey:orLoad:error:`; subclasses
+ with slower tiers use it so that concurrent misses on the same key read that
+ tier only once. The memory cache is checked with the key's shard locked
+ exclusively, but the `loader` is called with no lock held.
+
+ @param     memKey The memory cache key, as returned by `memoryCacheKeyForKey:`.
+
+ @param     loader Called at most once per miss to produce the object. It is
+            responsible for storing the object in the cache, if it should be
+            stored. If the cache was created with exception protection and
+            the `loader` throws an exception, the exception is propagated to
+            the caller that executed it, and waiting callers receive an error
+            wrapping the exception. Without exception protection, the
+            `loader` must not throw.
+
+ @param     errPtr If this method returns `nil` and this parameter is non-`nil`,
+            `*errPtr` will be updated to point to the `NSError` reported by
+            the `loader`, if any.
+
+ @return    The object in the memory cache or returned by the `loader`; may be
+            `nil`.
+
+ @note      The shard containing `memKey` must not be locked by the calling
+            thread.
+ */
+- (nullable id) objectForMemoryCacheKey:(nonnull id)memKey
+                         coalescingLoad:(nullable id (^ __nonnull)(NSErrorPtrPtr errPtr))loader
+                                  error:(NSErrorPtrPtr)errPtr;
+
 /*----------------------------------------------------------------------------*/
 #pragma mark Accessing cached items
 /*!    @name Accessing cached items                                           */
@@ -89,6 +313,28 @@
  */
 - (void) internalSetObject:(nonnull id)obj forKey:(nonnull id)key;
 
+/*!
+ Stores an object in the memory cache under the given memory cache key,
+ remembering the key it was stored under so that the `tierDelegate` can be
+ told that key if the object is later dropped.
+
+ Subclasses whose `memoryCacheKeyForKey:` doesn't return its argument should
+ store objects in the memory cache through this method; objects stored
+ through `internalSetObject:forKey:` by such subclasses are not reported to
+ the `tierDelegate` when dropped. The key is only remembered while the memory
+ cache is bounded or tracks expiry, since objects can't be dropped otherwise.
+
+ @param     obj The object to store.
+
+ @param     memKey The memory cache key, as returned by `memoryCacheKeyForKey:`.
+
+ @param     key The key the object was stored under, or `nil` if unknown.
+
+ @note      The shard containing `memKey` must be exclusively locked when
+            this method is called.
+ */
+- (void) internalSetObject:(nonnull id)obj forMemoryCacheKey:(nonnull id)memKey originalKey:(nullable id)key;
+
 /*!
  Called internally to remove from the cache the object associated with the given
  key.
@@ -101,6 +347,47 @@
  */
 - (void) internalRemoveObjectForKey:(nonnull id)key;
 
+/*----------------------------------------------------------------------------*/
+#pragma mark Eviction
+/*!    @name Eviction                                                         */
+/*----------------------------------------------------------------------------*/
+
+/*!
+ Returns the cost of storing the given object in the memory cache. The cost
+ is only consulted when the cache has a `totalCostLimit`.
+
+ The default implementation returns the `length` of `NSData` instances and
+ `0` for all other objects. Subclasses may override this method to provide
+ a more meaningful cost.
+
+ @param     obj The object being stored.
+
+ @param     key The memory cache key, as returned by `memoryCacheKeyForKey:`.
+
+ @return    The cost of the object.
+ */
+- (NSUInteger) costOfObject:(nonnull id)obj forKey:(nonnull id)key;
+
+/*!
+ Called when an object is evicted from the memory cache because the
+ `countLimit` or `totalCostLimit` was exceeded, or when the `admissionPolicy`
+ declines to store it. Objects removed through `removeObjectForKey:` or
+ `clearMemoryCache` are not reported.
+
+ The default implementation does nothing. Subclasses may override this method
+ to demote the evicted object to a slower tier instead of dropping it. The
+ `tierDelegate` is notified separately, under the key the object was stored
+ with; see `internalSetObject:forMemoryCacheKey:originalKey:`.
+
+ @param     obj The object that was evicted.
+
+ @param     key The memory cache key, as returned by `memoryCacheKeyForKey:`.
+
+ @note      The shard containing `key` is exclusively locked when this method
+            is called; implementations should defer any expensive work.
+ */
+- (void) internalObjectEvicted:(nonnull id)obj forKey:(nonnull id)key;
+
 /*!
  Called internally to empty the in-memory object cache.
 
@@ -110,6 +397,7 @@
  @note      The cache is locked when this method is called by the
             `MBThreadsafeCache` superclass implementation; subclasses that call
             this method directly must only do so when the cache is locked.
+            If the receiver is sharded, every shard is locked and cleared.
  */
 - (void) internalClearMemoryCache;
 
@@ -9,6 +9,99 @@
 #import <Foundation/Foundation.h>
 
 #import "MBAvailability.h"
+#import "MBCacheStatistics.h"
+#import "MBCacheTier.h"
+#import "NSError+MBToolbox.h"
+
+/******************************************************************************/
+#pragma mark Types
+/******************************************************************************/
+
+/*!
+ Specifies how an `MBThreadsafeCache` coordinates access among threads.
+ */
+typedef NS_ENUM(NSUInteger, MBThreadsafeCacheConcurrencyMode) {
+    /*! Every operation acquires exclusive access to the lock guarding the
+        key's shard. The lock is recursive. This is the default. */
+    MBThreadsafeCacheConcurrencyModeExclusive       = 0,
+
+    /*! Read operations (`objectForKey:` and `isKeyInCache:`) acquire shared
+        access to a reader-writer lock, and may run in parallel with one
+        another; only mutations are exclusive. The lock is *not* recursive.
+        Best suited for caches that are read far more often than written.
+
+        @warning    Subclasses must not mutate the cache from within the
+                    `internalObjectForKey:` or `internalIsKeyInCache:`
+                    primitives when using this mode. */
+    MBThreadsafeCacheConcurrencyModeReadWrite       = 1,
+
+    /*! Read operations (`objectForKey:`, `isKeyInCache:` and
+        `objectsForKeys:`) take no lock: each shard publishes an immutable
+        snapshot of its contents, which readers consult with a single atomic
+        load. Mutations acquire the shard's recursive lock exclusively, and
+        publish a new copy of the shard when they release it, so every write
+        costs time proportional to the size of the shard. Superseded snapshots
+        are released once no reader can still be using them. Best suited for
+        caches that are effectively immutable once warmed up.
+
+        Reads don't update the recency of entries, so a bounded cache evicts
+        in roughly the order entries were stored. Shards that track expiry,
+        or whose `admissionPolicy` filters admission, publish no snapshot and
+        are read under the lock instead.
+
+        @warning    Lock-free reads bypass the `internalObjectForKey:` and
+                    `internalIsKeyInCache:` primitives; subclasses that
+                    override them to change what reads return should not
+                    use this mode. */
+    MBThreadsafeCacheConcurrencyModeSnapshot        = 2,
+
+    /*! Like `MBThreadsafeCacheConcurrencyModeExclusive`, except that each
+        shard is guarded by an `MBAdaptiveMutex`, which spins briefly before
+        blocking and is much cheaper to acquire than a recursive lock.
+
+        @warning    The lock is *not* recursive, so the cache's public methods
+                    must not be called while the calling thread holds the
+                    cache lock (acquired via `lock`), or from within any
+                    subclass primitive or delegate method invoked by the
+                    cache. */
+    MBThreadsafeCacheConcurrencyModeExclusiveNonRecursive = 3
+};
+
+/*!
+ Specifies how an `MBThreadsafeCache` with a `countLimit` or `totalCostLimit`
+ selects the entries to evict when a limit is exceeded.
+ */
+typedef NS_ENUM(NSUInteger, MBThreadsafeCacheEvictionPolicy) {
+    /*! The least-recently-used entry is evicted first. Every successful
+        `objectForKey:` reorders the entry, so this policy is only honored
+        when the cache's concurrency mode is
+        `MBThreadsafeCacheConcurrencyModeExclusive`. This is the default. */
+    MBThreadsafeCacheEvictionPolicyLRU              = 0,
+
+    /*! An approximation of LRU that only sets a reference bit when an entry
+        is read. Caches using `MBThreadsafeCacheConcurrencyModeReadWrite`
+        always use this policy. */
+    MBThreadsafeCacheEvictionPolicyCLOCK            = 1
+};
+
+/*!
+ Specifies how an `MBThreadsafeCache` with a `countLimit` or `totalCostLimit`
+ decides whether a new object is worth storing once the cache is full.
+ */
+typedef NS_ENUM(NSUInteger, MBThreadsafeCacheAdmissionPolicy) {
+    /*! Every object is stored, evicting entries as needed. This is the
+        default. */
+    MBThreadsafeCacheAdmissionPolicyAlways          = 0,
+
+    /*! The cache estimates how often each key has been looked up recently,
+        using a compact frequency sketch that periodically ages. When storing
+        a new object would require evicting entries, the object is stored only
+        if its key is estimated to be more popular than every entry that would
+        be evicted to make room for it; otherwise, the object is rejected and
+        the cache is left unchanged. This keeps keys that are looked up only
+        once from displacing genuinely popular entries. */
+    MBThreadsafeCacheAdmissionPolicyTinyLFU         = 1
+};
 
 /******************************************************************************/
 #pragma mark -
@@ -26,7 +119,7 @@
             to the internal `MBThreadsafeCache(ForSubclassEyesOnly)` methods
             declared in the header file `MBThreadsafeCache+Subclassing.h`.
  */
-@interface MBThreadsafeCache : NSObject
+@interface MBThreadsafeCache : NSObject <MBCacheTier>
 
 /*----------------------------------------------------------------------------*/
 #pragma mark Object lifecycle
@@ -34,6 +127,55 @@
 /*----------------------------------------------------------------------------*/
 
 #if MB_BUILD_UIKIT
+/*!
+ Initializes a new `MBThreadsafeCache` instance using the specified
+ concurrency mode.
+
+ @param     mode The `MBThreadsafeCacheConcurrencyMode` determining how the
+            cache coordinates access among threads.
+
+ @param     shards The number of independently-locked shards to use. This value
+            will be rounded up to the nearest power of two, and must be at
+            least `1`.
+
+ @param     protect If `YES`, the cache will ensure that internal exceptions
+            do not leave locks in an inconsistent state. This adds overhead,
+            and is generally not needed unless subclasses override primitive
+            hooks that may throw exceptions.
+
+ @param     ignore If `YES`, the cache will not automatically clear itself when
+            a memory warning occurs.
+ */
+- (nonnull instancetype) initWithConcurrencyMode:(MBThreadsafeCacheConcurrencyMode)mode
+                                      shardCount:(NSUInteger)shards
+                             exceptionProtection:(BOOL)protect
+                            ignoreMemoryWarnings:(BOOL)ignore;
+
+/*!
+ Initializes a new `MBThreadsafeCache` instance that spreads its contents
+ across multiple independently-locked *shards*.
+
+ Each key is assigned to a shard based on its hash value, and only the lock
+ of that shard is held while the key is being accessed. This reduces lock
+ contention when many threads access the cache simultaneously.
+
+ @param     shards The number of shards to use. This value will be rounded up
+            to the nearest power of two, and must be at least `1`. A value of
+            `1` results in a cache equivalent to one created with
+            `initWithExceptionProtection:ignoreMemoryWarnings:`.
+
+ @param     protect If `YES`, the cache will ensure that internal exceptions
+            do not leave locks in an inconsistent state. This adds overhead,
+            and is generally not needed unless subclasses override primitive
+            hooks that may throw exceptions.
+
+ @param     ignore If `YES`, the cache will not automatically clear itself when
+            a memory warning occurs.
+ */
+- (nonnull instancetype) initWithShardCount:(NSUInteger)shards
+                        exceptionProtection:(BOOL)protect
+                       ignoreMemoryWarnings:(BOOL)ignore;
+
 /*!
  Initializes a new `MBThreadsafeCache` instance.
  
@@ -48,6 +190,47 @@
 - (nonnull instancetype) initWithExceptionProtection:(BOOL)protect
                                 ignoreMemoryWarnings:(BOOL)ignore;
 #else
+/*!
+ Initializes a new `MBThreadsafeCache` instance using the specified
+ concurrency mode.
+
+ @param     mode The `MBThreadsafeCacheConcurrencyMode` determining how the
+            cache coordinates access among threads.
+
+ @param     shards The number of independently-locked shards to use. This value
+            will be rounded up to the nearest power of two, and must be at
+            least `1`.
+
+ @param     protect If `YES`, the cache will ensure that internal exceptions
+            do not leave locks in an inconsistent state. This adds overhead,
+            and is generally not needed unless subclasses override primitive
+            hooks that may throw exceptions.
+ */
+- (nonnull instancetype) initWithConcurrencyMode:(MBThreadsafeCacheConcurrencyMode)mode
+                                      shardCount:(NSUInteger)shards
+                             exceptionProtection:(BOOL)protect;
+
+/*!
+ Initializes a new `MBThreadsafeCache` instance that spreads its contents
+ across multiple independently-locked *shards*.
+
+ Each key is assigned to a shard based on its hash value, and only the lock
+ of that shard is held while the key is being accessed. This reduces lock
+ contention when many threads access the cache simultaneously.
+
+ @param     shards The number of shards to use. This value will be rounded up
+            to the nearest power of two, and must be at least `1`. A value of
+            `1` results in a cache equivalent to one created with
+            `initWithExceptionProtection:`.
+
+ @param     protect If `YES`, the cache will ensure that internal exceptions
+            do not leave locks in an inconsistent state. This adds overhead,
+            and is generally not needed unless subclasses override primitive
+            hooks that may throw exceptions.
+ */
+- (nonnull instancetype) initWithShardCount:(NSUInteger)shards
+                        exceptionProtection:(BOOL)protect;
+
 /*!
  Initializes a new `MBThreadsafeCache` instance.
  
@@ -66,6 +249,148 @@
  */
 - (nonnull instancetype) init;
 
+/*----------------------------------------------------------------------------*/
+#pragma mark Cache properties
+/*!    @name Cache properties                                                 */
+/*----------------------------------------------------------------------------*/
+
+/*! Returns the number of independently-locked shards used by the cache. This
+    will be `1` unless the receiver was created using one of the
+    `initWithShardCount:...` initializers. */
+@property(nonatomic, readonly) NSUInteger shardCount;
+
+/*! Returns the `MBThreadsafeCacheConcurrencyMode` specified when the receiver
+    was initialized. */
+@property(nonatomic, readonly) MBThreadsafeCacheConcurrencyMode concurrencyMode;
+
+/*----------------------------------------------------------------------------*/
+#pragma mark Bounding the memory cache
+/*!    @name Bounding the memory cache                                        */
+/*----------------------------------------------------------------------------*/
+
+/*! The maximum number of objects the memory cache should hold. When the limit
+    is exceeded, entries are evicted according to the `evictionPolicy`. If `0`,
+    the default, there is no count limit.
+
+    @note   Limits are divided evenly among the receiver's shards, so a sharded
+            cache may begin evicting from one shard before the total is
+            reached. */
+@property(nonatomic, assign) NSUInteger countLimit;
+
+/*! The maximum total cost of the objects the memory cache should hold. The
+    cost of each object is determined when it is stored in the cache; see
+    the `costOfObject:forKey:` subclassing hook. When the limit is exceeded,
+    entries are evicted according to the `evictionPolicy`. If `0`, the
+    default, there is no cost limit.
+
+    @note   Limits are divided evenly among the receiver's shards, so a sharded
+            cache may begin evicting from one shard before the total is
+            reached. */
+@property(nonatomic, assign) NSUInteger totalCostLimit;
+
+/*! The `MBThreadsafeCacheEvictionPolicy` used when the `countLimit` or
+    `totalCostLimit` is exceeded. Defaults to
+    `MBThreadsafeCacheEvictionPolicyLRU`. */
+@property(nonatomic, assign) MBThreadsafeCacheEvictionPolicy evictionPolicy;
+
+/*! The `MBThreadsafeCacheAdmissionPolicy` used to decide whether new objects
+    are stored once the `countLimit` or `totalCostLimit` has been reached.
+    Defaults to `MBThreadsafeCacheAdmissionPolicyAlways`.
+
+    @note   Under `MBThreadsafeCacheAdmissionPolicyTinyLFU`, an object passed
+            to `setObject:forKey:` may not be stored, so a subsequent
+            `objectForKey:` can return `nil`. Objects that replace an existing
+            entry for the same key are always stored. */
+@property(nonatomic, assign) MBThreadsafeCacheAdmissionPolicy admissionPolicy;
+
+/*! Returns the number of objects evicted from the memory cache because
+    the `countLimit` or `totalCostLimit` was exceeded. */
+@property(nonatomic, readonly) NSUInteger evictionCount;
+
+/*! Returns the total cost of the objects evicted from the memory cache
+    because the `countLimit` or `totalCostLimit` was exceeded. */
+@property(nonatomic, readonly) NSUInteger evictedCost;
+
+/*----------------------------------------------------------------------------*/
+#pragma mark Expiring cached items
+/*!    @name Expiring cached items                                            */
+/*----------------------------------------------------------------------------*/
+
+/*! The number of seconds an object stored via `setObject:forKey:` remains
+    valid in the memory cache. Expired objects are treated as absent, and are
+    removed lazily when next accessed or by the periodic sweep configured
+    via `expirySweepInterval`. If `0`, the default, objects do not expire
+    unless stored using `setObject:forKey:timeToLive:`.
+
+    @note   Changing this value does not affect objects already in the
+            cache. */
+@property(nonatomic, assign) NSTimeInterval defaultTimeToLive;
+
+/*! If greater than `0`, a background timer removes expired objects from the
+    memory cache at this interval, in seconds. Otherwise, expired objects are
+    removed only when they are next accessed. Defaults to `0`. */
+@property(nonatomic, assign) NSTimeInterval expirySweepInterval;
+
+/*! Returns the number of objects removed from the memory cache because their
+    time-to-live had elapsed. */
+@property(nonatomic, readonly) NSUInteger expirationCount;
+
+/*!
+ Sets a cached object value that will expire after the given number of
+ seconds, and associates it with the given key.
+
+ @param     obj The new cached value.
+
+ @param     key The key whose associated value is to be set.
+
+ @param     ttl The number of seconds the value remains valid in the memory
+            cache. If `0`, the value does not expire.
+ */
+- (void) setObject:(nonnull id)obj forKey:(nonnull id)key timeToLive:(NSTimeInterval)ttl;
+
+/*!
+ Immediately removes all expired objects from the memory cache.
+
+ This is called automatically when an `expirySweepInterval` is set.
+ */
+- (void) purgeExpiredObjects;
+
+/*----------------------------------------------------------------------------*/
+#pragma mark Gathering statistics
+/*!    @name Gathering statistics                                             */
+/*----------------------------------------------------------------------------*/
+
+/*! If `YES`, the time spent waiting for shard locks and loading objects is
+    sampled into the latency histograms returned by `statistics`. This adds
+    two clock reads to every lock acquisition, so it defaults to `NO`. The
+    counters returned by `statistics` are maintained regardless. */
+@property(nonatomic, assign) BOOL measuresLatency;
+
+/*!
+ Returns a snapshot of the statistics gathered by the receiver since it was
+ created: counts of hits, misses, sets, evictions and bytes transferred, as
+ well as histograms of lock wait and load latency.
+
+ Each shard gathers its own statistics, so this method sums them without
+ acquiring any locks, and may safely be called as often as a metrics system
+ requires.
+
+ @return    The statistics.
+ */
+- (nonnull MBCacheStatistics*) statistics;
+
+/*----------------------------------------------------------------------------*/
+#pragma mark Tiering
+/*!    @name Tiering                                                          */
+/*----------------------------------------------------------------------------*/
+
+/*! Notified of each object evicted because the `countLimit` or
+    `totalCostLimit` was exceeded, and of each object declined by the
+    `admissionPolicy`. Set by an `MBTieredCache` to demote dropped objects
+    to the next tier. The delegate is called once the shard the object was
+    dropped from has been unlocked. */
+@property(nullable, nonatomic, weak) id<MBCacheTierDelegate> tierDelegate;
+
 /*----------------------------------------------------------------------------*/
 #pragma mark Accessing cached items
 /*!    @name Accessing cached items                                           */
@@ -90,6 +415,56 @@
  */
 - (nullable id) objectForKey:(nonnull id)key;
 
+/*!
+ Retrieves a cached object value given its key, loading it if it is not
+ present in the cache.
+
+ If the cache has no value for `key`, the `loader` block is executed to
+ produce one, and a non-`nil` result is stored in the cache using
+ `setObject:forKey:`.
+
+ Concurrent misses for the same key are coalesced: only one caller executes
+ its `loader`, while the others wait for that load to complete and then
+ receive its result (or its error). This prevents many threads from
+ redundantly performing the same expensive load when a popular key is absent.
+
+ @param     key The key whose associated value is to be retrieved.
+
+ @param     loader A block that produces the value for `key`. It is executed
+            on the calling thread, without any cache lock held. If it cannot
+            produce a value, it should return `nil` and may set `*errPtr` to
+            describe the problem. If the cache was created with exception
+            protection and the `loader` raises an exception, the exception
+            is propagated to the caller that executed it, and waiting callers
+            receive an error wrapping the exception. Without exception
+            protection, the `loader` must not raise.
+
+ @param     errPtr If this method returns `nil` and this parameter is non-`nil`,
+            `*errPtr` will be updated to point to the `NSError` reported by
+            the `loader`, if any.
+
+ @return    The value associated with `key`, or `nil` if it was not in the
+            cache and could not be loaded.
+ */
+- (nullable id) objectForKey:(nonnull id)key
+                      orLoad:(nullable id (^ __nonnull)(NSErrorPtrPtr errPtr))loader
+                       error:(NSErrorPtrPtr)errPtr;
+
+/*!
+ Retrieves the cached object values associated with the given keys.
+
+ This is equivalent to calling `objectForKey:` for each key, but considerably
+ cheaper for large numbers of keys: the keys are grouped by shard, and each
+ shard is locked only once for the entire batch.
+
+ @param     keys The keys whose associated values are to be retrieved. Each
+            key must conform to `NSCopying`.
+
+ @return    A dictionary mapping each key that has a value in the cache to
+            that value. Keys without values are omitted.
+ */
+- (nonnull NSDictionary*) objectsForKeys:(nonnull NSArray*)keys;
+
 /*----------------------------------------------------------------------------*/
 #pragma mark Modifying the cache
 /*!    @name Modifying the cache                                              */
@@ -104,6 +479,17 @@
  */
 - (void) setObject:(nonnull id)obj forKey:(nonnull id)key;
 
+/*!
+ Sets multiple cached object values at once.
+
+ This is equivalent to calling `setObject:forKey:` for each entry in the
+ dictionary, but each shard is locked only once for the entire batch.
+
+ @param     objectsAndKeys A dictionary whose keys are cache keys, and whose
+            values are the objects to associate with them.
+ */
+- (void) setObjectsAndKeys:(nonnull NSDictionary*)objectsAndKeys;
+
 /*!
  Removes from the cache the object associated with the given key.
 
@@ -170,6 +556,8 @@
  
  Used internally by the `MBThreadsafeCache` implementation and subclasses.
 
+ If the cache is sharded, every shard is locked.
+
  @note      You will generally not need to call this directly unless you want
             to make multiple changes to the cache atomically.
  */
@@ -7,6 +7,13 @@
 //
 
 #import "MBThreadsafeCache.h"
+#import "MBThreadsafeCache+Subclassing.h"
+#import "MBCacheEntryList.h"
+#import "MBCacheEpoch.h"
+#import "MBCacheFrequencySketch.h"
+#import "MBCacheStatisticsRecorder.h"
+#import "MBReadWriteLock.h"
+#import "MBAdaptiveMutex.h"
 
 #if MB_BUILD_UIKIT
 #import <UIKit/UIKit.h>
@@ -16,6 +23,310 @@
 
 #define DEBUG_LOCAL     0
 
+/******************************************************************************/
+#pragma mark Constants
+/******************************************************************************/
+
+#define kMaxShardCount          256
+#define kDefaultSketchCapacity  1024        // per shard, when only cost is limited
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark MBThreadsafeCacheShard class
+/******************************************************************************/
+
+// lets the exclusive-mode recursive lock be used wherever
+// the read-write lock is, so the read path needs no branch
+@interface MBThreadsafeCacheRecursiveLock : NSRecursiveLock <MBReadWriteLocking>
+@end
+
+@implementation MBThreadsafeCacheRecursiveLock
+
+- (void) lockForReading
+{
+    [self lock];
+}
+
+@end
+
+// likewise for the non-recursive mutex
+@interface MBThreadsafeCacheMutex : MBAdaptiveMutex <MBReadWriteLocking>
+@end
+
+@implementation MBThreadsafeCacheMutex
+
+- (void) lockForReading
+{
+    [self lock];
+}
+
+@end
+
+// represents a load in progress for a given key; the loading thread
+// holds the group until the load completes, and waiters wait on it
+@interface MBThreadsafeCacheLoad : NSObject
+{
+@public
+    dispatch_group_t _group;
+    id _result;
+    NSError* _error;
+}
+@end
+
+@implementation MBThreadsafeCacheLoad
+
+- (instancetype) init
+{
+    self = [super init];
+    if (self) {
+        _group = dispatch_group_create();
+        dispatch_group_enter(_group);
+    }
+    return self;
+}
+
+- (void) finishWithResult:(id)result error:(NSError*)err
+{
+    _result = result;
+    _error = err;
+    dispatch_group_leave(_group);
+}
+
+- (void) wait
+{
+    dispatch_group_wait(_group, DISPATCH_TIME_FOREVER);
+}
+
+@end
+
+// an object dropped from the memory cache, to be reported to the
+// tier delegate once the shard it was dropped from is unlocked
+@interface MBThreadsafeCacheDrop : NSObject
+{
+@public
+    id<MBCacheTierDelegate> _delegate;
+    id<MBCacheTier> _tier;
+    id _obj;
+    id _key;
+}
+@end
+
+@implementation MBThreadsafeCacheDrop
+@end
+
+// a shard is a lock along with the portion of the cache it guards;
+// ivars are public so the cache can reach them without messaging
+@interface MBThreadsafeCacheShard : NSObject
+{
+@public
+    id<MBReadWriteLocking> _lock;
+    NSMutableDictionary* _cache;
+    MBCacheEntryList* _entries;         // nil unless the cache is bounded
+    MBCacheFrequencySketch* _sketch;    // nil unless admission is filtered
+    NSMutableDictionary* _loads;        // memory cache key -> MBThreadsafeCacheLoad
+    NSMutableArray* _drops;             // MBThreadsafeCacheDrops awaiting the final unlock
+    NSUInteger _exclusiveHolds;         // depth of the exclusive lock held by its owner
+    NSUInteger _countLimit;
+    NSUInteger _costLimit;
+    BOOL _tracksExpiry;
+    atomic_ulong _evictedCost;
+    MBCacheStatisticsRecorder* _stats;
+    BOOL _publishesSnapshots;           // YES in snapshot mode
+    BOOL _dirty;                        // _cache changed since last published
+    atomic_uintptr_t _snapshot;         // retained NSDictionary, or 0
+}
+@end
+
+@implementation MBThreadsafeCacheShard
+
+- (instancetype) initWithConcurrencyMode:(MBThreadsafeCacheConcurrencyMode)mode
+{
+    self = [super init];
+    if (self) {
+        switch (mode) {
+            case MBThreadsafeCacheConcurrencyModeReadWrite:
+                _lock = [MBReadWriteLock new];
+                break;
+
+            case MBThreadsafeCacheConcurrencyModeExclusiveNonRecursive:
+                _lock = [MBThreadsafeCacheMutex new];
+                break;
+
+            case MBThreadsafeCacheConcurrencyModeSnapshot:
+                _publishesSnapshots = YES;
+                _dirty = YES;       // the first unlock publishes a snapshot
+                // fall through; writers are still serialized by the lock
+
+            case MBThreadsafeCacheConcurrencyModeExclusive:
+            default:
+                _lock = [MBThreadsafeCacheRecursiveLock new];
+                break;
+        }
+        _cache = [NSMutableDictionary new];
+        _stats = [MBCacheStatisticsRecorder new];
+        atomic_init(&_evictedCost, 0);
+        atomic_init(&_snapshot, 0);
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    // no reader can be using the cache, so there's no need to retire it
+    CFTypeRef snapshot = (CFTypeRef)atomic_load_explicit(&_snapshot, memory_order_relaxed);
+    if (snapshot) {
+        CFRelease(snapshot);
+    }
+}
+
+@end
+
+// replaces the shard's published snapshot with a copy of its current
+// contents, returning the old one, which the caller must retire once the
+// shard is unlocked; must be called with the shard exclusively locked
+static CFTypeRef MBPublishSnapshot(MBThreadsafeCacheShard* shard)
+{
+    shard->_dirty = NO;
+
+    // expiry and admission filtering need the entry list and frequency
+    // sketch, which readers can only consult under the lock; publishing
+    // no snapshot sends readers down the locked path
+    CFTypeRef snapshot = NULL;
+    if (!shard->_tracksExpiry && !shard->_sketch) {
+        snapshot = CFBridgingRetain([shard->_cache copy]);
+    }
+
+    return (CFTypeRef)atomic_exchange_explicit(&shard->_snapshot, (uintptr_t)snapshot, memory_order_seq_cst);
+}
+
+// looks the memory cache key up in the shard's published snapshot without
+// locking; returns NO if the shard has no snapshot, in which case the caller
+// must look the key up under the lock
+static inline BOOL MBLookUpInSnapshot(MBThreadsafeCacheShard* shard, id memKey, BOOL protect, id __strong* objPtr)
+{
+    MBCacheEpochRecord* record = MBCacheEpochRecordForCurrentThread();
+    MBCacheEpochEnter(record);
+    __unsafe_unretained NSDictionary* snapshot = (__bridge NSDictionary*)(void*)atomic_load_explicit(&shard->_snapshot, memory_order_acquire);
+    if (!snapshot) {
+        MBCacheEpochExit(record);
+        return NO;
+    }
+    if (protect) {
+        @try {
+            *objPtr = snapshot[memKey];
+        }
+        @finally {
+            MBCacheEpochExit(record);
+        }
+    }
+    else {
+        *objPtr = snapshot[memKey];
+        MBCacheEpochExit(record);
+    }
+    return YES;
+}
+
+// acquires the shard's lock exclusively, sampling the wait if measuring
+static inline void MBLockShard(MBThreadsafeCacheShard* shard)
+{
+    uint64_t start = MBCacheStatisticsBegin(shard->_stats);
+    [shard->_lock lock];
+    MBCacheStatisticsEnd(shard->_stats, MBCacheLatencyLockWait, start);
+    shard->_exclusiveHolds++;
+}
+
+// acquires the shard's lock for reading, sampling the wait if measuring
+static inline void MBLockShardForReading(MBThreadsafeCacheShard* shard)
+{
+    uint64_t start = MBCacheStatisticsBegin(shard->_stats);
+    [shard->_lock lockForReading];
+    MBCacheStatisticsEnd(shard->_stats, MBCacheLatencyLockWait, start);
+}
+
+// releases the shard's lock, first publishing a new snapshot if the shard
+// changed while it was held; the old snapshot is retired after unlocking,
+// since retiring may release earlier snapshots and the objects in them
+static inline void MBReleaseShard(MBThreadsafeCacheShard* shard)
+{
+    CFTypeRef old = NULL;
+    if (shard->_publishesSnapshots && shard->_dirty) {
+        old = MBPublishSnapshot(shard);
+    }
+    [shard->_lock unlock];
+    if (old) {
+        MBCacheEpochRetire(old);
+    }
+}
+
+// releases a lock acquired by MBLockShardForReading()
+static inline void MBUnlockShardForReading(MBThreadsafeCacheShard* shard)
+{
+    MBReleaseShard(shard);
+}
+
+// releases a lock acquired by MBLockShard(); when the outermost hold is
+// released, returns the objects dropped while the shard was held, which
+// the caller must pass to MBReportDrops() once it holds no shard locks
+static inline NSArray* MBUnlockShardDeferringDrops(MBThreadsafeCacheShard* shard)
+{
+    NSArray* drops = nil;
+    if (--shard->_exclusiveHolds == 0 && shard->_drops) {
+        drops = shard->_drops;
+        shard->_drops = nil;
+    }
+    MBReleaseShard(shard);
+    return drops;
+}
+
+// tells the tier delegate about dropped objects; no shard may be locked,
+// so that the delegate is free to call back into the cache
+static void MBReportDrops(NSArray* drops)
+{
+    for (MBThreadsafeCacheDrop* drop in drops) {
+        [drop->_delegate cacheTier:drop->_tier droppedObject:drop->_obj forKey:drop->_key];
+    }
+}
+
+// releases a lock acquired by MBLockShard(), then reports any drops
+static inline void MBUnlockShard(MBThreadsafeCacheShard* shard)
+{
+    NSArray* drops = MBUnlockShardDeferringDrops(shard);
+    if (drops) {
+        MBReportDrops(drops);
+    }
+}
+
+// like MBLookUpInSnapshot(), but also records the lookup if it succeeds
+static inline BOOL MBObjectFromSnapshot(MBThreadsafeCacheShard* shard, id memKey, BOOL protect, id __strong* objPtr)
+{
+    if (!MBLookUpInSnapshot(shard, memKey, protect, objPtr)) {
+        return NO;
+    }
+    MBCacheStatisticsIncrement(shard->_stats, (*objPtr ? MBCacheCounterMemoryHits : MBCacheCounterMemoryMisses), 1);
+    return YES;
+}
+
+// records a lookup of the memory cache key; call with the shard locked
+static inline void MBRecordLookup(MBThreadsafeCacheShard* shard, id memKey, BOOL hit)
+{
+    MBCacheStatisticsIncrement(shard->_stats, (hit ? MBCacheCounterMemoryHits : MBCacheCounterMemoryMisses), 1);
+    if (shard->_sketch) {
+        [shard->_sketch incrementKey:memKey];
+    }
+}
+
+// an implementation of one of the primitive operations, resolved once
+// when the cache is initialized, along with the selector it implements
+typedef struct {
+    SEL sel;
+    IMP imp;
+} MBThreadsafeCacheOperation;
+
+static inline MBThreadsafeCacheOperation MBResolveOperation(id cache, SEL sel)
+{
+    return (MBThreadsafeCacheOperation){sel, [cache methodForSelector:sel]};
+}
+
 /******************************************************************************/
 #pragma mark -
 #pragma mark MBThreadsafeCache implementation
@@ -23,12 +334,24 @@
 
 @implementation MBThreadsafeCache
 {
-    NSRecursiveLock* _lock;
+    NSArray* _shards;
+    NSUInteger _shardMask;
+    MBThreadsafeCacheShard* _firstShard;
     BOOL _exceptionProtection;
+    BOOL _memoryCacheKeysAreKeys;       // NO if a subclass maps keys to memory cache keys
+    MBThreadsafeCacheOperation _clearCacheOp;
+    MBThreadsafeCacheOperation _isKeyInCacheOp;
+    MBThreadsafeCacheOperation _objectForKeyOp;
+    MBThreadsafeCacheOperation _setObjectOp;
+    MBThreadsafeCacheOperation _removeObjectOp;
+    MBThreadsafeCacheOperation _setObjectWithTTLOp;
+    MBThreadsafeCacheOperation _collectObjectsOp;
+    MBThreadsafeCacheOperation _setObjectsOp;
+    MBThreadsafeCacheOperation _coalescingLoadOp;
+    dispatch_source_t _expirySweepTimer;
 #if MB_BUILD_UIKIT
     BOOL _clearOnMemoryWarning;
 #endif
-    NSMutableDictionary* _cache;
 }
 
 /******************************************************************************/
@@ -49,47 +372,537 @@
                                 ignoreMemoryWarnings:(BOOL)ignore
 #endif
 {
-    self = [super init];
-    if (self) {
-        _exceptionProtection = protect;
+#if MB_BUILD_UIKIT
+    return [self initWithShardCount:1 exceptionProtection:protect ignoreMemoryWarnings:ignore];
+#else
+    return [self initWithShardCount:1 exceptionProtection:protect];
+#endif
+}
+
+- (nonnull instancetype) initWithShardCount:(NSUInteger)shards
+                        exceptionProtection:(BOOL)protect
+#if MB_BUILD_UIKIT
+                       ignoreMemoryWarnings:(BOOL)ignore
+#endif
+{
+#if MB_BUILD_UIKIT
+    return [self initWithConcurrencyMode:MBThreadsafeCacheConcurrencyModeExclusive
+                              shardCount:shards
+                     exceptionProtection:protect
+                    ignoreMemoryWarnings:ignore];
+#else
+    return [self initWithConcurrencyMode:MBThreadsafeCacheConcurrencyModeExclusive
+                              shardCount:shards
+                     exceptionProtection:protect];
+#endif
+}
+
+- (nonnull instancetype) initWithConcurrencyMode:(MBThreadsafeCacheConcurrencyMode)mode
+                                      shardCount:(NSUInteger)shards
+                             exceptionProtection:(BOOL)protect
+#if MB_BUILD_UIKIT
+                            ignoreMemoryWarnings:(BOOL)ignore
+#endif
+{
+    self = [super init];
+    if (self) {
+        _concurrencyMode = mode;
+        _exceptionProtection = protect;
+
+        // round up to a power of two so we can mask instead of mod
+        NSUInteger shardCount = 1;
+        while (shardCount < shards && shardCount < kMaxShardCount) {
+            shardCount <<= 1;
+        }
+        _shardMask = shardCount - 1;
+
+        NSMutableArray* shardList = [NSMutableArray arrayWithCapacity:shardCount];
+        for (NSUInteger i=0; i<shardCount; i++) {
+            [shardList addObject:[[MBThreadsafeCacheShard alloc] initWithConcurrencyMode:mode]];
+        }
+        _shards = [shardList copy];
+        _firstShard = _shards[0];
+
+        IMP memKeyImp = [MBThreadsafeCache instanceMethodForSelector:@selector(memoryCacheKeyForKey:)];
+        _memoryCacheKeysAreKeys = ([self methodForSelector:@selector(memoryCacheKeyForKey:)] == memKeyImp);
+
+        [self _resolveOperations];
+
+#if MB_BUILD_UIKIT
+        _clearOnMemoryWarning = !ignore;
+        if (_clearOnMemoryWarning) {
+            [[NSNotificationCenter defaultCenter] addObserver:self
+                                                     selector:@selector(memoryWarning)
+                                                         name:UIApplicationDidReceiveMemoryWarningNotification
+                                                       object:nil];
+        }        
+#endif
+    }
+    return self;
+}
+
+// chooses the implementations of the primitive operations once, so the
+// public methods don't pay for a branch (or for @try) on every call
+- (void) _resolveOperations
+{
+    BOOL snapshots = (_concurrencyMode == MBThreadsafeCacheConcurrencyModeSnapshot);
+    if (_exceptionProtection) {
+        _clearCacheOp = MBResolveOperation(self, @selector(_clearCacheProtected));
+        _isKeyInCacheOp = MBResolveOperation(self, (snapshots ? @selector(_isKeyInCacheSnapshotProtected:) : @selector(_isKeyInCacheProtected:)));
+        _objectForKeyOp = MBResolveOperation(self, (snapshots ? @selector(_objectForKeySnapshotProtected:) : @selector(_objectForKeyProtected:)));
+        _setObjectOp = MBResolveOperation(self, @selector(_setObjectProtected:forKey:));
+        _removeObjectOp = MBResolveOperation(self, @selector(_removeObjectForKeyProtected:));
+        _setObjectWithTTLOp = MBResolveOperation(self, @selector(_setObjectProtected:forKey:timeToLive:));
+        _collectObjectsOp = MBResolveOperation(self, (snapshots ? @selector(_collectObjectsForKeysSnapshotProtected:inShard:intoKeys:objects:) : @selector(_collectObjectsForKeysProtected:inShard:intoKeys:objects:)));
+        _setObjectsOp = MBResolveOperation(self, @selector(_setObjectsForKeysProtected:inShard:fromDictionary:));
+        _coalescingLoadOp = MBResolveOperation(self, @selector(_objectForMemoryCacheKeyProtected:coalescingLoad:error:));
+    }
+    else {
+        _clearCacheOp = MBResolveOperation(self, @selector(_clearCacheUnprotected));
+        _isKeyInCacheOp = MBResolveOperation(self, (snapshots ? @selector(_isKeyInCacheSnapshotUnprotected:) : @selector(_isKeyInCacheUnprotected:)));
+        _objectForKeyOp = MBResolveOperation(self, (snapshots ? @selector(_objectForKeySnapshotUnprotected:) : @selector(_objectForKeyUnprotected:)));
+        _setObjectOp = MBResolveOperation(self, @selector(_setObjectUnprotected:forKey:));
+        _removeObjectOp = MBResolveOperation(self, @selector(_removeObjectForKeyUnprotected:));
+        _setObjectWithTTLOp = MBResolveOperation(self, @selector(_setObjectUnprotected:forKey:timeToLive:));
+        _collectObjectsOp = MBResolveOperation(self, (snapshots ? @selector(_collectObjectsForKeysSnapshotUnprotected:inShard:intoKeys:objects:) : @selector(_collectObjectsForKeysUnprotected:inShard:intoKeys:objects:)));
+        _setObjectsOp = MBResolveOperation(self, @selector(_setObjectsForKeysUnprotected:inShard:fromDictionary:));
+        _coalescingLoadOp = MBResolveOperation(self, @selector(_objectForMemoryCacheKeyUnprotected:coalescingLoad:error:));
+    }
+}
+
+- (void) dealloc
+{
+    if (_expirySweepTimer) {
+        dispatch_source_cancel(_expirySweepTimer);
+    }
+#if MB_BUILD_UIKIT
+    if (_clearOnMemoryWarning) {
+        [[NSNotificationCenter defaultCenter] removeObserver:self];
+    }            
+#endif
+}
+
+/******************************************************************************/
+#pragma mark Cache properties
+/******************************************************************************/
+
+- (NSUInteger) shardCount
+{
+    return _shardMask + 1;
+}
+
+/******************************************************************************/
+#pragma mark Bounding the memory cache
+/******************************************************************************/
+
+- (void) setCountLimit:(NSUInteger)countLimit
+{
+    [self lock];
+    _countLimit = countLimit;
+    [self _applyLimits];
+    [self unlock];
+}
+
+- (void) setTotalCostLimit:(NSUInteger)totalCostLimit
+{
+    [self lock];
+    _totalCostLimit = totalCostLimit;
+    [self _applyLimits];
+    [self unlock];
+}
+
+- (void) setEvictionPolicy:(MBThreadsafeCacheEvictionPolicy)evictionPolicy
+{
+    [self lock];
+    _evictionPolicy = evictionPolicy;
+    [self _applyLimits];
+    [self unlock];
+}
+
+- (void) setAdmissionPolicy:(MBThreadsafeCacheAdmissionPolicy)admissionPolicy
+{
+    [self lock];
+    _admissionPolicy = admissionPolicy;
+    [self _applyLimits];
+    [self unlock];
+}
+
+- (NSUInteger) evictionCount
+{
+    NSUInteger total = 0;
+    for (MBThreadsafeCacheShard* shard in _shards) {
+        total += atomic_load_explicit(&shard->_stats->_counters[MBCacheCounterEvictions], memory_order_relaxed);
+    }
+    return total;
+}
+
+- (NSUInteger) evictedCost
+{
+    NSUInteger total = 0;
+    for (MBThreadsafeCacheShard* shard in _shards) {
+        total += atomic_load_explicit(&shard->_evictedCost, memory_order_relaxed);
+    }
+    return total;
+}
+
+- (MBThreadsafeCacheEvictionPolicy) _effectiveEvictionPolicy
+{
+    // LRU reorders entries on read, which can't be done under a shared lock
+    if (_concurrencyMode == MBThreadsafeCacheConcurrencyModeReadWrite) {
+        return MBThreadsafeCacheEvictionPolicyCLOCK;
+    }
+    return _evictionPolicy;
+}
+
+// must be called with every shard locked
+- (void) _applyLimits
+{
+    NSUInteger shardCount = _shardMask + 1;
+    NSUInteger countLimit = (_countLimit + shardCount - 1) / shardCount;
+    NSUInteger costLimit = (_totalCostLimit + shardCount - 1) / shardCount;
+    BOOL bounded = (countLimit || costLimit);
+
+    MBThreadsafeCacheEvictionPolicy policy = [self _effectiveEvictionPolicy];
+
+    for (MBThreadsafeCacheShard* shard in _shards) {
+        shard->_countLimit = countLimit;
+        shard->_costLimit = costLimit;
+        shard->_dirty = YES;
+
+        if (!bounded || _admissionPolicy != MBThreadsafeCacheAdmissionPolicyTinyLFU) {
+            shard->_sketch = nil;
+        }
+        else {
+            NSUInteger capacity = countLimit ?: kDefaultSketchCapacity;
+            if (shard->_sketch.capacity != capacity) {
+                shard->_sketch = [[MBCacheFrequencySketch alloc] initWithCapacity:capacity];
+            }
+        }
+
+        if (!bounded && !shard->_tracksExpiry) {
+            shard->_entries = nil;
+            continue;
+        }
+
+        [self _trackEntriesInShard:shard];
+        shard->_entries.policy = policy;
+
+        [self _trimShard:shard];
+    }
+}
+
+// must be called with the shard exclusively locked
+- (void) _trackEntriesInShard:(MBThreadsafeCacheShard*)shard
+{
+    if (!shard->_entries) {
+        // start tracking whatever is already in the shard
+        MBCacheEntryList* entries = [MBCacheEntryList new];
+        entries.policy = [self _effectiveEvictionPolicy];
+        [shard->_cache enumerateKeysAndObjectsUsingBlock:^(id key, id obj, BOOL* stop) {
+            [entries addEntryForKey:key cost:[self costOfObject:obj forKey:key]];
+        }];
+        shard->_entries = entries;
+    }
+}
+
+// must be called with the shard exclusively locked
+- (void) _trimShard:(MBThreadsafeCacheShard*)shard
+{
+    MBCacheEntryList* entries = shard->_entries;
+    while ((shard->_countLimit && entries.count > shard->_countLimit)
+           || (shard->_costLimit && entries.totalCost > shard->_costLimit))
+    {
+        MBCacheEntry* victim = [entries nextVictim];
+        if (!victim) {
+            break;
+        }
+
+        id key = victim->_key;
+        id originalKey = victim->_originalKey;
+        NSUInteger cost = victim->_cost;
+        id obj = shard->_cache[key];
+
+        [entries removeEntryForKey:key];
+        [shard->_cache removeObjectForKey:key];
+        shard->_dirty = YES;
+
+        MBCacheStatisticsIncrement(shard->_stats, MBCacheCounterEvictions, 1);
+        atomic_fetch_add_explicit(&shard->_evictedCost, cost, memory_order_relaxed);
+
+        MBLogDebug(@"%@ evicted object for key: %@", [self class], key);
+
+        if (obj) {
+            [self _objectDropped:obj forMemoryCacheKey:key originalKey:originalKey inShard:shard];
+        }
+    }
+}
+
+// must be called with the shard exclusively locked
+- (void) _objectDropped:(id)obj forMemoryCacheKey:(id)memKey originalKey:(id)key inShard:(MBThreadsafeCacheShard*)shard
+{
+    [self internalObjectEvicted:obj forKey:memKey];
+
+    // the delegate must be given the key the object was stored under; if a
+    // subclass maps keys to memory cache keys, only the entry knows it
+    if (!key && _memoryCacheKeysAreKeys) {
+        key = memKey;
+    }
+    id<MBCacheTierDelegate> delegate = _tierDelegate;
+    if (!key || !delegate) {
+        return;
+    }
+
+    // the delegate is told once the shard is unlocked, so it may store the
+    // object in another tier, or call back into this one, without risking
+    // deadlock or lock-order inversions
+    MBThreadsafeCacheDrop* drop = [MBThreadsafeCacheDrop new];
+    drop->_delegate = delegate;
+    drop->_tier = self;
+    drop->_obj = obj;
+    drop->_key = key;
+    if (!shard->_drops) {
+        shard->_drops = [NSMutableArray new];
+    }
+    [shard->_drops addObject:drop];
+}
+
+/******************************************************************************/
+#pragma mark Statistics
+/******************************************************************************/
+
+- (BOOL) measuresLatency
+{
+    return atomic_load_explicit(&_firstShard->_stats->_measuresLatency, memory_order_relaxed);
+}
+
+- (void) setMeasuresLatency:(BOOL)measuresLatency
+{
+    for (MBThreadsafeCacheShard* shard in _shards) {
+        atomic_store_explicit(&shard->_stats->_measuresLatency, measuresLatency, memory_order_relaxed);
+    }
+}
+
+- (nonnull MBCacheStatistics*) statistics
+{
+    NSMutableArray* recorders = [NSMutableArray arrayWithCapacity:_shardMask + 1];
+    for (MBThreadsafeCacheShard* shard in _shards) {
+        [recorders addObject:shard->_stats];
+    }
+    return [[MBCacheStatistics alloc] initWithRecorders:recorders];
+}
+
+- (BOOL) lookUpObject:(id __nullable __strong * __nonnull)objPtr inSnapshotForMemoryCacheKey:(nonnull id)key
+{
+    if (_concurrencyMode != MBThreadsafeCacheConcurrencyModeSnapshot) {
+        return NO;
+    }
+
+    return MBObjectFromSnapshot([self _shardForMemoryCacheKey:key], key, _exceptionProtection, objPtr);
+}
+
+- (void) recordLookupOfKey:(nonnull id)key hit:(BOOL)hit
+{
+    MBRecordLookup([self _shardForMemoryCacheKey:key], key, hit);
+}
+
+- (void) incrementCounter:(MBCacheCounter)counter by:(uint64_t)amount forKey:(nonnull id)key
+{
+    MBCacheStatisticsIncrement([self _shardForMemoryCacheKey:key]->_stats, counter, amount);
+}
+
+- (uint64_t) beginMeasuringLatency
+{
+    return MBCacheStatisticsBegin(_firstShard->_stats);
+}
+
+- (void) endMeasuringLatency:(MBCacheLatency)latency startedAt:(uint64_t)start forKey:(nonnull id)key
+{
+    MBCacheStatisticsEnd([self _shardForMemoryCacheKey:key]->_stats, latency, start);
+}
+
+/******************************************************************************/
+#pragma mark Memory management
+/******************************************************************************/
+
+#if MB_BUILD_UIKIT
+- (void) memoryWarning
+{
+	MBLogDebugTrace();
+	
+	[self clearMemoryCache];
+}
+#endif
+
+/******************************************************************************/
+#pragma mark Expiring cached items
+/******************************************************************************/
+
+- (void) setDefaultTimeToLive:(NSTimeInterval)defaultTimeToLive
+{
+    [self lock];
+    _defaultTimeToLive = defaultTimeToLive;
+    if (defaultTimeToLive > 0) {
+        for (MBThreadsafeCacheShard* shard in _shards) {
+            shard->_tracksExpiry = YES;
+            shard->_dirty = YES;
+            [self _trackEntriesInShard:shard];
+        }
+    }
+    [self unlock];
+}
+
+- (void) setExpirySweepInterval:(NSTimeInterval)interval
+{
+    @synchronized (self) {
+        _expirySweepInterval = interval;
+
+        if (_expirySweepTimer) {
+            dispatch_source_cancel(_expirySweepTimer);
+            _expirySweepTimer = nil;
+        }
+
+        if (interval > 0) {
+            dispatch_queue_t q = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0);
+            dispatch_source_t timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, q);
+            uint64_t nanos = (uint64_t)(interval * NSEC_PER_SEC);
+            dispatch_source_set_timer(timer, dispatch_time(DISPATCH_TIME_NOW, nanos), nanos, nanos / 10);
+
+            __weak MBThreadsafeCache* weakSelf = self;
+            dispatch_source_set_event_handler(timer, ^{
+                [weakSelf purgeExpiredObjects];
+            });
+            dispatch_resume(timer);
+
+            _expirySweepTimer = timer;
+        }
+    }
+}
+
+- (NSUInteger) expirationCount
+{
+    NSUInteger total = 0;
+    for (MBThreadsafeCacheShard* shard in _shards) {
+        total += atomic_load_explicit(&shard->_stats->_counters[MBCacheCounterExpirations], memory_order_relaxed);
+    }
+    return total;
+}
+
+// must be called with the shard exclusively locked
+- (void) _removeExpiredObjectForKey:(id)key inShard:(MBThreadsafeCacheShard*)shard
+{
+    MBLogDebug(@"%@ expired object for key: %@", [self class], key);
+
+    [shard->_cache removeObjectForKey:key];
+    [shard->_entries removeEntryForKey:key];
+    shard->_dirty = YES;
+    MBCacheStatisticsIncrement(shard->_stats, MBCacheCounterExpirations, 1);
+}
+
+// returns YES if the entry for the key has expired; when the shard is held
+// exclusively, the expired object is also removed from the shard
+- (BOOL) _expireObjectForKey:(id)key inShard:(MBThreadsafeCacheShard*)shard entry:(MBCacheEntry*)entry
+{
+    if (!entry->_expiresAt || entry->_expiresAt > [NSDate timeIntervalSinceReferenceDate]) {
+        return NO;
+    }
+    if (_concurrencyMode != MBThreadsafeCacheConcurrencyModeReadWrite) {
+        [self _removeExpiredObjectForKey:key inShard:shard];
+    }
+    return YES;
+}
+
+- (void) purgeExpiredObjects
+{
+    MBLogDebugTrace();
+
+    NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+    for (MBThreadsafeCacheShard* shard in _shards) {
+        MBLockShard(shard);
+        if (shard->_tracksExpiry) {
+            for (id key in [shard->_entries keysOfEntriesExpiredAsOf:now]) {
+                [self _removeExpiredObjectForKey:key inShard:shard];
+            }
+        }
+        MBUnlockShard(shard);
+    }
+}
+
+- (void) _setTimeToLive:(NSTimeInterval)ttl forMemoryCacheKey:(id)key inShard:(MBThreadsafeCacheShard*)shard
+{
+    if (!shard->_tracksExpiry) {
+        if (ttl <= 0) {
+            return;     // nothing to track
+        }
+        shard->_tracksExpiry = YES;
+        shard->_dirty = YES;
+        [self _trackEntriesInShard:shard];
+    }
+
+    MBCacheEntry* entry = [shard->_entries entryForKey:key];
+    if (entry) {
+        entry->_expiresAt = (ttl > 0) ? [NSDate timeIntervalSinceReferenceDate] + ttl : 0;
+    }
+}
+
+- (void) setObject:(nonnull id)obj forKey:(nonnull id)key timeToLive:(NSTimeInterval)ttl
+{
+    MBLogDebugTrace();
+
+    ((void (*)(id, SEL, id, id, NSTimeInterval))_setObjectWithTTLOp.imp)(self, _setObjectWithTTLOp.sel, obj, key, ttl);
+}
+
+/******************************************************************************/
+#pragma mark Sharding
+/******************************************************************************/
+
+- (nonnull id) memoryCacheKeyForKey:(nonnull id)key
+{
+    return key;
+}
+
+- (NSUInteger) _shardIndexForMemoryCacheKey:(id)key
+{
+    // spread the bits of the key's hash using a Fibonacci multiplier; many
+    // -hash implementations leave the low-order bits poorly distributed
+    uint64_t hash = (uint64_t)[key hash] * 0x9E3779B97F4A7C15ULL;
+    return (NSUInteger)(hash >> 32) & _shardMask;
+}
 
-        _lock = [NSRecursiveLock new];
-        _cache = [NSMutableDictionary new];
+- (MBThreadsafeCacheShard*) _shardForMemoryCacheKey:(id)key
+{
+    if (!_shardMask) {
+        return _firstShard;
+    }
+    return _shards[[self _shardIndexForMemoryCacheKey:key]];
+}
 
-#if MB_BUILD_UIKIT
-        _clearOnMemoryWarning = !ignore;
-        if (_clearOnMemoryWarning) {
-            [[NSNotificationCenter defaultCenter] addObserver:self
-                                                     selector:@selector(memoryWarning)
-                                                         name:UIApplicationDidReceiveMemoryWarningNotification
-                                                       object:nil];
-        }        
-#endif
+- (MBThreadsafeCacheShard*) _shardForKey:(id)key
+{
+    if (!_shardMask) {
+        return _firstShard;
     }
-    return self;
+    return [self _shardForMemoryCacheKey:[self memoryCacheKeyForKey:key]];
 }
 
-#if MB_BUILD_UIKIT
-- (void) dealloc
+- (void) lockShardForKey:(nonnull id)key
 {
-    if (_clearOnMemoryWarning) {
-        [[NSNotificationCenter defaultCenter] removeObserver:self];
-    }            
+    MBLockShard([self _shardForMemoryCacheKey:key]);
 }
-#endif
 
-/******************************************************************************/
-#pragma mark Memory management
-/******************************************************************************/
+- (void) unlockShardForKey:(nonnull id)key
+{
+    MBUnlockShard([self _shardForMemoryCacheKey:key]);
+}
 
-#if MB_BUILD_UIKIT
-- (void) memoryWarning
+- (void) lockShardForReadingForKey:(nonnull id)key
 {
-	MBLogDebugTrace();
-	
-	[self clearMemoryCache];
+    MBLockShardForReading([self _shardForMemoryCacheKey:key]);
+}
+
+- (void) unlockShardForReadingForKey:(nonnull id)key
+{
+    MBUnlockShardForReading([self _shardForMemoryCacheKey:key]);
 }
-#endif
 
 /******************************************************************************/
 #pragma mark Locking & unlocking (for external use)
@@ -99,14 +912,31 @@
 {
     MBLogDebugTrace();
     
-    [_lock lock];
+    // shards are always locked in the same order to avoid deadlock
+    for (MBThreadsafeCacheShard* shard in _shards) {
+        MBLockShard(shard);
+    }
 }
 
 - (void) unlock
 {
     MBLogDebugTrace();
 
-    [_lock unlock];
+    // objects dropped while every shard was held (when applying new limits,
+    // for example) are reported once none is
+    NSMutableArray* drops = nil;
+    for (MBThreadsafeCacheShard* shard in [_shards reverseObjectEnumerator]) {
+        NSArray* shardDrops = MBUnlockShardDeferringDrops(shard);
+        if (shardDrops) {
+            if (!drops) {
+                drops = [NSMutableArray new];
+            }
+            [drops addObjectsFromArray:shardDrops];
+        }
+    }
+    if (drops) {
+        MBReportDrops(drops);
+    }
 }
 
 /******************************************************************************/
@@ -115,32 +945,179 @@
 
 - (NSMutableDictionary*) internalCache
 {
-    return _cache;
+    // the caller may mutate the dictionary directly
+    _firstShard->_dirty = YES;
+    return _firstShard->_cache;
+}
+
+- (NSMutableDictionary*) internalCacheForKey:(id)key
+{
+    MBThreadsafeCacheShard* shard = [self _shardForMemoryCacheKey:key];
+    shard->_dirty = YES;
+    return shard->_cache;
+}
+
+- (NSArray*) memoryCacheKeysWithLimit:(NSUInteger)limit
+{
+    NSMutableArray* shardKeys = [NSMutableArray arrayWithCapacity:_shardMask + 1];
+    NSUInteger total = 0;
+    for (MBThreadsafeCacheShard* shard in _shards) {
+        MBLockShardForReading(shard);
+        NSArray* keys = (shard->_entries ? [shard->_entries keysByRecency] : [shard->_cache allKeys]);
+        MBUnlockShardForReading(shard);
+
+        [shardKeys addObject:keys];
+        total += keys.count;
+    }
+    if (shardKeys.count == 1) {
+        NSArray* keys = shardKeys[0];
+        return (limit && keys.count > limit) ? [keys subarrayWithRange:NSMakeRange(0, limit)] : keys;
+    }
+
+    // interleaving the shards approximates an overall recency order
+    NSUInteger count = (limit ? MIN(limit, total) : total);
+    NSMutableArray* keys = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger i=0; keys.count < count; i++) {
+        for (NSArray* list in shardKeys) {
+            if (i < list.count && keys.count < count) {
+                [keys addObject:list[i]];
+            }
+        }
+    }
+    return keys;
 }
 
 - (void) internalClearMemoryCache
 {
-    [_cache removeAllObjects];
+    for (MBThreadsafeCacheShard* shard in _shards) {
+        [shard->_cache removeAllObjects];
+        [shard->_entries removeAllEntries];
+        shard->_dirty = YES;
+    }
 }
 
 - (BOOL) internalIsKeyInCache:(id)key
 {
-    return (_cache[key] != nil);
+    MBThreadsafeCacheShard* shard = [self _shardForMemoryCacheKey:key];
+    if (!shard->_cache[key]) {
+        return NO;
+    }
+    if (shard->_tracksExpiry) {
+        MBCacheEntry* entry = [shard->_entries entryForKey:key];
+        if (entry && [self _expireObjectForKey:key inShard:shard entry:entry]) {
+            return NO;
+        }
+    }
+    return YES;
 }
 
 - (id) internalObjectForKey:(id)key
 {
-    return _cache[key];
+    return [self _memoryObjectForKey:key];
+}
+
+// consults only the memory cache, whatever subclasses do with
+// internalObjectForKey:; the shard must be locked exclusively
+- (id) _memoryObjectForKey:(id)key
+{
+    MBThreadsafeCacheShard* shard = [self _shardForMemoryCacheKey:key];
+    id obj = shard->_cache[key];
+    if (obj && shard->_entries) {
+        MBCacheEntry* entry = [shard->_entries entryForKey:key];
+        if (entry) {
+            if (shard->_tracksExpiry && [self _expireObjectForKey:key inShard:shard entry:entry]) {
+                return nil;
+            }
+            [shard->_entries entryAccessed:entry];
+        }
+    }
+    return obj;
+}
+
+// must be called with the shard exclusively locked; returns NO if the
+// admission policy judges the new key less valuable than what it displaces
+- (BOOL) _shouldAdmitKey:(id)key cost:(NSUInteger)cost toShard:(MBThreadsafeCacheShard*)shard
+{
+    MBCacheEntryList* entries = shard->_entries;
+    NSUInteger countLimit = shard->_countLimit;
+    NSUInteger costLimit = shard->_costLimit;
+    if (!shard->_sketch || shard->_cache[key]) {
+        return YES;     // admission is unfiltered, or this is a replacement
+    }
+
+    __block NSUInteger count = entries.count + 1;
+    __block NSUInteger totalCost = entries.totalCost + cost;
+    if ((!countLimit || count <= countLimit) && (!costLimit || totalCost <= costLimit)) {
+        return YES;     // there's room without evicting anything
+    }
+
+    // the candidate must be accessed more often than every entry that
+    // would be evicted to make room for it
+    MBCacheFrequencySketch* sketch = shard->_sketch;
+    NSUInteger frequency = [sketch frequencyOfKey:key];
+    __block BOOL admit = YES;
+    [entries enumerateVictimsUsingBlock:^(MBCacheEntry* victim, BOOL* stop) {
+        if ([sketch frequencyOfKey:victim->_key] >= frequency) {
+            admit = NO;
+            *stop = YES;
+            return;
+        }
+        count--;
+        totalCost -= MIN(victim->_cost, totalCost);
+        if ((!countLimit || count <= countLimit) && (!costLimit || totalCost <= costLimit)) {
+            *stop = YES;
+        }
+    }];
+    return admit;
 }
 
 - (void) internalSetObject:(id)obj forKey:(id)key
 {
-    _cache[key] = obj;
+    [self internalSetObject:obj forMemoryCacheKey:key originalKey:nil];
+}
+
+- (void) internalSetObject:(id)obj forMemoryCacheKey:(id)memKey originalKey:(id)key
+{
+    MBThreadsafeCacheShard* shard = [self _shardForMemoryCacheKey:memKey];
+    NSUInteger cost = (shard->_entries ? [self costOfObject:obj forKey:memKey] : 0);
+    if (![self _shouldAdmitKey:memKey cost:cost toShard:shard]) {
+        MBCacheStatisticsIncrement(shard->_stats, MBCacheCounterRejections, 1);
+        MBLogDebug(@"%@ declined to admit object for key: %@", [self class], memKey);
+        [self _objectDropped:obj forMemoryCacheKey:memKey originalKey:key inShard:shard];
+        return;
+    }
+
+    shard->_cache[memKey] = obj;
+    shard->_dirty = YES;
+    if (shard->_entries) {
+        MBCacheEntry* entry = [shard->_entries addEntryForKey:memKey cost:cost];
+        entry->_originalKey = key;
+        if (_defaultTimeToLive > 0) {
+            entry->_expiresAt = [NSDate timeIntervalSinceReferenceDate] + _defaultTimeToLive;
+        }
+        [self _trimShard:shard];
+    }
 }
 
 - (void) internalRemoveObjectForKey:(id)key
 {
-    [_cache removeObjectForKey:key];
+    MBThreadsafeCacheShard* shard = [self _shardForMemoryCacheKey:key];
+    [shard->_cache removeObjectForKey:key];
+    [shard->_entries removeEntryForKey:key];
+    shard->_dirty = YES;
+}
+
+- (NSUInteger) costOfObject:(id)obj forKey:(id)key
+{
+    if ([obj isKindOfClass:[NSData class]]) {
+        return [(NSData*)obj length];
+    }
+    return 0;
+}
+
+- (void) internalObjectEvicted:(id)obj forKey:(id)key
+{
+    // nothing to do; subclasses may demote the object
 }
 
 /******************************************************************************/
@@ -149,12 +1126,12 @@
 
 - (void) _clearCacheProtected
 {
-    [_lock lock];
+    [self lock];
     @try {
         [self internalClearMemoryCache];
     }
     @finally {
-        [_lock unlock];
+        [self unlock];
     }
 }
 
@@ -162,46 +1139,173 @@
 {
     MBLogDebugTrace();
     
-    [_lock lock];
+    MBThreadsafeCacheShard* shard = [self _shardForKey:key];
+    MBLockShardForReading(shard);
     @try {
         return [self internalIsKeyInCache:key];
     }
     @finally {
-        [_lock unlock];
+        MBUnlockShardForReading(shard);
     }
 }
 
 - (id) _objectForKeyProtected:(id)key
 {
-    [_lock lock];
+    MBThreadsafeCacheShard* shard = [self _shardForKey:key];
+    id obj = nil;
+    MBLockShardForReading(shard);
     @try {
-        return [self internalObjectForKey:key];
+        obj = [self internalObjectForKey:key];
+        MBRecordLookup(shard, (shard->_sketch ? [self memoryCacheKeyForKey:key] : nil), (obj != nil));
     }
     @finally {
-        [_lock unlock];
+        MBUnlockShardForReading(shard);
+    }
+    return obj;
+}
+
+- (BOOL) _isKeyInCacheSnapshotProtected:(id)key
+{
+    if (key) {
+        id memKey = [self memoryCacheKeyForKey:key];
+        id obj = nil;
+        if (MBLookUpInSnapshot([self _shardForMemoryCacheKey:memKey], memKey, YES, &obj)) {
+            return (obj != nil);
+        }
+    }
+    return [self _isKeyInCacheProtected:key];
+}
+
+- (id) _objectForKeySnapshotProtected:(id)key
+{
+    if (key) {
+        id memKey = [self memoryCacheKeyForKey:key];
+        id obj = nil;
+        if (MBObjectFromSnapshot([self _shardForMemoryCacheKey:memKey], memKey, YES, &obj)) {
+            return obj;
+        }
     }
+    return [self _objectForKeyProtected:key];
 }
 
 - (void) _setObjectProtected:(id)obj forKey:(id)key
 {
-    [_lock lock];
+    MBThreadsafeCacheShard* shard = [self _shardForKey:key];
+    MBLockShard(shard);
     @try {
         [self internalSetObject:obj forKey:key];
     }
     @finally {
-        [_lock unlock];
+        MBUnlockShard(shard);
     }
+    MBCacheStatisticsIncrement(shard->_stats, MBCacheCounterSets, 1);
 }
 
 - (void) _removeObjectForKeyProtected:(id)key
 {
-    [_lock lock];
+    MBThreadsafeCacheShard* shard = [self _shardForKey:key];
+    MBLockShard(shard);
     @try {
         [self internalRemoveObjectForKey:key];
     }
     @finally {
-        [_lock unlock];
+        MBUnlockShard(shard);
+    }
+}
+
+- (void) _setObjectProtected:(id)obj forKey:(id)key timeToLive:(NSTimeInterval)ttl
+{
+    if (!key || !obj) {
+        [NSException raise:NSInvalidArgumentException format:@"illegal argument: nil %@", (!key ? @"key" : @"value")];
+    }
+
+    id memKey = [self memoryCacheKeyForKey:key];
+    MBThreadsafeCacheShard* shard = [self _shardForMemoryCacheKey:memKey];
+    MBLockShard(shard);
+    @try {
+        [self internalSetObject:obj forKey:key];
+        [self _setTimeToLive:ttl forMemoryCacheKey:memKey inShard:shard];
+    }
+    @finally {
+        MBUnlockShard(shard);
+    }
+    MBCacheStatisticsIncrement(shard->_stats, MBCacheCounterSets, 1);
+}
+
+- (void) _collectObjectsForKeysProtected:(NSArray*)keys
+                                 inShard:(MBThreadsafeCacheShard*)shard
+                                intoKeys:(NSMutableArray*)foundKeys
+                                 objects:(NSMutableArray*)foundObjects
+{
+    MBLockShardForReading(shard);
+    @try {
+        [self _collectObjectsForKeys:keys fromShard:shard intoKeys:foundKeys objects:foundObjects];
+    }
+    @finally {
+        MBUnlockShardForReading(shard);
+    }
+}
+
+- (void) _collectObjectsForKeysSnapshotProtected:(NSArray*)keys
+                                         inShard:(MBThreadsafeCacheShard*)shard
+                                        intoKeys:(NSMutableArray*)foundKeys
+                                         objects:(NSMutableArray*)foundObjects
+{
+    if (![self _collectObjectsForKeys:keys fromSnapshotOfShard:shard protect:YES intoKeys:foundKeys objects:foundObjects]) {
+        [self _collectObjectsForKeysProtected:keys inShard:shard intoKeys:foundKeys objects:foundObjects];
+    }
+}
+
+- (void) _setObjectsForKeysProtected:(NSArray*)keys
+                             inShard:(MBThreadsafeCacheShard*)shard
+                      fromDictionary:(NSDictionary*)objectsAndKeys
+{
+    MBLockShard(shard);
+    @try {
+        [self _setObjectsForKeys:keys fromDictionary:objectsAndKeys];
+    }
+    @finally {
+        MBUnlockShard(shard);
+    }
+    MBCacheStatisticsIncrement(shard->_stats, MBCacheCounterSets, keys.count);
+}
+
+- (nullable id) _objectForMemoryCacheKeyProtected:(id)memKey
+                                   coalescingLoad:(id (^)(NSErrorPtrPtr errPtr))loader
+                                            error:(NSErrorPtrPtr)errPtr
+{
+    MBThreadsafeCacheShard* shard = [self _shardForMemoryCacheKey:memKey];
+    MBThreadsafeCacheLoad* load = nil;
+    BOOL isLoader = NO;
+    id obj = nil;
+
+    MBLockShard(shard);
+    @try {
+        obj = [self _memoryObjectForKey:memKey inShard:shard orLoad:&load isLoader:&isLoader];
+    }
+    @finally {
+        MBUnlockShard(shard);
+    }
+
+    if (obj) {
+        return obj;
+    }
+
+    if (isLoader) {
+        NSError* err = nil;
+        id result = nil;
+        @try {
+            result = loader(&err);
+        }
+        @catch (NSException* ex) {
+            err = [NSError mockingbirdErrorWithException:ex];
+            @throw;
+        }
+        @finally {
+            [self _finishLoad:load forMemoryCacheKey:memKey inShard:shard result:result error:err];
+        }
     }
+    return [self _resultOfLoad:load isLoader:isLoader forMemoryCacheKey:memKey error:errPtr];
 }
 
 /******************************************************************************/
@@ -210,18 +1314,19 @@
 
 - (void) _clearCacheUnprotected
 {
-    [_lock lock];
+    [self lock];
     [self internalClearMemoryCache];
-    [_lock unlock];
+    [self unlock];
 }
 
 - (BOOL) _isKeyInCacheUnprotected:(id)key
 {
     MBLogDebugTrace();
     
-    [_lock lock];
+    MBThreadsafeCacheShard* shard = [self _shardForKey:key];
+    MBLockShardForReading(shard);
     BOOL inCache = [self internalIsKeyInCache:key];
-    [_lock unlock];
+    MBUnlockShardForReading(shard);
     return inCache;
 }
 
@@ -234,12 +1339,38 @@
         [NSException raise:NSInvalidArgumentException format:@"illegal argument: nil key"];
     }
     
-    [_lock lock];
+    MBThreadsafeCacheShard* shard = [self _shardForKey:key];
+    MBLockShardForReading(shard);
     id obj = [self internalObjectForKey:key];
-    [_lock unlock];
+    MBRecordLookup(shard, (shard->_sketch ? [self memoryCacheKeyForKey:key] : nil), (obj != nil));
+    MBUnlockShardForReading(shard);
     return obj;
 }
 
+- (BOOL) _isKeyInCacheSnapshotUnprotected:(id)key
+{
+    if (key) {
+        id memKey = [self memoryCacheKeyForKey:key];
+        id obj = nil;
+        if (MBLookUpInSnapshot([self _shardForMemoryCacheKey:memKey], memKey, NO, &obj)) {
+            return (obj != nil);
+        }
+    }
+    return [self _isKeyInCacheUnprotected:key];
+}
+
+- (id) _objectForKeySnapshotUnprotected:(id)key
+{
+    if (key) {
+        id memKey = [self memoryCacheKeyForKey:key];
+        id obj = nil;
+        if (MBObjectFromSnapshot([self _shardForMemoryCacheKey:memKey], memKey, NO, &obj)) {
+            return obj;
+        }
+    }
+    return [self _objectForKeyUnprotected:key];
+}
+
 - (void) _setObjectUnprotected:(id)obj forKey:(id)key
 {
     if (!key || !obj) {
@@ -249,9 +1380,11 @@
         [NSException raise:NSInvalidArgumentException format:@"illegal argument: nil %@", (!key ? @"key" : @"value")];
     }
     
-    [_lock lock];
+    MBThreadsafeCacheShard* shard = [self _shardForKey:key];
+    MBLockShard(shard);
     [self internalSetObject:obj forKey:key];
-    [_lock unlock];
+    MBUnlockShard(shard);
+    MBCacheStatisticsIncrement(shard->_stats, MBCacheCounterSets, 1);
 }
 
 - (void) _removeObjectForKeyUnprotected:(id)key
@@ -263,9 +1396,89 @@
         [NSException raise:NSInvalidArgumentException format:@"illegal argument: nil key"];
     }
     
-    [_lock lock];
+    MBThreadsafeCacheShard* shard = [self _shardForKey:key];
+    MBLockShard(shard);
     [self internalRemoveObjectForKey:key];
-    [_lock unlock];
+    MBUnlockShard(shard);
+}
+
+- (void) _setObjectUnprotected:(id)obj forKey:(id)key timeToLive:(NSTimeInterval)ttl
+{
+    if (!key || !obj) {
+        // this would throw an exception if we passed it on
+        // to _cache. it would defeat our avoidance of exception
+        // protection around the locking/unlocking
+        [NSException raise:NSInvalidArgumentException format:@"illegal argument: nil %@", (!key ? @"key" : @"value")];
+    }
+
+    id memKey = [self memoryCacheKeyForKey:key];
+    MBThreadsafeCacheShard* shard = [self _shardForMemoryCacheKey:memKey];
+    MBLockShard(shard);
+    [self internalSetObject:obj forKey:key];
+    [self _setTimeToLive:ttl forMemoryCacheKey:memKey inShard:shard];
+    MBUnlockShard(shard);
+    MBCacheStatisticsIncrement(shard->_stats, MBCacheCounterSets, 1);
+}
+
+- (void) _collectObjectsForKeysUnprotected:(NSArray*)keys
+                                   inShard:(MBThreadsafeCacheShard*)shard
+                                  intoKeys:(NSMutableArray*)foundKeys
+                                   objects:(NSMutableArray*)foundObjects
+{
+    MBLockShardForReading(shard);
+    [self _collectObjectsForKeys:keys fromShard:shard intoKeys:foundKeys objects:foundObjects];
+    MBUnlockShardForReading(shard);
+}
+
+- (void) _collectObjectsForKeysSnapshotUnprotected:(NSArray*)keys
+                                           inShard:(MBThreadsafeCacheShard*)shard
+                                          intoKeys:(NSMutableArray*)foundKeys
+                                           objects:(NSMutableArray*)foundObjects
+{
+    if (![self _collectObjectsForKeys:keys fromSnapshotOfShard:shard protect:NO intoKeys:foundKeys objects:foundObjects]) {
+        [self _collectObjectsForKeysUnprotected:keys inShard:shard intoKeys:foundKeys objects:foundObjects];
+    }
+}
+
+- (void) _setObjectsForKeysUnprotected:(NSArray*)keys
+                               inShard:(MBThreadsafeCacheShard*)shard
+                        fromDictionary:(NSDictionary*)objectsAndKeys
+{
+    MBLockShard(shard);
+    [self _setObjectsForKeys:keys fromDictionary:objectsAndKeys];
+    MBUnlockShard(shard);
+    MBCacheStatisticsIncrement(shard->_stats, MBCacheCounterSets, keys.count);
+}
+
+- (nullable id) _objectForMemoryCacheKeyUnprotected:(id)memKey
+                                     coalescingLoad:(id (^)(NSErrorPtrPtr errPtr))loader
+                                              error:(NSErrorPtrPtr)errPtr
+{
+    if (!memKey) {
+        // this would throw an exception if we passed it on
+        // to _loads. it would defeat our avoidance of exception
+        // protection around the locking/unlocking
+        [NSException raise:NSInvalidArgumentException format:@"illegal argument: nil key"];
+    }
+
+    MBThreadsafeCacheShard* shard = [self _shardForMemoryCacheKey:memKey];
+    MBThreadsafeCacheLoad* load = nil;
+    BOOL isLoader = NO;
+
+    MBLockShard(shard);
+    id obj = [self _memoryObjectForKey:memKey inShard:shard orLoad:&load isLoader:&isLoader];
+    MBUnlockShard(shard);
+
+    if (obj) {
+        return obj;
+    }
+
+    if (isLoader) {
+        NSError* err = nil;
+        id result = loader(&err);
+        [self _finishLoad:load forMemoryCacheKey:memKey inShard:shard result:result error:err];
+    }
+    return [self _resultOfLoad:load isLoader:isLoader forMemoryCacheKey:memKey error:errPtr];
 }
 
 /******************************************************************************/
@@ -276,60 +1489,242 @@
 {
 	MBLogDebugTrace();
 	
-    if (_exceptionProtection) {
-        [self _clearCacheProtected];
-    }
-    else {
-        [self _clearCacheUnprotected];
-    }
+    ((void (*)(id, SEL))_clearCacheOp.imp)(self, _clearCacheOp.sel);
 }
 
 - (BOOL) isKeyInCache:(nonnull id)key
 {
     MBLogDebugTrace();
     
-    if (_exceptionProtection) {
-        return [self _isKeyInCacheProtected:key];
-    }
-    else {
-        return [self _isKeyInCacheUnprotected:key];
-    }
+    return ((BOOL (*)(id, SEL, id))_isKeyInCacheOp.imp)(self, _isKeyInCacheOp.sel, key);
 }
 
 - (nullable id) objectForKey:(nonnull id)key
 {
 	MBLogDebugTrace();
 
-    if (_exceptionProtection) {
-        return [self _objectForKeyProtected:key];
-    }
-    else {
-        return [self _objectForKeyUnprotected:key];
-    }
+    return ((id (*)(id, SEL, id))_objectForKeyOp.imp)(self, _objectForKeyOp.sel, key);
 }
 
 - (void) setObject:(nonnull id)obj forKey:(nonnull id)key
 {
 	MBLogDebugTrace();
     
-    if (_exceptionProtection) {
-        [self _setObjectProtected:obj forKey:key];
-    }
-    else {
-        [self _setObjectUnprotected:obj forKey:key];
-    }
+    ((void (*)(id, SEL, id, id))_setObjectOp.imp)(self, _setObjectOp.sel, obj, key);
 }
 
 - (void) removeObjectForKey:(nonnull id)key
 {
 	MBLogDebugTrace();
 
-    if (_exceptionProtection) {
-        [self _removeObjectForKeyProtected:key];
+    ((void (*)(id, SEL, id))_removeObjectOp.imp)(self, _removeObjectOp.sel, key);
+}
+
+/******************************************************************************/
+#pragma mark Batch access
+/******************************************************************************/
+
+// calls the block once for each shard that the keys map to, passing the
+// shard along with the keys that belong to it in their original order
+- (void) _enumerateShardsForKeys:(NSArray*)keys
+                      usingBlock:(void (^)(MBThreadsafeCacheShard* shard, NSArray* shardKeys))block
+{
+    if (!_shardMask) {
+        if (keys.count) {
+            block(_firstShard, keys);
+        }
+        return;
     }
-    else {
-        [self _removeObjectForKeyUnprotected:key];
+
+    __strong NSMutableArray* shardKeys[kMaxShardCount] = {nil};
+    for (id key in keys) {
+        NSUInteger index = [self _shardIndexForMemoryCacheKey:[self memoryCacheKeyForKey:key]];
+        if (!shardKeys[index]) {
+            shardKeys[index] = [NSMutableArray new];
+        }
+        [shardKeys[index] addObject:key];
+    }
+
+    for (NSUInteger i=0; i<=_shardMask; i++) {
+        if (shardKeys[i]) {
+            block(_shards[i], shardKeys[i]);
+        }
+    }
+}
+
+// must be called with the shard locked
+- (void) _collectObjectsForKeys:(NSArray*)keys
+                      fromShard:(MBThreadsafeCacheShard*)shard
+                       intoKeys:(NSMutableArray*)foundKeys
+                        objects:(NSMutableArray*)foundObjects
+{
+    for (id key in keys) {
+        id obj = [self internalObjectForKey:key];
+        MBRecordLookup(shard, (shard->_sketch ? [self memoryCacheKeyForKey:key] : nil), (obj != nil));
+        if (obj) {
+            [foundKeys addObject:key];
+            [foundObjects addObject:obj];
+        }
+    }
+}
+
+// returns NO, without collecting anything, if the shard has no snapshot
+- (BOOL) _collectObjectsForKeys:(NSArray*)keys
+            fromSnapshotOfShard:(MBThreadsafeCacheShard*)shard
+                        protect:(BOOL)protect
+                       intoKeys:(NSMutableArray*)foundKeys
+                        objects:(NSMutableArray*)foundObjects
+{
+    NSUInteger hits = 0;
+    for (id key in keys) {
+        id obj = nil;
+        if (!MBLookUpInSnapshot(shard, [self memoryCacheKeyForKey:key], protect, &obj)) {
+            // the snapshot was withdrawn partway through; start over locked
+            [foundKeys removeObjectsInRange:NSMakeRange(foundKeys.count - hits, hits)];
+            [foundObjects removeObjectsInRange:NSMakeRange(foundObjects.count - hits, hits)];
+            return NO;
+        }
+        if (obj) {
+            [foundKeys addObject:key];
+            [foundObjects addObject:obj];
+            hits++;
+        }
+    }
+    MBCacheStatisticsIncrement(shard->_stats, MBCacheCounterMemoryHits, hits);
+    MBCacheStatisticsIncrement(shard->_stats, MBCacheCounterMemoryMisses, keys.count - hits);
+    return YES;
+}
+
+// must be called with the shard exclusively locked
+- (void) _setObjectsForKeys:(NSArray*)keys fromDictionary:(NSDictionary*)objectsAndKeys
+{
+    for (id key in keys) {
+        [self internalSetObject:objectsAndKeys[key] forKey:key];
+    }
+}
+
+- (nonnull NSDictionary*) objectsForKeys:(nonnull NSArray*)keys
+{
+    MBLogDebugTrace();
+
+    // objects are collected under the lock, but the dictionary is built
+    // afterwards, since copying the keys could raise an exception
+    NSMutableArray* foundKeys = [NSMutableArray arrayWithCapacity:keys.count];
+    NSMutableArray* foundObjects = [NSMutableArray arrayWithCapacity:keys.count];
+    MBThreadsafeCacheOperation op = _collectObjectsOp;
+    [self _enumerateShardsForKeys:keys usingBlock:^(MBThreadsafeCacheShard* shard, NSArray* shardKeys) {
+        ((void (*)(id, SEL, NSArray*, MBThreadsafeCacheShard*, NSMutableArray*, NSMutableArray*))op.imp)(self, op.sel, shardKeys, shard, foundKeys, foundObjects);
+    }];
+
+    return [NSDictionary dictionaryWithObjects:foundObjects forKeys:foundKeys];
+}
+
+- (void) setObjectsAndKeys:(nonnull NSDictionary*)objectsAndKeys
+{
+    MBLogDebugTrace();
+
+    MBThreadsafeCacheOperation op = _setObjectsOp;
+    [self _enumerateShardsForKeys:[objectsAndKeys allKeys] usingBlock:^(MBThreadsafeCacheShard* shard, NSArray* shardKeys) {
+        ((void (*)(id, SEL, NSArray*, MBThreadsafeCacheShard*, NSDictionary*))op.imp)(self, op.sel, shardKeys, shard, objectsAndKeys);
+    }];
+}
+
+/******************************************************************************/
+#pragma mark Coalesced loading
+/******************************************************************************/
+
+- (nullable id) objectForKey:(nonnull id)key
+                      orLoad:(nullable id (^ __nonnull)(NSErrorPtrPtr errPtr))loader
+                       error:(NSErrorPtrPtr)errPtr
+{
+    MBLogDebugTrace();
+
+    id obj = [self objectForKey:key];
+    if (obj) {
+        return obj;
+    }
+
+    id memKey = [self memoryCacheKeyForKey:key];
+    MBThreadsafeCacheShard* shard = [self _shardForMemoryCacheKey:memKey];
+    return [self objectForMemoryCacheKey:memKey
+                          coalescingLoad:^id(NSErrorPtrPtr loadErrPtr) {
+                              uint64_t start = MBCacheStatisticsBegin(shard->_stats);
+                              id result = loader(loadErrPtr);
+                              MBCacheStatisticsEnd(shard->_stats, MBCacheLatencyLoad, start);
+                              if (result) {
+                                  [self setObject:result forKey:key];
+                              }
+                              return result;
+                          }
+                                   error:errPtr];
+}
+
+// must be called with the shard exclusively locked; returns the object if
+// it is in the memory cache, otherwise joins the key's in-flight load,
+// starting one (and setting *isLoaderPtr) if there is none
+- (nullable id) _memoryObjectForKey:(id)memKey
+                            inShard:(MBThreadsafeCacheShard*)shard
+                             orLoad:(MBThreadsafeCacheLoad**)loadPtr
+                           isLoader:(BOOL*)isLoaderPtr
+{
+    id obj = [self _memoryObjectForKey:memKey];
+    if (obj) {
+        return obj;
     }
+
+    MBThreadsafeCacheLoad* load = shard->_loads[memKey];
+    if (!load) {
+        load = [MBThreadsafeCacheLoad new];
+        if (!shard->_loads) {
+            shard->_loads = [NSMutableDictionary new];
+        }
+        shard->_loads[memKey] = load;
+        *isLoaderPtr = YES;
+    }
+    *loadPtr = load;
+    return nil;
+}
+
+// called by the loading thread, without the shard locked, once its loader
+// has returned; wakes any threads waiting on the load
+- (void) _finishLoad:(MBThreadsafeCacheLoad*)load
+   forMemoryCacheKey:(id)memKey
+             inShard:(MBThreadsafeCacheShard*)shard
+              result:(id)result
+               error:(NSError*)err
+{
+    MBLockShard(shard);
+    [shard->_loads removeObjectForKey:memKey];
+    MBUnlockShard(shard);
+
+    [load finishWithResult:result error:err];
+}
+
+// waits for the load to finish, unless the calling thread performed it
+- (nullable id) _resultOfLoad:(MBThreadsafeCacheLoad*)load
+                     isLoader:(BOOL)isLoader
+            forMemoryCacheKey:(id)memKey
+                        error:(NSErrorPtrPtr)errPtr
+{
+    if (!isLoader) {
+        MBLogDebug(@"%@ waiting on in-flight load for memory cache key: %@", [self class], memKey);
+
+        [load wait];
+    }
+
+    if (!load->_result && errPtr) {
+        *errPtr = load->_error;
+    }
+    return load->_result;
+}
+
+- (nullable id) objectForMemoryCacheKey:(nonnull id)memKey
+                         coalescingLoad:(nullable id (^ __nonnull)(NSErrorPtrPtr errPtr))loader
+                                  error:(NSErrorPtrPtr)errPtr
+{
+    // checks again while holding the shard exclusively, in case another
+    // thread stored the value; otherwise, joins or starts the key's load
+    return ((id (*)(id, SEL, id, id, NSErrorPtrPtr))_coalescingLoadOp.imp)(self, _coalescingLoadOp.sel, memKey, loader, errPtr);
 }
 
 /******************************************************************************/
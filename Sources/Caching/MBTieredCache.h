@@ -0,0 +1,254 @@
+//
+//  MBTieredCache.h
+//  Mockingbird Toolbox
+//
+//  Created by Evan Coyne Maloney on 10/17/26.
+//  Copyright (c) 2026 Gilt Groupe. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#import "MBCacheStatistics.h"
+#import "MBCacheTier.h"
+#import "NSError+MBToolbox.h"
+
+/******************************************************************************/
+#pragma mark Types
+/******************************************************************************/
+
+/*!
+ Specifies which tiers an `MBTieredCache` writes to when an object is set.
+ */
+typedef NS_ENUM(NSUInteger, MBTieredCacheWritePolicy) {
+    /*! The object is stored in every tier before `setObject:forKey:` returns,
+        so slower tiers are never out of date. This is the default. */
+    MBTieredCacheWritePolicyWriteThrough    = 0,
+
+    /*! The object is stored only in the fastest tier and marked dirty. A
+        dirty object is written to the next tier when it is dropped from the
+        tier holding it, and to every tier when `flush` is called. Sets cost
+        no more than a set on the fastest tier, but an object that expires
+        from a tier before it's written to the next is lost. */
+    MBTieredCacheWritePolicyWriteBack       = 1
+};
+
+/*!
+ Specifies how an object found in a slower tier is copied into faster ones.
+ */
+typedef NS_ENUM(NSUInteger, MBTieredCachePromotionPolicy) {
+    /*! The object is copied into every faster tier. This is the default. */
+    MBTieredCachePromotionPolicyAll         = 0,
+
+    /*! The object is copied into the next faster tier only, so it reaches
+        the fastest tier only after repeated requests. This keeps objects
+        that are requested once from displacing those in the fastest tier. */
+    MBTieredCachePromotionPolicyAdjacent    = 1,
+
+    /*! The object is never copied into faster tiers. */
+    MBTieredCachePromotionPolicyNone        = 2
+};
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark MBTieredCache class
+/******************************************************************************/
+
+/*!
+ Assembles a stack of `MBCacheTier`s, ordered from fastest to slowest, into a
+ single cache; for example, a small memory cache in front of a large one, in
+ front of an `MBFilesystemCache`.
+
+ Reads search the tiers in order, copying the object found into faster tiers
+ according to the `promotionPolicy`. If no tier holds the object, the
+ `loader` (if any) is called and its result is stored in every tier. Writes
+ follow the `writePolicy`, and objects dropped from one tier can be demoted
+ to the next.
+
+ In front of the tiers, each thread may keep a small cache of its own; see
+ `threadLocalCountLimit`. Looking an object up there takes no locks at all.
+
+ Writes through the receiver and promotions of the same key are serialized,
+ so a promotion never replaces a newer object with an older one. Objects
+ stored in the tiers directly are not coordinated with the receiver.
+
+ @note      Each tier's `tierDelegate` is set to the receiver, so a tier may
+            belong to only one `MBTieredCache`. An `MBFilesystemCache` reports
+            the objects dropped from its memory cache under the keys they
+            were stored with, except for objects that entered its memory
+            cache before it was bounded or that were preloaded from its hot
+            set.
+ */
+@interface MBTieredCache : NSObject
+
+/*----------------------------------------------------------------------------*/
+#pragma mark Object lifecycle
+/*!    @name Object lifecycle                                                 */
+/*----------------------------------------------------------------------------*/
+
+/*!
+ Initializes a new `MBTieredCache` with the given tiers and loader.
+
+ @param     tiers An array of one or more distinct objects conforming to
+            `MBCacheTier`, ordered from fastest to slowest.
+
+ @param     loader An optional block called to produce the object for a key
+            that no tier holds. The block may be called from any thread, and
+            concurrently for the same key. It should return `nil` (and may
+            populate `errPtr`) if the object can't be produced.
+
+ @return    The new cache.
+ */
+- (nonnull instancetype) initWithTiers:(nonnull NSArray*)tiers
+                                loader:(nullable id (^)(id __nonnull key, NSErrorPtrPtr errPtr))loader;
+
+/*!
+ Initializes a new `MBTieredCache` with the given tiers and no loader.
+
+ @param     tiers An array of one or more distinct objects conforming to
+            `MBCacheTier`, ordered from fastest to slowest.
+
+ @return    The new cache.
+ */
+- (nonnull instancetype) initWithTiers:(nonnull NSArray*)tiers;
+
+/*----------------------------------------------------------------------------*/
+#pragma mark Configuration
+/*!    @name Configuration                                                    */
+/*----------------------------------------------------------------------------*/
+
+/*! The tiers, ordered from fastest to slowest. */
+@property(nonnull, nonatomic, readonly) NSArray* tiers;
+
+/*! The `MBTieredCacheWritePolicy` followed by `setObject:forKey:`. Changing
+    the policy from write-back to write-through flushes dirty objects. */
+@property(nonatomic, assign) MBTieredCacheWritePolicy writePolicy;
+
+/*! The `MBTieredCachePromotionPolicy` followed when an object is found in
+    a tier other than the fastest. */
+@property(atomic, assign) MBTieredCachePromotionPolicy promotionPolicy;
+
+/*! If `YES`, an object dropped from a tier is stored in the next tier even
+    if it isn't dirty. Only useful with a tier that may drop objects which
+    slower tiers have also dropped. Defaults to `NO`; dirty objects are always
+    demoted. */
+@property(atomic, assign) BOOL demotesDroppedObjects;
+
+/*! The maximum number of objects each thread caches in front of the tiers.
+    Any write through the receiver invalidates every thread's cache, so this
+    suits read-mostly workloads with a small set of hot keys. If `0`, the
+    default, threads don't cache objects of their own. */
+@property(atomic, assign) NSUInteger threadLocalCountLimit;
+
+/*----------------------------------------------------------------------------*/
+#pragma mark Statistics
+/*!    @name Statistics                                                       */
+/*----------------------------------------------------------------------------*/
+
+/*! If `YES`, the time spent in the `loader` is sampled into the `loadLatency`
+    histogram returned by `statistics`. Defaults to `NO`. */
+@property(nonatomic, assign) BOOL measuresLatency;
+
+/*!
+ Returns a snapshot of the statistics of the receiver as a whole. The
+ `memoryHits` count lookups satisfied by a thread's cache or by any tier; the
+ `memoryMisses` count lookups that no tier could satisfy, whether or not the
+ `loader` then produced an object. The `sets` count calls to
+ `setObject:forKey:`, and the `loadLatency` measures the `loader`.
+
+ @return    The statistics.
+ */
+- (nonnull MBCacheStatistics*) statistics;
+
+/*!
+ Returns a snapshot of the statistics of the per-thread caches, summed across
+ all threads: `memoryHits`, `memoryMisses` and `evictions`.
+
+ @return    The statistics.
+ */
+- (nonnull MBCacheStatistics*) threadLocalStatistics;
+
+/*!
+ Returns the `statistics` of each tier, in the order of the `tiers`.
+
+ @return    An array of `MBCacheStatistics`.
+ */
+- (nonnull NSArray*) tierStatistics;
+
+/*! Returns the number of objects copied into a faster tier. */
+@property(nonatomic, readonly) NSUInteger promotionCount;
+
+/*! Returns the number of objects written to the next tier after being
+    dropped from a faster one. */
+@property(nonatomic, readonly) NSUInteger demotionCount;
+
+/*----------------------------------------------------------------------------*/
+#pragma mark Accessing cached items
+/*!    @name Accessing cached items                                           */
+/*----------------------------------------------------------------------------*/
+
+/*!
+ Returns the object for the given key, calling the `loader` if no tier holds
+ it.
+
+ @param     key The key.
+
+ @return    The object, or `nil` if no tier holds it and it couldn't be loaded.
+ */
+- (nullable id) objectForKey:(nonnull id)key;
+
+/*!
+ Returns the object for the given key, calling the `loader` if no tier holds
+ it.
+
+ @param     key The key.
+
+ @param     errPtr If non-`nil` and the `loader` fails, `*errPtr` may be
+            populated with an `NSError` describing the failure.
+
+ @return    The object, or `nil` if no tier holds it and it couldn't be loaded.
+ */
+- (nullable id) objectForKey:(nonnull id)key error:(NSErrorPtrPtr)errPtr;
+
+/*!
+ Stores an object according to the `writePolicy`.
+
+ @param     obj The object.
+
+ @param     key The key.
+ */
+- (void) setObject:(nonnull id)obj forKey:(nonnull id)key;
+
+/*!
+ Removes the object for the given key from every tier.
+
+ @param     key The key.
+ */
+- (void) removeObjectForKey:(nonnull id)key;
+
+/*!
+ Allows accessing the cache using keyed subscripting; equivalent to
+ `objectForKey:`.
+
+ @param     key The key.
+
+ @return    The object, or `nil`.
+ */
+- (nullable id) objectForKeyedSubscript:(nonnull id)key;
+
+/*!
+ Allows storing objects using keyed subscripting; equivalent to
+ `setObject:forKey:`.
+
+ @param     obj The object.
+
+ @param     key The key.
+ */
+- (void) setObject:(nonnull id)obj forKeyedSubscript:(nonnull id)key;
+
+/*!
+ Writes every dirty object to every tier slower than the one holding it.
+ Does nothing unless the `writePolicy` is (or was) write-back.
+ */
+- (void) flush;
+
+@end
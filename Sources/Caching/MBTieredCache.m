@@ -0,0 +1,530 @@
+//
+//  MBTieredCache.m
+//  Mockingbird Toolbox
+//
+//  Created by Evan Coyne Maloney on 10/17/26.
+//  Copyright (c) 2026 Gilt Groupe. All rights reserved.
+//
+
+#import <pthread.h>
+#import <stdatomic.h>
+
+#import "MBTieredCache.h"
+#import "MBCacheStatisticsRecorder.h"
+#import "MBAdaptiveMutex.h"
+#import "MBModuleLogMacros.h"
+
+#define DEBUG_LOCAL     0
+
+/******************************************************************************/
+#pragma mark Constants
+/******************************************************************************/
+
+#define kStripeCount    64
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark MBTieredCacheStripe class
+/******************************************************************************/
+
+// serializes writes and promotions of the keys that hash to it; the
+// generation advances whenever a key's object may have changed, so that
+// a promotion can tell that what it read is no longer current
+@interface MBTieredCacheStripe : MBAdaptiveMutex
+{
+@public
+    atomic_ullong _generation;
+}
+@end
+
+@implementation MBTieredCacheStripe
+@end
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark MBTieredCacheThreadLocalCache class
+/******************************************************************************/
+
+// only ever accessed by the thread that owns it
+@interface MBTieredCacheThreadLocalCache : NSObject
+{
+@public
+    uint64_t _generation;
+    NSMutableDictionary* _objects;
+    NSMutableArray* _keys;              // in insertion order, for eviction
+}
+@end
+
+@implementation MBTieredCacheThreadLocalCache
+
+- (instancetype) init
+{
+    self = [super init];
+    if (self) {
+        _objects = [NSMutableDictionary new];
+        _keys = [NSMutableArray new];
+    }
+    return self;
+}
+
+@end
+
+static pthread_key_t MBTieredCacheThreadLocalKey;
+
+static void MBTieredCacheThreadExited(void* value)
+{
+    CFRelease(value);
+}
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark MBTieredCache implementation
+/******************************************************************************/
+
+@interface MBTieredCache () <MBCacheTierDelegate>
+@end
+
+@implementation MBTieredCache
+{
+    NSArray* _tiers;
+    NSUInteger _tierCount;
+    id (^_loader)(id key, NSErrorPtrPtr errPtr);
+    __strong MBTieredCacheStripe* _stripes[kStripeCount];
+    atomic_ullong _generation;          // advances on every write; for threads' caches
+    MBAdaptiveMutex* _dirtyLock;
+    NSMutableDictionary* _dirty;        // key -> index of the tier holding the newest object
+    MBCacheStatisticsRecorder* _stats;
+    MBCacheStatisticsRecorder* _threadLocalStats;
+    atomic_ulong _promotionCount;
+    atomic_ulong _demotionCount;
+}
+
+/******************************************************************************/
+#pragma mark Object lifecycle
+/******************************************************************************/
+
++ (void) initialize
+{
+    if (self == [MBTieredCache class]) {
+        pthread_key_create(&MBTieredCacheThreadLocalKey, MBTieredCacheThreadExited);
+    }
+}
+
+- (nonnull instancetype) initWithTiers:(nonnull NSArray*)tiers
+                                loader:(nullable id (^)(id __nonnull key, NSErrorPtrPtr errPtr))loader
+{
+    if (!tiers.count) {
+        [NSException raise:NSInvalidArgumentException format:@"illegal argument: no tiers"];
+    }
+    if ([NSSet setWithArray:tiers].count != tiers.count) {
+        [NSException raise:NSInvalidArgumentException format:@"illegal argument: duplicate tiers"];
+    }
+    for (id tier in tiers) {
+        if (![tier conformsToProtocol:@protocol(MBCacheTier)]) {
+            [NSException raise:NSInvalidArgumentException format:@"illegal argument: %@ doesn't conform to MBCacheTier", tier];
+        }
+    }
+
+    self = [super init];
+    if (self) {
+        _tiers = [tiers copy];
+        _tierCount = _tiers.count;
+        _loader = [loader copy];
+        for (NSUInteger i=0; i<kStripeCount; i++) {
+            _stripes[i] = [MBTieredCacheStripe new];
+            atomic_init(&_stripes[i]->_generation, 0);
+        }
+        atomic_init(&_generation, 0);
+        _dirtyLock = [MBAdaptiveMutex new];
+        _dirty = [NSMutableDictionary new];
+        _stats = [MBCacheStatisticsRecorder new];
+        _threadLocalStats = [MBCacheStatisticsRecorder new];
+        atomic_init(&_promotionCount, 0);
+        atomic_init(&_demotionCount, 0);
+
+        for (id<MBCacheTier> tier in _tiers) {
+            tier.tierDelegate = self;
+        }
+    }
+    return self;
+}
+
+- (nonnull instancetype) initWithTiers:(nonnull NSArray*)tiers
+{
+    return [self initWithTiers:tiers loader:nil];
+}
+
+/******************************************************************************/
+#pragma mark Configuration
+/******************************************************************************/
+
+- (void) setWritePolicy:(MBTieredCacheWritePolicy)writePolicy
+{
+    _writePolicy = writePolicy;
+    if (writePolicy == MBTieredCacheWritePolicyWriteThrough) {
+        [self flush];
+    }
+}
+
+/******************************************************************************/
+#pragma mark Statistics
+/******************************************************************************/
+
+- (BOOL) measuresLatency
+{
+    return atomic_load_explicit(&_stats->_measuresLatency, memory_order_relaxed);
+}
+
+- (void) setMeasuresLatency:(BOOL)measuresLatency
+{
+    atomic_store_explicit(&_stats->_measuresLatency, measuresLatency, memory_order_relaxed);
+}
+
+- (nonnull MBCacheStatistics*) statistics
+{
+    return [[MBCacheStatistics alloc] initWithRecorders:@[_stats]];
+}
+
+- (nonnull MBCacheStatistics*) threadLocalStatistics
+{
+    return [[MBCacheStatistics alloc] initWithRecorders:@[_threadLocalStats]];
+}
+
+- (nonnull NSArray*) tierStatistics
+{
+    NSMutableArray* stats = [NSMutableArray arrayWithCapacity:_tierCount];
+    for (id<MBCacheTier> tier in _tiers) {
+        [stats addObject:[tier statistics]];
+    }
+    return stats;
+}
+
+- (NSUInteger) promotionCount
+{
+    return atomic_load_explicit(&_promotionCount, memory_order_relaxed);
+}
+
+- (NSUInteger) demotionCount
+{
+    return atomic_load_explicit(&_demotionCount, memory_order_relaxed);
+}
+
+/******************************************************************************/
+#pragma mark Coordinating writes
+/******************************************************************************/
+
+- (MBTieredCacheStripe*) _stripeForKey:(id)key
+{
+    return _stripes[[key hash] % kStripeCount];
+}
+
+// must be called with the key's stripe locked; the generations advance
+// both before and after the tiers change, so that a read overlapping
+// any part of the write sees a different generation when it finishes
+- (void) _beginWriteToStripe:(MBTieredCacheStripe*)stripe
+{
+    atomic_fetch_add_explicit(&stripe->_generation, 1, memory_order_seq_cst);
+    atomic_fetch_add_explicit(&_generation, 1, memory_order_seq_cst);
+}
+
+- (void) _endWrite
+{
+    atomic_fetch_add_explicit(&_generation, 1, memory_order_seq_cst);
+}
+
+- (void) _markKey:(id)key dirtyInTier:(NSUInteger)index
+{
+    [_dirtyLock lock];
+    if (index != NSNotFound) {
+        _dirty[key] = @(index);
+    }
+    else {
+        [_dirty removeObjectForKey:key];
+    }
+    [_dirtyLock unlock];
+}
+
+/******************************************************************************/
+#pragma mark Thread-local caching
+/******************************************************************************/
+
+// each thread maps caches to its own thread-local caches; the map holds
+// the caches weakly, so it doesn't keep a deallocated cache's objects
+// alive beyond the thread's next use of the map
+- (MBTieredCacheThreadLocalCache*) _threadLocalCache
+{
+    NSMapTable* caches = (__bridge NSMapTable*)pthread_getspecific(MBTieredCacheThreadLocalKey);
+    if (!caches) {
+        caches = [NSMapTable weakToStrongObjectsMapTable];
+        pthread_setspecific(MBTieredCacheThreadLocalKey, CFBridgingRetain(caches));
+    }
+
+    MBTieredCacheThreadLocalCache* local = [caches objectForKey:self];
+    if (!local) {
+        local = [MBTieredCacheThreadLocalCache new];
+        [caches setObject:local forKey:self];
+    }
+    return local;
+}
+
+- (void) _storeObject:(id)obj forKey:(id)key inThreadLocalCache:(MBTieredCacheThreadLocalCache*)local limit:(NSUInteger)limit
+{
+    if (!local->_objects[key]) {
+        [local->_keys addObject:key];
+    }
+    local->_objects[key] = obj;
+
+    while (local->_keys.count > limit) {
+        [local->_objects removeObjectForKey:local->_keys[0]];
+        [local->_keys removeObjectAtIndex:0];
+        MBCacheStatisticsIncrement(_threadLocalStats, MBCacheCounterEvictions, 1);
+    }
+}
+
+/******************************************************************************/
+#pragma mark Promotion & demotion
+/******************************************************************************/
+
+// stores the object in the given tiers, unless the key's stripe has
+// changed since `generation`, in which case the object may be stale
+- (void) _copyObject:(id)obj
+              forKey:(id)key
+             toTiers:(NSRange)range
+   ifStripeUnchanged:(MBTieredCacheStripe*)stripe
+          generation:(uint64_t)generation
+{
+    if (!range.length) {
+        return;
+    }
+
+    [stripe lock];
+    if (atomic_load_explicit(&stripe->_generation, memory_order_seq_cst) == generation) {
+        for (NSUInteger i=range.location; i<NSMaxRange(range); i++) {
+            [(id<MBCacheTier>)_tiers[i] setObject:obj forKey:key];
+        }
+        atomic_fetch_add_explicit(&_promotionCount, range.length, memory_order_relaxed);
+    }
+    else {
+        MBLogDebug(@"%@ skipped promotion of object superseded during lookup for key: %@", [self class], key);
+    }
+    [stripe unlock];
+}
+
+- (NSRange) _promotionRangeForTier:(NSUInteger)index
+{
+    switch (self.promotionPolicy) {
+        case MBTieredCachePromotionPolicyAll:
+            return NSMakeRange(0, index);
+
+        case MBTieredCachePromotionPolicyAdjacent:
+            return (index ? NSMakeRange(index - 1, 1) : NSMakeRange(0, 0));
+
+        case MBTieredCachePromotionPolicyNone:
+            break;
+    }
+    return NSMakeRange(0, 0);
+}
+
+- (void) cacheTier:(nonnull id<MBCacheTier>)tier droppedObject:(nonnull id)obj forKey:(nonnull id)key
+{
+    // the write that caused the drop may hold a stripe lock, so this must
+    // not take one; advancing the stripe's generation is enough to stop a
+    // promotion from overwriting the object being demoted with an older one
+    NSUInteger index = [_tiers indexOfObjectIdenticalTo:tier];
+    if (index == NSNotFound || index + 1 >= _tierCount) {
+        return;
+    }
+
+    BOOL demote = self.demotesDroppedObjects;
+    [_dirtyLock lock];
+    NSNumber* dirtyIndex = _dirty[key];
+    if (dirtyIndex && dirtyIndex.unsignedIntegerValue == index) {
+        demote = YES;
+        if (index + 2 < _tierCount) {
+            _dirty[key] = @(index + 1);
+        }
+        else {
+            [_dirty removeObjectForKey:key];
+        }
+    }
+    [_dirtyLock unlock];
+
+    if (demote) {
+        MBLogDebug(@"%@ demoting object dropped from tier %lu for key: %@", [self class], (unsigned long)index, key);
+
+        atomic_fetch_add_explicit(&[self _stripeForKey:key]->_generation, 1, memory_order_seq_cst);
+        atomic_fetch_add_explicit(&_demotionCount, 1, memory_order_relaxed);
+        [(id<MBCacheTier>)_tiers[index + 1] setObject:obj forKey:key];
+    }
+}
+
+/******************************************************************************/
+#pragma mark Accessing cached items
+/******************************************************************************/
+
+- (nullable id) objectForKey:(nonnull id)key
+{
+    return [self objectForKey:key error:nil];
+}
+
+- (nullable id) objectForKey:(nonnull id)key error:(NSErrorPtrPtr)errPtr
+{
+    if (!key) {
+        [NSException raise:NSInvalidArgumentException format:@"illegal argument: nil key"];
+    }
+
+    // the generations must be read before the lookups they protect
+    uint64_t generation = atomic_load_explicit(&_generation, memory_order_seq_cst);
+    MBTieredCacheStripe* stripe = [self _stripeForKey:key];
+    uint64_t stripeGeneration = atomic_load_explicit(&stripe->_generation, memory_order_seq_cst);
+
+    MBTieredCacheThreadLocalCache* local = nil;
+    NSUInteger limit = self.threadLocalCountLimit;
+    if (limit) {
+        local = [self _threadLocalCache];
+        if (local->_generation != generation) {
+            [local->_objects removeAllObjects];
+            [local->_keys removeAllObjects];
+            local->_generation = generation;
+        }
+        id obj = local->_objects[key];
+        if (obj) {
+            MBCacheStatisticsIncrement(_threadLocalStats, MBCacheCounterMemoryHits, 1);
+            MBCacheStatisticsIncrement(_stats, MBCacheCounterMemoryHits, 1);
+            return obj;
+        }
+        MBCacheStatisticsIncrement(_threadLocalStats, MBCacheCounterMemoryMisses, 1);
+    }
+
+    id obj = nil;
+    for (NSUInteger i=0; i<_tierCount; i++) {
+        obj = [_tiers[i] objectForKey:key];
+        if (obj) {
+            [self _copyObject:obj
+                       forKey:key
+                      toTiers:[self _promotionRangeForTier:i]
+            ifStripeUnchanged:stripe
+                   generation:stripeGeneration];
+            break;
+        }
+    }
+
+    if (obj) {
+        MBCacheStatisticsIncrement(_stats, MBCacheCounterMemoryHits, 1);
+    }
+    else {
+        MBCacheStatisticsIncrement(_stats, MBCacheCounterMemoryMisses, 1);
+
+        if (_loader) {
+            uint64_t start = MBCacheStatisticsBegin(_stats);
+            obj = _loader(key, errPtr);
+            MBCacheStatisticsEnd(_stats, MBCacheLatencyLoad, start);
+
+            if (obj) {
+                [self _copyObject:obj
+                           forKey:key
+                          toTiers:NSMakeRange(0, _tierCount)
+                ifStripeUnchanged:stripe
+                       generation:stripeGeneration];
+            }
+        }
+    }
+
+    if (obj && local) {
+        [self _storeObject:obj forKey:key inThreadLocalCache:local limit:limit];
+    }
+    return obj;
+}
+
+- (void) setObject:(nonnull id)obj forKey:(nonnull id)key
+{
+    if (!obj || !key) {
+        [NSException raise:NSInvalidArgumentException format:@"illegal argument: nil %@", (!key ? @"key" : @"value")];
+    }
+
+    MBCacheStatisticsIncrement(_stats, MBCacheCounterSets, 1);
+
+    MBTieredCacheStripe* stripe = [self _stripeForKey:key];
+    [stripe lock];
+    [self _beginWriteToStripe:stripe];
+    if (self.writePolicy == MBTieredCacheWritePolicyWriteBack && _tierCount > 1) {
+        // marked first, in case the tier drops the object straight away
+        [self _markKey:key dirtyInTier:0];
+        [(id<MBCacheTier>)_tiers[0] setObject:obj forKey:key];
+    }
+    else {
+        [self _markKey:key dirtyInTier:NSNotFound];
+        for (id<MBCacheTier> tier in _tiers) {
+            [tier setObject:obj forKey:key];
+        }
+    }
+    [self _endWrite];
+    [stripe unlock];
+}
+
+- (void) removeObjectForKey:(nonnull id)key
+{
+    if (!key) {
+        [NSException raise:NSInvalidArgumentException format:@"illegal argument: nil key"];
+    }
+
+    MBTieredCacheStripe* stripe = [self _stripeForKey:key];
+    [stripe lock];
+    [self _beginWriteToStripe:stripe];
+    [self _markKey:key dirtyInTier:NSNotFound];
+    for (id<MBCacheTier> tier in _tiers) {
+        [tier removeObjectForKey:key];
+    }
+    [self _endWrite];
+    [stripe unlock];
+}
+
+- (nullable id) objectForKeyedSubscript:(nonnull id)key
+{
+    return [self objectForKey:key];
+}
+
+- (void) setObject:(nonnull id)obj forKeyedSubscript:(nonnull id)key
+{
+    [self setObject:obj forKey:key];
+}
+
+- (void) flush
+{
+    [_dirtyLock lock];
+    NSArray* keys = _dirty.allKeys;
+    [_dirtyLock unlock];
+
+    for (id key in keys) {
+        MBTieredCacheStripe* stripe = [self _stripeForKey:key];
+        [stripe lock];
+
+        [_dirtyLock lock];
+        NSNumber* dirtyIndex = _dirty[key];
+        [_dirtyLock unlock];
+
+        if (dirtyIndex) {
+            NSUInteger index = dirtyIndex.unsignedIntegerValue;
+            id obj = [_tiers[index] objectForKey:key];
+            if (obj) {
+                [self _beginWriteToStripe:stripe];
+                for (NSUInteger i=index+1; i<_tierCount; i++) {
+                    [(id<MBCacheTier>)_tiers[i] setObject:obj forKey:key];
+                }
+                [self _endWrite];
+            }
+
+            // the object may have been demoted meanwhile, and remains
+            // dirty in the tier it was demoted to
+            [_dirtyLock lock];
+            if ([_dirty[key] isEqual:dirtyIndex]) {
+                [_dirty removeObjectForKey:key];
+            }
+            [_dirtyLock unlock];
+        }
+
+        [stripe unlock];
+    }
+}
+
+@end
@@ -0,0 +1,102 @@
+//
+//  MBAdaptiveMutex.m
+//  Mockingbird Toolbox
+//
+//  Created by Evan Coyne Maloney on 10/17/26.
+//  Copyright (c) 2026 Gilt Groupe. All rights reserved.
+//
+
+#import <pthread.h>
+#import <stdatomic.h>
+
+#import "MBAdaptiveMutex.h"
+
+/******************************************************************************/
+#pragma mark Constants
+/******************************************************************************/
+
+#define kMaxSpinCount       100
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark MBAdaptiveMutex implementation
+/******************************************************************************/
+
+// tells the processor we're spinning, which saves power and lets a
+// hyperthreaded sibling (possibly the lock holder) run faster
+static inline void MBCPURelax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__arm64__) || defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+@implementation MBAdaptiveMutex
+{
+    pthread_mutex_t _mutex;
+    atomic_uint _spinEstimate;      // recent average spins needed to acquire
+}
+
+/******************************************************************************/
+#pragma mark Object lifecycle
+/******************************************************************************/
+
+- (instancetype) init
+{
+    self = [super init];
+    if (self) {
+        pthread_mutex_init(&_mutex, NULL);
+        atomic_init(&_spinEstimate, 0);
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    pthread_mutex_destroy(&_mutex);
+}
+
+/******************************************************************************/
+#pragma mark Locking & unlocking
+/******************************************************************************/
+
+- (void) lock
+{
+    if (pthread_mutex_trylock(&_mutex) == 0) {
+        return;
+    }
+
+    // spin for up to twice the recent average before giving up and
+    // blocking; the same heuristic as glibc's adaptive mutexes
+    unsigned estimate = atomic_load_explicit(&_spinEstimate, memory_order_relaxed);
+    unsigned limit = MIN(kMaxSpinCount, estimate * 2 + 10);
+    unsigned spins = 0;
+    while (YES) {
+        if (spins++ >= limit) {
+            pthread_mutex_lock(&_mutex);
+            break;
+        }
+        MBCPURelax();
+        if (pthread_mutex_trylock(&_mutex) == 0) {
+            break;
+        }
+    }
+
+    // move the estimate an eighth of the way toward this acquisition
+    int adjustment = ((int)spins - (int)estimate) / 8;
+    atomic_store_explicit(&_spinEstimate, (unsigned)((int)estimate + adjustment), memory_order_relaxed);
+}
+
+- (BOOL) tryLock
+{
+    return (pthread_mutex_trylock(&_mutex) == 0);
+}
+
+- (void) unlock
+{
+    pthread_mutex_unlock(&_mutex);
+}
+
+@end
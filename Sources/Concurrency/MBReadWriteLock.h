@@ -0,0 +1,69 @@
+//
+//  MBReadWriteLock.h
+//  Mockingbird Toolbox
+//
+//  Created by Evan Coyne Maloney on 10/17/26.
+//  Copyright (c) 2026 Gilt Groupe. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark MBReadWriteLocking protocol
+/******************************************************************************/
+
+/*!
+ Adopted by locks that distinguish between *shared* (read) and *exclusive*
+ (write) access.
+
+ The `lock` method declared by `NSLocking` acquires exclusive access; `unlock`
+ releases whichever kind of access the calling thread holds.
+ */
+@protocol MBReadWriteLocking <NSLocking>
+
+/*!
+ Acquires shared access to the lock. Any number of threads may hold shared
+ access simultaneously, but never while another thread holds exclusive
+ access.
+ */
+- (void) lockForReading;
+
+@end
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark MBReadWriteLock class
+/******************************************************************************/
+
+/*!
+ A thin Objective-C wrapper around a POSIX `pthread_rwlock_t`.
+
+ Unlike `MBConcurrentReadWriteCoordinator`, which enqueues writes for
+ asynchronous execution, `MBReadWriteLock` blocks the calling thread until
+ the requested access is granted. This makes it suitable for guarding state
+ where a write must be visible as soon as the writing call returns.
+
+ @warning   The lock is *not* recursive. A thread holding the lock must not
+            attempt to acquire it again, regardless of the kind of access
+            held or requested; doing so will deadlock.
+ */
+@interface MBReadWriteLock : NSObject <MBReadWriteLocking>
+
+/*!
+ Acquires shared access to the lock, blocking until no writer holds it.
+ */
+- (void) lockForReading;
+
+/*!
+ Acquires exclusive access to the lock, blocking until no reader or writer
+ holds it.
+ */
+- (void) lock;
+
+/*!
+ Releases the access held by the calling thread.
+ */
+- (void) unlock;
+
+@end
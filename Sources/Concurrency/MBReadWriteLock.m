@@ -0,0 +1,60 @@
+//
+//  MBReadWriteLock.m
+//  Mockingbird Toolbox
+//
+//  Created by Evan Coyne Maloney on 10/17/26.
+//  Copyright (c) 2026 Gilt Groupe. All rights reserved.
+//
+
+#import <pthread.h>
+
+#import "MBReadWriteLock.h"
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark MBReadWriteLock implementation
+/******************************************************************************/
+
+@implementation MBReadWriteLock
+{
+    pthread_rwlock_t _rwlock;
+}
+
+/******************************************************************************/
+#pragma mark Object lifecycle
+/******************************************************************************/
+
+- (instancetype) init
+{
+    self = [super init];
+    if (self) {
+        pthread_rwlock_init(&_rwlock, NULL);
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    pthread_rwlock_destroy(&_rwlock);
+}
+
+/******************************************************************************/
+#pragma mark Locking & unlocking
+/******************************************************************************/
+
+- (void) lockForReading
+{
+    pthread_rwlock_rdlock(&_rwlock);
+}
+
+- (void) lock
+{
+    pthread_rwlock_wrlock(&_rwlock);
+}
+
+- (void) unlock
+{
+    pthread_rwlock_unlock(&_rwlock);
+}
+
+@end
@@ -35,14 +35,19 @@ FOUNDATION_EXPORT const unsigned char MBToolboxVersionString[];
 #import <MBToolbox/UIView+MBSnapshotImage.h>
 #import <MBToolbox/UIFont+MBStringSizing.h>
 #import <MBToolbox/MBCacheOperations.h>
+#import <MBToolbox/MBCacheStatistics.h>
+#import <MBToolbox/MBCacheTier.h>
 #import <MBToolbox/MBFilesystemCache+Subclassing.h>
 #import <MBToolbox/MBFilesystemCache.h>
 #import <MBToolbox/MBThreadsafeCache+Subclassing.h>
 #import <MBToolbox/MBThreadsafeCache.h>
+#import <MBToolbox/MBTieredCache.h>
 #import <MBToolbox/MBAssert.h>
 #import <MBToolbox/MBDebug.h>
 #import <MBToolbox/MBRuntime.h>
 #import <MBToolbox/MBConcurrentReadWriteCoordinator.h>
+#import <MBToolbox/MBReadWriteLock.h>
+#import <MBToolbox/MBAdaptiveMutex.h>
 #import <MBToolbox/NSError+MBToolbox.h>
 #import <MBToolbox/MBEvents.h>
 #import <MBToolbox/MBFieldListFormatter.h>
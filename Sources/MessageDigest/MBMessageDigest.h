@@ -96,6 +96,44 @@
  */
 + (nullable NSString*) MD5ForFileAtPath:(nonnull NSString*)path;
 
+/*----------------------------------------------------------------------------*/
+#pragma mark Creating non-cryptographic hashes
+/*!    @name Creating non-cryptographic hashes                                */
+/*----------------------------------------------------------------------------*/
+
+/*!
+ Computes a 128-bit MurmurHash3 hash given an input string.
+
+ MurmurHash3 is many times faster than MD5, but it is *not* a secure hash;
+ use it only where inputs are not chosen by an adversary, such as to derive
+ names for cache files.
+
+ @param     src the string for which the hash will be computed
+
+ @return    the hash, as a lowercase hexadecimal string
+ */
++ (nonnull NSString*) Murmur3ForString:(nonnull NSString*)src;
+
+/*!
+ Computes a 128-bit MurmurHash3 hash from an `NSData` instance.
+
+ @param     src the data for which the hash will be computed
+
+ @return    the hash, as a lowercase hexadecimal string
+ */
++ (nonnull NSString*) Murmur3ForData:(nonnull NSData*)src;
+
+/*!
+ Computes a 128-bit MurmurHash3 hash from an array of bytes.
+
+ @param     bytes the byte array for which the hash will be computed
+
+ @param     len the length of the byte array
+
+ @return    the hash, as a lowercase hexadecimal string
+ */
++ (nonnull NSString*) Murmur3ForBytes:(nonnull const void*)bytes length:(size_t)len;
+
 /*----------------------------------------------------------------------------*/
 #pragma mark Creating SHA-1 message digests
 /*!    @name Creating SHA-1 message digests                                   */
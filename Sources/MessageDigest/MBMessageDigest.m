@@ -19,6 +19,94 @@
 /******************************************************************************/
 
 #define DEFAULT_FILE_BUFFER_SIZE        8192
+#define MURMUR3_DIGEST_LENGTH           16
+
+/******************************************************************************/
+#pragma mark MurmurHash3
+/******************************************************************************/
+
+// MurmurHash3 (x64, 128-bit variant) by Austin Appleby, who placed it in the
+// public domain; the output is the two 64-bit halves in little-endian order
+
+static inline uint64_t MBRotateLeft64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t MBMurmur3Finalize(uint64_t k)
+{
+    k ^= k >> 33;
+    k *= 0xFF51AFD7ED558CCDULL;
+    k ^= k >> 33;
+    k *= 0xC4CEB9FE1A85EC53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+static void MBMurmur3(const void* bytes, size_t len, uint8_t digest[MURMUR3_DIGEST_LENGTH])
+{
+    const uint8_t* data = bytes;
+    const uint64_t c1 = 0x87C37B91114253D5ULL;
+    const uint64_t c2 = 0x4CF5AD432745937FULL;
+    uint64_t h1 = 0;
+    uint64_t h2 = 0;
+
+    size_t blockCnt = len / 16;
+    for (size_t i=0; i<blockCnt; i++) {
+        uint64_t k1, k2;
+        memcpy(&k1, data + (i * 16), sizeof(k1));
+        memcpy(&k2, data + (i * 16) + 8, sizeof(k2));
+
+        k1 *= c1; k1 = MBRotateLeft64(k1, 31); k1 *= c2; h1 ^= k1;
+        h1 = MBRotateLeft64(h1, 27); h1 += h2; h1 = (h1 * 5) + 0x52DCE729;
+
+        k2 *= c2; k2 = MBRotateLeft64(k2, 33); k2 *= c1; h2 ^= k2;
+        h2 = MBRotateLeft64(h2, 31); h2 += h1; h2 = (h2 * 5) + 0x38495AB5;
+    }
+
+    // the final 0-15 bytes
+    const uint8_t* tail = data + (blockCnt * 16);
+    size_t tailLen = len & 15;
+    uint64_t k1 = 0;
+    uint64_t k2 = 0;
+    for (size_t i=tailLen; i>8; i--) {
+        k2 ^= ((uint64_t)tail[i-1]) << ((i - 9) * 8);
+    }
+    if (tailLen > 8) {
+        k2 *= c2; k2 = MBRotateLeft64(k2, 33); k2 *= c1; h2 ^= k2;
+    }
+    for (size_t i=MIN(tailLen, 8); i>0; i--) {
+        k1 ^= ((uint64_t)tail[i-1]) << ((i - 1) * 8);
+    }
+    if (tailLen > 0) {
+        k1 *= c1; k1 = MBRotateLeft64(k1, 31); k1 *= c2; h1 ^= k1;
+    }
+
+    h1 ^= len;
+    h2 ^= len;
+    h1 += h2;
+    h2 += h1;
+    h1 = MBMurmur3Finalize(h1);
+    h2 = MBMurmur3Finalize(h2);
+    h1 += h2;
+    h2 += h1;
+
+    h1 = CFSwapInt64HostToLittle(h1);
+    h2 = CFSwapInt64HostToLittle(h2);
+    memcpy(digest, &h1, sizeof(h1));
+    memcpy(digest + 8, &h2, sizeof(h2));
+}
+
+// avoids a copy when the string's storage is already UTF-8 compatible
+static const char* MBUTF8BytesOfString(NSString* src, size_t* lenPtr)
+{
+    const char* bytes = CFStringGetCStringPtr((__bridge CFStringRef)src, kCFStringEncodingUTF8);
+    if (!bytes) {
+        bytes = [src UTF8String];
+    }
+    *lenPtr = strlen(bytes);
+    return bytes;
+}
 
 /******************************************************************************/
 #pragma mark -
@@ -51,11 +139,14 @@
 
 + (NSString*) _hexStringForDigest:(unsigned char*)digest ofLength:(NSUInteger)numBytes
 {
-    NSMutableString* hex = [NSMutableString stringWithCapacity:numBytes*2];
+    static const char kHexDigits[] = "0123456789abcdef";
+
+    char hex[numBytes * 2];
     for (NSUInteger i=0; i<numBytes; i++) {
-        [hex appendFormat:@"%02x", digest[i]];
+        hex[i * 2] = kHexDigits[digest[i] >> 4];
+        hex[(i * 2) + 1] = kHexDigits[digest[i] & 0xF];
     }
-    return hex;
+    return [[NSString alloc] initWithBytes:hex length:(numBytes * 2) encoding:NSASCIIStringEncoding];
 }
 
 + (NSString*) _hexStringForMD5:(unsigned char*)md5
@@ -85,8 +176,8 @@
 
 + (nonnull NSString*) MD5ForString:(nonnull NSString*)src
 {
-    const char* data = [src UTF8String];
-    CC_LONG dataSize = (CC_LONG) strlen(data);
+    size_t dataSize = 0;
+    const char* data = MBUTF8BytesOfString(src, &dataSize);
     return [self MD5ForBytes:data length:dataSize];
 }
 
@@ -189,6 +280,30 @@
     return md5;
 }
 
+/******************************************************************************/
+#pragma mark Creating non-cryptographic hashes
+/******************************************************************************/
+
++ (nonnull NSString*) Murmur3ForString:(nonnull NSString*)src
+{
+    size_t dataSize = 0;
+    const char* data = MBUTF8BytesOfString(src, &dataSize);
+    return [self Murmur3ForBytes:data length:dataSize];
+}
+
++ (nonnull NSString*) Murmur3ForData:(nonnull NSData*)src
+{
+    return [self Murmur3ForBytes:[src bytes] length:[src length]];
+}
+
++ (nonnull NSString*) Murmur3ForBytes:(nonnull const void*)bytes length:(size_t)len
+{
+    unsigned char hash[MURMUR3_DIGEST_LENGTH];
+    MBMurmur3(bytes, len, hash);
+
+    return [self _hexStringForDigest:hash ofLength:MURMUR3_DIGEST_LENGTH];
+}
+
 /******************************************************************************/
 #pragma mark Creating SHA-1 message digests
 /******************************************************************************/
@@ -33,4 +33,13 @@
  */
 - (nonnull NSString*) SHA1;
 
+/*!
+ Computes a 128-bit MurmurHash3 hash from the contents of the receiver.
+
+ @note      MurmurHash3 is fast, but it is not a secure hash.
+
+ @return    the hash, as a lowercase hexadecimal string
+ */
+- (nonnull NSString*) Murmur3;
+
 @end
@@ -29,4 +29,9 @@
     return [MBMessageDigest SHA1ForString:self];
 }
 
+- (nonnull NSString*) Murmur3
+{
+    return [MBMessageDigest Murmur3ForString:self];
+}
+
 @end
@@ -255,6 +255,25 @@
  */
 - (nonnull NSData*) dataForOperation;
 
+/*!
+ Called internally to write the data returned by `dataForOperation` to the
+ file.
+
+ The default implementation writes the data atomically to `path`. Subclasses
+ may override this method to store the data by some other means.
+
+ @param     data The data to write.
+
+ @param     path The filesystem path of the file to be written.
+
+ @param     errPtr If this method returns `NO` and this parameter is non-`nil`,
+            `*errPtr` will be updated to point to an `NSError` instance
+            containing further information about the error.
+
+ @return    `YES` if the data was written; `NO` otherwise.
+ */
+- (BOOL) writeData:(nonnull NSData*)data toFile:(nonnull NSString*)path error:(NSErrorPtrPtr)errPtr;
+
 @end
 
 /******************************************************************************/
@@ -184,6 +184,15 @@ MBImplementSingleton();
     return _fileData;
 }
 
+- (BOOL) writeData:(nonnull NSData*)data toFile:(nonnull NSString*)path error:(NSErrorPtrPtr)errPtr
+{
+    NSDataWritingOptions options = NSDataWritingAtomic;
+#if TARGET_OS_IPHONE
+    options |= NSDataWritingFileProtectionNone;
+#endif
+    return [data writeToFile:path options:options error:errPtr];
+}
+
 - (void) main
 {
     MBLogDebugTrace();
@@ -192,11 +201,7 @@ MBImplementSingleton();
         @try {
             NSError* err = nil;
             NSData* data = [self dataForOperation];
-            NSDataWritingOptions options = NSDataWritingAtomic;
-#if TARGET_OS_IPHONE
-            options |= NSDataWritingFileProtectionNone;
-#endif
-            if (![data writeToFile:_filePath options:options error:&err]) {
+            if (![self writeData:data toFile:_filePath error:&err]) {
                 MBLogError(@"%@ error while trying to write the file at %@: %@", [self class], _filePath, [err localizedDescription]);
             }
             else {
@@ -27,6 +27,10 @@
  class-level methods as well. It is more efficient to get the singleton
  instance and call instance-level methods when you expect to do many calls to
  the `MBRegexCache`.
+
+ The hit rate of the cache, and the time spent compiling patterns that
+ weren't in it, can be monitored through the `statistics` method inherited
+ from `MBThreadsafeCache`.
  
  @warning   You *must not* create instances of this class yourself; this class
             is a singleton. Call the `instance` class method (declared by the
@@ -31,7 +31,20 @@ MBImplementSingleton();
         MBLogError(@"WARNING: %@ compiled with regular expression caching DISABLED!", [self class]);
     }
     
-    return [super init];
+    // the regex cache is a process-wide singleton that is written once per
+    // pattern and read many times from many threads, so readers use published
+    // snapshots and take no lock at all; sharding keeps each copy-on-write small
+    NSUInteger shards = [[NSProcessInfo processInfo] activeProcessorCount];
+#if MB_BUILD_UIKIT
+    return [super initWithConcurrencyMode:MBThreadsafeCacheConcurrencyModeSnapshot
+                               shardCount:shards
+                      exceptionProtection:NO
+                     ignoreMemoryWarnings:NO];
+#else
+    return [super initWithConcurrencyMode:MBThreadsafeCacheConcurrencyModeSnapshot
+                               shardCount:shards
+                      exceptionProtection:NO];
+#endif
 }
 
 /******************************************************************************/
@@ -44,27 +57,32 @@ MBImplementSingleton();
 {
     MBLogDebugTrace();
     
-    NSString* cacheKey = [NSString stringWithFormat:@"%@ 0x%lx", pattern, (unsigned long)options];
+    NSError* logError = nil;
     NSRegularExpression* regex = nil;
-    if (!DEBUG_FLAG(DEBUG_DISABLE_CACHING)) {
-        regex = self[cacheKey];
-    }
-    if (!regex) {
-        NSError* logError = nil;
-
+    if (DEBUG_FLAG(DEBUG_DISABLE_CACHING)) {
         regex = [NSRegularExpression regularExpressionWithPattern:pattern
                                                           options:options
                                                             error:&logError];
-        if (errPtr) {
-            *errPtr = logError;
-        }
-        else if (logError) {
-            MBLogError(@"Error %@ attempting to create NSRegularExpression instance from the pattern: %@", logError, pattern);
-        }
- 
-        if (regex && !DEBUG_FLAG(DEBUG_DISABLE_CACHING)) {
-            [self setObject:regex forKey:cacheKey];
-        }
+    }
+    else {
+        // loading through the cache coalesces concurrent compilations of
+        // the same pattern, and lets the compile time show up in the
+        // load latency reported by our statistics
+        NSString* cacheKey = [NSString stringWithFormat:@"%@ 0x%lx", pattern, (unsigned long)options];
+        regex = [self objectForKey:cacheKey
+                            orLoad:^id(NSErrorPtrPtr loadErrPtr) {
+                                return [NSRegularExpression regularExpressionWithPattern:pattern
+                                                                                 options:options
+                                                                                   error:loadErrPtr];
+                            }
+                             error:&logError];
+    }
+
+    if (errPtr) {
+        *errPtr = logError;
+    }
+    else if (logError) {
+        MBLogError(@"Error %@ attempting to create NSRegularExpression instance from the pattern: %@", logError, pattern);
     }
     return regex;
 }
@@ -0,0 +1,715 @@
+//
+//  Test-MBFilesystemCache.m
+//  MockingbirdTests
+//
+//  Created by Evan Coyne Maloney on 10/17/26.
+//  Copyright (c) 2026 Gilt Groupe. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <XCTest/XCTest.h>
+
+#import "MBFilesystemCache.h"
+#import "MBCacheOperations.h"
+#import "MBFilesystemCache+Subclassing.h"
+#import "MBThreadsafeCache+Subclassing.h"
+#import "MBCacheCodec.h"
+#import "NSString+MBMessageDigest.h"
+
+/******************************************************************************/
+#pragma mark Constants
+/******************************************************************************/
+
+static const NSTimeInterval kTestTimeout        = 5.0;
+static const NSTimeInterval kSlowReadDelay      = 0.05;
+static const NSUInteger kBenchmarkHitCount      = 10000;
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark MBTestSlowFilesystemCache class
+/******************************************************************************/
+
+// simulates a slow filesystem by delaying every cache file read; objects
+// for "cold" keys are never kept in memory, so every read of one hits disk
+@interface MBTestSlowFilesystemCache : MBFilesystemCache
+@property(atomic, assign) NSUInteger decodeCount;
+@end
+
+@implementation MBTestSlowFilesystemCache
+
+- (id) objectFromCacheFile:(NSString*)path
+{
+    [NSThread sleepForTimeInterval:kSlowReadDelay];
+
+    return [super objectFromCacheFile:path];
+}
+
+- (id) objectFromCacheData:(NSData*)cacheData
+{
+    @synchronized (self) {
+        self.decodeCount++;
+    }
+
+    return [super objectFromCacheData:cacheData];
+}
+
+- (BOOL) shouldStoreObject:(id)cacheObj forKey:(id)key inMemoryCache:(MBFilesystemCache*)cache
+{
+    return ![key hasPrefix:@"cold"];
+}
+
+@end
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark MBTestCountingFilesystemCache class
+/******************************************************************************/
+
+// counts the number of times a cache filename is derived from a key
+@interface MBTestCountingFilesystemCache : MBFilesystemCache
+@property(atomic, assign) NSUInteger filenameCount;
+@end
+
+@implementation MBTestCountingFilesystemCache
+
+- (NSString*) filenameForCacheKey:(id)key
+{
+    self.filenameCount++;
+
+    return [super filenameForCacheKey:key];
+}
+
+@end
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark Tests
+/******************************************************************************/
+
+@interface MBFilesystemCacheTests : XCTestCase
+@end
+
+@implementation MBFilesystemCacheTests
+{
+    MBFilesystemCache* _cache;
+}
+
+- (void) setUp
+{
+    [super setUp];
+
+    NSString* name = [NSString stringWithFormat:@"MBFilesystemCacheTests-%@", [[NSUUID UUID] UUIDString]];
+    _cache = [[MBTestSlowFilesystemCache alloc] initWithName:name];
+}
+
+- (void) tearDown
+{
+    [_cache.writeQueue waitUntilAllOperationsAreFinished];
+    [_cache clearFilesystemCache];
+    _cache = nil;
+
+    [super tearDown];
+}
+
+- (NSData*) _dataForKey:(NSString*)key
+{
+    return [key dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+- (void) testAsyncMemoryHit
+{
+    NSData* data = [self _dataForKey:@"hit"];
+    _cache[@"hit"] = data;
+
+    __block id result = nil;
+    [_cache objectForKey:@"hit" completion:^(id cacheObj) {
+        result = cacheObj;
+    }];
+    XCTAssertEqualObjects(result, data, @"expected memory hit to complete synchronously");
+}
+
+- (void) testAsyncFilesystemLoad
+{
+    NSData* data = [self _dataForKey:@"disk"];
+    _cache[@"disk"] = data;
+    [_cache.writeQueue waitUntilAllOperationsAreFinished];
+    [_cache clearMemoryCache];
+
+    XCTestExpectation* loaded = [self expectationWithDescription:@"filesystem load"];
+    [_cache objectForKey:@"disk" completion:^(id cacheObj) {
+        XCTAssertEqualObjects(cacheObj, data, @"unexpected object loaded from filesystem");
+        [loaded fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:kTestTimeout handler:nil];
+
+    XCTAssertTrue([_cache isKeyInMemoryCache:@"disk"], @"expected loaded object to enter memory cache");
+}
+
+- (void) testAsyncMiss
+{
+    XCTestExpectation* missed = [self expectationWithDescription:@"cache miss"];
+    [_cache objectForKey:@"absent" completion:^(id cacheObj) {
+        XCTAssertNil(cacheObj, @"expected no object for absent key");
+        [missed fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:kTestTimeout handler:nil];
+}
+
+- (void) testWriteCoalescing
+{
+    MBCacheWriteQueue* writeQueue = _cache.writeQueue;
+    [writeQueue waitUntilAllOperationsAreFinished];
+    NSUInteger supersededBefore = writeQueue.supersededWriteCount;
+
+    [writeQueue setSuspended:YES];
+    for (NSUInteger i=0; i<100; i++) {
+        _cache[@"hot"] = [self _dataForKey:[NSString stringWithFormat:@"value %lu", (unsigned long)i]];
+    }
+    XCTAssertEqual(writeQueue.pendingWriteCount, (NSUInteger)1, @"expected writes to the same file to coalesce");
+    [writeQueue setSuspended:NO];
+    [writeQueue waitUntilAllOperationsAreFinished];
+
+    XCTAssertEqual(writeQueue.supersededWriteCount - supersededBefore, (NSUInteger)99, @"unexpected superseded write count");
+    XCTAssertEqual(writeQueue.pendingWriteCount, (NSUInteger)0, @"expected no pending writes");
+
+    NSData* written = [NSData dataWithContentsOfFile:[_cache filePathForCacheKey:@"hot"]];
+    XCTAssertEqualObjects([_cache decodedCacheData:written error:nil], [self _dataForKey:@"value 99"], @"expected only the final value to be written");
+}
+
+- (void) testFileIndex
+{
+    _cache[@"indexed"] = [self _dataForKey:@"indexed"];
+    [_cache.writeQueue waitUntilAllOperationsAreFinished];
+    XCTAssertTrue([_cache isKeyInFilesystemCache:@"indexed"], @"expected written file to be indexed");
+
+    // a second instance loads (or rebuilds) the index from disk
+    MBFilesystemCache* reopened = [[MBFilesystemCache alloc] initWithName:_cache.cacheName];
+    XCTAssertTrue([reopened isKeyInFilesystemCache:@"indexed"], @"expected file to be found by new instance");
+    XCTAssertFalse([reopened isKeyInFilesystemCache:@"unindexed"], @"expected absent file not to be found");
+
+    [_cache removeObjectForKey:@"indexed"];
+    XCTAssertFalse([_cache isKeyInFilesystemCache:@"indexed"], @"expected removal to be reflected in the index");
+}
+
+- (void) testKeyHash
+{
+    NSString* name = [NSString stringWithFormat:@"MBFilesystemCacheTests-%@", [[NSUUID UUID] UUIDString]];
+    MBTestCountingFilesystemCache* cache = [[MBTestCountingFilesystemCache alloc] initWithName:name];
+    cache.keyHash = MBFilesystemCacheKeyHashMurmur3;
+
+    NSString* filename = [[cache filePathForCacheKey:@"key"] lastPathComponent];
+    XCTAssertEqualObjects([filename stringByDeletingPathExtension], [@"key" Murmur3], @"unexpected cache filename");
+
+    // each operation should derive the filename only once
+    cache.filenameCount = 0;
+    cache[@"other key"] = [self _dataForKey:@"other key"];
+    XCTAssertEqual(cache.filenameCount, (NSUInteger)1, @"expected a set to hash its key once");
+    XCTAssertNotNil(cache[@"other key"], @"expected object to be found");
+    XCTAssertTrue([cache isKeyInCache:@"other key"], @"expected key to be in cache");
+    XCTAssertEqual(cache.filenameCount, (NSUInteger)1, @"expected repeated use of a key not to rehash it");
+
+    XCTAssertFalse([cache isKeyInCache:@"missing key"], @"expected key not to be in cache");
+    XCTAssertEqual(cache.filenameCount, (NSUInteger)2, @"expected a new key to be hashed once");
+
+    [cache.writeQueue waitUntilAllOperationsAreFinished];
+    [cache clearMemoryCache];
+    XCTAssertEqualObjects(cache[@"other key"], [self _dataForKey:@"other key"], @"unexpected object loaded from file");
+    [cache clearFilesystemCache];
+}
+
+- (void) testSizeLimit
+{
+    const NSUInteger dataSize = 1024;
+    const NSUInteger fileCount = 20;
+    for (NSUInteger i=0; i<fileCount; i++) {
+        NSString* key = [NSString stringWithFormat:@"cold %lu", (unsigned long)i];
+        _cache[key] = [NSMutableData dataWithLength:dataSize];
+    }
+    [_cache.writeQueue waitUntilAllOperationsAreFinished];
+
+    // each file carries a header in addition to its data
+    NSString* path = [_cache filePathForCacheKey:@"cold 0"];
+    NSUInteger fileSize = (NSUInteger)[[[NSFileManager defaultManager] attributesOfItemAtPath:path error:nil] fileSize];
+    XCTAssertTrue(fileSize > dataSize, @"expected cache file to include a header");
+
+    // the size is known once the index has loaded
+    NSDate* deadline = [NSDate dateWithTimeIntervalSinceNow:kTestTimeout];
+    while (_cache.sizeOfCacheFiles != fileSize * fileCount && [deadline timeIntervalSinceNow] > 0) {
+        [NSThread sleepForTimeInterval:0.01];
+    }
+    XCTAssertEqual(_cache.sizeOfCacheFiles, (unsigned long long)(fileSize * fileCount), @"unexpected size of cache files");
+
+    // reading a file makes it the most recently accessed
+    XCTAssertNotNil(_cache[@"cold 0"], @"expected object to be loaded from file");
+
+    _cache.maxSizeOfCacheFiles = fileSize * 10;
+    [[MBFilesystemOperationQueue instance] waitUntilAllOperationsAreFinished];
+
+    XCTAssertEqual(_cache.sizeOfCacheFiles, (unsigned long long)(fileSize * 9), @"expected eviction down to the low-water mark");
+    XCTAssertTrue([_cache isKeyInFilesystemCache:@"cold 0"], @"expected recently accessed file to survive eviction");
+
+    NSUInteger remaining = 0;
+    for (NSUInteger i=1; i<fileCount; i++) {
+        NSString* key = [NSString stringWithFormat:@"cold %lu", (unsigned long)i];
+        if ([_cache isKeyInFilesystemCache:key]) {
+            remaining++;
+        }
+    }
+    XCTAssertEqual(remaining, (NSUInteger)8, @"unexpected number of files surviving eviction");
+}
+
+- (void) testPruneOperation
+{
+    const NSUInteger fileCount = 10;
+    NSDate* longAgo = [NSDate dateWithTimeIntervalSinceNow:-(2 * kMBFilesystemCacheDefaultMaxAge)];
+    for (NSUInteger i=0; i<fileCount; i++) {
+        NSString* key = [NSString stringWithFormat:@"cold %lu", (unsigned long)i];
+        _cache[key] = [self _dataForKey:key];
+    }
+    [_cache.writeQueue waitUntilAllOperationsAreFinished];
+
+    // age every file but the first
+    for (NSUInteger i=1; i<fileCount; i++) {
+        NSString* key = [NSString stringWithFormat:@"cold %lu", (unsigned long)i];
+        [[NSFileManager defaultManager] setAttributes:@{NSFileModificationDate: longAgo}
+                                         ofItemAtPath:[_cache filePathForCacheKey:key]
+                                                error:nil];
+    }
+
+    [_cache purgeOutOfDateCacheFiles];
+    MBCachePruneOperation* op = _cache.pruneOperation;
+    XCTAssertNotNil(op, @"expected a prune operation");
+    [op waitUntilFinished];
+
+    XCTAssertEqual(op.examinedFileCount, fileCount, @"unexpected number of files examined");
+    XCTAssertEqual(op.deletedFileCount, fileCount - 1, @"unexpected number of files deleted");
+    XCTAssertTrue(op.examinedFilesPerSecond > 0, @"expected a nonzero examination rate");
+    XCTAssertNil(op.resumeFilename, @"expected no resume point after completion");
+
+    XCTAssertTrue([_cache isKeyInFilesystemCache:@"cold 0"], @"expected recent file to survive pruning");
+    XCTAssertFalse([_cache isKeyInCache:@"cold 1"], @"expected pruned file to be forgotten by the cache");
+}
+
+- (void) testBloomFilter
+{
+    _cache.usesBloomFilter = YES;
+
+    for (NSUInteger i=0; i<1000; i++) {
+        NSString* key = [NSString stringWithFormat:@"absent %lu", (unsigned long)i];
+        XCTAssertFalse([_cache isKeyInCache:key], @"expected absent key not to be found");
+    }
+    double rate = _cache.bloomFilterFalsePositiveRate;
+    XCTAssertTrue(rate >= 0.0 && rate < 0.05, @"unexpected false-positive rate: %g", rate);
+
+    _cache[@"filtered"] = [self _dataForKey:@"filtered"];
+    [_cache.writeQueue waitUntilAllOperationsAreFinished];
+    XCTAssertTrue([_cache isKeyInFilesystemCache:@"filtered"], @"expected written file to pass the filter");
+
+    // while a new instance rebuilds its filter, lookups must still succeed
+    MBFilesystemCache* reopened = [[MBFilesystemCache alloc] initWithName:_cache.cacheName];
+    reopened.usesBloomFilter = YES;
+    XCTAssertTrue([reopened isKeyInFilesystemCache:@"filtered"], @"expected file to be found by new instance");
+
+    [_cache removeObjectForKey:@"filtered"];
+    XCTAssertFalse([_cache isKeyInFilesystemCache:@"filtered"], @"expected removed file not to be found");
+}
+
+- (void) testCompression
+{
+    NSMutableString* json = [NSMutableString string];
+    for (NSUInteger i=0; i<200; i++) {
+        [json appendFormat:@"{\"id\": %lu, \"name\": \"item\", \"tags\": [\"a\", \"b\"]},", (unsigned long)i];
+    }
+    NSData* payload = [json dataUsingEncoding:NSUTF8StringEncoding];
+
+    // files written before compression was enabled remain readable
+    _cache[@"plain"] = payload;
+    [_cache.writeQueue waitUntilAllOperationsAreFinished];
+
+    _cache.compression = MBFilesystemCacheCompressionLZ4;
+    _cache[@"lz4"] = payload;
+    _cache[@"tiny"] = [self _dataForKey:@"tiny"];
+    [_cache.writeQueue waitUntilAllOperationsAreFinished];
+
+    _cache.compression = MBFilesystemCacheCompressionLZFSE;
+    _cache[@"lzfse"] = payload;
+    [_cache.writeQueue waitUntilAllOperationsAreFinished];
+    [_cache clearMemoryCache];
+
+    NSData* written = [NSData dataWithContentsOfFile:[_cache filePathForCacheKey:@"lz4"]];
+    XCTAssertTrue(written.length < payload.length / 2, @"expected payload to be compressed");
+
+    for (NSString* key in @[@"plain", @"lz4", @"lzfse"]) {
+        XCTAssertEqualObjects(_cache[key], payload, @"unexpected object loaded for %@", key);
+    }
+    XCTAssertEqualObjects(_cache[@"tiny"], [self _dataForKey:@"tiny"], @"unexpected object loaded for small payload");
+
+    // corrupt files are rejected rather than handed to the delegate
+    NSMutableData* corrupt = [written mutableCopy];
+    corrupt.length = corrupt.length / 2;
+    [corrupt writeToFile:[_cache filePathForCacheKey:@"lz4"] atomically:YES];
+    [_cache clearMemoryCache];
+    XCTAssertNil(_cache[@"lz4"], @"expected truncated file not to decode");
+}
+
+- (void) testCacheFileHeader
+{
+    _cache.maxAgeOfCacheFiles = 60;
+    _cache[@"checked"] = [self _dataForKey:@"checked"];
+    _cache[@"expiring"] = [self _dataForKey:@"expiring"];
+    [_cache.writeQueue waitUntilAllOperationsAreFinished];
+    [_cache clearMemoryCache];
+
+    NSString* path = [_cache filePathForCacheKey:@"checked"];
+    MBCacheFileAttributes attrs;
+    XCTAssertTrue([MBCacheCodec getAttributes:&attrs ofFileAtPath:path], @"expected a valid header");
+    XCTAssertEqual(attrs.compression, MBFilesystemCacheCompressionNone, @"unexpected compression");
+    XCTAssertEqual(attrs.decodedLength, (uint64_t)[self _dataForKey:@"checked"].length, @"unexpected decoded length");
+    XCTAssertEqualWithAccuracy(attrs.expiresAt - attrs.createdAt, 60.0, 0.001, @"unexpected expiry");
+
+    // flipping a single payload bit must be caught by the checksum
+    NSMutableData* corrupt = [[NSData dataWithContentsOfFile:path] mutableCopy];
+    ((uint8_t*)corrupt.mutableBytes)[corrupt.length - 1] ^= 0x01;
+    NSError* err = nil;
+    XCTAssertNil([_cache decodedCacheData:corrupt error:&err], @"expected corrupt data not to decode");
+    XCTAssertNotNil(err, @"expected an error describing the corruption");
+    [corrupt writeToFile:path atomically:YES];
+    XCTAssertNil(_cache[@"checked"], @"expected corrupt file to be rejected");
+
+    // an expired file is rejected based on its header alone
+    NSString* expiringPath = [_cache filePathForCacheKey:@"expiring"];
+    NSData* expiring = [NSData dataWithContentsOfFile:expiringPath];
+    NSData* decoded = [_cache decodedCacheData:expiring error:nil];
+    XCTAssertEqualObjects(decoded, [self _dataForKey:@"expiring"], @"expected intact file to decode");
+    NSData* expired = [MBCacheCodec encodeData:decoded
+                              usingCompression:MBFilesystemCacheCompressionNone
+                                     expiresAt:[NSDate timeIntervalSinceReferenceDate] - 1];
+    [expired writeToFile:expiringPath atomically:YES];
+    XCTAssertNil(_cache[@"expiring"], @"expected expired file to be rejected");
+}
+
+- (void) testConcurrentMissesDecodeOnce
+{
+    NSData* data = [self _dataForKey:@"shared"];
+    _cache[@"shared"] = data;
+    [_cache.writeQueue waitUntilAllOperationsAreFinished];
+    [_cache clearMemoryCache];
+
+    // every loading path joins the same in-flight filesystem load
+    MBFilesystemCache* cache = _cache;
+    dispatch_group_t group = dispatch_group_create();
+    dispatch_apply(12, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+        switch (i % 3) {
+            case 0:
+                XCTAssertEqualObjects(cache[@"shared"], data, @"unexpected object");
+                break;
+
+            case 1:
+                XCTAssertEqualObjects([cache objectsForKeys:@[@"shared"]][@"shared"], data, @"unexpected batch object");
+                break;
+
+            default:
+                dispatch_group_enter(group);
+                [cache objectForKey:@"shared" completion:^(id cacheObj) {
+                    XCTAssertEqualObjects(cacheObj, data, @"unexpected async object");
+                    dispatch_group_leave(group);
+                }];
+                break;
+        }
+    });
+    XCTAssertEqual(dispatch_group_wait(group, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(kTestTimeout * NSEC_PER_SEC))), 0L, @"timed out waiting for async loads");
+
+    XCTAssertEqual(((MBTestSlowFilesystemCache*)_cache).decodeCount, (NSUInteger)1, @"expected concurrent misses to share a single decode");
+}
+
+- (void) testBatchAccess
+{
+    NSMutableDictionary* objectsAndKeys = [NSMutableDictionary dictionary];
+    NSMutableArray* keys = [NSMutableArray array];
+    for (NSUInteger i=0; i<100; i++) {
+        NSString* key = [NSString stringWithFormat:@"batch %lu", (unsigned long)i];
+        [keys addObject:key];
+        if (i % 4 != 3) {
+            objectsAndKeys[key] = [self _dataForKey:key];
+        }
+    }
+    [_cache setObjectsAndKeys:objectsAndKeys];
+    [_cache.writeQueue waitUntilAllOperationsAreFinished];
+
+    // leave some objects in memory, so the batch is served from both tiers
+    [_cache clearMemoryCache];
+    for (NSUInteger i=0; i<100; i+=4) {
+        (void) _cache[keys[i]];
+    }
+
+    NSDictionary* found = [_cache objectsForKeys:keys];
+    XCTAssertEqualObjects(found, objectsAndKeys, @"expected exactly the stored keys to be found");
+    XCTAssertTrue([_cache isKeyInMemoryCache:@"batch 1"], @"expected loaded object to enter memory cache");
+
+    [_cache clearMemoryCache];
+    XCTestExpectation* loaded = [self expectationWithDescription:@"batch load"];
+    [_cache objectsForKeys:keys completion:^(NSDictionary* cacheObjs) {
+        XCTAssertEqualObjects(cacheObjs, objectsAndKeys, @"expected exactly the stored keys to be loaded");
+        [loaded fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:kTestTimeout handler:nil];
+}
+
+- (void) testPreload
+{
+    NSMutableArray* keys = [NSMutableArray array];
+    for (NSUInteger i=0; i<20; i++) {
+        NSString* key = [NSString stringWithFormat:@"warm %lu", (unsigned long)i];
+        [keys addObject:key];
+        _cache[key] = [self _dataForKey:key];
+    }
+    [_cache.writeQueue waitUntilAllOperationsAreFinished];
+    [_cache clearMemoryCache];
+    (void) _cache[@"warm 0"];
+
+    XCTestExpectation* preloaded = [self expectationWithDescription:@"preload"];
+    [_cache preloadObjectsForKeys:[keys arrayByAddingObject:@"absent"] completion:^(NSUInteger loadedCount) {
+        XCTAssertEqual(loadedCount, (NSUInteger)19, @"expected objects already in memory or absent to be skipped");
+        [preloaded fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:kTestTimeout handler:nil];
+    for (NSString* key in keys) {
+        XCTAssertTrue([_cache isKeyInMemoryCache:key], @"expected preloaded object to be in memory cache");
+    }
+}
+
+- (void) testHotSet
+{
+    _cache.hotSetCountLimit = 5;
+    for (NSUInteger i=0; i<10; i++) {
+        NSString* key = [NSString stringWithFormat:@"hot %lu", (unsigned long)i];
+        _cache[key] = [self _dataForKey:key];
+    }
+    [_cache.writeQueue waitUntilAllOperationsAreFinished];
+
+    NSError* err = nil;
+    XCTAssertTrue([_cache saveHotSet:&err], @"expected hot set to be saved: %@", err);
+
+    // a new instance starts with an empty memory cache
+    MBFilesystemCache* reopened = [[MBFilesystemCache alloc] initWithName:_cache.cacheName];
+    XCTestExpectation* preloaded = [self expectationWithDescription:@"hot set preload"];
+    [reopened preloadHotSetWithCompletion:^(NSUInteger loadedCount) {
+        XCTAssertEqual(loadedCount, (NSUInteger)5, @"expected the hot set to be limited");
+        [preloaded fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:kTestTimeout handler:nil];
+
+    NSUInteger inMemory = 0;
+    for (NSUInteger i=0; i<10; i++) {
+        NSString* key = [NSString stringWithFormat:@"hot %lu", (unsigned long)i];
+        if ([reopened isKeyInMemoryCache:key]) {
+            XCTAssertEqualObjects([reopened objectForKeyInMemoryCache:key], [self _dataForKey:key], @"unexpected preloaded object");
+            inMemory++;
+        }
+    }
+    XCTAssertEqual(inMemory, (NSUInteger)5, @"expected hot set objects to be in memory cache");
+}
+
+- (void) testStatistics
+{
+    _cache.measuresLatency = YES;
+    _cache[@"disk"] = [self _dataForKey:@"disk"];
+    [_cache.writeQueue waitUntilAllOperationsAreFinished];
+    [_cache clearMemoryCache];
+
+    XCTAssertNotNil(_cache[@"disk"], @"expected object to be loaded from filesystem");
+    XCTAssertNotNil(_cache[@"disk"], @"expected object to be in memory cache");
+    XCTAssertNil(_cache[@"absent"], @"expected no object for absent key");
+
+    MBCacheStatistics* stats = [_cache statistics];
+    XCTAssertEqual(stats.memoryHits, (uint64_t)1, @"unexpected memory hit count");
+    XCTAssertEqual(stats.memoryMisses, (uint64_t)2, @"unexpected memory miss count");
+    XCTAssertEqual(stats.diskHits, (uint64_t)1, @"unexpected disk hit count");
+    XCTAssertEqual(stats.misses, (uint64_t)1, @"unexpected miss count");
+    XCTAssertEqual(stats.sets, (uint64_t)1, @"unexpected set count");
+
+    NSDictionary* attrs = [[NSFileManager defaultManager] attributesOfItemAtPath:[_cache filePathForCacheKey:@"disk"] error:nil];
+    XCTAssertEqual(stats.bytesWritten, (uint64_t)[attrs fileSize], @"expected the cache file to be counted as written");
+    XCTAssertEqual(stats.bytesRead, (uint64_t)[attrs fileSize], @"expected the cache file to be counted as read");
+    XCTAssertEqual(stats.loadLatency.count, (uint64_t)1, @"expected the filesystem load to be measured");
+    XCTAssertGreaterThanOrEqual(stats.loadLatency.meanNanoseconds, kSlowReadDelay * NSEC_PER_SEC, @"expected the load latency to include the read delay");
+}
+
+- (void) testSegmentedStorage
+{
+    NSString* name = [NSString stringWithFormat:@"MBFilesystemCacheTests-%@", [[NSUUID UUID] UUIDString]];
+    MBFilesystemCache* cache = [[MBFilesystemCache alloc] initWithName:name
+                                                         cacheDelegate:_cache
+                                                            shardCount:1
+                                                           storageMode:MBFilesystemCacheStorageModeSegmented];
+    cache.cacheDelegate = cache;
+    XCTAssertEqual(cache.storageMode, MBFilesystemCacheStorageModeSegmented, @"unexpected storage mode");
+
+    for (NSUInteger i=0; i<100; i++) {
+        NSString* key = [NSString stringWithFormat:@"key %lu", (unsigned long)i];
+        cache[key] = [self _dataForKey:key];
+    }
+    [cache.writeQueue waitUntilAllOperationsAreFinished];
+    [cache removeObjectForKey:@"key 0"];
+
+    // a new instance must rebuild its index from the segment files
+    MBFilesystemCache* reopened = [[MBFilesystemCache alloc] initWithName:name
+                                                            cacheDelegate:_cache
+                                                               shardCount:1
+                                                              storageMode:MBFilesystemCacheStorageModeSegmented];
+    reopened.cacheDelegate = reopened;
+    XCTAssertFalse([reopened isKeyInCache:@"key 0"], @"expected removed key to stay removed");
+    for (NSUInteger i=1; i<100; i++) {
+        NSString* key = [NSString stringWithFormat:@"key %lu", (unsigned long)i];
+        XCTAssertTrue([reopened isKeyInFilesystemCache:key], @"expected key to be in filesystem cache");
+        XCTAssertEqualObjects(reopened[key], [self _dataForKey:key], @"unexpected object loaded from segment");
+    }
+
+    NSString* dir = [[cache filePathForCacheKey:@"key 1"] stringByDeletingLastPathComponent];
+    NSArray* files = [[NSFileManager defaultManager] contentsOfDirectoryAtPath:dir error:nil];
+    XCTAssertEqual(files.count, (NSUInteger)1, @"expected all objects to share a single segment file");
+
+    // mapped data must outlive the segment file it came from
+    [reopened clearMemoryCache];
+    NSData* mapped = reopened[@"key 1"];
+    [reopened clearFilesystemCache];
+    XCTAssertFalse([reopened isKeyInFilesystemCache:@"key 1"], @"expected filesystem cache to be empty");
+    XCTAssertEqualObjects(mapped, [self _dataForKey:@"key 1"], @"expected mapped data to remain valid");
+}
+
+- (void) testSegmentedSizeLimit
+{
+    NSString* name = [NSString stringWithFormat:@"MBFilesystemCacheTests-%@", [[NSUUID UUID] UUIDString]];
+    MBFilesystemCache* cache = [[MBFilesystemCache alloc] initWithName:name
+                                                         cacheDelegate:_cache
+                                                            shardCount:1
+                                                           storageMode:MBFilesystemCacheStorageModeSegmented];
+    cache.cacheDelegate = cache;
+
+    const NSUInteger recordCount = 20;
+    for (NSUInteger i=0; i<recordCount - 1; i++) {
+        NSString* key = [NSString stringWithFormat:@"key %lu", (unsigned long)i];
+        cache[key] = [NSMutableData dataWithLength:1024];
+    }
+    [cache.writeQueue waitUntilAllOperationsAreFinished];
+    cache[@"newest"] = [NSMutableData dataWithLength:1024];
+    [cache.writeQueue waitUntilAllOperationsAreFinished];
+
+    // the size of the records is known without any index to load
+    unsigned long long recordSize = cache.sizeOfCacheFiles / recordCount;
+    XCTAssertTrue(recordSize > 1024, @"expected each record to include its data");
+    XCTAssertEqual(cache.sizeOfCacheFiles, recordSize * recordCount, @"unexpected size of cache records");
+
+    cache.maxSizeOfCacheFiles = recordSize * 10;
+    [[MBFilesystemOperationQueue instance] waitUntilAllOperationsAreFinished];
+
+    XCTAssertEqual(cache.sizeOfCacheFiles, recordSize * 9, @"expected eviction down to the low-water mark");
+    XCTAssertTrue([cache isKeyInFilesystemCache:@"newest"], @"expected the most recently written record to survive eviction");
+
+    [cache clearFilesystemCache];
+    XCTAssertEqual(cache.sizeOfCacheFiles, (unsigned long long)0, @"expected an empty store to have no size");
+}
+
+- (void) testExclusiveNonRecursiveMode
+{
+    NSString* name = [NSString stringWithFormat:@"MBFilesystemCacheTests-%@", [[NSUUID UUID] UUIDString]];
+    MBFilesystemCache* cache = [[MBFilesystemCache alloc] initWithName:name
+                                                         cacheDelegate:_cache
+                                                            shardCount:1
+                                                           storageMode:MBFilesystemCacheStorageModeFilePerKey
+                                                       concurrencyMode:MBThreadsafeCacheConcurrencyModeExclusiveNonRecursive];
+    cache.cacheDelegate = cache;
+    XCTAssertEqual(cache.concurrencyMode, MBThreadsafeCacheConcurrencyModeExclusiveNonRecursive, @"unexpected concurrency mode");
+
+    // none of these may re-acquire the shard lock while holding it
+    cache[@"single"] = [self _dataForKey:@"single"];
+    [cache setObjectsAndKeys:@{@"batch 1": [self _dataForKey:@"batch 1"],
+                               @"batch 2": [self _dataForKey:@"batch 2"]}];
+    XCTAssertTrue([cache isKeyInMemoryCache:@"single"], @"expected object to be stored in memory");
+    XCTAssertEqualObjects(cache[@"batch 2"], [self _dataForKey:@"batch 2"], @"unexpected object in cache");
+
+    // loading from the filesystem stores the object in memory
+    [cache.writeQueue waitUntilAllOperationsAreFinished];
+    [cache clearMemoryCache];
+    XCTAssertEqualObjects(cache[@"single"], [self _dataForKey:@"single"], @"unexpected object loaded from filesystem");
+    XCTAssertTrue([cache isKeyInMemoryCache:@"single"], @"expected loaded object to be stored in memory");
+
+    [cache removeObjectForKey:@"single"];
+    XCTAssertFalse([cache isKeyInCache:@"single"], @"expected object to be removed");
+}
+
+- (void) testReadWriteModeMemoryReadsShareTheLock
+{
+    NSString* name = [NSString stringWithFormat:@"MBFilesystemCacheTests-%@", [[NSUUID UUID] UUIDString]];
+    MBFilesystemCache* cache = [[MBFilesystemCache alloc] initWithName:name
+                                                         cacheDelegate:_cache
+                                                            shardCount:1
+                                                           storageMode:MBFilesystemCacheStorageModeFilePerKey
+                                                       concurrencyMode:MBThreadsafeCacheConcurrencyModeReadWrite];
+    cache.cacheDelegate = cache;
+    cache[@"key"] = [self _dataForKey:@"key"];
+
+    // memory cache reads only take the read lock, so they must not wait
+    // for another reader to release the shard
+    id memKey = [cache memoryCacheKeyForKey:@"key"];
+    [cache lockShardForReadingForKey:memKey];
+    XCTestExpectation* done = [self expectationWithDescription:@"read while another reader held the shard"];
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        XCTAssertEqualObjects([cache objectForKeyInMemoryCache:@"key"], [self _dataForKey:@"key"], @"expected memory hit");
+        XCTAssertTrue([cache isKeyInMemoryCache:@"key"], @"expected object to be stored in memory");
+        [done fulfill];
+    });
+    [self waitForExpectationsWithTimeout:kTestTimeout handler:nil];
+    [cache unlockShardForReadingForKey:memKey];
+
+    [cache.writeQueue waitUntilAllOperationsAreFinished];
+    [cache clearFilesystemCache];
+}
+
+/******************************************************************************/
+#pragma mark Lock contention benchmark
+/******************************************************************************/
+
+- (void) testMemoryHitsDuringFilesystemLoads
+{
+    NSData* hot = [self _dataForKey:@"hot"];
+    for (NSUInteger i=0; i<8; i++) {
+        NSString* key = [NSString stringWithFormat:@"cold %lu", (unsigned long)i];
+        _cache[key] = [self _dataForKey:key];
+    }
+    [_cache.writeQueue waitUntilAllOperationsAreFinished];
+    _cache[@"hot"] = hot;
+
+    // keep slow filesystem loads in flight for the duration of the benchmark
+    __block volatile BOOL loading = YES;
+    dispatch_group_t group = dispatch_group_create();
+    dispatch_queue_t q = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+    MBFilesystemCache* cache = _cache;
+    for (NSUInteger i=0; i<4; i++) {
+        dispatch_group_async(group, q, ^{
+            NSUInteger n = i;
+            while (loading) {
+                NSString* key = [NSString stringWithFormat:@"cold %lu", (unsigned long)(n++ % 8)];
+                (void) cache[key];
+            }
+        });
+    }
+    [NSThread sleepForTimeInterval:kSlowReadDelay / 2];
+
+    // no memory hit should ever wait behind a file read
+    __block NSTimeInterval slowestHit = 0;
+    [self measureBlock:^{
+        for (NSUInteger i=0; i<kBenchmarkHitCount; i++) {
+            NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+            XCTAssertEqualObjects(cache[@"hot"], hot, @"expected memory hit");
+            slowestHit = MAX(slowestHit, [NSDate timeIntervalSinceReferenceDate] - start);
+        }
+    }];
+
+    loading = NO;
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+
+    XCTAssertLessThan(slowestHit, kSlowReadDelay, @"a memory hit waited on a filesystem load");
+}
+
+@end
@@ -58,6 +58,15 @@
     XCTAssertEqualObjects(testOne, testTwo, @"hashes don't match");
 }
 
+- (void) _testMurmur3String:(NSString*)toHash expectingString:(NSString*)expectedHash
+{
+    NSString* testOne = [toHash Murmur3];
+    XCTAssertEqualObjects(testOne, expectedHash, @"unexpected hash");
+
+    NSString* testTwo = [MBMessageDigest Murmur3ForData:[toHash dataUsingEncoding:NSUTF8StringEncoding]];
+    XCTAssertEqualObjects(testOne, testTwo, @"hashes don't match");
+}
+
 - (void) _testMD5String:(NSString*)toHash expectingData:(NSData*)expectedHash
 {
     NSData* testHash = [MBMessageDigest MD5DataForString:toHash];
@@ -85,6 +94,23 @@
           expectingString:@"8d2f164edadeadace439d9069bcd4bfd69897f6d"];
 }
 
+- (void) testMurmur3
+{
+    [self _testMurmur3String:@""
+             expectingString:@"00000000000000000000000000000000"];
+
+    // the reference implementation yields the 64-bit halves
+    // 0xcbd8a7b341bd9b02 & 0x5b1e906a48ae1d19
+    [self _testMurmur3String:@"hello"
+             expectingString:@"029bbd41b3a7d8cb191dae486a901e5b"];
+
+    [self _testMurmur3String:@"this is a test"
+             expectingString:@"1280558d90b61e73de3efead6bf1eb4b"];
+
+    [self _testMurmur3String:@"this is a not a test\nbut maybe it should be\n"
+             expectingString:@"1da4323b1031c694f2aae21df4e4f1ed"];
+}
+
 - (void) testHashDataToString
 {
     // the base64 encoding of the string "this is a test" is dGhpcyBpcyBhIHRlc3Q=
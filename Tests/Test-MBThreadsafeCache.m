@@ -0,0 +1,720 @@
+//
+//  Test-MBThreadsafeCache.m
+//  MockingbirdTests
+//
+//  Created by Evan Coyne Maloney on 10/17/26.
+//  Copyright (c) 2026 Gilt Groupe. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <XCTest/XCTest.h>
+#import <stdatomic.h>
+
+#import "MBThreadsafeCache.h"
+#import "MBCacheEpoch.h"
+#import "MBRegexCache.h"
+
+/******************************************************************************/
+#pragma mark Constants
+/******************************************************************************/
+
+static const NSUInteger kTestKeyCount           = 1000;
+static const NSUInteger kBenchmarkReadCount     = 200000;
+static const NSUInteger kTraceKeyCount          = 10000;
+static const NSUInteger kTraceRequestCount      = 200000;
+static const double     kTraceZipfExponent      = 0.99;
+static const double     kTraceCrawlFraction     = 0.3;
+static const NSTimeInterval kTestTimeout        = 5.0;
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark Helpers
+/******************************************************************************/
+
+static MBThreadsafeCache* MBTestCacheWithProtection(MBThreadsafeCacheConcurrencyMode mode, NSUInteger shards, BOOL protect)
+{
+#if MB_BUILD_UIKIT
+    return [[MBThreadsafeCache alloc] initWithConcurrencyMode:mode shardCount:shards exceptionProtection:protect ignoreMemoryWarnings:YES];
+#else
+    return [[MBThreadsafeCache alloc] initWithConcurrencyMode:mode shardCount:shards exceptionProtection:protect];
+#endif
+}
+
+static MBThreadsafeCache* MBTestCacheWithMode(MBThreadsafeCacheConcurrencyMode mode, NSUInteger shards)
+{
+    return MBTestCacheWithProtection(mode, shards, NO);
+}
+
+static MBThreadsafeCache* MBTestCacheWithShards(NSUInteger shards)
+{
+    return MBTestCacheWithMode(MBThreadsafeCacheConcurrencyModeExclusive, shards);
+}
+
+static uint64_t MBTestNextRandom(uint64_t* state)
+{
+    // xorshift64; deterministic, so every run replays the same trace
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+static double MBTestNextUniform(uint64_t* state)
+{
+    return (double)(MBTestNextRandom(state) >> 11) / (double)(1ULL << 53);
+}
+
+// a Zipf-distributed workload over a fixed key population, interleaved with
+// requests for never-repeated keys, as a crawler or one-off lookups would make
+static NSArray* MBTestZipfianTrace(void)
+{
+    double* cdf = malloc(kTraceKeyCount * sizeof(double));
+    double total = 0;
+    for (NSUInteger i=0; i<kTraceKeyCount; i++) {
+        total += 1.0 / pow(i + 1, kTraceZipfExponent);
+        cdf[i] = total;
+    }
+
+    NSMutableArray* trace = [NSMutableArray arrayWithCapacity:kTraceRequestCount];
+    uint64_t state = 0x2545F4914F6CDD1DULL;
+    NSUInteger crawled = 0;
+    for (NSUInteger r=0; r<kTraceRequestCount; r++) {
+        if (MBTestNextUniform(&state) < kTraceCrawlFraction) {
+            [trace addObject:[NSString stringWithFormat:@"crawl %lu", (unsigned long)crawled++]];
+            continue;
+        }
+
+        double target = MBTestNextUniform(&state) * total;
+        NSUInteger lo = 0, hi = kTraceKeyCount - 1;
+        while (lo < hi) {
+            NSUInteger mid = (lo + hi) / 2;
+            if (cdf[mid] < target) {
+                lo = mid + 1;
+            }
+            else {
+                hi = mid;
+            }
+        }
+        [trace addObject:@(lo)];
+    }
+    free(cdf);
+    return trace;
+}
+
+// replays the trace against the cache as a read-through cache would
+static double MBTestHitRateForTrace(NSArray* trace, MBThreadsafeCacheAdmissionPolicy admission)
+{
+    MBThreadsafeCache* cache = MBTestCacheWithShards(1);
+    cache.countLimit = 500;
+    cache.admissionPolicy = admission;
+    for (id key in trace) {
+        if (!cache[key]) {
+            cache[key] = key;
+        }
+    }
+    return [cache statistics].hitRate;
+}
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark Test keys
+/******************************************************************************/
+
+// a key that raises an exception when the cache compares it
+@interface MBTestExplodingKey : NSObject <NSCopying>
+@end
+
+@implementation MBTestExplodingKey
+
+- (id) copyWithZone:(NSZone*)zone
+{
+    return self;
+}
+
+- (NSUInteger) hash
+{
+    [NSException raise:NSInternalInconsistencyException format:@"boom"];
+    return 0;
+}
+
+@end
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark Tests
+/******************************************************************************/
+
+@interface MBThreadsafeCacheTests : XCTestCase
+@end
+
+@implementation MBThreadsafeCacheTests
+
+- (void) _testBasicOperationsOnCache:(MBThreadsafeCache*)cache
+{
+    for (NSUInteger i=0; i<kTestKeyCount; i++) {
+        NSString* key = [NSString stringWithFormat:@"key %lu", (unsigned long)i];
+        cache[key] = @(i);
+    }
+    for (NSUInteger i=0; i<kTestKeyCount; i++) {
+        NSString* key = [NSString stringWithFormat:@"key %lu", (unsigned long)i];
+        XCTAssertTrue([cache isKeyInCache:key], @"expected key to be in cache");
+        XCTAssertEqualObjects(cache[key], @(i), @"unexpected cached value");
+    }
+    for (NSUInteger i=0; i<kTestKeyCount; i+=2) {
+        NSString* key = [NSString stringWithFormat:@"key %lu", (unsigned long)i];
+        [cache removeObjectForKey:key];
+        XCTAssertNil(cache[key], @"expected removed key to be gone");
+    }
+    [cache clearMemoryCache];
+    XCTAssertNil(cache[@"key 1"], @"expected cache to be empty after clearing");
+}
+
+- (void) testUnshardedCache
+{
+    MBThreadsafeCache* cache = MBTestCacheWithShards(1);
+    XCTAssertEqual(cache.shardCount, (NSUInteger)1, @"unexpected shard count");
+
+    [self _testBasicOperationsOnCache:cache];
+}
+
+- (void) testShardedCache
+{
+    MBThreadsafeCache* cache = MBTestCacheWithShards(6);
+    XCTAssertEqual(cache.shardCount, (NSUInteger)8, @"shard count should be rounded up to a power of two");
+
+    [self _testBasicOperationsOnCache:cache];
+}
+
+- (void) testConcurrentShardedAccess
+{
+    MBThreadsafeCache* cache = MBTestCacheWithShards(16);
+
+    dispatch_apply(kTestKeyCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+        NSNumber* key = @(i % 64);
+        cache[key] = @(i);
+        XCTAssertNotNil(cache[key], @"expected value for key");
+    });
+
+    for (NSUInteger i=0; i<64; i++) {
+        XCTAssertTrue([cache isKeyInCache:@(i)], @"expected key to be in cache");
+    }
+}
+
+- (void) testReadWriteModeCache
+{
+    MBThreadsafeCache* cache = MBTestCacheWithMode(MBThreadsafeCacheConcurrencyModeReadWrite, 4);
+    XCTAssertEqual(cache.concurrencyMode, MBThreadsafeCacheConcurrencyModeReadWrite, @"unexpected concurrency mode");
+
+    [self _testBasicOperationsOnCache:cache];
+}
+
+- (void) testExclusiveNonRecursiveModeCache
+{
+    MBThreadsafeCache* cache = MBTestCacheWithMode(MBThreadsafeCacheConcurrencyModeExclusiveNonRecursive, 4);
+    XCTAssertEqual(cache.concurrencyMode, MBThreadsafeCacheConcurrencyModeExclusiveNonRecursive, @"unexpected concurrency mode");
+
+    [self _testBasicOperationsOnCache:cache];
+
+    // none of these may re-acquire a lock the cache already holds
+    cache.countLimit = 8;
+    cache.defaultTimeToLive = 60;
+    for (NSUInteger i=0; i<16; i++) {
+        cache[@(i)] = @(i);
+    }
+    [cache setObjectsAndKeys:@{@"batch 1": @1, @"batch 2": @2}];
+    XCTAssertEqualObjects([cache objectsForKeys:@[@"batch 1"]], (@{@"batch 1": @1}), @"unexpected batch result");
+    XCTAssertEqualObjects([cache objectForKey:@"loaded" orLoad:^id(NSErrorPtrPtr errPtr) {
+        return @"value";
+    } error:nil], @"value", @"unexpected loaded value");
+    [cache purgeExpiredObjects];
+    [cache clearMemoryCache];
+    XCTAssertNil(cache[@"loaded"], @"expected cache to be empty after clearing");
+}
+
+- (void) testExclusiveNonRecursiveConcurrentAccess
+{
+    MBThreadsafeCache* cache = MBTestCacheWithMode(MBThreadsafeCacheConcurrencyModeExclusiveNonRecursive, 1);
+
+    dispatch_apply(kTestKeyCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+        NSNumber* key = @(i % 64);
+        cache[key] = @(i);
+        XCTAssertNotNil(cache[key], @"expected value for key");
+    });
+
+    for (NSUInteger i=0; i<64; i++) {
+        XCTAssertTrue([cache isKeyInCache:@(i)], @"expected key to be in cache");
+    }
+}
+
+- (void) testSnapshotModeCache
+{
+    MBThreadsafeCache* cache = MBTestCacheWithMode(MBThreadsafeCacheConcurrencyModeSnapshot, 4);
+    XCTAssertEqual(cache.concurrencyMode, MBThreadsafeCacheConcurrencyModeSnapshot, @"unexpected concurrency mode");
+
+    [self _testBasicOperationsOnCache:cache];
+
+    cache[@"batch 1"] = @1;
+    [cache setObjectsAndKeys:@{@"batch 2": @2, @"batch 3": @3}];
+    NSDictionary* found = [cache objectsForKeys:@[@"batch 1", @"batch 2", @"batch 3", @"missing"]];
+    XCTAssertEqualObjects(found, (@{@"batch 1": @1, @"batch 2": @2, @"batch 3": @3}), @"unexpected batch result");
+}
+
+- (void) testSnapshotModeConcurrentAccess
+{
+    MBThreadsafeCache* cache = MBTestCacheWithMode(MBThreadsafeCacheConcurrencyModeSnapshot, 4);
+    for (NSUInteger i=0; i<64; i++) {
+        cache[@(i)] = @(i);
+    }
+
+    // readers race a writer that keeps replacing the snapshots they're
+    // reading; every read must still see a value that was stored for its key
+    __block atomic_bool writing = true;
+    dispatch_queue_t q = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+    dispatch_group_t group = dispatch_group_create();
+    dispatch_group_async(group, q, ^{
+        for (NSUInteger i=0; i<kTestKeyCount * 10; i++) {
+            cache[@(i % 64)] = @(i);
+        }
+        atomic_store(&writing, false);
+    });
+    dispatch_apply(8, q, ^(size_t reader) {
+        while (atomic_load(&writing)) {
+            for (NSUInteger i=0; i<64; i++) {
+                NSNumber* value = cache[@(i)];
+                XCTAssertNotNil(value, @"expected value for key");
+                XCTAssertEqual(value.unsignedIntegerValue % 64, i, @"unexpected value for key");
+            }
+        }
+    });
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+
+    NSUInteger last = kTestKeyCount * 10 - 1;
+    for (NSUInteger i=0; i<64; i++) {
+        XCTAssertEqualObjects(cache[@(i)], @(last - (last - i) % 64), @"expected the last write to be published");
+    }
+}
+
+- (void) testSnapshotModeTimeToLive
+{
+    // shards that track expiry are read under the lock, so expiry still applies
+    MBThreadsafeCache* cache = MBTestCacheWithMode(MBThreadsafeCacheConcurrencyModeSnapshot, 1);
+    cache[@"forever"] = @YES;
+    [cache setObject:@YES forKey:@"brief" timeToLive:0.05];
+    XCTAssertNotNil(cache[@"brief"], @"expected unexpired value");
+
+    [NSThread sleepForTimeInterval:0.1];
+    XCTAssertNil(cache[@"brief"], @"expected expired value to be gone");
+    XCTAssertFalse([cache isKeyInCache:@"brief"], @"expected expired key to be gone");
+    XCTAssertNotNil(cache[@"forever"], @"expected unexpiring value to remain");
+}
+
+- (void) testSnapshotModeReclaimsWithoutFurtherWrites
+{
+    MBThreadsafeCache* cache = MBTestCacheWithMode(MBThreadsafeCacheConcurrencyModeSnapshot, 1);
+    __weak id weakObj = nil;
+    MBCacheEpochRecord* record = MBCacheEpochRecordForCurrentThread();
+    @autoreleasepool {
+        id obj = [NSObject new];
+        weakObj = obj;
+        cache[@"key"] = obj;
+
+        // a read in progress keeps the snapshot holding the object from
+        // being released when it's replaced
+        MBCacheEpochEnter(record);
+        [cache removeObjectForKey:@"key"];
+        MBCacheEpochExit(record);
+    }
+
+    // no further write retires anything, but the snapshot is released anyway
+    NSDate* deadline = [NSDate dateWithTimeIntervalSinceNow:kTestTimeout];
+    while (weakObj && [deadline timeIntervalSinceNow] > 0) {
+        [NSThread sleepForTimeInterval:0.01];
+    }
+    XCTAssertNil(weakObj, @"expected the retired snapshot to be released");
+}
+
+- (void) testExceptionProtection
+{
+    MBThreadsafeCacheConcurrencyMode modes[] = {MBThreadsafeCacheConcurrencyModeExclusive,
+                                                MBThreadsafeCacheConcurrencyModeReadWrite,
+                                                MBThreadsafeCacheConcurrencyModeSnapshot};
+    for (NSUInteger m=0; m<sizeof(modes)/sizeof(modes[0]); m++) {
+        MBThreadsafeCache* cache = MBTestCacheWithProtection(modes[m], 1, YES);
+        [self _testBasicOperationsOnCache:cache];
+
+        // the lock must be released as the exception unwinds, or the
+        // next operation from another thread would deadlock
+        MBTestExplodingKey* key = [MBTestExplodingKey new];
+        XCTAssertThrows(cache[key] = @YES, @"expected the key's exception to propagate");
+        XCTAssertThrows((void) cache[key], @"expected the key's exception to propagate");
+        XCTAssertThrows([cache isKeyInCache:key], @"expected the key's exception to propagate");
+        XCTAssertThrows([cache setObject:@YES forKey:key timeToLive:60], @"expected the key's exception to propagate");
+        XCTAssertThrows([cache objectsForKeys:@[key]], @"expected the key's exception to propagate");
+        XCTAssertThrows([cache setObjectsAndKeys:@{key: @YES}], @"expected the key's exception to propagate");
+
+        XCTestExpectation* done = [self expectationWithDescription:@"other thread finished"];
+        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            cache[@"after"] = @YES;
+            XCTAssertNotNil(cache[@"after"], @"expected the cache to remain usable");
+            [done fulfill];
+        });
+        [self waitForExpectationsWithTimeout:kTestTimeout handler:nil];
+    }
+}
+
+- (void) testOperationsReleaseShardLocks
+{
+    MBThreadsafeCacheConcurrencyMode modes[] = {MBThreadsafeCacheConcurrencyModeExclusive,
+                                                MBThreadsafeCacheConcurrencyModeReadWrite,
+                                                MBThreadsafeCacheConcurrencyModeSnapshot,
+                                                MBThreadsafeCacheConcurrencyModeExclusiveNonRecursive};
+    for (NSUInteger m=0; m<sizeof(modes)/sizeof(modes[0]); m++) {
+        for (NSNumber* protect in @[@NO, @YES]) {
+            MBThreadsafeCache* cache = MBTestCacheWithProtection(modes[m], 1, protect.boolValue);
+
+            // every public operation, on this thread...
+            cache[@"key"] = @"value";
+            [cache setObject:@"expiring" forKey:@"ttl" timeToLive:60];
+            (void) cache[@"key"];
+            (void) [cache isKeyInCache:@"key"];
+            [cache setObjectsAndKeys:@{@"batch": @YES}];
+            (void) [cache objectsForKeys:@[@"key", @"batch"]];
+            (void) [cache objectForKey:@"loaded" orLoad:^id(NSErrorPtrPtr errPtr) {
+                return @"loaded";
+            } error:nil];
+            [cache removeObjectForKey:@"batch"];
+            [cache clearMemoryCache];
+
+            // ...must leave the lock free for another; recursive locks would
+            // otherwise hide an unbalanced unlock from the calling thread
+            XCTestExpectation* done = [self expectationWithDescription:@"other thread acquired the lock"];
+            dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+                [cache lock];
+                [cache unlock];
+                cache[@"after"] = @YES;
+                XCTAssertNotNil(cache[@"after"], @"expected the cache to remain usable");
+                [done fulfill];
+            });
+            [self waitForExpectationsWithTimeout:kTestTimeout handler:nil];
+        }
+    }
+
+    // MBRegexCache is a snapshot-mode cache shared by the whole process
+    dispatch_apply(8, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+        XCTAssertNotNil([MBRegexCache regularExpressionWithPattern:@"^a+b?$"], @"expected a compiled expression");
+    });
+}
+
+- (void) testLRUEviction
+{
+    MBThreadsafeCache* cache = MBTestCacheWithShards(1);
+    cache.countLimit = 3;
+
+    cache[@"a"] = @1;
+    cache[@"b"] = @2;
+    cache[@"c"] = @3;
+    (void) cache[@"a"];         // "b" is now least-recently used
+    cache[@"d"] = @4;
+
+    XCTAssertNil(cache[@"b"], @"expected least-recently-used entry to be evicted");
+    XCTAssertNotNil(cache[@"a"], @"expected recently-used entry to survive");
+    XCTAssertNotNil(cache[@"c"], @"expected entry to survive");
+    XCTAssertNotNil(cache[@"d"], @"expected newest entry to survive");
+    XCTAssertEqual(cache.evictionCount, (NSUInteger)1, @"unexpected eviction count");
+}
+
+- (void) testCLOCKEviction
+{
+    MBThreadsafeCache* cache = MBTestCacheWithShards(1);
+    cache.evictionPolicy = MBThreadsafeCacheEvictionPolicyCLOCK;
+    cache.countLimit = 3;
+
+    cache[@"a"] = @1;
+    cache[@"b"] = @2;
+    cache[@"c"] = @3;
+    (void) cache[@"a"];         // "a" gets a second chance
+    cache[@"d"] = @4;
+
+    XCTAssertNil(cache[@"b"], @"expected unreferenced entry to be evicted");
+    XCTAssertNotNil(cache[@"a"], @"expected referenced entry to survive");
+    XCTAssertEqual(cache.evictionCount, (NSUInteger)1, @"unexpected eviction count");
+}
+
+- (void) testCostLimit
+{
+    MBThreadsafeCache* cache = MBTestCacheWithShards(1);
+    cache.totalCostLimit = 100;
+
+    for (NSUInteger i=0; i<10; i++) {
+        cache[@(i)] = [NSMutableData dataWithLength:30];
+    }
+
+    XCTAssertEqual(cache.evictionCount, (NSUInteger)7, @"unexpected eviction count");
+    XCTAssertEqual(cache.evictedCost, (NSUInteger)210, @"unexpected evicted cost");
+    XCTAssertNotNil(cache[@9], @"expected newest entry to survive");
+}
+
+- (void) testTimeToLive
+{
+    MBThreadsafeCache* cache = MBTestCacheWithShards(1);
+
+    [cache setObject:@1 forKey:@"short" timeToLive:0.1];
+    cache[@"forever"] = @2;
+    XCTAssertNotNil(cache[@"short"], @"expected unexpired entry to be present");
+
+    [NSThread sleepForTimeInterval:0.2];
+
+    XCTAssertFalse([cache isKeyInCache:@"short"], @"expected expired entry to be absent");
+    XCTAssertNil(cache[@"short"], @"expected expired entry to be absent");
+    XCTAssertNotNil(cache[@"forever"], @"expected entry without time-to-live to survive");
+    XCTAssertEqual(cache.expirationCount, (NSUInteger)1, @"unexpected expiration count");
+}
+
+- (void) testExpirySweep
+{
+    MBThreadsafeCache* cache = MBTestCacheWithMode(MBThreadsafeCacheConcurrencyModeReadWrite, 2);
+    cache.defaultTimeToLive = 0.1;
+
+    for (NSUInteger i=0; i<10; i++) {
+        cache[@(i)] = @(i);
+    }
+    [NSThread sleepForTimeInterval:0.2];
+    [cache purgeExpiredObjects];
+
+    XCTAssertEqual(cache.expirationCount, (NSUInteger)10, @"expected every entry to expire");
+}
+
+- (void) testCoalescedLoading
+{
+    MBThreadsafeCache* cache = MBTestCacheWithShards(4);
+    __block atomic_ulong loadCount;
+    atomic_init(&loadCount, 0);
+
+    dispatch_apply(64, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+        NSError* err = nil;
+        id val = [cache objectForKey:@"key" orLoad:^id(NSErrorPtrPtr errPtr) {
+            atomic_fetch_add(&loadCount, 1);
+            [NSThread sleepForTimeInterval:0.1];
+            return @"loaded";
+        } error:&err];
+        XCTAssertEqualObjects(val, @"loaded", @"unexpected loaded value");
+        XCTAssertNil(err, @"unexpected error");
+    });
+
+    XCTAssertEqual(atomic_load(&loadCount), (unsigned long)1, @"expected the loader to run exactly once");
+    XCTAssertEqualObjects(cache[@"key"], @"loaded", @"expected loaded value to be cached");
+}
+
+- (void) testCoalescedLoadingError
+{
+    MBThreadsafeCache* cache = MBTestCacheWithShards(1);
+    __block atomic_ulong errorCount;
+    atomic_init(&errorCount, 0);
+
+    dispatch_apply(16, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+        NSError* err = nil;
+        id val = [cache objectForKey:@"missing" orLoad:^id(NSErrorPtrPtr errPtr) {
+            [NSThread sleepForTimeInterval:0.1];
+            if (errPtr) {
+                *errPtr = [NSError mockingbirdErrorWithDescription:@"load failed"];
+            }
+            return nil;
+        } error:&err];
+        XCTAssertNil(val, @"expected load to fail");
+        if (err) {
+            atomic_fetch_add(&errorCount, 1);
+        }
+    });
+
+    XCTAssertEqual(atomic_load(&errorCount), (unsigned long)16, @"expected every caller to receive the error");
+    XCTAssertFalse([cache isKeyInCache:@"missing"], @"expected failed load not to be cached");
+}
+
+- (void) testBatchAccess
+{
+    for (NSNumber* shards in @[@1, @8]) {
+        MBThreadsafeCache* cache = MBTestCacheWithShards(shards.unsignedIntegerValue);
+
+        NSMutableDictionary* objectsAndKeys = [NSMutableDictionary dictionary];
+        NSMutableArray* keys = [NSMutableArray array];
+        for (NSUInteger i=0; i<200; i++) {
+            NSString* key = [NSString stringWithFormat:@"key %lu", (unsigned long)i];
+            [keys addObject:key];
+            if (i % 2 == 0) {
+                objectsAndKeys[key] = @(i);
+            }
+        }
+        [cache setObjectsAndKeys:objectsAndKeys];
+        XCTAssertEqualObjects(cache[@"key 10"], @10, @"expected batch-set value to be retrievable");
+
+        NSDictionary* found = [cache objectsForKeys:keys];
+        XCTAssertEqualObjects(found, objectsAndKeys, @"expected exactly the stored keys to be found");
+        XCTAssertEqual([cache objectsForKeys:@[]].count, (NSUInteger)0, @"expected nothing for no keys");
+    }
+}
+
+/******************************************************************************/
+#pragma mark Statistics
+/******************************************************************************/
+
+- (void) testStatistics
+{
+    MBThreadsafeCache* cache = MBTestCacheWithShards(1);
+    cache.countLimit = 8;
+    cache.measuresLatency = YES;
+
+    for (NSUInteger i=0; i<16; i++) {
+        cache[@(i)] = @(i);
+    }
+    for (NSUInteger i=8; i<16; i++) {
+        XCTAssertNotNil(cache[@(i)], @"expected recently-set key to be cached");
+    }
+    XCTAssertNil(cache[@"missing"], @"expected no value for missing key");
+    [cache objectsForKeys:@[@15, @"also missing"]];
+    [cache objectForKey:@"loaded" orLoad:^id(NSErrorPtrPtr errPtr) {
+        return @"value";
+    } error:nil];
+
+    MBCacheStatistics* stats = [cache statistics];
+    XCTAssertEqual(stats.memoryHits, (uint64_t)9, @"unexpected memory hit count");
+    XCTAssertEqual(stats.memoryMisses, (uint64_t)3, @"unexpected memory miss count");
+    XCTAssertEqual(stats.misses, (uint64_t)3, @"expected every memory miss to be a miss");
+    XCTAssertEqual(stats.diskHits, (uint64_t)0, @"expected no disk hits");
+    XCTAssertEqual(stats.sets, (uint64_t)17, @"unexpected set count");
+    XCTAssertEqual(stats.evictions, (uint64_t)cache.evictionCount, @"expected evictions to match evictionCount");
+    XCTAssertEqualWithAccuracy(stats.hitRate, 0.75, 0.001, @"unexpected hit rate");
+    XCTAssertEqual(stats.loadLatency.count, (uint64_t)1, @"expected the load to be measured");
+    XCTAssertGreaterThan(stats.lockWaitLatency.count, (uint64_t)0, @"expected lock waits to be measured");
+    XCTAssertGreaterThanOrEqual([stats.loadLatency nanosecondsAtPercentile:100], [stats.loadLatency nanosecondsAtPercentile:50], @"expected percentiles to be ordered");
+    XCTAssertNotNil([NSPropertyListSerialization dataWithPropertyList:[stats dictionaryRepresentation]
+                                                               format:NSPropertyListBinaryFormat_v1_0
+                                                              options:0
+                                                                error:nil], @"expected the statistics to be a valid property list");
+
+    cache.measuresLatency = NO;
+    (void) cache[@15];
+    XCTAssertEqual([cache statistics].lockWaitLatency.count, stats.lockWaitLatency.count, @"expected no measurement once disabled");
+}
+
+/******************************************************************************/
+#pragma mark Admission
+/******************************************************************************/
+
+- (void) testTinyLFUAdmission
+{
+    MBThreadsafeCache* cache = MBTestCacheWithShards(1);
+    cache.countLimit = 4;
+    cache.admissionPolicy = MBThreadsafeCacheAdmissionPolicyTinyLFU;
+
+    for (NSUInteger i=0; i<4; i++) {
+        cache[@(i)] = @(i);
+        for (NSUInteger j=0; j<3; j++) {
+            (void) cache[@(i)];
+        }
+    }
+
+    // a key that has never been requested can't displace popular ones
+    cache[@"one-hit wonder"] = @YES;
+    XCTAssertNil(cache[@"one-hit wonder"], @"expected unpopular key to be rejected");
+    XCTAssertEqual([cache statistics].rejections, (uint64_t)1, @"expected the rejection to be counted");
+    for (NSUInteger i=0; i<4; i++) {
+        XCTAssertNotNil(cache[@(i)], @"expected popular key to remain cached");
+    }
+
+    // replacing an existing entry is always allowed
+    cache[@0] = @"replaced";
+    XCTAssertEqualObjects(cache[@0], @"replaced", @"expected replacement to be stored");
+
+    // once requested often enough, a key earns admission
+    for (NSUInteger j=0; j<8; j++) {
+        (void) cache[@"rising"];
+    }
+    cache[@"rising"] = @YES;
+    XCTAssertNotNil(cache[@"rising"], @"expected frequently-requested key to be admitted");
+    XCTAssertEqual(cache.evictionCount, (NSUInteger)1, @"expected one entry to make room");
+}
+
+- (void) testTinyLFUHitRateOnZipfianTrace
+{
+    NSArray* trace = MBTestZipfianTrace();
+    double lruHitRate = MBTestHitRateForTrace(trace, MBThreadsafeCacheAdmissionPolicyAlways);
+    double tinyLFUHitRate = MBTestHitRateForTrace(trace, MBThreadsafeCacheAdmissionPolicyTinyLFU);
+
+    XCTAssertGreaterThan(tinyLFUHitRate, lruHitRate + 0.03, @"expected TinyLFU admission to improve the hit rate (LRU = %.3f; LRU + TinyLFU = %.3f)", lruHitRate, tinyLFUHitRate);
+}
+
+/******************************************************************************/
+#pragma mark Contention benchmarks
+/******************************************************************************/
+
+- (void) _measureReadContentionOnCache:(MBThreadsafeCache*)cache
+{
+    for (NSUInteger i=0; i<kTestKeyCount; i++) {
+        cache[@(i)] = @(i);
+    }
+
+    dispatch_queue_t q = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+    [self measureBlock:^{
+        dispatch_apply(kBenchmarkReadCount, q, ^(size_t i) {
+            (void) cache[@(i % kTestKeyCount)];
+        });
+    }];
+}
+
+- (void) _measureReadThroughputOnCache:(MBThreadsafeCache*)cache
+{
+    for (NSUInteger i=0; i<kTestKeyCount; i++) {
+        cache[@(i)] = @(i);
+    }
+
+    // the keys are boxed up front so the measurement is of the cache alone
+    NSMutableArray* lookups = [NSMutableArray arrayWithCapacity:kTestKeyCount];
+    for (NSUInteger i=0; i<kTestKeyCount; i++) {
+        [lookups addObject:@(i)];
+    }
+
+    [self measureBlock:^{
+        for (NSUInteger i=0; i<kBenchmarkReadCount; i++) {
+            (void) [cache objectForKey:lookups[i % kTestKeyCount]];
+        }
+    }];
+}
+
+- (void) testReadThroughputUnprotected
+{
+    [self _measureReadThroughputOnCache:MBTestCacheWithProtection(MBThreadsafeCacheConcurrencyModeExclusive, 1, NO)];
+}
+
+- (void) testReadThroughputProtected
+{
+    [self _measureReadThroughputOnCache:MBTestCacheWithProtection(MBThreadsafeCacheConcurrencyModeExclusive, 1, YES)];
+}
+
+- (void) testReadContentionExclusiveMode
+{
+    [self _measureReadContentionOnCache:MBTestCacheWithMode(MBThreadsafeCacheConcurrencyModeExclusive, 1)];
+}
+
+- (void) testReadContentionReadWriteMode
+{
+    [self _measureReadContentionOnCache:MBTestCacheWithMode(MBThreadsafeCacheConcurrencyModeReadWrite, 1)];
+}
+
+- (void) testReadContentionExclusiveNonRecursiveMode
+{
+    [self _measureReadContentionOnCache:MBTestCacheWithMode(MBThreadsafeCacheConcurrencyModeExclusiveNonRecursive, 1)];
+}
+
+- (void) testReadThroughputExclusiveNonRecursiveMode
+{
+    [self _measureReadThroughputOnCache:MBTestCacheWithMode(MBThreadsafeCacheConcurrencyModeExclusiveNonRecursive, 1)];
+}
+
+- (void) testReadContentionSnapshotMode
+{
+    [self _measureReadContentionOnCache:MBTestCacheWithMode(MBThreadsafeCacheConcurrencyModeSnapshot, 1)];
+}
+
+@end
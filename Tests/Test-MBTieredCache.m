@@ -0,0 +1,317 @@
+//
+//  Test-MBTieredCache.m
+//  MockingbirdTests
+//
+//  Created by Evan Coyne Maloney on 10/17/26.
+//  Copyright (c) 2026 Gilt Groupe. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <XCTest/XCTest.h>
+
+#import "MBTieredCache.h"
+#import "MBThreadsafeCache.h"
+#import "MBFilesystemCache.h"
+
+/******************************************************************************/
+#pragma mark Constants
+/******************************************************************************/
+
+static const NSUInteger kTestKeyCount           = 64;
+static const NSUInteger kTestWritesPerKey       = 100;
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark Helpers
+/******************************************************************************/
+
+static MBThreadsafeCache* MBTestTierWithMode(MBThreadsafeCacheConcurrencyMode mode, NSUInteger countLimit)
+{
+#if MB_BUILD_UIKIT
+    MBThreadsafeCache* tier = [[MBThreadsafeCache alloc] initWithConcurrencyMode:mode shardCount:1 exceptionProtection:NO ignoreMemoryWarnings:YES];
+#else
+    MBThreadsafeCache* tier = [[MBThreadsafeCache alloc] initWithConcurrencyMode:mode shardCount:1 exceptionProtection:NO];
+#endif
+    tier.countLimit = countLimit;
+    return tier;
+}
+
+static MBThreadsafeCache* MBTestTierWithCountLimit(NSUInteger countLimit)
+{
+    return MBTestTierWithMode(MBThreadsafeCacheConcurrencyModeExclusive, countLimit);
+}
+
+static MBFilesystemCache* MBTestFilesystemTierWithCountLimit(NSUInteger countLimit)
+{
+    NSString* name = [NSString stringWithFormat:@"MBTieredCacheTests-%@", [[NSUUID UUID] UUIDString]];
+    MBFilesystemCache* tier = [[MBFilesystemCache alloc] initWithName:name];
+    tier.countLimit = countLimit;
+    return tier;
+}
+
+static NSData* MBTestDataForKey(NSString* key)
+{
+    return [key dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark MBTestReentrantTierDelegate class
+/******************************************************************************/
+
+// records the keys of dropped objects, calling back into the tier each time
+@interface MBTestReentrantTierDelegate : NSObject <MBCacheTierDelegate>
+@property(nonnull, nonatomic, readonly) NSMutableArray* droppedKeys;
+@end
+
+@implementation MBTestReentrantTierDelegate
+
+- (instancetype) init
+{
+    self = [super init];
+    if (self) {
+        _droppedKeys = [NSMutableArray new];
+    }
+    return self;
+}
+
+- (void) cacheTier:(id<MBCacheTier>)tier droppedObject:(id)obj forKey:(id)key
+{
+    [_droppedKeys addObject:key];
+    (void) [tier objectForKey:key];
+    [tier removeObjectForKey:key];
+}
+
+@end
+
+/******************************************************************************/
+#pragma mark -
+#pragma mark Tests
+/******************************************************************************/
+
+@interface MBTieredCacheTests : XCTestCase
+@end
+
+@implementation MBTieredCacheTests
+
+- (void) testReadThroughAndPromotion
+{
+    MBThreadsafeCache* fast = MBTestTierWithCountLimit(0);
+    MBThreadsafeCache* slow = MBTestTierWithCountLimit(0);
+    __block NSUInteger loads = 0;
+    MBTieredCache* cache = [[MBTieredCache alloc] initWithTiers:@[fast, slow] loader:^id(id key, NSErrorPtrPtr errPtr) {
+        loads++;
+        return ([key isEqual:@"absent"] ? nil : [key uppercaseString]);
+    }];
+    XCTAssertTrue(fast.tierDelegate == (id)cache, @"expected the tiered cache to be each tier's delegate");
+
+    // loaded objects are stored in every tier
+    XCTAssertEqualObjects(cache[@"key"], @"KEY", @"unexpected loaded object");
+    XCTAssertEqualObjects(fast[@"key"], @"KEY", @"expected loaded object in the fast tier");
+    XCTAssertEqualObjects(slow[@"key"], @"KEY", @"expected loaded object in the slow tier");
+    XCTAssertEqualObjects(cache[@"key"], @"KEY", @"unexpected cached object");
+    XCTAssertEqual(loads, (NSUInteger)1, @"expected a single load");
+
+    XCTAssertNil(cache[@"absent"], @"expected failed load to return nil");
+    XCTAssertNil(slow[@"absent"], @"expected failed load not to be stored");
+
+    // a hit in the slow tier is promoted to the fast one
+    [fast clearMemoryCache];
+    XCTAssertEqualObjects(cache[@"key"], @"KEY", @"unexpected object from slow tier");
+    XCTAssertEqualObjects(fast[@"key"], @"KEY", @"expected object to be promoted");
+    XCTAssertEqual(loads, (NSUInteger)2, @"expected no load for an object in a tier");
+    XCTAssertEqual(cache.promotionCount, (NSUInteger)3, @"expected two loaded copies and one promotion");
+
+    MBCacheStatistics* stats = cache.statistics;
+    XCTAssertEqual(stats.memoryHits, (uint64_t)2, @"unexpected hit count");
+    XCTAssertEqual(stats.memoryMisses, (uint64_t)2, @"unexpected miss count");
+    NSArray* tierStats = cache.tierStatistics;
+    XCTAssertEqual(tierStats.count, (NSUInteger)2, @"expected statistics for each tier");
+    XCTAssertGreaterThanOrEqual([tierStats[1] memoryHits], (uint64_t)1, @"expected the slow tier to record its hit");
+}
+
+- (void) testPromotionPolicies
+{
+    MBThreadsafeCache* l1 = MBTestTierWithCountLimit(0);
+    MBThreadsafeCache* l2 = MBTestTierWithCountLimit(0);
+    MBThreadsafeCache* l3 = MBTestTierWithCountLimit(0);
+    MBTieredCache* cache = [[MBTieredCache alloc] initWithTiers:@[l1, l2, l3]];
+
+    l3[@"key"] = @"value";
+    cache.promotionPolicy = MBTieredCachePromotionPolicyNone;
+    XCTAssertEqualObjects(cache[@"key"], @"value", @"unexpected object");
+    XCTAssertNil(l2[@"key"], @"expected no promotion");
+
+    cache.promotionPolicy = MBTieredCachePromotionPolicyAdjacent;
+    XCTAssertEqualObjects(cache[@"key"], @"value", @"unexpected object");
+    XCTAssertEqualObjects(l2[@"key"], @"value", @"expected promotion to the adjacent tier");
+    XCTAssertNil(l1[@"key"], @"expected no promotion beyond the adjacent tier");
+    XCTAssertEqualObjects(cache[@"key"], @"value", @"unexpected object");
+    XCTAssertEqualObjects(l1[@"key"], @"value", @"expected second request to promote again");
+}
+
+- (void) testWriteThrough
+{
+    MBThreadsafeCache* fast = MBTestTierWithCountLimit(2);
+    MBThreadsafeCache* slow = MBTestTierWithCountLimit(0);
+    MBTieredCache* cache = [[MBTieredCache alloc] initWithTiers:@[fast, slow]];
+
+    for (NSUInteger i=0; i<8; i++) {
+        cache[@(i)] = @(i * 10);
+    }
+    for (NSUInteger i=0; i<8; i++) {
+        XCTAssertEqualObjects(slow[@(i)], @(i * 10), @"expected every object in the slow tier");
+    }
+    XCTAssertEqual(cache.demotionCount, (NSUInteger)0, @"expected clean objects not to be demoted");
+
+    [cache removeObjectForKey:@7];
+    XCTAssertNil(fast[@7], @"expected object removed from the fast tier");
+    XCTAssertNil(slow[@7], @"expected object removed from the slow tier");
+    XCTAssertNil(cache[@7], @"expected object to be removed");
+}
+
+- (void) testWriteBack
+{
+    MBThreadsafeCache* fast = MBTestTierWithCountLimit(2);
+    MBThreadsafeCache* slow = MBTestTierWithCountLimit(0);
+    MBTieredCache* cache = [[MBTieredCache alloc] initWithTiers:@[fast, slow]];
+    cache.writePolicy = MBTieredCacheWritePolicyWriteBack;
+
+    cache[@"a"] = @1;
+    XCTAssertNil(slow[@"a"], @"expected the write to stop at the fast tier");
+
+    // evicting a dirty object demotes it
+    cache[@"b"] = @2;
+    cache[@"c"] = @3;
+    XCTAssertNil(fast[@"a"], @"expected the oldest object to be evicted");
+    XCTAssertEqualObjects(slow[@"a"], @1, @"expected the evicted object to be demoted");
+    XCTAssertEqual(cache.demotionCount, (NSUInteger)1, @"expected one demotion");
+    XCTAssertEqualObjects(cache[@"a"], @1, @"expected the demoted object to be found");
+
+    // flushing writes the rest
+    [cache flush];
+    XCTAssertEqualObjects(slow[@"c"], @3, @"expected dirty object to be flushed");
+
+    // switching to write-through flushes too
+    cache[@"d"] = @4;
+    cache.writePolicy = MBTieredCacheWritePolicyWriteThrough;
+    XCTAssertEqualObjects(slow[@"d"], @4, @"expected dirty object to be flushed");
+}
+
+- (void) testThreadLocalCache
+{
+    MBThreadsafeCache* tier = MBTestTierWithCountLimit(0);
+    MBTieredCache* cache = [[MBTieredCache alloc] initWithTiers:@[tier]];
+    cache.threadLocalCountLimit = 4;
+
+    cache[@"key"] = @"old";
+    for (NSUInteger i=0; i<10; i++) {
+        XCTAssertEqualObjects(cache[@"key"], @"old", @"unexpected object");
+    }
+    MBCacheStatistics* stats = cache.threadLocalStatistics;
+    XCTAssertEqual(stats.memoryHits, (uint64_t)9, @"expected repeated reads to hit the thread's cache");
+    XCTAssertEqual(stats.memoryMisses, (uint64_t)1, @"expected only the first read to miss");
+
+    // writes invalidate threads' caches
+    cache[@"key"] = @"new";
+    XCTAssertEqualObjects(cache[@"key"], @"new", @"expected the write to be visible");
+
+    // and the cache stays within its limit
+    for (NSUInteger i=0; i<8; i++) {
+        tier[@(i)] = @(i);
+        XCTAssertEqualObjects(cache[@(i)], @(i), @"unexpected object");
+    }
+    XCTAssertEqual(cache.threadLocalStatistics.evictions, (uint64_t)5, @"expected the thread's cache to evict");
+}
+
+- (void) testDroppedObjectsReportedAfterUnlocking
+{
+    // with non-recursive locks, a delegate called while
+    // the tier is locked can't call back into it
+    MBThreadsafeCacheConcurrencyMode modes[] = {MBThreadsafeCacheConcurrencyModeExclusiveNonRecursive,
+                                                MBThreadsafeCacheConcurrencyModeReadWrite};
+    for (NSUInteger i=0; i<sizeof(modes)/sizeof(modes[0]); i++) {
+        MBThreadsafeCache* tier = MBTestTierWithMode(modes[i], 2);
+        MBTestReentrantTierDelegate* delegate = [MBTestReentrantTierDelegate new];
+        tier.tierDelegate = delegate;
+
+        tier[@"a"] = @1;
+        tier[@"b"] = @2;
+        tier[@"c"] = @3;
+        XCTAssertEqualObjects(delegate.droppedKeys, @[@"a"], @"expected the evicted key to be reported");
+
+        // lowering the limit evicts with every shard locked
+        tier.countLimit = 1;
+        XCTAssertEqualObjects(delegate.droppedKeys, (@[@"a", @"b"]), @"expected the newly evicted key to be reported");
+        XCTAssertEqualObjects(tier[@"c"], @3, @"expected the newest object to remain");
+    }
+}
+
+- (void) testFilesystemCacheAsSlowestTier
+{
+    MBThreadsafeCache* memory = MBTestTierWithCountLimit(0);
+    MBFilesystemCache* filesystem = MBTestFilesystemTierWithCountLimit(0);
+    MBTieredCache* cache = [[MBTieredCache alloc] initWithTiers:@[memory, filesystem] loader:^id(id key, NSErrorPtrPtr errPtr) {
+        return MBTestDataForKey(key);
+    }];
+
+    NSData* data = MBTestDataForKey(@"key");
+    XCTAssertEqualObjects(cache[@"key"], data, @"unexpected loaded object");
+    [filesystem.writeQueue waitUntilAllOperationsAreFinished];
+    XCTAssertTrue([filesystem isKeyInFilesystemCache:@"key"], @"expected loaded object to be written to the filesystem");
+
+    // with both memory caches empty, the object comes from disk
+    [memory clearMemoryCache];
+    [filesystem clearMemoryCache];
+    XCTAssertEqualObjects(cache[@"key"], data, @"expected object to be read from the filesystem");
+    XCTAssertEqualObjects(memory[@"key"], data, @"expected object to be promoted to memory");
+
+    [filesystem clearFilesystemCache];
+}
+
+- (void) testFilesystemCacheReportsDroppedObjectsByKey
+{
+    MBFilesystemCache* filesystem = MBTestFilesystemTierWithCountLimit(2);
+    MBThreadsafeCache* slow = MBTestTierWithCountLimit(0);
+    MBTieredCache* cache = [[MBTieredCache alloc] initWithTiers:@[filesystem, slow]];
+    cache.writePolicy = MBTieredCacheWritePolicyWriteBack;
+
+    // the filesystem cache's memory is keyed by filename, but a dirty
+    // object it evicts must be demoted under the key it was stored with
+    cache[@"a"] = MBTestDataForKey(@"a");
+    cache[@"b"] = MBTestDataForKey(@"b");
+    cache[@"c"] = MBTestDataForKey(@"c");
+    XCTAssertFalse([filesystem isKeyInMemoryCache:@"a"], @"expected the oldest object to be evicted");
+    XCTAssertEqualObjects(slow[@"a"], MBTestDataForKey(@"a"), @"expected the evicted object to be demoted under its key");
+    XCTAssertEqual(cache.demotionCount, (NSUInteger)1, @"expected one demotion");
+
+    [filesystem.writeQueue waitUntilAllOperationsAreFinished];
+    [filesystem clearFilesystemCache];
+}
+
+- (void) testConcurrentWriteBack
+{
+    MBThreadsafeCache* fast = MBTestTierWithCountLimit(8);
+    MBThreadsafeCache* middle = MBTestTierWithCountLimit(16);
+    MBThreadsafeCache* slow = MBTestTierWithCountLimit(0);
+    MBTieredCache* cache = [[MBTieredCache alloc] initWithTiers:@[fast, middle, slow]];
+    cache.writePolicy = MBTieredCacheWritePolicyWriteBack;
+    cache.threadLocalCountLimit = 4;
+
+    // each key has a single writer, which must always read back its own
+    // latest write while other keys' writes evict and demote around it
+    dispatch_apply(kTestKeyCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t k) {
+        for (NSUInteger i=0; i<kTestWritesPerKey; i++) {
+            cache[@(k)] = @(i);
+            XCTAssertEqualObjects(cache[@(k)], @(i), @"expected to read the latest write");
+        }
+    });
+
+    [cache flush];
+    for (NSUInteger k=0; k<kTestKeyCount; k++) {
+        XCTAssertEqualObjects(slow[@(k)], @(kTestWritesPerKey - 1), @"expected the latest write in the slowest tier");
+    }
+    XCTAssertGreaterThan(cache.demotionCount, (NSUInteger)0, @"expected evictions to demote dirty objects");
+}
+
+@end